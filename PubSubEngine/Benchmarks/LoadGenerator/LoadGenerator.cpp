@@ -0,0 +1,705 @@
+// LoadGenerator.cpp : Headless end-to-end benchmark. Starts the PES, SE and SS locally (unless --no-spawn),
+// drives N publishers and M subscribers over K topics and reports throughput and end-to-end latency.
+//
+// Every payload starts with the publisher's QueryPerformanceCounter value, which is system wide, so the
+// subscriber side measures publish -> PES -> SE -> subscriber latency directly. Only messages published
+// inside the measurement window (after --warmup, for --duration) are counted.
+//
+// The last line of stdout is a JSON object with the configuration and results; --output appends the same
+// line to a file so runs of different builds can be compared.
+
+#include "../../Common/pch.h"
+#define _CRT_SECURE_NO_WARNINGS
+#define WIN32_LEAN_AND_MEAN
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <process.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../Common/frame.h"
+#include "../../Common/histogram.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+#define PUBLISHER_PORT "55001"
+#define SUBSCRIBER_PORT "55002"
+#define PUBLISHER_AUTH "PES_AUTH"
+#define SUBSCRIBER_AUTH "SUB_AUTH"
+#define MAX_SUBSCRIPTIONS 50            // MAX_TOPICS_PER_CLIENT of the Subscriber Engine
+#define MAX_NAME 32
+#define CONNECT_TIMEOUT_MS 15000        // Services may still be starting
+#define CONNECT_RETRY_MS 100
+#define PAYLOAD_HEADER_SIZE 17          // 16 hex digits of the send counter and a space
+
+typedef struct {
+    int publishers;
+    int subscribers;
+    int topics;
+    int subscriptions;                  // Topics each subscriber subscribes to
+    size_t payloadSize;
+    double zipfExponent;                // 0 selects uniform topic choice
+    unsigned int rate;                  // Messages per second per publisher, 0 for as fast as possible
+    unsigned int batch;                 // Messages per FRAME_PUBLISH_BATCH, 1 sends plain FRAME_PUBLISH
+    unsigned int warmupSeconds;
+    unsigned int durationSeconds;
+    unsigned int settleMilliseconds;    // Time for subscriptions to reach the PES
+    unsigned int drainMilliseconds;     // Time for in-flight messages after publishing stops
+    bool spawnServices;
+    const char* storageMode;
+    const char* label;
+    const char* outputPath;
+} LoadConfig;
+
+typedef struct {
+    int index;
+    HANDLE thread;
+    unsigned long long sent;            // Inside the window
+    unsigned long long failed;
+    unsigned long long* topicSent;      // Per topic, inside the window
+    bool connected;
+} PublisherState;
+
+typedef struct {
+    int index;
+    HANDLE thread;
+    SOCKET socket;
+    volatile LONG ready;                // All subscriptions confirmed
+    unsigned long long received;        // Inside the window
+    unsigned long long bytes;
+    Histogram latency;                  // Nanoseconds
+} SubscriberState;
+
+static LoadConfig config;
+static LARGE_INTEGER frequency;
+static char (*topics)[MAX_NAME];         // Topic names by index
+static double* topicCdf;                // Cumulative Zipf weights, NULL for uniform
+static int* topicSubscribers;           // Subscribers per topic
+static HANDLE startEvent;
+static volatile LONG64 windowStart;
+static volatile LONG64 windowEnd;
+static volatile bool stopping = false;
+static unsigned long runId;             // Keeps usernames unique across runs against the same services
+static Histogram combinedLatency;
+
+static LONG64 Now(void) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+static LONG64 MillisecondsToTicks(unsigned long long milliseconds) {
+    return (LONG64)(milliseconds * (unsigned long long)frequency.QuadPart / 1000ULL);
+}
+
+// xorshift64*; each thread keeps its own state
+static unsigned long long NextRandom(unsigned long long* state) {
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static int ChooseTopic(unsigned long long* state) {
+    if (topicCdf == NULL) {
+        return (int)(NextRandom(state) % (unsigned long long)config.topics);
+    }
+
+    double u = (double)(NextRandom(state) >> 11) / 9007199254740992.0; // [0, 1)
+    int low = 0;
+    int high = config.topics - 1;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (topicCdf[middle] > u) {
+            high = middle;
+        }
+        else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+// Topic j of subscriber s; distinct for j < subscriptions <= topics
+static int SubscriptionTopic(int subscriber, int j) {
+    return (int)(((long long)subscriber * config.subscriptions + j) % config.topics);
+}
+
+static SOCKET ConnectWithRetry(const char* port) {
+    struct addrinfo* result = NULL;
+    struct addrinfo hints;
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if (getaddrinfo("localhost", port, &hints, &result) != 0) {
+        return INVALID_SOCKET;
+    }
+
+    SOCKET sock = INVALID_SOCKET;
+    ULONGLONG deadline = GetTickCount64() + CONNECT_TIMEOUT_MS;
+    while (!stopping && GetTickCount64() < deadline) {
+        sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+        if (sock == INVALID_SOCKET) {
+            break;
+        }
+        if (connect(sock, result->ai_addr, (int)result->ai_addrlen) == 0) {
+            BOOL noDelay = TRUE;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+            break;
+        }
+        closesocket(sock);
+        sock = INVALID_SOCKET;
+        Sleep(CONNECT_RETRY_MS);
+    }
+
+    freeaddrinfo(result);
+    return sock;
+}
+
+// Authenticate and wait for the welcome response
+static bool Authenticate(SOCKET sock, FrameStream* stream, const char* authKey, const char* username) {
+    Frame frame;
+    if (!Frame_Send(sock, FRAME_AUTH, authKey, username) ||
+        FrameStream_Read(stream, &frame) <= 0 || frame.type != FRAME_RESPONSE) {
+        return false;
+    }
+    return strstr(frame.payload, "Welcome") != NULL;
+}
+
+static unsigned __stdcall PublisherThread(void* param) {
+    PublisherState* state = (PublisherState*)param;
+    char username[MAX_NAME];
+    snprintf(username, sizeof(username), "lg%lu-p%d", runId, state->index);
+
+    SOCKET sock = ConnectWithRetry(PUBLISHER_PORT);
+    FrameStream stream;
+    if (sock == INVALID_SOCKET || !FrameStream_Init(&stream, sock)) {
+        fprintf(stderr, "Publisher %d could not connect\n", state->index);
+        if (sock != INVALID_SOCKET) {
+            closesocket(sock);
+        }
+        return 1;
+    }
+    if (!Authenticate(sock, &stream, PUBLISHER_AUTH, username)) {
+        fprintf(stderr, "Publisher %d was not accepted\n", state->index);
+        FrameStream_Destroy(&stream);
+        closesocket(sock);
+        return 1;
+    }
+    state->connected = true;
+
+    // Batches are built in records and then framed; a batch of one is a plain publish frame
+    size_t recordsCapacity = config.batch * Frame_BatchRecordSize(MAX_NAME, config.payloadSize);
+    size_t frameCapacity = config.batch > 1 ? Frame_EncodedSize(0, recordsCapacity) : Frame_EncodedSize(MAX_NAME, config.payloadSize);
+    char* payload = (char*)malloc(config.payloadSize + 1);
+    char* frameBuffer = (char*)malloc(frameCapacity);
+    char* records = (char*)malloc(recordsCapacity);
+    int* batchTopics = (int*)malloc(config.batch * sizeof(int));
+    if (payload == NULL || frameBuffer == NULL || records == NULL || batchTopics == NULL) {
+        free(payload);
+        free(frameBuffer);
+        free(records);
+        free(batchTopics);
+        FrameStream_Destroy(&stream);
+        closesocket(sock);
+        return 1;
+    }
+    memset(payload, 'x', config.payloadSize);
+    payload[config.payloadSize] = '\0';
+
+    unsigned long long random = 0x9E3779B97F4A7C15ULL * (unsigned long long)(state->index + 1);
+    LONG64 interval = config.rate ? frequency.QuadPart / config.rate : 0;
+
+    WaitForSingleObject(startEvent, INFINITE);
+    LONG64 next = Now();
+    long long credits = 0;  // Granted by the PES after the welcome and as it routes our messages
+
+    while (!stopping) {
+        LONG64 now = Now();
+        if (now >= windowEnd) {
+            break;
+        }
+
+        if (interval) {
+            // Pace to the configured rate; sleep while far ahead, spin the last millisecond
+            if (now < next) {
+                if (next - now > MillisecondsToTicks(2)) {
+                    Sleep(1);
+                }
+                else {
+                    YieldProcessor();
+                }
+                continue;
+            }
+            next += interval;
+        }
+
+        // Wait for the PES to grant more before stamping the next message
+        while (credits <= 0) {
+            Frame frame;
+            if (FrameStream_Read(&stream, &frame) <= 0) {
+                break;
+            }
+            if (frame.type == FRAME_CREDIT) {
+                credits += strtoll(frame.payload, NULL, 10);
+            }
+        }
+        if (credits <= 0) {
+            state->failed++;
+            break;
+        }
+
+        // Every message of a batch carries the same send time, taken just before the write
+        LONG64 sendTime = Now();
+        char header[PAYLOAD_HEADER_SIZE + 1];
+        snprintf(header, sizeof(header), "%016llx ", (unsigned long long)sendTime);
+        memcpy(payload, header, PAYLOAD_HEADER_SIZE);
+
+        size_t size;
+        long long count = credits < (long long)config.batch ? credits : (long long)config.batch;
+        if (config.batch > 1) {
+            size_t length = 0;
+            for (long long i = 0; i < count; i++) {
+                batchTopics[i] = ChooseTopic(&random);
+                length += Frame_AppendBatchRecord(records + length, recordsCapacity - length,
+                    topics[batchTopics[i]], strlen(topics[batchTopics[i]]), payload, config.payloadSize);
+            }
+            size = Frame_Encode(frameBuffer, frameCapacity, FRAME_PUBLISH_BATCH, 0, NULL, 0, records, length);
+        }
+        else {
+            batchTopics[0] = ChooseTopic(&random);
+            size = Frame_Encode(frameBuffer, frameCapacity, FRAME_PUBLISH, 0,
+                topics[batchTopics[0]], strlen(topics[batchTopics[0]]), payload, config.payloadSize);
+        }
+        if (size == 0 || !Frame_SendAll(sock, frameBuffer, size)) {
+            state->failed++;
+            break;
+        }
+        credits -= count;
+        next += interval * (count - 1);
+
+        if (sendTime >= windowStart && sendTime < windowEnd) {
+            state->sent += (unsigned long long)count;
+            for (long long i = 0; i < count; i++) {
+                state->topicSent[batchTopics[i]]++;
+            }
+        }
+    }
+
+    free(payload);
+    free(frameBuffer);
+    free(records);
+    free(batchTopics);
+    FrameStream_Destroy(&stream);
+    closesocket(sock);
+    return 0;
+}
+
+static unsigned __stdcall SubscriberThread(void* param) {
+    SubscriberState* state = (SubscriberState*)param;
+    char username[MAX_NAME];
+    snprintf(username, sizeof(username), "lg%lu-s%d", runId, state->index);
+
+    SOCKET sock = ConnectWithRetry(SUBSCRIBER_PORT);
+    FrameStream stream;
+    if (sock == INVALID_SOCKET || !FrameStream_Init(&stream, sock)) {
+        fprintf(stderr, "Subscriber %d could not connect\n", state->index);
+        if (sock != INVALID_SOCKET) {
+            closesocket(sock);
+        }
+        return 1;
+    }
+    if (!Authenticate(sock, &stream, SUBSCRIBER_AUTH, username)) {
+        fprintf(stderr, "Subscriber %d was not accepted\n", state->index);
+        FrameStream_Destroy(&stream);
+        closesocket(sock);
+        return 1;
+    }
+    state->socket = sock;
+
+    for (int j = 0; j < config.subscriptions; j++) {
+        if (!Frame_Send(sock, FRAME_SUBSCRIBE, topics[SubscriptionTopic(state->index, j)], NULL)) {
+            fprintf(stderr, "Subscriber %d failed to subscribe\n", state->index);
+            FrameStream_Destroy(&stream);
+            return 1;
+        }
+    }
+
+    double nanosecondsPerTick = 1e9 / (double)frequency.QuadPart;
+    int confirmations = 0;
+    Frame frame;
+
+    // Runs until the main thread closes the socket
+    while (FrameStream_Read(&stream, &frame) > 0) {
+        if (frame.type == FRAME_RESPONSE) {
+            if (++confirmations == config.subscriptions) {
+                InterlockedExchange(&state->ready, 1);
+            }
+            continue;
+        }
+        if (frame.type != FRAME_MESSAGE || frame.payloadLength < PAYLOAD_HEADER_SIZE) {
+            continue;
+        }
+
+        LONG64 receiveTime = Now();
+        LONG64 sendTime = (LONG64)strtoull(frame.payload, NULL, 16);
+        if (sendTime < windowStart || sendTime >= windowEnd) {
+            continue;
+        }
+
+        state->received++;
+        state->bytes += frame.payloadLength;
+        Histogram_Record(&state->latency, (unsigned long long)((double)(receiveTime - sendTime) * nanosecondsPerTick));
+    }
+
+    FrameStream_Destroy(&stream);
+    return 0;
+}
+
+static bool StartService(const char* directory, const char* executable, const char* arguments, PROCESS_INFORMATION* process) {
+    char commandLine[MAX_PATH * 2];
+    snprintf(commandLine, sizeof(commandLine), "\"%s%s\" %s", directory, executable, arguments);
+
+    STARTUPINFOA startup;
+    ZeroMemory(&startup, sizeof(startup));
+    startup.cb = sizeof(startup);
+    ZeroMemory(process, sizeof(*process));
+
+    if (!CreateProcessA(NULL, commandLine, NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &startup, process)) {
+        fprintf(stderr, "Failed to start %s (error %lu)\n", commandLine, GetLastError());
+        return false;
+    }
+    return true;
+}
+
+static void StopService(PROCESS_INFORMATION* process) {
+    if (process->hProcess != NULL) {
+        TerminateProcess(process->hProcess, 0);
+        WaitForSingleObject(process->hProcess, 5000);
+        CloseHandle(process->hThread);
+        CloseHandle(process->hProcess);
+        process->hProcess = NULL;
+    }
+}
+
+static bool BuildTopics(void) {
+    topics = (char(*)[MAX_NAME])malloc((size_t)config.topics * MAX_NAME);
+    topicSubscribers = (int*)calloc((size_t)config.topics, sizeof(int));
+    if (topics == NULL || topicSubscribers == NULL) {
+        return false;
+    }
+    for (int i = 0; i < config.topics; i++) {
+        snprintf(topics[i], MAX_NAME, "bench/%d", i);
+    }
+    for (int s = 0; s < config.subscribers; s++) {
+        for (int j = 0; j < config.subscriptions; j++) {
+            topicSubscribers[SubscriptionTopic(s, j)]++;
+        }
+    }
+
+    if (config.zipfExponent <= 0.0) {
+        topicCdf = NULL;
+        return true;
+    }
+
+    // Topic i has weight 1 / (i + 1)^s
+    topicCdf = (double*)malloc((size_t)config.topics * sizeof(double));
+    if (topicCdf == NULL) {
+        return false;
+    }
+    double total = 0.0;
+    for (int i = 0; i < config.topics; i++) {
+        total += 1.0 / pow((double)(i + 1), config.zipfExponent);
+        topicCdf[i] = total;
+    }
+    for (int i = 0; i < config.topics; i++) {
+        topicCdf[i] /= total;
+    }
+    return true;
+}
+
+static void PrintUsage(void) {
+    printf("Usage: LoadGenerator [options]\n"
+        "  --publishers N      publisher connections (default 4)\n"
+        "  --subscribers M     subscriber connections (default 4)\n"
+        "  --topics K          distinct topics (default 16)\n"
+        "  --subscriptions S   topics per subscriber, at most %d (default min(K, %d))\n"
+        "  --payload BYTES     payload size, at least %d (default 64)\n"
+        "  --zipf S            Zipf exponent for topic choice, 0 for uniform (default 0)\n"
+        "  --rate R            messages/s per publisher, 0 for unlimited (default 0)\n"
+        "  --batch N           messages per multi-message publish frame (default 1)\n"
+        "  --warmup SECONDS    unmeasured warmup (default 2)\n"
+        "  --duration SECONDS  measured window (default 10)\n"
+        "  --settle MS         wait for subscriptions to reach the PES (default 1000)\n"
+        "  --drain MS          wait for in-flight messages (default 1000)\n"
+        "  --storage MODE      Storage Service durability: sync, group or async (default group)\n"
+        "  --no-spawn          use services that are already running\n"
+        "  --label TEXT        build or run label copied to the JSON result (no quotes)\n"
+        "  --output FILE       append the JSON result line to FILE\n",
+        MAX_SUBSCRIPTIONS, MAX_SUBSCRIPTIONS, PAYLOAD_HEADER_SIZE);
+}
+
+static bool ParseArguments(int argc, char* argv[]) {
+    config.publishers = 4;
+    config.subscribers = 4;
+    config.topics = 16;
+    config.subscriptions = -1;
+    config.payloadSize = 64;
+    config.zipfExponent = 0.0;
+    config.rate = 0;
+    config.batch = 1;
+    config.warmupSeconds = 2;
+    config.durationSeconds = 10;
+    config.settleMilliseconds = 1000;
+    config.drainMilliseconds = 1000;
+    config.spawnServices = true;
+    config.storageMode = "group";
+    config.label = "";
+    config.outputPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(option, "--no-spawn") == 0) {
+            config.spawnServices = false;
+            continue;
+        }
+        if (value == NULL) {
+            return false;
+        }
+        i++;
+
+        if (strcmp(option, "--publishers") == 0) config.publishers = atoi(value);
+        else if (strcmp(option, "--subscribers") == 0) config.subscribers = atoi(value);
+        else if (strcmp(option, "--topics") == 0) config.topics = atoi(value);
+        else if (strcmp(option, "--subscriptions") == 0) config.subscriptions = atoi(value);
+        else if (strcmp(option, "--payload") == 0) config.payloadSize = (size_t)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--zipf") == 0) config.zipfExponent = atof(value);
+        else if (strcmp(option, "--rate") == 0) config.rate = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--batch") == 0) config.batch = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--warmup") == 0) config.warmupSeconds = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--duration") == 0) config.durationSeconds = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--settle") == 0) config.settleMilliseconds = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--drain") == 0) config.drainMilliseconds = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--storage") == 0) config.storageMode = value;
+        else if (strcmp(option, "--label") == 0) config.label = value;
+        else if (strcmp(option, "--output") == 0) config.outputPath = value;
+        else return false;
+    }
+
+    if (config.subscriptions < 0) {
+        config.subscriptions = config.topics < MAX_SUBSCRIPTIONS ? config.topics : MAX_SUBSCRIPTIONS;
+    }
+    return config.publishers > 0 && config.subscribers >= 0 && config.topics > 0 &&
+        config.subscriptions > 0 && config.subscriptions <= config.topics && config.subscriptions <= MAX_SUBSCRIPTIONS &&
+        config.payloadSize >= PAYLOAD_HEADER_SIZE && config.payloadSize < FRAME_MAX_PAYLOAD &&
+        config.batch > 0 && config.batch * Frame_BatchRecordSize(MAX_NAME, config.payloadSize) <= FRAME_MAX_PAYLOAD &&
+        config.durationSeconds > 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (!ParseArguments(argc, argv)) {
+        PrintUsage();
+        return 1;
+    }
+
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        fprintf(stderr, "WSAStartup failed\n");
+        return 1;
+    }
+    QueryPerformanceFrequency(&frequency);
+    runId = GetTickCount() % 100000;
+
+    if (!BuildTopics()) {
+        fprintf(stderr, "Out of memory for %d topics\n", config.topics);
+        return 1;
+    }
+
+    // Services are expected next to this executable
+    PROCESS_INFORMATION services[3];
+    ZeroMemory(services, sizeof(services));
+    if (config.spawnServices) {
+        char directory[MAX_PATH];
+        DWORD length = GetModuleFileNameA(NULL, directory, sizeof(directory));
+        char* slash = strrchr(directory, '\\');
+        if (length == 0 || slash == NULL) {
+            fprintf(stderr, "Cannot locate the service executables\n");
+            return 1;
+        }
+        slash[1] = '\0';
+
+        char storageArguments[64];
+        snprintf(storageArguments, sizeof(storageArguments), "loadgen_storage 64 %s", config.storageMode);
+        if (!StartService(directory, "StorageService.exe", storageArguments, &services[0]) ||
+            !StartService(directory, "SubscriberEngine.exe", "--headless", &services[1]) ||
+            !StartService(directory, "PublisherEngine.exe", "--headless", &services[2])) {
+            for (int i = 0; i < 3; i++) {
+                StopService(&services[i]);
+            }
+            return 1;
+        }
+    }
+
+    PublisherState* publishers = (PublisherState*)calloc((size_t)config.publishers, sizeof(PublisherState));
+    SubscriberState* subscribers = (SubscriberState*)calloc((size_t)config.subscribers, sizeof(SubscriberState));
+    startEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (publishers == NULL || subscribers == NULL || startEvent == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // Subscribers first so their interest reaches the PES before anything is published
+    int exitCode = 0;
+    for (int i = 0; i < config.subscribers; i++) {
+        subscribers[i].index = i;
+        subscribers[i].socket = INVALID_SOCKET;
+        Histogram_Reset(&subscribers[i].latency);
+        subscribers[i].thread = (HANDLE)_beginthreadex(NULL, 0, SubscriberThread, &subscribers[i], 0, NULL);
+    }
+
+    ULONGLONG deadline = GetTickCount64() + CONNECT_TIMEOUT_MS;
+    int ready = 0;
+    while (GetTickCount64() < deadline) {
+        ready = 0;
+        for (int i = 0; i < config.subscribers; i++) {
+            ready += subscribers[i].ready ? 1 : 0;
+        }
+        if (ready == config.subscribers) {
+            break;
+        }
+        Sleep(50);
+    }
+    if (ready != config.subscribers) {
+        fprintf(stderr, "Only %d of %d subscribers are ready\n", ready, config.subscribers);
+        exitCode = 1;
+    }
+    Sleep(config.settleMilliseconds);
+
+    for (int i = 0; i < config.publishers && exitCode == 0; i++) {
+        publishers[i].index = i;
+        publishers[i].topicSent = (unsigned long long*)calloc((size_t)config.topics, sizeof(unsigned long long));
+        publishers[i].thread = (HANDLE)_beginthreadex(NULL, 0, PublisherThread, &publishers[i], 0, NULL);
+        if (publishers[i].topicSent == NULL || publishers[i].thread == NULL) {
+            fprintf(stderr, "Failed to start publisher %d\n", i);
+            exitCode = 1;
+        }
+    }
+
+    // The window is fixed before publishers are released, so every thread uses the same bounds
+    LONG64 start = Now();
+    windowStart = start + MillisecondsToTicks(config.warmupSeconds * 1000ULL);
+    windowEnd = exitCode == 0 ? windowStart + MillisecondsToTicks(config.durationSeconds * 1000ULL) : start;
+    SetEvent(startEvent);
+
+    for (int i = 0; i < config.publishers; i++) {
+        if (publishers[i].thread != NULL) {
+            WaitForSingleObject(publishers[i].thread, INFINITE);
+            CloseHandle(publishers[i].thread);
+        }
+    }
+
+    Sleep(config.drainMilliseconds);
+    stopping = true;
+    for (int i = 0; i < config.subscribers; i++) {
+        if (subscribers[i].socket != INVALID_SOCKET) {
+            shutdown(subscribers[i].socket, SD_BOTH);
+            closesocket(subscribers[i].socket);
+        }
+    }
+    for (int i = 0; i < config.subscribers; i++) {
+        if (subscribers[i].thread != NULL) {
+            WaitForSingleObject(subscribers[i].thread, INFINITE);
+            CloseHandle(subscribers[i].thread);
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        StopService(&services[i]);
+    }
+
+    // Combine per-thread results
+    unsigned long long published = 0;
+    unsigned long long failed = 0;
+    unsigned long long expected = 0;
+    unsigned long long delivered = 0;
+    unsigned long long deliveredBytes = 0;
+    int connectedPublishers = 0;
+    Histogram* latency = &combinedLatency;
+
+    for (int i = 0; i < config.publishers; i++) {
+        published += publishers[i].sent;
+        failed += publishers[i].failed;
+        connectedPublishers += publishers[i].connected ? 1 : 0;
+        for (int t = 0; t < config.topics && publishers[i].topicSent != NULL; t++) {
+            expected += publishers[i].topicSent[t] * (unsigned long long)topicSubscribers[t];
+        }
+        free(publishers[i].topicSent);
+    }
+    for (int i = 0; i < config.subscribers; i++) {
+        delivered += subscribers[i].received;
+        deliveredBytes += subscribers[i].bytes;
+        Histogram_Merge(latency, &subscribers[i].latency);
+    }
+    if (connectedPublishers != config.publishers) {
+        fprintf(stderr, "Only %d of %d publishers connected\n", connectedPublishers, config.publishers);
+        exitCode = 1;
+    }
+
+    double seconds = (double)config.durationSeconds;
+    printf("=== Load Generator ===\n");
+    printf("%d publishers, %d subscribers, %d topics (%d per subscriber), %zu byte payloads, %s topic choice\n",
+        config.publishers, config.subscribers, config.topics, config.subscriptions, config.payloadSize,
+        topicCdf ? "zipf" : "uniform");
+    printf("Published: %llu (%.0f msg/s, %llu failed)\n", published, published / seconds, failed);
+    printf("Delivered: %llu of %llu expected (%.0f msg/s, %.0f bytes/s)\n",
+        delivered, expected, delivered / seconds, deliveredBytes / seconds);
+    printf("Latency us: p50 %.1f | p99 %.1f | p999 %.1f | max %.1f | mean %.1f\n",
+        Histogram_Percentile(latency, 50.0) / 1000.0, Histogram_Percentile(latency, 99.0) / 1000.0,
+        Histogram_Percentile(latency, 99.9) / 1000.0, latency->max / 1000.0, Histogram_Mean(latency) / 1000.0);
+
+    char result[1024];
+    snprintf(result, sizeof(result),
+        "{\"label\":\"%s\",\"publishers\":%d,\"subscribers\":%d,\"topics\":%d,\"subscriptions\":%d,"
+        "\"payloadBytes\":%zu,\"zipf\":%.3f,\"rate\":%u,\"batch\":%u,\"durationSeconds\":%u,\"storage\":\"%s\","
+        "\"published\":%llu,\"failed\":%llu,\"expected\":%llu,\"delivered\":%llu,"
+        "\"publishedPerSecond\":%.1f,\"deliveredPerSecond\":%.1f,\"bytesPerSecond\":%.1f,"
+        "\"latencyMicroseconds\":{\"p50\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f,\"mean\":%.1f}}",
+        config.label, config.publishers, config.subscribers, config.topics, config.subscriptions,
+        config.payloadSize, config.zipfExponent, config.rate, config.batch, config.durationSeconds, config.storageMode,
+        published, failed, expected, delivered,
+        published / seconds, delivered / seconds, deliveredBytes / seconds,
+        Histogram_Percentile(latency, 50.0) / 1000.0, Histogram_Percentile(latency, 99.0) / 1000.0,
+        Histogram_Percentile(latency, 99.9) / 1000.0, latency->max / 1000.0, Histogram_Mean(latency) / 1000.0);
+    printf("%s\n", result);
+
+    if (config.outputPath != NULL) {
+        FILE* output = fopen(config.outputPath, "a");
+        if (output == NULL) {
+            fprintf(stderr, "Cannot append to %s\n", config.outputPath);
+            exitCode = 1;
+        }
+        else {
+            fprintf(output, "%s\n", result);
+            fclose(output);
+        }
+    }
+
+    CloseHandle(startEvent);
+    free(publishers);
+    free(subscribers);
+    free(topics);
+    free(topicSubscribers);
+    free(topicCdf);
+    WSACleanup();
+    return exitCode;
+}
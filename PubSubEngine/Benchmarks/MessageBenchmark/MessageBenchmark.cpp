@@ -0,0 +1,79 @@
+// MessageBenchmark.cpp : Microbenchmarks for Message_Init and Message_Validate with short and
+// full-length topics and payloads.
+
+#include "../../Common/pch.h"
+#define _CRT_SECURE_NO_WARNINGS
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../Common/benchmark.h"
+#include "../../Common/message.h"
+
+typedef struct {
+    const char* topic;
+    const char* payload;
+    Message message;
+} MessageContext;
+
+static void RunInit(void* context, unsigned int operations) {
+    MessageContext* message = (MessageContext*)context;
+    for (unsigned int i = 0; i < operations; i++) {
+        Message_Init(&message->message, message->topic, message->payload);
+    }
+    Benchmark_Consume((unsigned char)message->message.message[0]);
+}
+
+static void RunValidate(void* context, unsigned int operations) {
+    MessageContext* message = (MessageContext*)context;
+    unsigned long long valid = 0;
+    for (unsigned int i = 0; i < operations; i++) {
+        valid += Message_Validate(&message->message);
+    }
+    Benchmark_Consume(valid);
+}
+
+static void RunInitAndValidate(void* context, unsigned int operations) {
+    MessageContext* message = (MessageContext*)context;
+    unsigned long long valid = 0;
+    for (unsigned int i = 0; i < operations; i++) {
+        Message_Init(&message->message, message->topic, message->payload);
+        valid += Message_Validate(&message->message);
+    }
+    Benchmark_Consume(valid);
+}
+
+static void BenchmarkMessage(const BenchmarkConfig* config, const char* label, const char* topic, const char* payload) {
+    MessageContext message;
+    message.topic = topic;
+    message.payload = payload;
+    Message_Init(&message.message, topic, payload);
+
+    char name[64];
+    snprintf(name, sizeof(name), "Message_Init/%s", label);
+    Benchmark_Run(config, name, RunInit, &message, NULL);
+    snprintf(name, sizeof(name), "Message_Validate/%s", label);
+    Benchmark_Run(config, name, RunValidate, &message, NULL);
+    snprintf(name, sizeof(name), "Message_Init+Validate/%s", label);
+    Benchmark_Run(config, name, RunInitAndValidate, &message, NULL);
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    if (!Benchmark_ParseArguments(&config, argc, argv)) {
+        return 1;
+    }
+
+    // Full-length strings are one byte over the field so Message_Init truncates them
+    static char longTopic[MAX_TOPIC_LENGTH + 1];
+    static char longPayload[MAX_MESSAGE_LENGTH + 1];
+    memset(longTopic, 't', MAX_TOPIC_LENGTH);
+    memset(longPayload, 'p', MAX_MESSAGE_LENGTH);
+
+    printf("=== Message ===\n");
+    BenchmarkMessage(&config, "short", "sensor/42/temperature", "{\"value\":21.5}");
+    BenchmarkMessage(&config, "long", longTopic, longPayload);
+    return 0;
+}
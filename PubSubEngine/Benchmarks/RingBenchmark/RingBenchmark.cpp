@@ -0,0 +1,421 @@
+// RingBenchmark.cpp : Stress checks and microbenchmarks for the lock-free rings. The checks push
+// millions of items through small rings from several threads and verify that nothing is lost,
+// duplicated or reordered; the benchmark fails if any check does. The timed cases measure the
+// producer's side against a consumer thread draining the ring, as the engines' link writers do,
+// with a queue guarded by a kernel mutex as the baseline.
+
+#include "../../Common/pch.h"
+#define _CRT_SECURE_NO_WARNINGS
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../Common/benchmark.h"
+#include "../../Common/ring.h"
+
+#define CHECK_ITEMS 2000000        // Items pushed through each stress check
+#define CHECK_CAPACITY 16          // Small enough that producers keep hitting a full ring
+#define CHECK_PRODUCERS 4
+#define CHECK_MAX_BATCH 24
+#define CHECK_WAIT_MS 10           // Pop timeout, so a lost item ends the check once the producers are done
+#define BENCH_CAPACITY 4096
+#define BENCH_BATCH 32             // Items per call in the batch cases
+#define BENCH_BACKGROUND_PRODUCERS 2
+
+typedef enum {
+    QUEUE_SPSC,
+    QUEUE_MPSC,
+    QUEUE_MUTEX
+} QueueKind;
+
+// A fixed ring guarded by a kernel mutex; full and empty are polled
+typedef struct {
+    HANDLE mutex;
+    void** slots;
+    size_t capacity;
+    size_t head;
+    size_t count;
+} MutexQueue;
+
+typedef struct {
+    QueueKind kind;
+    SpscRing spsc;
+    MpscRing mpsc;
+    MutexQueue locked;
+    volatile LONG stopping;
+    HANDLE consumer;
+    HANDLE producers[BENCH_BACKGROUND_PRODUCERS];
+    int producerCount;
+    volatile LONG64 consumed;
+} Harness;
+
+typedef struct {
+    MpscRing* ring;
+    int producer;
+    unsigned int seed;
+} CheckProducer;
+
+static unsigned int NextRandom(unsigned int* seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return (*seed >> 16) & 0x7FFF;
+}
+
+static void* CheckValue(int producer, unsigned int sequence) {
+    return (void*)(ULONG_PTR)(((ULONG_PTR)producer << 24) | (sequence + 1));
+}
+
+static unsigned __stdcall SpscCheckProducer(void* param) {
+    SpscRing* ring = (SpscRing*)param;
+    unsigned int seed = 7;
+    void* items[CHECK_MAX_BATCH];
+
+    for (unsigned int sent = 0; sent < CHECK_ITEMS;) {
+        unsigned int batch = 1 + NextRandom(&seed) % CHECK_MAX_BATCH;
+        if (batch > CHECK_ITEMS - sent) {
+            batch = CHECK_ITEMS - sent;
+        }
+        for (unsigned int i = 0; i < batch; i++) {
+            items[i] = CheckValue(0, sent + i);
+        }
+        SpscRing_PushBatch(ring, items, batch);
+        sent += batch;
+    }
+    return 0;
+}
+
+// One producer, one consumer, random batch sizes on both sides; every item must arrive in order
+static bool CheckSpsc(void) {
+    SpscRing ring;
+    if (!SpscRing_Init(&ring, CHECK_CAPACITY)) {
+        printf("FAILED SpscRing: out of memory\n");
+        return false;
+    }
+
+    unsigned threadId;
+    HANDLE producer = (HANDLE)_beginthreadex(NULL, 0, SpscCheckProducer, &ring, 0, &threadId);
+    if (producer == NULL) {
+        SpscRing_Destroy(&ring);
+        printf("FAILED SpscRing: could not start producer\n");
+        return false;
+    }
+
+    // Keep draining after a failure so the producer never blocks on a full ring
+    unsigned int seed = 11;
+    unsigned int received = 0;
+    bool ordered = true;
+    void* items[CHECK_MAX_BATCH];
+    while (received < CHECK_ITEMS) {
+        size_t max = 1 + NextRandom(&seed) % CHECK_MAX_BATCH;
+        size_t count = SpscRing_PopBatch(&ring, items, max, CHECK_WAIT_MS);
+        if (count == 0 && WaitForSingleObject(producer, 0) == WAIT_OBJECT_0 && SpscRing_Count(&ring) == 0) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (ordered && items[i] != CheckValue(0, received)) {
+                printf("FAILED SpscRing: item %u out of order\n", received);
+                ordered = false;
+            }
+            received++;
+        }
+    }
+
+    WaitForSingleObject(producer, INFINITE);
+    CloseHandle(producer);
+    bool passed = ordered && received == CHECK_ITEMS && SpscRing_Count(&ring) == 0;
+    SpscRing_Destroy(&ring);
+    if (passed) {
+        printf("Passed SpscRing: %u items in order\n", received);
+    }
+    else if (ordered) {
+        printf("FAILED SpscRing: %u of %u items arrived\n", received, CHECK_ITEMS);
+    }
+    return passed;
+}
+
+static unsigned __stdcall MpscCheckProducer(void* param) {
+    CheckProducer* producer = (CheckProducer*)param;
+    void* items[CHECK_MAX_BATCH];
+    unsigned int total = CHECK_ITEMS / CHECK_PRODUCERS;
+
+    for (unsigned int sent = 0; sent < total;) {
+        unsigned int batch = 1 + NextRandom(&producer->seed) % CHECK_MAX_BATCH;
+        if (batch > total - sent) {
+            batch = total - sent;
+        }
+        for (unsigned int i = 0; i < batch; i++) {
+            items[i] = CheckValue(producer->producer, sent + i);
+        }
+        MpscRing_PushBatch(producer->ring, items, batch);
+        sent += batch;
+    }
+    return 0;
+}
+
+// Several producers; each producer's items must arrive in its own order and none may be lost
+static bool CheckMpsc(void) {
+    MpscRing ring;
+    if (!MpscRing_Init(&ring, CHECK_CAPACITY)) {
+        printf("FAILED MpscRing: out of memory\n");
+        return false;
+    }
+
+    CheckProducer producers[CHECK_PRODUCERS];
+    HANDLE threads[CHECK_PRODUCERS];
+    int started = 0;
+    for (int i = 0; i < CHECK_PRODUCERS; i++) {
+        producers[i].ring = &ring;
+        producers[i].producer = i;
+        producers[i].seed = 101u * (unsigned int)(i + 1);
+        unsigned threadId;
+        threads[i] = (HANDLE)_beginthreadex(NULL, 0, MpscCheckProducer, &producers[i], 0, &threadId);
+        if (threads[i] == NULL) {
+            break;
+        }
+        started++;
+    }
+
+    // Keep draining after a failure so no producer stays blocked on a full ring
+    unsigned int expected = (unsigned int)started * (CHECK_ITEMS / CHECK_PRODUCERS);
+    unsigned int next[CHECK_PRODUCERS] = { 0 };
+    unsigned int received = 0;
+    bool ordered = true;
+    void* items[CHECK_MAX_BATCH];
+    while (received < expected) {
+        size_t count = MpscRing_PopBatch(&ring, items, CHECK_MAX_BATCH, CHECK_WAIT_MS);
+        if (count == 0 && WaitForMultipleObjects((DWORD)started, threads, TRUE, 0) == WAIT_OBJECT_0 &&
+            MpscRing_Count(&ring) == 0) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            ULONG_PTR value = (ULONG_PTR)items[i];
+            int producer = (int)(value >> 24);
+            if (ordered && (producer >= started || (value & 0xFFFFFF) != next[producer] + 1)) {
+                printf("FAILED MpscRing: unexpected item %#llx after %u items\n", (unsigned long long)value, received);
+                ordered = false;
+            }
+            if (ordered) {
+                next[producer]++;
+            }
+            received++;
+        }
+    }
+
+    for (int i = 0; i < started; i++) {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+    bool passed = ordered && started == CHECK_PRODUCERS && received == expected && MpscRing_Count(&ring) == 0;
+    MpscRing_Destroy(&ring);
+    if (passed) {
+        printf("Passed MpscRing: %u items from %d producers in order\n", received, started);
+    }
+    else if (ordered && started != CHECK_PRODUCERS) {
+        printf("FAILED MpscRing: started %d of %d producers\n", started, CHECK_PRODUCERS);
+    }
+    else if (ordered) {
+        printf("FAILED MpscRing: %u of %u items arrived\n", received, expected);
+    }
+    return passed;
+}
+
+static void MutexQueue_Push(MutexQueue* queue, void* item) {
+    for (;;) {
+        WaitForSingleObject(queue->mutex, INFINITE);
+        if (queue->count < queue->capacity) {
+            queue->slots[(queue->head + queue->count) % queue->capacity] = item;
+            queue->count++;
+            ReleaseMutex(queue->mutex);
+            return;
+        }
+        ReleaseMutex(queue->mutex);
+        SwitchToThread();
+    }
+}
+
+static size_t MutexQueue_PopBatch(MutexQueue* queue, void** items, size_t max) {
+    WaitForSingleObject(queue->mutex, INFINITE);
+    size_t popped = 0;
+    while (popped < max && queue->count > 0) {
+        items[popped++] = queue->slots[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    ReleaseMutex(queue->mutex);
+    return popped;
+}
+
+static void Harness_Push(Harness* harness, void* item) {
+    switch (harness->kind) {
+    case QUEUE_SPSC:
+        SpscRing_Push(&harness->spsc, item);
+        break;
+    case QUEUE_MPSC:
+        MpscRing_Push(&harness->mpsc, item);
+        break;
+    case QUEUE_MUTEX:
+        MutexQueue_Push(&harness->locked, item);
+        break;
+    }
+}
+
+static unsigned __stdcall ConsumerThread(void* param) {
+    Harness* harness = (Harness*)param;
+    void* items[BENCH_BATCH];
+
+    for (;;) {
+        size_t count = 0;
+        switch (harness->kind) {
+        case QUEUE_SPSC:
+            count = SpscRing_PopBatch(&harness->spsc, items, BENCH_BATCH, 10);
+            break;
+        case QUEUE_MPSC:
+            count = MpscRing_PopBatch(&harness->mpsc, items, BENCH_BATCH, 10);
+            break;
+        case QUEUE_MUTEX:
+            count = MutexQueue_PopBatch(&harness->locked, items, BENCH_BATCH);
+            if (count == 0) {
+                SwitchToThread();
+            }
+            break;
+        }
+
+        harness->consumed += (LONG64)count;
+        if (count == 0 && harness->stopping) {
+            break;
+        }
+    }
+    return 0;
+}
+
+// Keeps pushing until the harness stops, so the measured producer contends for the tail
+static unsigned __stdcall BackgroundProducerThread(void* param) {
+    Harness* harness = (Harness*)param;
+    while (!harness->stopping) {
+        Harness_Push(harness, harness);
+    }
+    return 0;
+}
+
+static bool Harness_Start(Harness* harness, QueueKind kind, int backgroundProducers) {
+    ZeroMemory(harness, sizeof(*harness));
+    harness->kind = kind;
+
+    bool ready = false;
+    switch (kind) {
+    case QUEUE_SPSC:
+        ready = SpscRing_Init(&harness->spsc, BENCH_CAPACITY);
+        break;
+    case QUEUE_MPSC:
+        ready = MpscRing_Init(&harness->mpsc, BENCH_CAPACITY);
+        break;
+    case QUEUE_MUTEX:
+        harness->locked.capacity = BENCH_CAPACITY;
+        harness->locked.slots = (void**)calloc(BENCH_CAPACITY, sizeof(void*));
+        harness->locked.mutex = CreateMutex(NULL, FALSE, NULL);
+        ready = harness->locked.slots != NULL && harness->locked.mutex != NULL;
+        break;
+    }
+    if (!ready) {
+        return false;
+    }
+
+    unsigned threadId;
+    harness->consumer = (HANDLE)_beginthreadex(NULL, 0, ConsumerThread, harness, 0, &threadId);
+    for (int i = 0; i < backgroundProducers; i++) {
+        harness->producers[i] = (HANDLE)_beginthreadex(NULL, 0, BackgroundProducerThread, harness, 0, &threadId);
+        if (harness->producers[i] != NULL) {
+            harness->producerCount++;
+        }
+    }
+    return harness->consumer != NULL;
+}
+
+static void Harness_Stop(Harness* harness) {
+    harness->stopping = 1;
+    for (int i = 0; i < harness->producerCount; i++) {
+        WaitForSingleObject(harness->producers[i], INFINITE);
+        CloseHandle(harness->producers[i]);
+    }
+    if (harness->consumer != NULL) {
+        WaitForSingleObject(harness->consumer, INFINITE);
+        CloseHandle(harness->consumer);
+    }
+
+    switch (harness->kind) {
+    case QUEUE_SPSC:
+        SpscRing_Destroy(&harness->spsc);
+        break;
+    case QUEUE_MPSC:
+        MpscRing_Destroy(&harness->mpsc);
+        break;
+    case QUEUE_MUTEX:
+        free(harness->locked.slots);
+        if (harness->locked.mutex != NULL) {
+            CloseHandle(harness->locked.mutex);
+        }
+        break;
+    }
+}
+
+static void RunPush(void* context, unsigned int operations) {
+    Harness* harness = (Harness*)context;
+    for (unsigned int i = 0; i < operations; i++) {
+        Harness_Push(harness, harness);
+    }
+}
+
+static void RunPushBatch(void* context, unsigned int operations) {
+    Harness* harness = (Harness*)context;
+    void* items[BENCH_BATCH];
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        items[i] = harness;
+    }
+
+    for (unsigned int done = 0; done < operations;) {
+        unsigned int batch = operations - done < BENCH_BATCH ? operations - done : BENCH_BATCH;
+        if (harness->kind == QUEUE_SPSC) {
+            SpscRing_PushBatch(&harness->spsc, items, batch);
+        }
+        else {
+            MpscRing_PushBatch(&harness->mpsc, items, batch);
+        }
+        done += batch;
+    }
+}
+
+static void RunCase(const BenchmarkConfig* config, const char* name, QueueKind kind, int backgroundProducers,
+    BenchmarkFunction function) {
+    Harness harness;
+    if (!Harness_Start(&harness, kind, backgroundProducers)) {
+        printf("Failed to set up %s\n", name);
+        Harness_Stop(&harness);
+        return;
+    }
+    Benchmark_Run(config, name, function, &harness, NULL);
+    Harness_Stop(&harness);
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    if (!Benchmark_ParseArguments(&config, argc, argv)) {
+        return 1;
+    }
+
+    printf("=== Ring checks ===\n");
+    if (!CheckSpsc() || !CheckMpsc()) {
+        return 1;
+    }
+
+    printf("=== Rings ===\n");
+    RunCase(&config, "SpscRing/push", QUEUE_SPSC, 0, RunPush);
+    RunCase(&config, "SpscRing/push_batch", QUEUE_SPSC, 0, RunPushBatch);
+    RunCase(&config, "MpscRing/push", QUEUE_MPSC, 0, RunPush);
+    RunCase(&config, "MpscRing/push_batch", QUEUE_MPSC, 0, RunPushBatch);
+    RunCase(&config, "MpscRing/push_contended", QUEUE_MPSC, BENCH_BACKGROUND_PRODUCERS, RunPush);
+    RunCase(&config, "MutexQueue/push", QUEUE_MUTEX, 0, RunPush);
+    RunCase(&config, "MutexQueue/push_contended", QUEUE_MUTEX, BENCH_BACKGROUND_PRODUCERS, RunPush);
+    return 0;
+}
@@ -0,0 +1,188 @@
+// StorageBenchmark.cpp : Microbenchmarks for the Storage Service core without its socket front end.
+//   SaveMessage  - append one message in each durability mode
+//   GetMessages  - fetch one topic's messages from a synthetic log written before the run and
+//                  reopened, so the topic index is rebuilt from the segments as on a restart
+// Sync saves force the disk and queries copy out whole topics, so those cases run smaller batches.
+
+#include "../../Common/pch.h"
+#define _CRT_SECURE_NO_WARNINGS
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Link with ws2_32.lib
+#pragma comment(lib, "ws2_32.lib")
+
+#include "../../Common/benchmark.h"
+#include "../../Common/message.h"
+#include "../../StorageService/StorageService.h"
+
+#define BENCHMARK_DIRECTORY "storage_benchmark"
+#define SLOW_BATCH_DIVISOR 100
+
+typedef struct {
+    size_t messages;   // Messages written to the synthetic log
+    size_t topics;     // ...spread round-robin over this many topics
+} LogShape;
+
+static const LogShape logShapes[] = { { 10000, 10 }, { 10000, 1000 }, { 100000, 100 } };
+
+typedef struct {
+    char topic[MAX_TOPIC_LENGTH];
+    const char* payload;
+} SaveContext;
+
+typedef struct {
+    char (*topics)[MAX_TOPIC_LENGTH];
+    size_t topicCount;
+} QueryContext;
+
+static void MakeTopic(char* buffer, size_t size, size_t index) {
+    snprintf(buffer, size, "sensor/%zu/temperature", index);
+}
+
+// Delete every file the log left behind, then the directory itself
+static void RemoveStorage(void) {
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA(BENCHMARK_DIRECTORY "\\*", &found);
+    if (search != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                char path[MAX_PATH];
+                snprintf(path, sizeof(path), "%s\\%s", BENCHMARK_DIRECTORY, found.cFileName);
+                DeleteFileA(path);
+            }
+        } while (FindNextFileA(search, &found));
+        FindClose(search);
+    }
+    RemoveDirectoryA(BENCHMARK_DIRECTORY);
+}
+
+// The same run with batch divided by SLOW_BATCH_DIVISOR
+static BenchmarkConfig SlowCaseConfig(const BenchmarkConfig* config) {
+    BenchmarkConfig caseConfig = *config;
+    caseConfig.batch = config->batch / SLOW_BATCH_DIVISOR > 0 ? config->batch / SLOW_BATCH_DIVISOR : 1;
+    return caseConfig;
+}
+
+static bool OpenStorage(StorageDurability mode) {
+    StorageDurabilityConfig durability;
+    durability.mode = mode;
+    durability.groupRecords = STORAGE_DEFAULT_GROUP_RECORDS;
+    durability.groupMicroseconds = STORAGE_DEFAULT_GROUP_MICROSECONDS;
+    return StorageService_Init(BENCHMARK_DIRECTORY, 0, &durability);
+}
+
+static void RunSaveMessage(void* context, unsigned int operations) {
+    SaveContext* save = (SaveContext*)context;
+    unsigned long long saved = 0;
+    for (unsigned int i = 0; i < operations; i++) {
+        saved += StorageService_SaveMessage(save->topic, save->payload, NULL);
+    }
+    Benchmark_Consume(saved);
+}
+
+static void RunGetMessages(void* context, unsigned int operations) {
+    QueryContext* query = (QueryContext*)context;
+    unsigned long long returned = 0;
+    for (unsigned int i = 0; i < operations; i++) {
+        char* buffer = NULL;
+        int messageCount = 0;
+        if (StorageService_GetMessages(query->topics[i % query->topicCount], &buffer, &messageCount)) {
+            returned += (unsigned long long)messageCount;
+        }
+        free(buffer);
+    }
+    Benchmark_Consume(returned);
+}
+
+static bool BenchmarkSave(const BenchmarkConfig* config, StorageDurability mode, const char* modeName) {
+    char name[64];
+    snprintf(name, sizeof(name), "SaveMessage/%s", modeName);
+    if (config->filter != NULL && strstr(name, config->filter) == NULL) {
+        return true;
+    }
+
+    RemoveStorage();
+    if (!OpenStorage(mode)) {
+        return false;
+    }
+
+    BenchmarkConfig caseConfig = mode == STORAGE_DURABILITY_SYNC ? SlowCaseConfig(config) : *config;
+
+    SaveContext save;
+    MakeTopic(save.topic, sizeof(save.topic), 0);
+    save.payload = "{\"value\":21.5,\"unit\":\"C\",\"sequence\":1234567}";
+
+    Benchmark_Run(&caseConfig, name, RunSaveMessage, &save, NULL);
+
+    StorageService_Destroy();
+    return true;
+}
+
+static bool BenchmarkGet(const BenchmarkConfig* config, const LogShape* shape) {
+    char name[64];
+    snprintf(name, sizeof(name), "GetMessages/%zux%zu", shape->messages, shape->topics);
+    if (config->filter != NULL && strstr(name, config->filter) == NULL) {
+        return true; // Skip building a log nobody will read
+    }
+
+    QueryContext query;
+    query.topicCount = shape->topics;
+    query.topics = (char(*)[MAX_TOPIC_LENGTH])malloc(shape->topics * sizeof(*query.topics));
+    if (!query.topics) {
+        return false;
+    }
+    for (size_t i = 0; i < shape->topics; i++) {
+        MakeTopic(query.topics[i], sizeof(query.topics[i]), i);
+    }
+
+    RemoveStorage();
+    if (!OpenStorage(STORAGE_DURABILITY_ASYNC)) {
+        free(query.topics);
+        return false;
+    }
+    char payload[64];
+    for (size_t i = 0; i < shape->messages; i++) {
+        snprintf(payload, sizeof(payload), "{\"value\":%zu}", i);
+        StorageService_SaveMessage(query.topics[i % shape->topics], payload, NULL);
+    }
+    StorageService_Destroy();
+
+    if (!OpenStorage(STORAGE_DURABILITY_ASYNC)) {
+        free(query.topics);
+        return false;
+    }
+    BenchmarkConfig caseConfig = SlowCaseConfig(config);
+    Benchmark_Run(&caseConfig, name, RunGetMessages, &query, NULL);
+    StorageService_Destroy();
+
+    free(query.topics);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    if (!Benchmark_ParseArguments(&config, argc, argv)) {
+        return 1;
+    }
+
+    printf("=== Storage ===\n");
+    bool success = true;
+    success = success && BenchmarkSave(&config, STORAGE_DURABILITY_SYNC, "sync");
+    success = success && BenchmarkSave(&config, STORAGE_DURABILITY_GROUP, "group");
+    success = success && BenchmarkSave(&config, STORAGE_DURABILITY_ASYNC, "async");
+    for (size_t i = 0; success && i < sizeof(logShapes) / sizeof(logShapes[0]); i++) {
+        success = BenchmarkGet(&config, &logShapes[i]);
+    }
+
+    RemoveStorage();
+    if (!success) {
+        printf("Failed to open the benchmark storage in %s\n", BENCHMARK_DIRECTORY);
+        return 1;
+    }
+    return 0;
+}
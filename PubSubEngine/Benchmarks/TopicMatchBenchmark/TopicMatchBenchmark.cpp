@@ -0,0 +1,152 @@
+// TopicMatchBenchmark.cpp : Microbenchmarks for topic matching on the message path.
+//   IsTopicInList      - the PES's old comma separated interest scan (the baseline in topicfixture)
+//   HasInterest        - its replacement, a TopicSet lookup
+//   NotifySubscribers  - the Subscriber Engine fan-out loop: encode once, find the topic's members,
+//                        push the shared frame onto each member's send queue
+
+#include "../../Common/pch.h"
+#define _CRT_SECURE_NO_WARNINGS
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Link with ws2_32.lib
+#pragma comment(lib, "ws2_32.lib")
+
+#include "../../Common/benchmark.h"
+#include "../../Common/topicset.h"
+#include "../../Common/topicfixture.h"
+#include "../../Common/topicindex.h"
+#include "../../Common/sendqueue.h"
+
+static const size_t listSizes[] = { 10, 100, 1000 };
+static const int fanOuts[] = { 1, 16, 256 };
+
+typedef struct {
+    TopicIndex index;
+    SendQueue* queues;           // One per subscriber slot
+    int subscribers;
+    const char* topic;
+    const char* payload;
+} FanOutContext;
+
+static void RunIsTopicInList(void* context, unsigned int operations) {
+    TopicFixture* fixture = (TopicFixture*)context;
+    unsigned long long hits = 0;
+    for (unsigned int i = 0; i < operations; i++) {
+        hits += TopicFixture_IsTopicInList(fixture->probes[i % TOPICFIXTURE_PROBES], fixture->topicList);
+    }
+    Benchmark_Consume(hits);
+}
+
+static void RunHasInterest(void* context, unsigned int operations) {
+    TopicFixture* fixture = (TopicFixture*)context;
+    unsigned long long hits = 0;
+    for (unsigned int i = 0; i < operations; i++) {
+        hits += TopicSet_Contains(&fixture->set, fixture->probes[i % TOPICFIXTURE_PROBES]);
+    }
+    Benchmark_Consume(hits);
+}
+
+// Same steps as SubscriberEngine_NotifySubscribers minus the lock and the reactor send;
+// each queue is completed straight away so it never fills up
+static void RunNotifySubscribers(void* context, unsigned int operations) {
+    FanOutContext* fanOut = (FanOutContext*)context;
+    unsigned long long queued = 0;
+
+    for (unsigned int i = 0; i < operations; i++) {
+        SharedFrame* frame = SharedFrame_Create(FRAME_MESSAGE, fanOut->topic, fanOut->payload);
+        if (!frame) {
+            return;
+        }
+
+        int memberCount;
+        const int* slots = TopicIndex_Find(&fanOut->index, fanOut->topic, &memberCount);
+        for (int m = 0; m < memberCount; m++) {
+            SendQueue* queue = &fanOut->queues[slots[m]];
+            const char* sendData;
+            size_t sendLength;
+            if (SendQueue_Push(queue, frame, &sendData, &sendLength)) {
+                queued++;
+            }
+            while (SendQueue_Complete(queue, &sendData, &sendLength)) {
+            }
+        }
+
+        SharedFrame_Release(frame);
+    }
+    Benchmark_Consume(queued);
+}
+
+static bool BenchmarkInterest(const BenchmarkConfig* config, size_t topicCount) {
+    TopicFixture fixture;
+    if (!TopicFixture_Init(&fixture, topicCount)) {
+        return false;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "IsTopicInList/%zu", topicCount);
+    Benchmark_Run(config, name, RunIsTopicInList, &fixture, NULL);
+    snprintf(name, sizeof(name), "HasInterest/%zu", topicCount);
+    Benchmark_Run(config, name, RunHasInterest, &fixture, NULL);
+
+    TopicFixture_Destroy(&fixture);
+    return true;
+}
+
+static bool BenchmarkFanOut(const BenchmarkConfig* config, int subscribers) {
+    FanOutContext fanOut;
+    fanOut.subscribers = subscribers;
+    fanOut.topic = "sensor/42/temperature";
+    fanOut.payload = "{\"value\":21.5,\"unit\":\"C\",\"sequence\":1234567}";
+    fanOut.queues = (SendQueue*)calloc((size_t)subscribers, sizeof(SendQueue));
+    if (!fanOut.queues || !TopicIndex_Init(&fanOut.index, 64)) {
+        free(fanOut.queues);
+        return false;
+    }
+
+    // Other topics share the index so lookups probe a realistic table
+    char topic[64];
+    for (int i = 0; i < subscribers; i++) {
+        SendQueue_Init(&fanOut.queues[i], 0, 0);
+        TopicIndex_Add(&fanOut.index, fanOut.topic, i);
+        TopicFixture_MakeTopic(topic, sizeof(topic), 1000 + (size_t)i);
+        TopicIndex_Add(&fanOut.index, topic, i);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "NotifySubscribers/%d", subscribers);
+    Benchmark_Run(config, name, RunNotifySubscribers, &fanOut, NULL);
+
+    for (int i = 0; i < subscribers; i++) {
+        SendQueue_Destroy(&fanOut.queues[i]);
+    }
+    TopicIndex_Destroy(&fanOut.index);
+    free(fanOut.queues);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    if (!Benchmark_ParseArguments(&config, argc, argv)) {
+        return 1;
+    }
+
+    printf("=== Topic matching ===\n");
+    for (size_t i = 0; i < sizeof(listSizes) / sizeof(listSizes[0]); i++) {
+        if (!BenchmarkInterest(&config, listSizes[i])) {
+            printf("Out of memory for %zu topics\n", listSizes[i]);
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < sizeof(fanOuts) / sizeof(fanOuts[0]); i++) {
+        if (!BenchmarkFanOut(&config, fanOuts[i])) {
+            printf("Out of memory for %d subscribers\n", fanOuts[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
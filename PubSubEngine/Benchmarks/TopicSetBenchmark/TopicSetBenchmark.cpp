@@ -0,0 +1,88 @@
+// TopicSetBenchmark.cpp : Compares TopicSet lookups with the old comma separated topic list scan.
+
+#include "../../Common/pch.h"
+#define _CRT_SECURE_NO_WARNINGS
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../../Common/benchmark.h"
+#include "../../Common/topicset.h"
+#include "../../Common/topicfixture.h"
+
+static const size_t topicCounts[] = { 10, 1000, 100000 };
+
+static void RunBuild(void* context, unsigned int operations) {
+    TopicFixture* fixture = (TopicFixture*)context;
+    unsigned long long built = 0;
+    for (unsigned int i = 0; i < operations; i++) {
+        TopicSet set;
+        if (TopicSet_Init(&set, fixture->topicCount)) {
+            built += TopicSet_BuildFromList(&set, fixture->topicList, ',');
+            TopicSet_Destroy(&set);
+        }
+    }
+    Benchmark_Consume(built);
+}
+
+static void RunTopicSet(void* context, unsigned int operations) {
+    TopicFixture* fixture = (TopicFixture*)context;
+    unsigned long long hits = 0;
+    for (unsigned int i = 0; i < operations; i++) {
+        hits += TopicSet_Contains(&fixture->set, fixture->probes[i % TOPICFIXTURE_PROBES]);
+    }
+    Benchmark_Consume(hits);
+}
+
+static void RunIsTopicInList(void* context, unsigned int operations) {
+    TopicFixture* fixture = (TopicFixture*)context;
+    unsigned long long hits = 0;
+    for (unsigned int i = 0; i < operations; i++) {
+        hits += TopicFixture_IsTopicInList(fixture->probes[i % TOPICFIXTURE_PROBES], fixture->topicList);
+    }
+    Benchmark_Consume(hits);
+}
+
+static bool BenchmarkTopics(const BenchmarkConfig* config, size_t topicCount) {
+    TopicFixture fixture;
+    if (!TopicFixture_Init(&fixture, topicCount)) {
+        return false;
+    }
+
+    // Building and the legacy scan are O(topic count) per call, so scale their batch down
+    BenchmarkConfig scaled = *config;
+    scaled.batch = (unsigned int)(config->batch / topicCount);
+    if (scaled.batch == 0) {
+        scaled.batch = 1;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "TopicSet_BuildFromList/%zu", topicCount);
+    Benchmark_Run(&scaled, name, RunBuild, &fixture, NULL);
+    snprintf(name, sizeof(name), "TopicSet_Contains/%zu", topicCount);
+    Benchmark_Run(config, name, RunTopicSet, &fixture, NULL);
+    snprintf(name, sizeof(name), "IsTopicInList/%zu", topicCount);
+    Benchmark_Run(&scaled, name, RunIsTopicInList, &fixture, NULL);
+
+    TopicFixture_Destroy(&fixture);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    if (!Benchmark_ParseArguments(&config, argc, argv)) {
+        return 1;
+    }
+
+    printf("=== TopicSet vs IsTopicInList ===\n");
+    for (size_t i = 0; i < sizeof(topicCounts) / sizeof(topicCounts[0]); i++) {
+        if (!BenchmarkTopics(&config, topicCounts[i])) {
+            printf("Out of memory for %zu topics\n", topicCounts[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
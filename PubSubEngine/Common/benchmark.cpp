@@ -0,0 +1,130 @@
+#include "pch.h"
+#include "benchmark.h"
+#include <windows.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static volatile unsigned long long benchmarkSink;
+
+static int CompareDoubles(const void* a, const void* b) {
+    double left = *(const double*)a;
+    double right = *(const double*)b;
+    return (left > right) - (left < right);
+}
+
+// Nearest-rank percentile of sorted samples
+static double Percentile(const double* sorted, unsigned int count, double percentile) {
+    unsigned int rank = (unsigned int)ceil(percentile / 100.0 * count);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[(rank > count ? count : rank) - 1];
+}
+
+bool Benchmark_ParseArguments(BenchmarkConfig* config, int argc, char* argv[]) {
+    config->warmup = BENCHMARK_DEFAULT_WARMUP;
+    config->iterations = BENCHMARK_DEFAULT_ITERATIONS;
+    config->batch = BENCHMARK_DEFAULT_BATCH;
+    config->filter = NULL;
+    config->outputPath = NULL;
+
+    bool valid = (argc % 2) == 1; // Every option takes a value
+    for (int i = 1; valid && i + 1 < argc; i += 2) {
+        const char* option = argv[i];
+        const char* value = argv[i + 1];
+
+        if (strcmp(option, "--warmup") == 0) config->warmup = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--iterations") == 0) config->iterations = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--batch") == 0) config->batch = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(option, "--filter") == 0) config->filter = value;
+        else if (strcmp(option, "--output") == 0) config->outputPath = value;
+        else valid = false;
+    }
+
+    if (!valid || config->iterations == 0 || config->batch == 0) {
+        printf("Usage: %s [--warmup N] [--iterations N] [--batch N] [--filter TEXT] [--output FILE]\n"
+            "  warmup      untimed samples (default %d)\n"
+            "  iterations  timed samples (default %d)\n"
+            "  batch       operations per sample (default %d)\n"
+            "  filter      only run cases whose name contains TEXT\n"
+            "  output      append one JSON line per case to FILE\n",
+            argv[0], BENCHMARK_DEFAULT_WARMUP, BENCHMARK_DEFAULT_ITERATIONS, BENCHMARK_DEFAULT_BATCH);
+        return false;
+    }
+    return true;
+}
+
+bool Benchmark_Run(const BenchmarkConfig* config, const char* name, BenchmarkFunction function, void* context,
+    BenchmarkStats* stats) {
+    if (config->filter != NULL && strstr(name, config->filter) == NULL) {
+        return false;
+    }
+
+    double* samples = (double*)malloc(config->iterations * sizeof(double));
+    if (samples == NULL) {
+        printf("%-40s out of memory\n", name);
+        return false;
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    double nanosecondsPerTick = 1e9 / (double)frequency.QuadPart;
+
+    for (unsigned int i = 0; i < config->warmup; i++) {
+        function(context, config->batch);
+    }
+
+    for (unsigned int i = 0; i < config->iterations; i++) {
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        function(context, config->batch);
+        QueryPerformanceCounter(&end);
+        samples[i] = (double)(end.QuadPart - start.QuadPart) * nanosecondsPerTick / config->batch;
+    }
+
+    BenchmarkStats result;
+    double sum = 0.0;
+    for (unsigned int i = 0; i < config->iterations; i++) {
+        sum += samples[i];
+    }
+    result.mean = sum / config->iterations;
+
+    double squares = 0.0;
+    for (unsigned int i = 0; i < config->iterations; i++) {
+        squares += (samples[i] - result.mean) * (samples[i] - result.mean);
+    }
+    result.stddev = config->iterations > 1 ? sqrt(squares / (config->iterations - 1)) : 0.0;
+
+    qsort(samples, config->iterations, sizeof(double), CompareDoubles);
+    result.min = samples[0];
+    result.p50 = Percentile(samples, config->iterations, 50.0);
+    result.p90 = Percentile(samples, config->iterations, 90.0);
+    result.p99 = Percentile(samples, config->iterations, 99.0);
+    result.max = samples[config->iterations - 1];
+    free(samples);
+
+    printf("%-40s %12.1f ns/op +- %-10.1f min %10.1f | p50 %10.1f | p90 %10.1f | p99 %10.1f | max %10.1f\n",
+        name, result.mean, result.stddev, result.min, result.p50, result.p90, result.p99, result.max);
+
+    if (config->outputPath != NULL) {
+        FILE* output = fopen(config->outputPath, "a");
+        if (output != NULL) {
+            fprintf(output, "{\"name\":\"%s\",\"batch\":%u,\"iterations\":%u,\"meanNs\":%.3f,\"stddevNs\":%.3f,"
+                "\"minNs\":%.3f,\"p50Ns\":%.3f,\"p90Ns\":%.3f,\"p99Ns\":%.3f,\"maxNs\":%.3f}\n",
+                name, config->batch, config->iterations, result.mean, result.stddev,
+                result.min, result.p50, result.p90, result.p99, result.max);
+            fclose(output);
+        }
+    }
+
+    if (stats != NULL) {
+        *stats = result;
+    }
+    return true;
+}
+
+void Benchmark_Consume(unsigned long long value) {
+    benchmarkSink += value;
+}
@@ -0,0 +1,45 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Defaults for Benchmark_ParseArguments
+#define BENCHMARK_DEFAULT_WARMUP 20
+#define BENCHMARK_DEFAULT_ITERATIONS 200
+#define BENCHMARK_DEFAULT_BATCH 1000
+
+// How a microbenchmark executable runs its cases
+typedef struct {
+    unsigned int warmup;      // Untimed samples before measuring
+    unsigned int iterations;  // Timed samples
+    unsigned int batch;       // Operations per sample; a sample's time is divided by this
+    const char* filter;       // Only run cases whose name contains this (NULL for all)
+    const char* outputPath;   // Append one JSON line per case (NULL for none)
+} BenchmarkConfig;
+
+// Perform operations operations of the case being measured
+typedef void (*BenchmarkFunction)(void* context, unsigned int operations);
+
+// Results of one case in nanoseconds per operation
+typedef struct {
+    double mean;
+    double stddev;
+    double min;
+    double p50;
+    double p90;
+    double p99;
+    double max;
+} BenchmarkStats;
+
+// Read --warmup, --iterations, --batch, --filter and --output; prints usage and returns false on bad input
+bool Benchmark_ParseArguments(BenchmarkConfig* config, int argc, char* argv[]);
+
+// Time a case and print its statistics; returns false if the case was filtered out
+bool Benchmark_Run(const BenchmarkConfig* config, const char* name, BenchmarkFunction function, void* context,
+    BenchmarkStats* stats);
+
+// Keep a computed value alive so the compiler cannot drop the work that produced it
+void Benchmark_Consume(unsigned long long value);
+
+#endif // BENCHMARK_H
@@ -0,0 +1,371 @@
+#include "pch.h"
+#include "executor.h"
+#include "logging.h"
+#include <windows.h>
+#include <process.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void TaskDeque_Init(TaskDeque* deque) {
+    deque->tasks = NULL;
+    deque->capacity = 0;
+    deque->top = 0;
+    deque->count = 0;
+    InitializeCriticalSectionAndSpinCount(&deque->lock, EXECUTOR_LOCK_SPIN);
+}
+
+static void TaskDeque_Destroy(TaskDeque* deque) {
+    DeleteCriticalSection(&deque->lock);
+    free(deque->tasks);
+    deque->tasks = NULL;
+    deque->capacity = 0;
+    deque->count = 0;
+}
+
+// Append a task at the bottom, doubling the ring when it is full (caller holds the lock)
+static bool TaskDeque_PushBottom(TaskDeque* deque, const ExecutorTask* task) {
+    if (deque->count == deque->capacity) {
+        size_t capacity = deque->capacity > 0 ? deque->capacity * 2 : EXECUTOR_INITIAL_CAPACITY;
+        ExecutorTask* tasks = (ExecutorTask*)malloc(capacity * sizeof(ExecutorTask));
+        if (!tasks) {
+            return false;
+        }
+
+        // Unwrap the ring so the oldest task lands at index 0
+        for (size_t i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->top + i) & (deque->capacity - 1)];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = capacity;
+        deque->top = 0;
+    }
+
+    deque->tasks[(deque->top + deque->count) & (deque->capacity - 1)] = *task;
+    deque->count++;
+    return true;
+}
+
+// Take the newest task (caller holds the lock)
+static bool TaskDeque_PopBottom(TaskDeque* deque, ExecutorTask* task) {
+    if (deque->count == 0) {
+        return false;
+    }
+
+    deque->count--;
+    *task = deque->tasks[(deque->top + deque->count) & (deque->capacity - 1)];
+    return true;
+}
+
+// Take the oldest task (caller holds the lock)
+static bool TaskDeque_PopTop(TaskDeque* deque, ExecutorTask* task) {
+    if (deque->count == 0) {
+        return false;
+    }
+
+    *task = deque->tasks[deque->top];
+    deque->top = (deque->top + 1) & (deque->capacity - 1);
+    deque->count--;
+    return true;
+}
+
+static void RunTask(ExecutorWorker* worker, const ExecutorTask* task) {
+    InterlockedDecrement(&worker->executor->pending);
+    task->function(task->argument);
+    worker->executed++;  // Only the owning worker writes its counters
+}
+
+static bool PopOwn(ExecutorWorker* worker, ExecutorTask* task) {
+    if (worker->deque.count == 0) {
+        return false;
+    }
+
+    EnterCriticalSection(&worker->deque.lock);
+    bool found = TaskDeque_PopBottom(&worker->deque, task);
+    LeaveCriticalSection(&worker->deque.lock);
+    return found;
+}
+
+// Take up to half of another worker's deque, oldest first. The first task is returned
+// to run now and the rest move to this worker's deque, where they can be stolen in turn.
+static bool Steal(ExecutorWorker* worker, ExecutorTask* task) {
+    Executor* executor = worker->executor;
+
+    for (int i = 1; i < executor->workerCount; i++) {
+        ExecutorWorker* victim = &executor->workers[(worker->index + i) % executor->workerCount];
+        if (victim->deque.count == 0) {
+            continue;
+        }
+
+        ExecutorTask stolen[EXECUTOR_STEAL_BATCH];
+        size_t taken = 0;
+
+        EnterCriticalSection(&victim->deque.lock);
+        size_t wanted = (victim->deque.count + 1) / 2;
+        if (wanted > EXECUTOR_STEAL_BATCH) {
+            wanted = EXECUTOR_STEAL_BATCH;
+        }
+        while (taken < wanted && TaskDeque_PopTop(&victim->deque, &stolen[taken])) {
+            taken++;
+        }
+        LeaveCriticalSection(&victim->deque.lock);
+
+        if (taken == 0) {
+            continue;
+        }
+        worker->stolen += (LONG64)taken;
+
+        size_t kept = 1;
+        EnterCriticalSection(&worker->deque.lock);
+        while (kept < taken && TaskDeque_PushBottom(&worker->deque, &stolen[kept])) {
+            kept++;
+        }
+        LeaveCriticalSection(&worker->deque.lock);
+
+        // Only a failed deque allocation leaves tasks behind; run them rather than lose them
+        for (; kept < taken; kept++) {
+            RunTask(worker, &stolen[kept]);
+        }
+
+        *task = stolen[0];
+        return true;
+    }
+    return false;
+}
+
+static unsigned __stdcall WorkerThread(void* param) {
+    ExecutorWorker* worker = (ExecutorWorker*)param;
+    Executor* executor = worker->executor;
+    TlsSetValue(executor->workerSlot, worker);
+
+    for (;;) {
+        ExecutorTask task;
+        if (PopOwn(worker, &task) || Steal(worker, &task)) {
+            RunTask(worker, &task);
+            continue;
+        }
+
+        if (executor->stopping && executor->pending == 0) {
+            break;
+        }
+
+        // Announce the sleep before the last look: a submitter either sees this worker
+        // asleep and wakes it, or this worker sees the submitter's pending count
+        InterlockedIncrement(&executor->sleepers);
+        if (executor->pending == 0 && !executor->stopping) {
+            WaitForSingleObject(executor->wakeSemaphore, EXECUTOR_IDLE_WAIT);
+        }
+        InterlockedDecrement(&executor->sleepers);
+    }
+
+    return 0;
+}
+
+bool Executor_Init(Executor* executor, int workerCount, bool pinCores) {
+    if (!executor) {
+        return false;
+    }
+
+    ZeroMemory(executor, sizeof(*executor));
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int processors = (int)info.dwNumberOfProcessors;
+    if (workerCount <= 0) {
+        workerCount = processors;
+    }
+    if (workerCount > EXECUTOR_MAX_WORKERS) {
+        workerCount = EXECUTOR_MAX_WORKERS;
+    }
+
+    executor->workerSlot = TlsAlloc();
+    if (executor->workerSlot == TLS_OUT_OF_INDEXES) {
+        return false;
+    }
+
+    executor->wakeSemaphore = CreateSemaphore(NULL, 0, workerCount, NULL);
+    if (executor->wakeSemaphore == NULL) {
+        TlsFree(executor->workerSlot);
+        return false;
+    }
+
+    // Every deque exists before the first worker starts looking for work to steal
+    for (int i = 0; i < workerCount; i++) {
+        TaskDeque_Init(&executor->workers[i].deque);
+        executor->workers[i].executor = executor;
+        executor->workers[i].index = i;
+    }
+    executor->workerCount = workerCount;
+
+    for (int i = 0; i < workerCount; i++) {
+        unsigned threadId;
+        executor->workers[i].thread = (HANDLE)_beginthreadex(NULL, 0, WorkerThread, &executor->workers[i], 0, &threadId);
+        if (executor->workers[i].thread == NULL) {
+            Executor_Destroy(executor);
+            return false;
+        }
+
+        if (pinCores && processors > 0 && i < (int)(sizeof(DWORD_PTR) * 8)) {
+            DWORD_PTR mask = (DWORD_PTR)1 << (i % processors);
+            if (SetThreadAffinityMask(executor->workers[i].thread, mask) == 0) {
+                LogMessage(LOG_WARNING, "Failed to pin worker %d to processor %d: %lu", i, i % processors, GetLastError());
+            }
+        }
+    }
+
+    LogMessage(LOG_INFO, "Executor started with %d workers%s", workerCount, pinCores ? " pinned to processors" : "");
+    return true;
+}
+
+void Executor_Destroy(Executor* executor) {
+    if (!executor || executor->wakeSemaphore == NULL) {
+        return;
+    }
+
+    // Workers keep going until nothing is pending, so tasks queued by running tasks still run
+    InterlockedExchange(&executor->stopping, 1);
+    ReleaseSemaphore(executor->wakeSemaphore, executor->workerCount, NULL);
+
+    for (int i = 0; i < executor->workerCount; i++) {
+        if (executor->workers[i].thread != NULL) {
+            WaitForSingleObject(executor->workers[i].thread, INFINITE);
+            CloseHandle(executor->workers[i].thread);
+            executor->workers[i].thread = NULL;
+        }
+    }
+
+    for (int i = 0; i < executor->workerCount; i++) {
+        TaskDeque_Destroy(&executor->workers[i].deque);
+    }
+    executor->workerCount = 0;
+
+    TlsFree(executor->workerSlot);
+    CloseHandle(executor->wakeSemaphore);
+    executor->wakeSemaphore = NULL;
+}
+
+bool Executor_Submit(Executor* executor, ExecutorFunction function, void* argument) {
+    if (!executor || !function || executor->workerCount == 0) {
+        return false;
+    }
+
+    // Work queued by a task stays with its worker; everything else is spread round-robin
+    ExecutorWorker* worker = (ExecutorWorker*)TlsGetValue(executor->workerSlot);
+    if (!worker) {
+        unsigned long next = (unsigned long)InterlockedIncrement(&executor->nextWorker);
+        worker = &executor->workers[next % (unsigned long)executor->workerCount];
+    }
+
+    ExecutorTask task = { function, argument };
+    InterlockedIncrement(&executor->pending);
+
+    EnterCriticalSection(&worker->deque.lock);
+    bool pushed = TaskDeque_PushBottom(&worker->deque, &task);
+    LeaveCriticalSection(&worker->deque.lock);
+
+    if (!pushed) {
+        InterlockedDecrement(&executor->pending);
+        return false;
+    }
+
+    if (executor->sleepers > 0) {
+        ReleaseSemaphore(executor->wakeSemaphore, 1, NULL);
+    }
+    return true;
+}
+
+long Executor_Pending(const Executor* executor) {
+    return executor ? executor->pending + executor->backlog : 0;
+}
+
+void Executor_GetStats(const Executor* executor, ExecutorStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!executor) {
+        return;
+    }
+
+    stats->pending = Executor_Pending(executor);
+    for (int i = 0; i < executor->workerCount; i++) {
+        stats->executed += (unsigned long long)executor->workers[i].executed;
+        stats->stolen += (unsigned long long)executor->workers[i].stolen;
+    }
+}
+
+bool ExecutorStrand_Init(ExecutorStrand* strand, Executor* executor) {
+    if (!strand || !executor) {
+        return false;
+    }
+
+    strand->executor = executor;
+    strand->scheduled = false;
+    TaskDeque_Init(&strand->queue);
+    return true;
+}
+
+void ExecutorStrand_Destroy(ExecutorStrand* strand) {
+    if (!strand || !strand->executor) {
+        return;
+    }
+
+    TaskDeque_Destroy(&strand->queue);
+    strand->executor = NULL;
+}
+
+// Drain one batch from a strand, then hand the worker back if the strand is still busy
+static void RunStrand(void* argument) {
+    ExecutorStrand* strand = (ExecutorStrand*)argument;
+    Executor* executor = strand->executor;
+
+    for (;;) {
+        for (int i = 0; i < EXECUTOR_STRAND_BATCH; i++) {
+            ExecutorTask task;
+            EnterCriticalSection(&strand->queue.lock);
+            if (!TaskDeque_PopTop(&strand->queue, &task)) {
+                strand->scheduled = false;
+                LeaveCriticalSection(&strand->queue.lock);
+                return;
+            }
+            LeaveCriticalSection(&strand->queue.lock);
+
+            InterlockedDecrement(&executor->backlog);
+            task.function(task.argument);
+        }
+
+        EnterCriticalSection(&strand->queue.lock);
+        bool more = strand->queue.count > 0;
+        if (!more) {
+            strand->scheduled = false;
+        }
+        LeaveCriticalSection(&strand->queue.lock);
+
+        // Requeue behind other strands so one hot strand cannot hold a worker forever
+        if (!more || Executor_Submit(executor, RunStrand, strand)) {
+            return;
+        }
+    }
+}
+
+bool ExecutorStrand_Post(ExecutorStrand* strand, ExecutorFunction function, void* argument) {
+    if (!strand || !strand->executor || !function) {
+        return false;
+    }
+
+    ExecutorTask task = { function, argument };
+    InterlockedIncrement(&strand->executor->backlog);
+
+    EnterCriticalSection(&strand->queue.lock);
+    if (!TaskDeque_PushBottom(&strand->queue, &task)) {
+        LeaveCriticalSection(&strand->queue.lock);
+        InterlockedDecrement(&strand->executor->backlog);
+        return false;
+    }
+    bool schedule = !strand->scheduled;
+    strand->scheduled = true;
+    LeaveCriticalSection(&strand->queue.lock);
+
+    // Without room on the workers the strand drains here rather than leave its tasks stuck
+    if (schedule && !Executor_Submit(strand->executor, RunStrand, strand)) {
+        RunStrand(strand);
+    }
+    return true;
+}
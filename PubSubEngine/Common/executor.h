@@ -0,0 +1,101 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Upper bound on worker threads; 0 passed to Executor_Init means one per processor
+#define EXECUTOR_MAX_WORKERS 64
+
+#define EXECUTOR_INITIAL_CAPACITY 256  // Tasks a deque holds before it grows
+#define EXECUTOR_STEAL_BATCH 32        // Most tasks a thief moves in one steal
+#define EXECUTOR_STRAND_BATCH 64       // Tasks a strand runs before giving its worker back
+#define EXECUTOR_IDLE_WAIT 100         // ms an idle worker sleeps before looking for work again
+#define EXECUTOR_LOCK_SPIN 4000        // Spins on a contended deque before blocking
+
+typedef void (*ExecutorFunction)(void* argument);
+
+typedef struct {
+    ExecutorFunction function;
+    void* argument;  // Owned by the task; the function frees it if needed
+} ExecutorTask;
+
+// Growable ring of tasks. A worker pushes and pops its own deque at the bottom, so it
+// keeps running what it queued last while that is still in cache; thieves take the
+// oldest half from the top.
+typedef struct {
+    ExecutorTask* tasks;
+    size_t capacity;       // Power of two
+    size_t top;            // Index of the oldest task
+    size_t count;
+    CRITICAL_SECTION lock;
+} TaskDeque;
+
+typedef struct Executor Executor;
+
+typedef struct {
+    TaskDeque deque;
+    Executor* executor;
+    int index;
+    HANDLE thread;
+    volatile LONG64 executed;  // Tasks run by this worker
+    volatile LONG64 stolen;    // Tasks taken from other workers' deques
+} ExecutorWorker;
+
+// A fixed pool of workers with one deque each. Submissions from a worker stay on its
+// own deque; submissions from other threads are spread round-robin, and idle workers
+// steal, so a burst on one producer still reaches every core.
+struct Executor {
+    ExecutorWorker workers[EXECUTOR_MAX_WORKERS];
+    int workerCount;
+    DWORD workerSlot;          // Thread-local slot holding the calling worker, if any
+    HANDLE wakeSemaphore;      // Released once per task while workers sleep
+    volatile LONG nextWorker;  // Round-robin cursor for outside submissions
+    volatile LONG sleepers;    // Workers waiting on wakeSemaphore
+    volatile LONG pending;     // Tasks queued on worker deques and not yet started
+    volatile LONG backlog;     // Tasks waiting in strand queues
+    volatile LONG stopping;
+};
+
+// Tasks posted to one strand run one at a time in posting order, on whichever worker
+// is free; unrelated strands run in parallel. A strand drains up to
+// EXECUTOR_STRAND_BATCH tasks each time it is scheduled.
+typedef struct {
+    Executor* executor;
+    TaskDeque queue;
+    bool scheduled;  // Queued on or running on a worker (guarded by queue.lock)
+} ExecutorStrand;
+
+// Snapshot of an executor's counters
+typedef struct {
+    long pending;
+    unsigned long long executed;
+    unsigned long long stolen;
+} ExecutorStats;
+
+// Start workerCount workers (0 = one per processor), optionally pinning worker i to processor i
+bool Executor_Init(Executor* executor, int workerCount, bool pinCores);
+
+// Run every queued task, including ones queued while draining, then stop the workers
+void Executor_Destroy(Executor* executor);
+
+// Queue a task; returns false if it could not be queued, in which case the caller still owns argument
+bool Executor_Submit(Executor* executor, ExecutorFunction function, void* argument);
+
+// Get the number of tasks queued and not yet started, strand queues included
+long Executor_Pending(const Executor* executor);
+
+// Read the executor's counters
+void Executor_GetStats(const Executor* executor, ExecutorStats* stats);
+
+// Bind a strand to an executor
+bool ExecutorStrand_Init(ExecutorStrand* strand, Executor* executor);
+
+// Free a strand; the executor must have drained it already
+void ExecutorStrand_Destroy(ExecutorStrand* strand);
+
+// Queue a task behind everything posted to the strand before it
+bool ExecutorStrand_Post(ExecutorStrand* strand, ExecutorFunction function, void* argument);
+
+#endif // EXECUTOR_H
@@ -0,0 +1,460 @@
+#include "pch.h"
+#include "frame.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_STACK_BUFFER 1024
+#define FRAME_SEND_WAIT_MS 1000
+
+static void WriteUInt16(char* out, size_t value) {
+    out[0] = (char)((value >> 8) & 0xFF);
+    out[1] = (char)(value & 0xFF);
+}
+
+static void WriteUInt32(char* out, size_t value) {
+    out[0] = (char)((value >> 24) & 0xFF);
+    out[1] = (char)((value >> 16) & 0xFF);
+    out[2] = (char)((value >> 8) & 0xFF);
+    out[3] = (char)(value & 0xFF);
+}
+
+static size_t ReadUInt16(const char* in) {
+    const unsigned char* bytes = (const unsigned char*)in;
+    return ((size_t)bytes[0] << 8) | bytes[1];
+}
+
+static size_t ReadUInt32(const char* in) {
+    const unsigned char* bytes = (const unsigned char*)in;
+    return ((size_t)bytes[0] << 24) | ((size_t)bytes[1] << 16) | ((size_t)bytes[2] << 8) | bytes[3];
+}
+
+size_t Frame_EncodedSize(size_t topicLength, size_t payloadLength) {
+    return FRAME_HEADER_SIZE + topicLength + 1 + payloadLength + 1;
+}
+
+size_t Frame_Encode(char* buffer, size_t bufferSize, FrameType type, unsigned char flags,
+    const char* topic, size_t topicLength, const char* payload, size_t payloadLength) {
+    return Frame_EncodeTraced(buffer, bufferSize, type, flags, NULL, topic, topicLength, payload, payloadLength);
+}
+
+size_t Frame_EncodeTraced(char* buffer, size_t bufferSize, FrameType type, unsigned char flags,
+    const TraceHeader* trace, const char* topic, size_t topicLength, const char* payload, size_t payloadLength) {
+    if (!buffer || topicLength > FRAME_MAX_TOPIC || payloadLength > FRAME_MAX_PAYLOAD) {
+        return 0;
+    }
+
+    size_t traceLength = trace ? Trace_EncodedSize(trace) : 0;
+    size_t total = Frame_EncodedSize(topicLength, payloadLength) + traceLength;
+    if (total > bufferSize) {
+        return 0;
+    }
+
+    buffer[0] = (char)type;
+    buffer[1] = (char)(trace ? (flags | FRAME_FLAG_TRACE) : (flags & ~FRAME_FLAG_TRACE));
+    WriteUInt16(buffer + 2, topicLength);
+    WriteUInt32(buffer + 4, payloadLength);
+
+    char* cursor = buffer + FRAME_HEADER_SIZE;
+    if (trace) {
+        if (Trace_Encode(cursor, traceLength, trace) == 0) {
+            return 0;
+        }
+        cursor += traceLength;
+    }
+
+    if (topicLength > 0) {
+        memcpy(cursor, topic, topicLength);
+    }
+    cursor[topicLength] = '\0';
+    cursor += topicLength + 1;
+
+    if (payloadLength > 0) {
+        memcpy(cursor, payload, payloadLength);
+    }
+    cursor[payloadLength] = '\0';
+
+    return total;
+}
+
+// Block until a non-blocking socket can take more data
+static bool WaitWritable(SOCKET sock) {
+    fd_set writeSet;
+    FD_ZERO(&writeSet);
+    FD_SET(sock, &writeSet);
+
+    struct timeval timeout;
+    timeout.tv_sec = FRAME_SEND_WAIT_MS / 1000;
+    timeout.tv_usec = (FRAME_SEND_WAIT_MS % 1000) * 1000;
+
+    return select(0, NULL, &writeSet, NULL, &timeout) > 0;
+}
+
+// Wait up to timeoutMs for a socket to have data or a pending close; false on timeout
+static bool WaitReadable(SOCKET sock, DWORD timeoutMs) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(sock, &readSet);
+
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+    // An error is reported by the receive that follows
+    return select(0, &readSet, NULL, NULL, &timeout) != 0;
+}
+
+// Fail a send; once part of the data went out the peer would read whatever follows from the middle
+// of a frame, so shut the socket down and let its owner find out on the next receive or send
+static bool FailSend(SOCKET sock, bool partial) {
+    if (partial) {
+        shutdown(sock, SD_BOTH);
+    }
+    return false;
+}
+
+bool Frame_SendAll(SOCKET sock, const char* data, size_t length) {
+    const char* start = data;
+    while (length > 0) {
+        int sent = send(sock, data, (int)length, 0);
+        if (sent == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK) {
+            // Reactor sockets are non-blocking; keep the blocking contract for callers
+            if (!WaitWritable(sock)) {
+                return FailSend(sock, data != start);
+            }
+            continue;
+        }
+        if (sent == SOCKET_ERROR || sent == 0) {
+            return FailSend(sock, data != start);
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+bool Frame_SendBuffers(SOCKET sock, WSABUF* buffers, DWORD count) {
+    bool partial = false;
+    while (count > 0) {
+        DWORD sent = 0;
+        if (WSASend(sock, buffers, count, &sent, 0, NULL, NULL) == SOCKET_ERROR) {
+            if (WSAGetLastError() == WSAEWOULDBLOCK && WaitWritable(sock)) {
+                continue;
+            }
+            return FailSend(sock, partial);
+        }
+        if (sent == 0) {
+            return FailSend(sock, partial);
+        }
+        partial = true;
+
+        while (count > 0 && sent >= buffers->len) {
+            sent -= buffers->len;
+            buffers++;
+            count--;
+        }
+        if (count > 0) {
+            buffers->buf += sent;
+            buffers->len -= sent;
+        }
+    }
+    return true;
+}
+
+bool Frame_Send(SOCKET sock, FrameType type, const char* topic, const char* payload) {
+    return Frame_SendTraced(sock, type, NULL, topic, payload);
+}
+
+bool Frame_SendTraced(SOCKET sock, FrameType type, const TraceHeader* trace, const char* topic, const char* payload) {
+    size_t topicLength = topic ? strlen(topic) : 0;
+    size_t payloadLength = payload ? strlen(payload) : 0;
+    size_t total = Frame_EncodedSize(topicLength, payloadLength) + (trace ? Trace_EncodedSize(trace) : 0);
+
+    // Small frames (the common case) are encoded on the stack
+    char stackBuffer[FRAME_STACK_BUFFER];
+    char* buffer = total <= sizeof(stackBuffer) ? stackBuffer : (char*)malloc(total);
+    if (!buffer) {
+        return false;
+    }
+
+    bool success = Frame_EncodeTraced(buffer, total, type, 0, trace, topic, topicLength, payload, payloadLength) > 0 &&
+        Frame_SendAll(sock, buffer, total);
+
+    if (buffer != stackBuffer) {
+        free(buffer);
+    }
+    return success;
+}
+
+bool FrameDecoder_Init(FrameDecoder* decoder, size_t initialCapacity) {
+    if (!decoder) {
+        return false;
+    }
+
+    if (initialCapacity < FRAME_HEADER_SIZE + 2) {
+        initialCapacity = FRAME_DECODER_INITIAL_CAPACITY;
+    }
+
+    decoder->buffer = (char*)malloc(initialCapacity);
+    decoder->capacity = decoder->buffer ? initialCapacity : 0;
+    decoder->start = 0;
+    decoder->end = 0;
+    decoder->required = 0;
+    return decoder->buffer != NULL;
+}
+
+void FrameDecoder_Destroy(FrameDecoder* decoder) {
+    if (!decoder) {
+        return;
+    }
+
+    free(decoder->buffer);
+    decoder->buffer = NULL;
+    decoder->capacity = 0;
+    decoder->start = 0;
+    decoder->end = 0;
+    decoder->required = 0;
+}
+
+char* FrameDecoder_WritePtr(FrameDecoder* decoder, size_t* available) {
+    *available = 0;
+    if (!decoder || !decoder->buffer) {
+        return NULL;
+    }
+
+    // Move unconsumed bytes to the front so the buffer never creeps forward
+    if (decoder->start > 0) {
+        size_t pending = decoder->end - decoder->start;
+        if (pending > 0) {
+            memmove(decoder->buffer, decoder->buffer + decoder->start, pending);
+        }
+        decoder->start = 0;
+        decoder->end = pending;
+    }
+
+    // Grow when a declared frame does not fit, or when the buffer is simply full
+    size_t needed = decoder->required > decoder->end ? decoder->required : decoder->end + 1;
+    if (needed > decoder->capacity) {
+        size_t newCapacity = decoder->capacity * 2;
+        while (newCapacity < needed) {
+            newCapacity *= 2;
+        }
+        if (newCapacity > FRAME_MAX_SIZE) {
+            newCapacity = FRAME_MAX_SIZE;
+        }
+        if (newCapacity < needed) {
+            return NULL;
+        }
+
+        char* grown = (char*)realloc(decoder->buffer, newCapacity);
+        if (!grown) {
+            return NULL;
+        }
+        decoder->buffer = grown;
+        decoder->capacity = newCapacity;
+    }
+
+    *available = decoder->capacity - decoder->end;
+    return decoder->buffer + decoder->end;
+}
+
+void FrameDecoder_Commit(FrameDecoder* decoder, size_t length) {
+    decoder->end += length;
+}
+
+int FrameDecoder_Receive(FrameDecoder* decoder, SOCKET sock) {
+    size_t available;
+    char* target = FrameDecoder_WritePtr(decoder, &available);
+    if (!target) {
+        WSASetLastError(WSAENOBUFS);
+        return -1;
+    }
+
+    int bytesReceived = recv(sock, target, (int)available, 0);
+    if (bytesReceived > 0) {
+        FrameDecoder_Commit(decoder, (size_t)bytesReceived);
+    }
+    return bytesReceived == SOCKET_ERROR ? -1 : bytesReceived;
+}
+
+// Decode the frame at the start of data
+// Returns 1 with *total set to its size, 0 with *total set to the bytes needed so far, -1 on a protocol error
+static int ParseFrame(const char* data, size_t pending, Frame* frame, size_t* total) {
+    if (pending < FRAME_HEADER_SIZE) {
+        *total = FRAME_HEADER_SIZE;
+        return 0;
+    }
+
+    unsigned char type = (unsigned char)data[0];
+    unsigned char flags = (unsigned char)data[1];
+    size_t topicLength = ReadUInt16(data + 2);
+    size_t payloadLength = ReadUInt32(data + 4);
+
+    if (type < FRAME_TYPE_MIN || type > FRAME_TYPE_MAX ||
+        topicLength > FRAME_MAX_TOPIC || payloadLength > FRAME_MAX_PAYLOAD) {
+        return -1;
+    }
+
+    // The trace block's size comes from its hop count, so a traced frame is sized in two steps
+    size_t traceLength = 0;
+    if (flags & FRAME_FLAG_TRACE) {
+        if (pending < FRAME_HEADER_SIZE + TRACE_WIRE_HEADER) {
+            *total = FRAME_HEADER_SIZE + TRACE_WIRE_HEADER;
+            return 0;
+        }
+        size_t hopCount = (unsigned char)data[FRAME_HEADER_SIZE + TRACE_WIRE_HEADER - 1];
+        if (hopCount > TRACE_MAX_HOPS) {
+            return -1;
+        }
+        traceLength = TRACE_WIRE_HEADER + hopCount * TRACE_WIRE_HOP;
+    }
+
+    *total = Frame_EncodedSize(topicLength, payloadLength) + traceLength;
+    if (pending < *total) {
+        return 0;
+    }
+
+    const char* topic = data + FRAME_HEADER_SIZE + traceLength;
+    const char* payload = topic + topicLength + 1;
+    if (topic[topicLength] != '\0' || payload[payloadLength] != '\0') {
+        return -1;
+    }
+
+    frame->type = (FrameType)type;
+    frame->flags = flags;
+    frame->trace = traceLength > 0 ? data + FRAME_HEADER_SIZE : NULL;
+    frame->traceLength = traceLength;
+    frame->topic = topic;
+    frame->topicLength = topicLength;
+    frame->payload = payload;
+    frame->payloadLength = payloadLength;
+    return 1;
+}
+
+bool Frame_Parse(const char* data, size_t length, Frame* frame) {
+    size_t total;
+    return data && ParseFrame(data, length, frame, &total) == 1 && total == length;
+}
+
+size_t Frame_BatchRecordSize(size_t topicLength, size_t payloadLength) {
+    return FRAME_BATCH_RECORD_HEADER + topicLength + 1 + payloadLength + 1;
+}
+
+size_t Frame_AppendBatchRecord(char* buffer, size_t bufferSize, const char* topic, size_t topicLength,
+    const char* payload, size_t payloadLength) {
+    size_t total = Frame_BatchRecordSize(topicLength, payloadLength);
+    if (!buffer || topicLength == 0 || topicLength > FRAME_MAX_TOPIC || total > bufferSize) {
+        return 0;
+    }
+
+    WriteUInt16(buffer, topicLength);
+    WriteUInt32(buffer + 2, payloadLength);
+    char* cursor = buffer + FRAME_BATCH_RECORD_HEADER;
+    memcpy(cursor, topic, topicLength);
+    cursor[topicLength] = '\0';
+    cursor += topicLength + 1;
+    if (payloadLength > 0) {
+        memcpy(cursor, payload, payloadLength);
+    }
+    cursor[payloadLength] = '\0';
+    return total;
+}
+
+int Frame_NextBatchRecord(const Frame* batch, size_t* offset, Frame* message) {
+    size_t remaining = batch->payloadLength - *offset;
+    if (remaining == 0) {
+        return 0;
+    }
+    if (remaining < FRAME_BATCH_RECORD_HEADER) {
+        return -1;
+    }
+
+    const char* record = batch->payload + *offset;
+    size_t topicLength = ReadUInt16(record);
+    size_t payloadLength = ReadUInt32(record + 2);
+    if (topicLength == 0 || topicLength > FRAME_MAX_TOPIC || payloadLength > remaining ||
+        Frame_BatchRecordSize(topicLength, payloadLength) > remaining) {
+        return -1;
+    }
+
+    const char* topic = record + FRAME_BATCH_RECORD_HEADER;
+    const char* payload = topic + topicLength + 1;
+    if (topic[topicLength] != '\0' || payload[payloadLength] != '\0') {
+        return -1;
+    }
+
+    message->type = FRAME_PUBLISH;
+    message->flags = batch->flags;
+    message->trace = batch->trace;
+    message->traceLength = batch->traceLength;
+    message->topic = topic;
+    message->topicLength = topicLength;
+    message->payload = payload;
+    message->payloadLength = payloadLength;
+    *offset += Frame_BatchRecordSize(topicLength, payloadLength);
+    return 1;
+}
+
+int FrameDecoder_Next(FrameDecoder* decoder, Frame* frame) {
+    size_t total;
+    int result = ParseFrame(decoder->buffer + decoder->start, decoder->end - decoder->start, frame, &total);
+    if (result == 1) {
+        decoder->start += total;
+        decoder->required = 0;
+    }
+    else if (result == 0) {
+        decoder->required = total;
+    }
+    return result;
+}
+
+bool FrameStream_Init(FrameStream* stream, SOCKET sock) {
+    if (!stream) {
+        return false;
+    }
+
+    stream->socket = sock;
+    return FrameDecoder_Init(&stream->decoder, FRAME_DECODER_INITIAL_CAPACITY);
+}
+
+void FrameStream_Destroy(FrameStream* stream) {
+    if (!stream) {
+        return;
+    }
+
+    FrameDecoder_Destroy(&stream->decoder);
+    stream->socket = INVALID_SOCKET;
+}
+
+int FrameStream_Read(FrameStream* stream, Frame* frame) {
+    while (true) {
+        int result = FrameDecoder_Next(&stream->decoder, frame);
+        if (result != 0) {
+            return result;
+        }
+
+        int bytesReceived = FrameDecoder_Receive(&stream->decoder, stream->socket);
+        if (bytesReceived <= 0) {
+            return bytesReceived;
+        }
+    }
+}
+
+int FrameStream_ReadTimeout(FrameStream* stream, Frame* frame, DWORD timeoutMs) {
+    ULONGLONG deadline = GetTickCount64() + timeoutMs;
+    while (true) {
+        int result = FrameDecoder_Next(&stream->decoder, frame);
+        if (result != 0) {
+            return result;
+        }
+
+        ULONGLONG now = GetTickCount64();
+        if (!WaitReadable(stream->socket, now < deadline ? (DWORD)(deadline - now) : 0)) {
+            return FRAME_STREAM_TIMEOUT;
+        }
+
+        int bytesReceived = FrameDecoder_Receive(&stream->decoder, stream->socket);
+        if (bytesReceived <= 0) {
+            return bytesReceived;
+        }
+    }
+}
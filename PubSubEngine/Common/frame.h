@@ -0,0 +1,162 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <WinSock2.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "trace.h"
+
+// Wire layout of a frame (all integers in network byte order):
+//   [type:1][flags:1][topicLength:2][payloadLength:4][trace][topic][\0][payload][\0]
+// The terminators are not counted in the lengths; they let receivers use the
+// topic and payload as C strings straight out of the read buffer.
+// The trace block (see trace.h) is only present when flags has FRAME_FLAG_TRACE set.
+#define FRAME_HEADER_SIZE 8
+#define FRAME_MAX_TOPIC 1024
+#define FRAME_MAX_PAYLOAD (64 * 1024)
+#define FRAME_MAX_SIZE (FRAME_HEADER_SIZE + TRACE_MAX_WIRE_SIZE + FRAME_MAX_TOPIC + FRAME_MAX_PAYLOAD + 2)
+
+// Flag bit marking a frame that carries a trace block
+#define FRAME_FLAG_TRACE 0x80
+
+// Initial read buffer size for a decoder; it grows on demand up to FRAME_MAX_SIZE
+#define FRAME_DECODER_INITIAL_CAPACITY 4096
+
+// Kinds of frames exchanged between clients and services
+typedef enum {
+    FRAME_AUTH = 1,      // topic: auth key, payload: username / service name
+    FRAME_RESPONSE = 2,  // payload: human readable status text
+    FRAME_PUBLISH = 3,   // topic + payload published by a client or forwarded by the PES
+    FRAME_SUBSCRIBE = 4, // topic a subscriber wants to receive
+    FRAME_MESSAGE = 5,   // topic + payload delivered to a subscriber
+    FRAME_INTEREST = 6,  // payload: interest line between the SE and the PES
+    FRAME_ACK = 7,       // payload: publish frames received by the Storage Service that are committed or refused, flags: durability mode
+    FRAME_CREDIT = 8,    // payload: further messages the PES lets a publisher send
+    FRAME_CONFIRM = 9,   // payload: publish sequence settled through, flags: CONFIRM_* outcome since the last confirm
+    FRAME_PUBLISH_BATCH = 10, // payload: batch records, each published as if sent in its own FRAME_PUBLISH
+    FRAME_NACK = 11      // payload: position of a publish frame the Storage Service did not store
+} FrameType;
+
+#define FRAME_TYPE_MIN FRAME_AUTH
+#define FRAME_TYPE_MAX FRAME_NACK
+
+// Layout of one message inside a FRAME_PUBLISH_BATCH payload, repeated back to back:
+//   [topicLength:2][payloadLength:4][topic][\0][payload][\0]
+// A trace block on the batch frame applies to every message in it.
+#define FRAME_BATCH_RECORD_HEADER 6
+
+// Outcomes carried in a FRAME_CONFIRM. A publisher's messages are numbered from 1 in the order
+// sent on the connection; each confirm covers every message after the previous one.
+#define CONFIRM_STORED 1    // Committed by the Storage Service under its durability mode
+#define CONFIRM_UNSTORED 2  // Routed to live subscribers but not known to be stored
+#define CONFIRM_REJECTED 3  // Dropped by the PES (reserved topic or out of memory)
+
+// Returned by FrameStream_ReadTimeout when no frame arrived in time
+#define FRAME_STREAM_TIMEOUT -2
+
+// Structure to represent a decoded frame
+// topic and payload point into the decoder buffer and stay valid until the next read
+typedef struct {
+    FrameType type;
+    unsigned char flags;
+    const char* trace;        // Encoded trace block, NULL when the frame is not traced
+    size_t traceLength;
+    const char* topic;
+    size_t topicLength;
+    const char* payload;
+    size_t payloadLength;
+} Frame;
+
+// Incremental decoder that extracts any number of frames from one read buffer
+typedef struct {
+    char* buffer;
+    size_t capacity;
+    size_t start;     // First byte not yet consumed
+    size_t end;       // One past the last byte received
+    size_t required;  // Size of the frame currently waiting for more bytes
+} FrameDecoder;
+
+// A socket paired with its decoder
+typedef struct {
+    SOCKET socket;
+    FrameDecoder decoder;
+} FrameStream;
+
+// Get the number of bytes a frame occupies on the wire
+size_t Frame_EncodedSize(size_t topicLength, size_t payloadLength);
+
+// Encode a frame into buffer; returns the encoded size or 0 if it does not fit
+size_t Frame_Encode(char* buffer, size_t bufferSize, FrameType type, unsigned char flags,
+    const char* topic, size_t topicLength, const char* payload, size_t payloadLength);
+
+// Encode a frame carrying a trace block (NULL trace encodes a plain frame)
+size_t Frame_EncodeTraced(char* buffer, size_t bufferSize, FrameType type, unsigned char flags,
+    const TraceHeader* trace, const char* topic, size_t topicLength, const char* payload, size_t payloadLength);
+
+// Decode one complete encoded frame, e.g. a frame waiting in a send queue
+bool Frame_Parse(const char* data, size_t length, Frame* frame);
+
+// Get the number of bytes one message occupies in a batch payload
+size_t Frame_BatchRecordSize(size_t topicLength, size_t payloadLength);
+
+// Append one message to a batch payload being built in buffer; returns the bytes added or 0 if it does not fit
+size_t Frame_AppendBatchRecord(char* buffer, size_t bufferSize, const char* topic, size_t topicLength,
+    const char* payload, size_t payloadLength);
+
+// Extract the message at *offset (start at 0) of a FRAME_PUBLISH_BATCH as a FRAME_PUBLISH carrying
+// the batch's trace. Returns 1 and advances *offset, 0 after the last message, -1 if the batch is malformed.
+int Frame_NextBatchRecord(const Frame* batch, size_t* offset, Frame* message);
+
+// Send an entire buffer, retrying on partial sends
+// Non-blocking sockets wait for writability instead of failing with WSAEWOULDBLOCK. If the send
+// fails or times out after part of the buffer went out, the socket is shut down: nothing may follow.
+bool Frame_SendAll(SOCKET sock, const char* data, size_t length);
+
+// Send several non-empty buffers with one gathering write per attempt, retrying on partial sends.
+// buffers is consumed: entries that went out are skipped and a partly sent one is advanced.
+// Like Frame_SendAll, a failure after some data went out shuts the socket down.
+bool Frame_SendBuffers(SOCKET sock, WSABUF* buffers, DWORD count);
+
+// Encode and send a frame; topic and payload may be NULL for empty fields
+bool Frame_Send(SOCKET sock, FrameType type, const char* topic, const char* payload);
+
+// Encode and send a frame carrying a trace block (NULL trace sends a plain frame)
+bool Frame_SendTraced(SOCKET sock, FrameType type, const TraceHeader* trace, const char* topic, const char* payload);
+
+// Initialize a decoder with the given starting capacity
+bool FrameDecoder_Init(FrameDecoder* decoder, size_t initialCapacity);
+
+// Free the decoder buffer
+void FrameDecoder_Destroy(FrameDecoder* decoder);
+
+// Get space to read into; invalidates frames returned earlier
+// Returns NULL if the buffer cannot grow any further
+char* FrameDecoder_WritePtr(FrameDecoder* decoder, size_t* available);
+
+// Mark bytes written through FrameDecoder_WritePtr as received
+void FrameDecoder_Commit(FrameDecoder* decoder, size_t length);
+
+// Receive whatever the socket has into the decoder
+// Returns the number of bytes received, 0 when the peer closed the connection, or -1 on
+// error (WSAGetLastError() is WSAEWOULDBLOCK once a non-blocking socket is drained)
+int FrameDecoder_Receive(FrameDecoder* decoder, SOCKET sock);
+
+// Extract the next complete frame
+// Returns 1 when a frame was produced, 0 when more bytes are needed, -1 on a protocol error
+int FrameDecoder_Next(FrameDecoder* decoder, Frame* frame);
+
+// Initialize a stream around a connected socket (the stream does not own the socket)
+bool FrameStream_Init(FrameStream* stream, SOCKET sock);
+
+// Free the stream's decoder
+void FrameStream_Destroy(FrameStream* stream);
+
+// Block until the next frame is available
+// Returns 1 when a frame was produced, 0 when the peer closed the connection, -1 on error
+int FrameStream_Read(FrameStream* stream, Frame* frame);
+
+// Wait up to timeoutMs for the next frame (0 only takes what has already arrived)
+// Returns as FrameStream_Read, or FRAME_STREAM_TIMEOUT if no complete frame arrived in time
+int FrameStream_ReadTimeout(FrameStream* stream, Frame* frame, DWORD timeoutMs);
+
+#endif // FRAME_H
@@ -0,0 +1,98 @@
+#include "pch.h"
+#include "histogram.h"
+#include <string.h>
+
+// Position of the highest set bit of a non-zero value
+static int HighestBit(unsigned long long value) {
+    int bit = 0;
+    if (value >> 32) { value >>= 32; bit += 32; }
+    if (value >> 16) { value >>= 16; bit += 16; }
+    if (value >> 8)  { value >>= 8;  bit += 8; }
+    if (value >> 4)  { value >>= 4;  bit += 4; }
+    if (value >> 2)  { value >>= 2;  bit += 2; }
+    if (value >> 1)  { bit += 1; }
+    return bit;
+}
+
+size_t Histogram_BucketIndex(unsigned long long value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+
+    // The top HISTOGRAM_SUB_BUCKET_BITS + 1 bits select the bucket; the rest are dropped
+    int shift = HighestBit(value) - HISTOGRAM_SUB_BUCKET_BITS;
+    return (size_t)(shift + 1) * HISTOGRAM_SUB_BUCKETS + (size_t)((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+}
+
+unsigned long long Histogram_BucketUpperBound(size_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    int shift = (int)(index / HISTOGRAM_SUB_BUCKETS) - 1;
+    unsigned long long lower = (unsigned long long)(HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+void Histogram_Reset(Histogram* histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+void Histogram_Record(Histogram* histogram, unsigned long long value) {
+    histogram->counts[Histogram_BucketIndex(value)]++;
+    if (histogram->count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->count++;
+    histogram->sum += value;
+}
+
+void Histogram_Merge(Histogram* target, const Histogram* source) {
+    if (source->count == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        target->counts[i] += source->counts[i];
+    }
+    if (target->count == 0 || source->min < target->min) {
+        target->min = source->min;
+    }
+    if (source->max > target->max) {
+        target->max = source->max;
+    }
+    target->count += source->count;
+    target->sum += source->sum;
+}
+
+unsigned long long Histogram_Percentile(const Histogram* histogram, double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    // Rank of the value asked for, counting from 1
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * (double)histogram->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > histogram->count) {
+        rank = histogram->count;
+    }
+
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            unsigned long long bound = Histogram_BucketUpperBound(i);
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+double Histogram_Mean(const Histogram* histogram) {
+    return histogram->count ? (double)histogram->sum / (double)histogram->count : 0.0;
+}
@@ -0,0 +1,42 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Log-linear buckets: values below HISTOGRAM_SUB_BUCKETS are exact, larger values share a bucket with
+// others within 1 / HISTOGRAM_SUB_BUCKETS (~3%) of them. Covers the full unsigned 64-bit range.
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+// Fixed-size value distribution (latencies, sizes). Not synchronized; give each thread its own
+// histogram and merge them when reporting.
+typedef struct {
+    unsigned long long counts[HISTOGRAM_BUCKETS];
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long min;
+    unsigned long long max;
+} Histogram;
+
+// Clear all recorded values
+void Histogram_Reset(Histogram* histogram);
+
+// Record one value
+void Histogram_Record(Histogram* histogram, unsigned long long value);
+
+// Add every value recorded in source to target
+void Histogram_Merge(Histogram* target, const Histogram* source);
+
+// Get the smallest bucketed value at or below which percentile (0-100) percent of the values fall
+unsigned long long Histogram_Percentile(const Histogram* histogram, double percentile);
+
+// Get the mean of the recorded values (0 when empty)
+double Histogram_Mean(const Histogram* histogram);
+
+// Get the bucket a value falls into and the largest value sharing that bucket
+size_t Histogram_BucketIndex(unsigned long long value);
+unsigned long long Histogram_BucketUpperBound(size_t index);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,69 @@
+#include "pch.h"
+#include "interest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+size_t Interest_FormatDelta(char* buffer, size_t bufferSize, const InterestDelta* delta) {
+    if (!buffer || !delta || bufferSize == 0) {
+        return 0;
+    }
+
+    int written = snprintf(buffer, bufferSize, "%s|%lu|%c|%s",
+        INTEREST_TOPIC, delta->version, (char)delta->op, delta->topic);
+    if (written < 0 || (size_t)written >= bufferSize) {
+        return 0;
+    }
+    return (size_t)written;
+}
+
+bool Interest_ParseDelta(const char* line, InterestDelta* delta) {
+    if (!line || !delta) {
+        return false;
+    }
+
+    size_t prefixLength = strlen(INTEREST_TOPIC);
+    if (strncmp(line, INTEREST_TOPIC, prefixLength) != 0 || line[prefixLength] != '|') {
+        return false;
+    }
+
+    const char* cursor = line + prefixLength + 1;
+    char* end = NULL;
+    delta->version = strtoul(cursor, &end, 10);
+    if (end == cursor || *end != '|') {
+        return false;
+    }
+
+    cursor = end + 1;
+    switch (*cursor) {
+    case INTEREST_RESET:
+    case INTEREST_SNAPSHOT:
+    case INTEREST_ADD:
+    case INTEREST_REMOVE:
+    case INTEREST_SYNC:
+        delta->op = (InterestOp)*cursor;
+        break;
+    default:
+        return false;
+    }
+
+    if (cursor[1] != '|') {
+        return false;
+    }
+
+    const char* topic = cursor + 2;
+    if (strlen(topic) >= MAX_TOPIC_LENGTH) {
+        return false;
+    }
+    strcpy(delta->topic, topic);
+
+    if ((delta->op == INTEREST_ADD || delta->op == INTEREST_REMOVE || delta->op == INTEREST_SNAPSHOT) &&
+        delta->topic[0] == '\0') {
+        return false;
+    }
+    return true;
+}
+
+bool Interest_IsControlTopic(const char* topic) {
+    return topic && strcmp(topic, INTEREST_TOPIC) == 0;
+}
@@ -0,0 +1,40 @@
+#ifndef INTEREST_H
+#define INTEREST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "message.h"
+
+// Reserved topic used for interest control lines between the SE and the PES
+#define INTEREST_TOPIC "$interest"
+
+// Longest encoded interest line, including the terminator
+#define MAX_INTEREST_LINE (MAX_TOPIC_LENGTH + 48)
+
+// Interest operations pushed from the Subscriber Engine to the Publisher Engine
+typedef enum {
+    INTEREST_RESET = '=',     // Drop all known topics, a snapshot follows
+    INTEREST_SNAPSHOT = '*',  // Topic is part of the snapshot for the given version
+    INTEREST_ADD = '+',       // Topic gained its first subscriber
+    INTEREST_REMOVE = '-',    // Topic lost its last subscriber
+    INTEREST_SYNC = '?'       // PES asks the SE to resend a snapshot
+} InterestOp;
+
+// Structure to represent a single interest change
+typedef struct {
+    unsigned long version;          // Version of the interest set after this change
+    InterestOp op;                  // Kind of change
+    char topic[MAX_TOPIC_LENGTH];   // Topic affected (empty for RESET and SYNC)
+} InterestDelta;
+
+// Encode a delta as "$interest|<version>|<op>|<topic>" (sent as a FRAME_INTEREST payload)
+// Returns the number of bytes written, or 0 if the buffer is too small
+size_t Interest_FormatDelta(char* buffer, size_t bufferSize, const InterestDelta* delta);
+
+// Decode a single interest line into a delta
+bool Interest_ParseDelta(const char* line, InterestDelta* delta);
+
+// Check whether a topic name is reserved for interest control traffic
+bool Interest_IsControlTopic(const char* topic);
+
+#endif // INTEREST_H
@@ -0,0 +1,327 @@
+#include "pch.h"
+#include "logformat.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Longest single conversion ("%-+#0*.*lld" and the like) rendered through snprintf
+#define LOG_MAX_CONVERSION 32
+
+// Bytes a packed string needs besides its characters: length prefix and terminator
+#define LOG_STRING_OVERHEAD 3
+
+// One conversion of a format string
+typedef struct {
+    const char* start;     // The '%'
+    const char* end;       // One past the conversion character
+    int starCount;         // '*' width / precision arguments read before the value
+    bool literal;          // "%%"
+    LogArgumentType type;
+} LogConversion;
+
+static const char* SkipDigits(const char* p) {
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    return p;
+}
+
+// Parse the conversion starting at p ('%'); false for conversions that cannot be deferred
+static bool ScanConversion(const char* p, LogConversion* conversion) {
+    conversion->start = p;
+    conversion->starCount = 0;
+    conversion->literal = false;
+    p++;
+
+    if (*p == '%') {
+        conversion->literal = true;
+        conversion->end = p + 1;
+        return true;
+    }
+
+    while (*p != '\0' && strchr("-+ #0'", *p) != NULL) {
+        p++;
+    }
+    if (*p == '*') {
+        conversion->starCount++;
+        p++;
+    }
+    else {
+        p = SkipDigits(p);
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            conversion->starCount++;
+            p++;
+        }
+        else {
+            p = SkipDigits(p);
+        }
+    }
+
+    // Length modifier; 'L' marks long double, anything unknown is rejected below
+    char length = ' ';
+    if (p[0] == 'h') {
+        p += (p[1] == 'h') ? 2 : 1;
+    }
+    else if (p[0] == 'l' && p[1] == 'l') {
+        length = 'q';
+        p += 2;
+    }
+    else if (p[0] == 'I' && p[1] == '6' && p[2] == '4') {
+        length = 'q';
+        p += 3;
+    }
+    else if (p[0] == 'I' && p[1] == '3' && p[2] == '2') {
+        p += 3;
+    }
+    else if (*p == 'l' || *p == 'L' || *p == 'z' || *p == 'j' || *p == 't' || *p == 'I') {
+        length = (*p == 'I') ? 'z' : *p;
+        p++;
+    }
+
+    char specifier = *p;
+    if (specifier == '\0') {
+        return false;
+    }
+    conversion->end = p + 1;
+
+    switch (specifier) {
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+        switch (length) {
+        case ' ': conversion->type = LOG_ARGUMENT_INT; return true;
+        case 'l': conversion->type = (specifier == 'c') ? LOG_ARGUMENT_INT : LOG_ARGUMENT_LONG; return true;
+        case 'q': conversion->type = LOG_ARGUMENT_LONGLONG; return true;
+        case 'z': conversion->type = LOG_ARGUMENT_SIZE; return true;
+        case 'j': conversion->type = LOG_ARGUMENT_INTMAX; return true;
+        case 't': conversion->type = LOG_ARGUMENT_PTRDIFF; return true;
+        default:  return false;
+        }
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        if (length != ' ' && length != 'l' && length != 'L') {
+            return false;
+        }
+        conversion->type = (length == 'L') ? LOG_ARGUMENT_LONGDOUBLE : LOG_ARGUMENT_DOUBLE;
+        return true;
+    case 's':
+        // Wide strings are not supported
+        conversion->type = LOG_ARGUMENT_STRING;
+        return length == ' ';
+    case 'p':
+        conversion->type = LOG_ARGUMENT_POINTER;
+        return length == ' ';
+    default:
+        return false; // %n, wide characters and unknown conversions
+    }
+}
+
+bool LogFormat_Parse(LogFormat* logFormat, const char* format) {
+    logFormat->format = format;
+    logFormat->argumentCount = 0;
+    logFormat->fixedBytes = 0;
+
+    const char* p = format;
+    while ((p = strchr(p, '%')) != NULL) {
+        LogConversion conversion;
+        if (!ScanConversion(p, &conversion)) {
+            return false;
+        }
+        p = conversion.end;
+        if (conversion.literal) {
+            continue;
+        }
+        if (conversion.end - conversion.start >= LOG_MAX_CONVERSION ||
+            logFormat->argumentCount + conversion.starCount + 1 > LOG_MAX_FORMAT_ARGUMENTS) {
+            return false;
+        }
+
+        for (int i = 0; i < conversion.starCount; i++) {
+            logFormat->argumentTypes[logFormat->argumentCount++] = LOG_ARGUMENT_INT;
+            logFormat->fixedBytes += sizeof(unsigned long long);
+        }
+        logFormat->argumentTypes[logFormat->argumentCount++] = (unsigned char)conversion.type;
+        logFormat->fixedBytes += (conversion.type == LOG_ARGUMENT_STRING) ? LOG_STRING_OVERHEAD : sizeof(unsigned long long);
+    }
+    return true;
+}
+
+size_t LogFormat_Pack(const LogFormat* logFormat, va_list args, char* buffer, size_t capacity) {
+    size_t used = 0;
+    size_t reserved = logFormat->fixedBytes; // Still needed by this and the following arguments
+
+    if (reserved > capacity) {
+        return 0;
+    }
+
+    for (unsigned char i = 0; i < logFormat->argumentCount; i++) {
+        LogArgumentType type = (LogArgumentType)logFormat->argumentTypes[i];
+
+        if (type == LOG_ARGUMENT_STRING) {
+            const char* text = va_arg(args, const char*);
+            if (text == NULL) {
+                text = "(null)";
+            }
+
+            size_t available = capacity - used - reserved;
+            if (available > 0xFFFF) {
+                available = 0xFFFF;
+            }
+            size_t length = strnlen(text, available);
+
+            unsigned short prefix = (unsigned short)length;
+            memcpy(buffer + used, &prefix, sizeof(prefix));
+            memcpy(buffer + used + sizeof(prefix), text, length);
+            buffer[used + sizeof(prefix) + length] = '\0';
+            used += LOG_STRING_OVERHEAD + length;
+            reserved -= LOG_STRING_OVERHEAD;
+            continue;
+        }
+
+        unsigned long long raw = 0;
+        switch (type) {
+        case LOG_ARGUMENT_INT:      raw = (unsigned long long)(long long)va_arg(args, int); break;
+        case LOG_ARGUMENT_LONG:     raw = (unsigned long long)(long long)va_arg(args, long); break;
+        case LOG_ARGUMENT_LONGLONG: raw = (unsigned long long)va_arg(args, long long); break;
+        case LOG_ARGUMENT_SIZE:     raw = (unsigned long long)va_arg(args, size_t); break;
+        case LOG_ARGUMENT_INTMAX:   raw = (unsigned long long)va_arg(args, intmax_t); break;
+        case LOG_ARGUMENT_PTRDIFF:  raw = (unsigned long long)va_arg(args, ptrdiff_t); break;
+        case LOG_ARGUMENT_POINTER:  raw = (unsigned long long)(uintptr_t)va_arg(args, void*); break;
+        case LOG_ARGUMENT_DOUBLE: {
+            double value = va_arg(args, double);
+            memcpy(&raw, &value, sizeof(raw));
+            break;
+        }
+        case LOG_ARGUMENT_LONGDOUBLE: {
+            double value = (double)va_arg(args, long double);
+            memcpy(&raw, &value, sizeof(raw));
+            break;
+        }
+        default:
+            break;
+        }
+
+        memcpy(buffer + used, &raw, sizeof(raw));
+        used += sizeof(raw);
+        reserved -= sizeof(raw);
+    }
+
+    return used;
+}
+
+// snprintf one conversion with its '*' arguments in front of the value
+#define LOG_PRINT_CONVERSION(value) \
+    (starCount == 0 ? snprintf(output, size, spec, value) : \
+     starCount == 1 ? snprintf(output, size, spec, stars[0], value) : \
+                      snprintf(output, size, spec, stars[0], stars[1], value))
+
+static int RenderConversion(char* output, size_t size, const char* spec, const int* stars, int starCount,
+    LogArgumentType type, unsigned long long raw, const char* text) {
+    double real;
+    memcpy(&real, &raw, sizeof(real));
+
+    switch (type) {
+    case LOG_ARGUMENT_INT:        return LOG_PRINT_CONVERSION((int)raw);
+    case LOG_ARGUMENT_LONG:       return LOG_PRINT_CONVERSION((long)raw);
+    case LOG_ARGUMENT_LONGLONG:   return LOG_PRINT_CONVERSION((long long)raw);
+    case LOG_ARGUMENT_SIZE:       return LOG_PRINT_CONVERSION((size_t)raw);
+    case LOG_ARGUMENT_INTMAX:     return LOG_PRINT_CONVERSION((intmax_t)raw);
+    case LOG_ARGUMENT_PTRDIFF:    return LOG_PRINT_CONVERSION((ptrdiff_t)raw);
+    case LOG_ARGUMENT_DOUBLE:     return LOG_PRINT_CONVERSION(real);
+    case LOG_ARGUMENT_LONGDOUBLE: return LOG_PRINT_CONVERSION((long double)real);
+    case LOG_ARGUMENT_POINTER:    return LOG_PRINT_CONVERSION((void*)(uintptr_t)raw);
+    case LOG_ARGUMENT_STRING:     return LOG_PRINT_CONVERSION(text);
+    default:                      return -1;
+    }
+}
+
+bool LogFormat_Render(const LogFormat* logFormat, const char* data, size_t length, char* output, size_t size) {
+    const char* p = logFormat->format;
+    size_t position = 0;
+    size_t consumed = 0;
+
+    if (size == 0) {
+        return false;
+    }
+    output[0] = '\0';
+
+    while (*p != '\0') {
+        const char* next = strchr(p, '%');
+        size_t literalLength = (next != NULL) ? (size_t)(next - p) : strlen(p);
+
+        // Copy the text up to the next conversion, truncating at the end of output
+        size_t copy = literalLength;
+        if (copy > size - 1 - position) {
+            copy = size - 1 - position;
+        }
+        memcpy(output + position, p, copy);
+        position += copy;
+        output[position] = '\0';
+        if (next == NULL) {
+            break;
+        }
+
+        LogConversion conversion;
+        if (!ScanConversion(next, &conversion)) {
+            return false;
+        }
+        p = conversion.end;
+        if (conversion.literal) {
+            if (position < size - 1) {
+                output[position++] = '%';
+                output[position] = '\0';
+            }
+            continue;
+        }
+
+        int stars[2];
+        for (int i = 0; i < conversion.starCount; i++) {
+            unsigned long long raw;
+            if (consumed + sizeof(raw) > length) {
+                return false;
+            }
+            memcpy(&raw, data + consumed, sizeof(raw));
+            consumed += sizeof(raw);
+            stars[i] = (int)raw;
+        }
+
+        unsigned long long raw = 0;
+        const char* text = NULL;
+        if (conversion.type == LOG_ARGUMENT_STRING) {
+            unsigned short prefix;
+            if (consumed + sizeof(prefix) > length) {
+                return false;
+            }
+            memcpy(&prefix, data + consumed, sizeof(prefix));
+            if (consumed + LOG_STRING_OVERHEAD + prefix > length || data[consumed + sizeof(prefix) + prefix] != '\0') {
+                return false;
+            }
+            text = data + consumed + sizeof(prefix);
+            consumed += LOG_STRING_OVERHEAD + prefix;
+        }
+        else {
+            if (consumed + sizeof(raw) > length) {
+                return false;
+            }
+            memcpy(&raw, data + consumed, sizeof(raw));
+            consumed += sizeof(raw);
+        }
+
+        char spec[LOG_MAX_CONVERSION];
+        size_t specLength = (size_t)(conversion.end - conversion.start);
+        if (specLength >= sizeof(spec)) {
+            return false;
+        }
+        memcpy(spec, conversion.start, specLength);
+        spec[specLength] = '\0';
+
+        int written = RenderConversion(output + position, size - position, spec, stars, conversion.starCount,
+            conversion.type, raw, text);
+        if (written < 0) {
+            return false;
+        }
+        position += ((size_t)written < size - position) ? (size_t)written : size - 1 - position;
+    }
+
+    return consumed == length;
+}
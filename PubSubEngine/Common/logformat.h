@@ -0,0 +1,80 @@
+#ifndef LOGFORMAT_H
+#define LOGFORMAT_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Most arguments (including '*' widths) a deferred format may take
+#define LOG_MAX_FORMAT_ARGUMENTS 16
+
+// Most distinct deferred formats a process can register
+#define LOG_MAX_FORMATS 4096
+
+// Format id of a LogFormat that could not be registered; its calls are formatted immediately
+#define LOG_FORMAT_UNSUPPORTED 0x7FFFFFFF
+
+// C type each conversion reads with va_arg; numbers are packed as 8 raw bytes,
+// strings as [length:2][bytes][\0]
+typedef enum {
+    LOG_ARGUMENT_INT,
+    LOG_ARGUMENT_LONG,
+    LOG_ARGUMENT_LONGLONG,
+    LOG_ARGUMENT_SIZE,
+    LOG_ARGUMENT_INTMAX,
+    LOG_ARGUMENT_PTRDIFF,
+    LOG_ARGUMENT_DOUBLE,
+    LOG_ARGUMENT_LONGDOUBLE,
+    LOG_ARGUMENT_POINTER,
+    LOG_ARGUMENT_STRING
+} LogArgumentType;
+
+// A printf format string whose arguments are recorded raw and rendered later.
+// Call sites keep one in a static variable (see LOG_FAST); only format needs initializing.
+typedef struct {
+    const char* format;
+    volatile long id;            // 0 until registered, then 1..LOG_MAX_FORMATS or LOG_FORMAT_UNSUPPORTED
+    unsigned char argumentCount;
+    unsigned char argumentTypes[LOG_MAX_FORMAT_ARGUMENTS];
+    unsigned short fixedBytes;   // Packed size of the arguments with every string empty
+} LogFormat;
+
+// Binary log file layout (host byte order; decode on the same architecture):
+//   LogBinaryHeader, then records of LogBinaryRecordHeader followed by length bytes of data.
+// The first message with a given format id is preceded by a FORMAT record carrying the format string.
+#define LOG_BINARY_MAGIC "PSBLOG01"
+#define LOG_BINARY_MAGIC_LENGTH 8
+
+typedef enum {
+    LOG_BINARY_FORMAT = 1,  // data: format string without terminator
+    LOG_BINARY_MESSAGE = 2, // data: arguments packed by LogFormat_Pack
+    LOG_BINARY_TEXT = 3     // data: text formatted when it was logged
+} LogBinaryRecordKind;
+
+#pragma pack(push, 1)
+typedef struct {
+    char magic[LOG_BINARY_MAGIC_LENGTH];
+    unsigned long long counterFrequency; // Counter ticks per second
+    unsigned long long counterBase;      // Counter value at baseTime
+    unsigned long long baseTime;         // FILETIME (UTC) when the file was started
+} LogBinaryHeader;
+
+typedef struct {
+    unsigned char kind;
+    unsigned char level;
+    unsigned short formatId;
+    unsigned short length;
+    unsigned long long counter;
+} LogBinaryRecordHeader;
+#pragma pack(pop)
+
+// Work out the argument types of format; false if it uses a conversion that cannot be deferred
+bool LogFormat_Parse(LogFormat* logFormat, const char* format);
+
+// Copy the arguments of a parsed format into buffer, truncating strings to fit; returns the bytes used
+size_t LogFormat_Pack(const LogFormat* logFormat, va_list args, char* buffer, size_t capacity);
+
+// Render packed arguments through the format string; false if the data does not match the format
+bool LogFormat_Render(const LogFormat* logFormat, const char* data, size_t length, char* output, size_t size);
+
+#endif // LOGFORMAT_H
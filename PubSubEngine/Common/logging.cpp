@@ -1,14 +1,60 @@
 #include "pch.h"
 #include "logging.h"
+#include <windows.h>
+#include <process.h>
 #include <stdarg.h>
-#include <time.h>
+#include <stdlib.h>
 #include <string.h>
 
+// Bytes the writer collects before handing them to fwrite
+#define LOG_BATCH_BUFFER_SIZE (64 * 1024)
+
+// Producers blocked on a full queue spin this many times before sleeping
+#define LOG_FULL_SPIN_LIMIT 64
+
+// One queued message. sequence tells producers and the writer whose turn the slot is:
+// equal to the claim position when free, position + 1 once the message is ready to write.
+typedef struct {
+    volatile LONG64 sequence;
+    LONG64 counter;          // QueryPerformanceCounter when the message was logged
+    LogLevel level;
+    unsigned short formatId; // 0 for formatted text, otherwise the LogFormat the arguments belong to
+    unsigned short length;
+    char data[LOG_MAX_MESSAGE];
+} LogRecord;
+
+// Bounded multi-producer / single-consumer queue; the two cursors live on separate cache lines
+typedef struct {
+    volatile LONG64 enqueuePosition;  // Next slot producers claim
+    char padding[64 - sizeof(LONG64)];
+    volatile LONG64 dequeuePosition;  // Next slot the writer reads (writer only)
+} LogRing;
+
 static FILE* logFile = NULL;
-static LogLevel currentLogLevel = LOG_INFO;
+static bool binaryOutput = false;
+static volatile LogLevel currentLogLevel = LOG_INFO;
+static volatile LogFullPolicy fullPolicy = LOG_FULL_BLOCK;
+static LogRecord* records = NULL;
+static LogRing ring;
+static volatile LONG64 droppedMessages = 0;
+static volatile LONG64 droppedReported = 0;
+static HANDLE writerWakeup = NULL;
+static HANDLE writerThread = NULL;
+static volatile bool writerStopping = false;
+static char* batchBuffer = NULL;
+static size_t batchUsed = 0;
 
-// Convert LogLevel to string
-static const char* LogLevelToString(LogLevel level) {
+// Performance counter value and wall clock time captured together when logging started
+static LONG64 counterFrequency = 1;
+static LONG64 counterBase = 0;
+static ULONGLONG baseTime = 0;
+
+// Deferred formats by id; registration is process wide and survives CloseLogging
+static LogFormat* registeredFormats[LOG_MAX_FORMATS + 1];
+static volatile LONG formatCount = 0;
+static bool formatWritten[LOG_MAX_FORMATS + 1]; // Format record already in the binary file (writer only)
+
+const char* LogLevelToString(LogLevel level) {
     switch (level) {
     case LOG_DEBUG:   return "DEBUG";
     case LOG_INFO:    return "INFO";
@@ -18,54 +64,393 @@ static const char* LogLevelToString(LogLevel level) {
     }
 }
 
-int InitializeLogging(const char* logFilePath) {
+static LONG64 ReadCounter(void) {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+// Format a counter value as local "YYYY-MM-DD HH:MM:SS", reusing the last result within the same second
+static const char* FormatTimestamp(LONG64 counter) {
+    static char timestamp[26];
+    static ULONGLONG cachedSecond = 0;
+
+    LONG64 elapsed = counter - counterBase;
+    ULONGLONG ticks = baseTime + (ULONGLONG)(elapsed / counterFrequency) * 10000000ULL +
+        (ULONGLONG)(elapsed % counterFrequency) * 10000000ULL / (ULONGLONG)counterFrequency;
+    ULONGLONG second = ticks / 10000000ULL;
+    if (second != cachedSecond || timestamp[0] == '\0') {
+        FILETIME time;
+        FILETIME local;
+        SYSTEMTIME parts;
+        time.dwLowDateTime = (DWORD)ticks;
+        time.dwHighDateTime = (DWORD)(ticks >> 32);
+        FileTimeToLocalFileTime(&time, &local);
+        FileTimeToSystemTime(&local, &parts);
+        snprintf(timestamp, sizeof(timestamp), "%04u-%02u-%02u %02u:%02u:%02u",
+            parts.wYear, parts.wMonth, parts.wDay, parts.wHour, parts.wMinute, parts.wSecond);
+        cachedSecond = second;
+    }
+    return timestamp;
+}
+
+static void FlushBatch(void) {
+    if (batchUsed > 0) {
+        fwrite(batchBuffer, 1, batchUsed, logFile);
+        batchUsed = 0;
+    }
+}
+
+static void AppendLine(LONG64 counter, LogLevel level, const char* text) {
+    // A line is at most the timestamp, level and LOG_MAX_MESSAGE text
+    if (batchUsed + LOG_MAX_MESSAGE + 64 > LOG_BATCH_BUFFER_SIZE) {
+        FlushBatch();
+    }
+
+    int written = snprintf(batchBuffer + batchUsed, LOG_BATCH_BUFFER_SIZE - batchUsed, "[%s] [%s] %s\n",
+        FormatTimestamp(counter), LogLevelToString(level), text);
+    if (written > 0) {
+        batchUsed += (size_t)written;
+    }
+}
+
+static void AppendBinary(LogBinaryRecordKind kind, LogLevel level, unsigned short formatId, LONG64 counter,
+    const char* data, size_t length) {
+    if (batchUsed + sizeof(LogBinaryRecordHeader) + length > LOG_BATCH_BUFFER_SIZE) {
+        FlushBatch();
+    }
+
+    LogBinaryRecordHeader header;
+    header.kind = (unsigned char)kind;
+    header.level = (unsigned char)level;
+    header.formatId = formatId;
+    header.length = (unsigned short)length;
+    header.counter = (unsigned long long)counter;
+    memcpy(batchBuffer + batchUsed, &header, sizeof(header));
+    memcpy(batchBuffer + batchUsed + sizeof(header), data, length);
+    batchUsed += sizeof(header) + length;
+}
+
+static void WriteRecord(const LogRecord* record) {
+    if (binaryOutput) {
+        if (record->formatId == 0) {
+            AppendBinary(LOG_BINARY_TEXT, record->level, 0, record->counter, record->data, record->length);
+            return;
+        }
+
+        // The decoder learns each format string from the first record that uses it
+        if (!formatWritten[record->formatId]) {
+            const char* format = registeredFormats[record->formatId]->format;
+            AppendBinary(LOG_BINARY_FORMAT, record->level, record->formatId, 0, format, strnlen(format, LOG_BATCH_BUFFER_SIZE / 2));
+            formatWritten[record->formatId] = true;
+        }
+        AppendBinary(LOG_BINARY_MESSAGE, record->level, record->formatId, record->counter, record->data, record->length);
+        return;
+    }
+
+    if (record->formatId == 0) {
+        AppendLine(record->counter, record->level, record->data);
+        return;
+    }
+
+    char text[LOG_MAX_MESSAGE];
+    if (!LogFormat_Render(registeredFormats[record->formatId], record->data, record->length, text, sizeof(text))) {
+        snprintf(text, sizeof(text), "(unreadable arguments for \"%s\")", registeredFormats[record->formatId]->format);
+    }
+    AppendLine(record->counter, record->level, text);
+}
+
+// Write every ready record in one batch; runs on the writer thread only
+static void DrainRecords(void) {
+    LONG64 position = ring.dequeuePosition;
+
+    while (true) {
+        LogRecord* record = &records[position & (LOG_RING_CAPACITY - 1)];
+        if (record->sequence != position + 1) {
+            break;
+        }
+
+        WriteRecord(record);
+
+        // Hand the slot back to producers for the next lap around the ring
+        InterlockedExchange64(&record->sequence, position + LOG_RING_CAPACITY);
+        position++;
+    }
+    ring.dequeuePosition = position;
+
+    LONG64 dropped = droppedMessages;
+    if (dropped != droppedReported) {
+        char notice[64];
+        int length = snprintf(notice, sizeof(notice), "%lld log messages dropped (queue full)", dropped - droppedReported);
+        if (binaryOutput) {
+            AppendBinary(LOG_BINARY_TEXT, LOG_WARNING, 0, ReadCounter(), notice, (size_t)length);
+        }
+        else {
+            AppendLine(ReadCounter(), LOG_WARNING, notice);
+        }
+        droppedReported = dropped;
+    }
+
+    if (batchUsed > 0) {
+        FlushBatch();
+        fflush(logFile);
+    }
+}
+
+static unsigned __stdcall LogWriterThread(void* param) {
+    (void)param;
+
+    while (!writerStopping) {
+        WaitForSingleObject(writerWakeup, LOG_FLUSH_INTERVAL);
+        DrainRecords();
+    }
+
+    // Producers are done by the time CloseLogging stops the writer
+    DrainRecords();
+    return 0;
+}
+
+// Claim a free slot; returns NULL if the queue is full
+static LogRecord* ClaimRecord(LONG64* claimed) {
+    while (true) {
+        LONG64 position = ring.enqueuePosition;
+        LogRecord* record = &records[position & (LOG_RING_CAPACITY - 1)];
+        LONG64 difference = record->sequence - position;
+
+        if (difference == 0) {
+            if (InterlockedCompareExchange64(&ring.enqueuePosition, position + 1, position) == position) {
+                *claimed = position;
+                return record;
+            }
+        }
+        else if (difference < 0) {
+            return NULL; // The writer has not freed this slot from the previous lap yet
+        }
+        // Otherwise another producer took the slot first; retry with the new position
+    }
+}
+
+// Claim a slot according to the full-queue policy; returns NULL if the message is dropped
+static LogRecord* AcquireRecord(LONG64* claimed) {
+    LogRecord* record;
+    int spins = 0;
+
+    while ((record = ClaimRecord(claimed)) == NULL) {
+        if (fullPolicy == LOG_FULL_DROP) {
+            InterlockedIncrement64(&droppedMessages);
+            return NULL;
+        }
+
+        // Blocking policy: make sure the writer is draining, then back off
+        SetEvent(writerWakeup);
+        if (++spins < LOG_FULL_SPIN_LIMIT) {
+            SwitchToThread();
+        }
+        else {
+            Sleep(1);
+        }
+    }
+    return record;
+}
+
+static void PublishRecord(LogRecord* record, LONG64 position, LogLevel level) {
+    InterlockedExchange64(&record->sequence, position + 1);
+
+    // Wake the writer early when the queue is half full or an error should reach the file promptly
+    if (level == LOG_ERROR || position - ring.dequeuePosition == LOG_RING_CAPACITY / 2) {
+        SetEvent(writerWakeup);
+    }
+}
+
+static void QueueText(LogLevel level, const char* format, va_list args) {
+    LONG64 position;
+    LogRecord* record = AcquireRecord(&position);
+    if (record == NULL) {
+        return;
+    }
+
+    record->counter = ReadCounter();
+    record->level = level;
+    record->formatId = 0;
+
+    int length = vsnprintf(record->data, sizeof(record->data), format, args);
+    if (length < 0) {
+        length = 0;
+    }
+    record->length = (unsigned short)(((size_t)length < sizeof(record->data)) ? (size_t)length : sizeof(record->data) - 1);
+
+    PublishRecord(record, position, level);
+}
+
+// Give a call site's format an id the first time it logs; concurrent first calls wait for the winner
+static LONG RegisterFormat(LogFormat* logFormat) {
+    if (InterlockedCompareExchange(&logFormat->id, -1, 0) == 0) {
+        LONG id = LOG_FORMAT_UNSUPPORTED;
+        if (LogFormat_Parse(logFormat, logFormat->format)) {
+            LONG next = InterlockedIncrement(&formatCount);
+            if (next <= LOG_MAX_FORMATS) {
+                registeredFormats[next] = logFormat;
+                id = next;
+            }
+        }
+        InterlockedExchange(&logFormat->id, id);
+        return id;
+    }
+
+    while (logFormat->id == -1) {
+        SwitchToThread();
+    }
+    return logFormat->id;
+}
+
+static int StartLogging(const char* logFilePath, bool binary) {
     if (logFile != NULL) {
         return 1; // Already initialized
     }
 
-    logFile = fopen(logFilePath, "a");
+    records = (LogRecord*)malloc(LOG_RING_CAPACITY * sizeof(LogRecord));
+    batchBuffer = (char*)malloc(LOG_BATCH_BUFFER_SIZE);
+    writerWakeup = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (records == NULL || batchBuffer == NULL || writerWakeup == NULL) {
+        CloseLogging();
+        return 3; // Failed to allocate the queue
+    }
+
+    for (LONG64 i = 0; i < LOG_RING_CAPACITY; i++) {
+        records[i].sequence = i;
+    }
+    ring.enqueuePosition = 0;
+    ring.dequeuePosition = 0;
+    droppedMessages = 0;
+    droppedReported = 0;
+    batchUsed = 0;
+    memset(formatWritten, 0, sizeof(formatWritten));
+
+    LARGE_INTEGER frequency;
+    FILETIME now;
+    QueryPerformanceFrequency(&frequency);
+    GetSystemTimeAsFileTime(&now);
+    counterFrequency = frequency.QuadPart;
+    counterBase = ReadCounter();
+    baseTime = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+
+    binaryOutput = binary;
+    logFile = fopen(logFilePath, binary ? "ab" : "a");
     if (logFile == NULL) {
+        CloseLogging();
         return 2; // Failed to open file
     }
 
+    if (binary) {
+        // Every session starts with its own header so appended runs decode independently
+        LogBinaryHeader header;
+        memcpy(header.magic, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_LENGTH);
+        header.counterFrequency = (unsigned long long)counterFrequency;
+        header.counterBase = (unsigned long long)counterBase;
+        header.baseTime = baseTime;
+        fwrite(&header, sizeof(header), 1, logFile);
+    }
+
+    writerStopping = false;
+    unsigned threadId;
+    writerThread = (HANDLE)_beginthreadex(NULL, 0, LogWriterThread, NULL, 0, &threadId);
+    if (writerThread == NULL) {
+        CloseLogging();
+        return 4; // Failed to start the writer
+    }
+
     return 0;
 }
 
+int InitializeLogging(const char* logFilePath) {
+    const char* binary = getenv(LOG_BINARY_ENVIRONMENT);
+    if (binary != NULL && strcmp(binary, "1") == 0) {
+        char binaryPath[MAX_PATH];
+        snprintf(binaryPath, sizeof(binaryPath), "%s%s", logFilePath, LOG_BINARY_EXTENSION);
+        return StartLogging(binaryPath, true);
+    }
+    return StartLogging(logFilePath, false);
+}
+
+int InitializeBinaryLogging(const char* logFilePath) {
+    return StartLogging(logFilePath, true);
+}
+
 void CloseLogging(void) {
+    if (writerThread != NULL) {
+        writerStopping = true;
+        SetEvent(writerWakeup);
+        WaitForSingleObject(writerThread, INFINITE);
+        CloseHandle(writerThread);
+        writerThread = NULL;
+    }
+
     if (logFile != NULL) {
         fclose(logFile);
         logFile = NULL;
     }
+
+    if (writerWakeup != NULL) {
+        CloseHandle(writerWakeup);
+        writerWakeup = NULL;
+    }
+
+    free(records);
+    free(batchBuffer);
+    records = NULL;
+    batchBuffer = NULL;
 }
 
 void LogMessage(LogLevel level, const char* format, ...) {
-    if (level < currentLogLevel || logFile == NULL) {
+    if (level < currentLogLevel || writerThread == NULL) {
         return;
     }
 
-    // Get current time
-    time_t now;
-    time(&now);
-    struct tm* timeinfo = localtime(&now);
-    char timestamp[26];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", timeinfo);
-
-    // Print timestamp and log level
-    fprintf(logFile, "[%s] [%s] ", timestamp, LogLevelToString(level));
-
-    // Print the actual message
     va_list args;
     va_start(args, format);
-    vfprintf(logFile, format, args);
+    QueueText(level, format, args);
     va_end(args);
+}
+
+void LogMessageFast(LogFormat* logFormat, LogLevel level, ...) {
+    if (level < currentLogLevel || writerThread == NULL) {
+        return;
+    }
+
+    LONG id = logFormat->id;
+    if (id <= 0) {
+        id = RegisterFormat(logFormat);
+    }
 
-    // Add newline
-    fprintf(logFile, "\n");
+    va_list args;
+    va_start(args, level);
+    if (id == LOG_FORMAT_UNSUPPORTED) {
+        // Conversions the packer does not understand are formatted right away
+        QueueText(level, logFormat->format, args);
+        va_end(args);
+        return;
+    }
 
-    // Flush the file buffer
-    fflush(logFile);
+    LONG64 position;
+    LogRecord* record = AcquireRecord(&position);
+    if (record != NULL) {
+        record->counter = ReadCounter();
+        record->level = level;
+        record->formatId = (unsigned short)id;
+        record->length = (unsigned short)LogFormat_Pack(logFormat, args, record->data, sizeof(record->data));
+        PublishRecord(record, position, level);
+    }
+    va_end(args);
 }
 
 void SetLogLevel(LogLevel level) {
     currentLogLevel = level;
-}
\ No newline at end of file
+}
+
+void SetLogFullPolicy(LogFullPolicy policy) {
+    fullPolicy = policy;
+}
+
+unsigned long long GetDroppedLogCount(void) {
+    return (unsigned long long)droppedMessages;
+}
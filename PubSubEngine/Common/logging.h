@@ -2,6 +2,21 @@
 #define LOGGING_H
 
 #include <stdio.h>
+#include "logformat.h"
+
+// Messages queued for the background writer (must be a power of two)
+#define LOG_RING_CAPACITY 4096
+
+// Longest message text or packed LOG_FAST arguments kept per record; longer ones are truncated
+#define LOG_MAX_MESSAGE 512
+
+// How often the writer drains the queue when nothing wakes it earlier (ms)
+#define LOG_FLUSH_INTERVAL 50
+
+// Setting this environment variable to 1 makes InitializeLogging write binary records
+// to the log path with LOG_BINARY_EXTENSION appended; decode them with LogDecoder
+#define LOG_BINARY_ENVIRONMENT "PUBSUB_BINARY_LOG"
+#define LOG_BINARY_EXTENSION ".bin"
 
 // Log levels
 typedef enum {
@@ -11,17 +26,48 @@ typedef enum {
     LOG_ERROR
 } LogLevel;
 
-// Initialize logging with a file path
+// What LogMessage does when the queue is full
+typedef enum {
+    LOG_FULL_BLOCK, // Wait for the writer to make room (default)
+    LOG_FULL_DROP   // Discard the message; the writer reports how many were dropped
+} LogFullPolicy;
+
+// Initialize logging with a file path and start the background writer
 // Returns 0 on success, non-zero on failure
 int InitializeLogging(const char* logFilePath);
 
-// Close the log file
+// Initialize logging that appends binary records to a file instead of text
+// Returns 0 on success, non-zero on failure
+int InitializeBinaryLogging(const char* logFilePath);
+
+// Write out every queued message, stop the writer and close the log file
 void CloseLogging(void);
 
 // Log a message with the specified level
+// The message is formatted in the caller and queued; a background thread writes it to the file
 void LogMessage(LogLevel level, const char* format, ...);
 
+// Log a message whose formatting is deferred: the caller only records the format id, a
+// performance counter timestamp and the raw arguments. Use through LOG_FAST on hot paths.
+void LogMessageFast(LogFormat* logFormat, LogLevel level, ...);
+
+// LogMessage for hot paths; format must be a string literal
+#define LOG_FAST(level, format, ...) \
+    do { \
+        static LogFormat logFastFormat = { format }; \
+        LogMessageFast(&logFastFormat, level, ##__VA_ARGS__); \
+    } while (0)
+
+// Name of a log level as written in the log
+const char* LogLevelToString(LogLevel level);
+
 // Set minimum log level (messages below this level won't be logged)
 void SetLogLevel(LogLevel level);
 
-#endif // LOGGING_H 
\ No newline at end of file
+// Choose whether LogMessage blocks or drops when the queue is full
+void SetLogFullPolicy(LogFullPolicy policy);
+
+// Get the number of messages dropped since logging started
+unsigned long long GetDroppedLogCount(void);
+
+#endif // LOGGING_H
@@ -0,0 +1,341 @@
+#include "pch.h"
+#include "logindex.h"
+#include "logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV64_OFFSET_BASIS 14695981039346656037ULL
+#define FNV64_PRIME 1099511628211ULL
+
+// Progress of re-indexing one segment from the log
+typedef struct {
+    LogIndex* index;
+    unsigned long long segmentBase;
+    unsigned long long segmentEnd;
+    bool failed;
+} RebuildState;
+
+// FNV-1a over the topic; 0 is reserved for empty slots
+static unsigned long long HashTopic(const char* topic) {
+    unsigned long long hash = FNV64_OFFSET_BASIS;
+    for (const unsigned char* cursor = (const unsigned char*)topic; *cursor; cursor++) {
+        hash ^= *cursor;
+        hash *= FNV64_PRIME;
+    }
+    return hash ? hash : 1;
+}
+
+static void WriteUInt64(char* out, unsigned long long value) {
+    for (int i = 7; i >= 0; i--) {
+        out[i] = (char)(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+static unsigned long long ReadUInt64(const char* in) {
+    const unsigned char* bytes = (const unsigned char*)in;
+    unsigned long long value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+static void WriteUInt32(char* out, unsigned int value) {
+    out[0] = (char)((value >> 24) & 0xFF);
+    out[1] = (char)((value >> 16) & 0xFF);
+    out[2] = (char)((value >> 8) & 0xFF);
+    out[3] = (char)(value & 0xFF);
+}
+
+static unsigned int ReadUInt32(const char* in) {
+    const unsigned char* bytes = (const unsigned char*)in;
+    return ((unsigned int)bytes[0] << 24) | ((unsigned int)bytes[1] << 16) | ((unsigned int)bytes[2] << 8) | bytes[3];
+}
+
+static void BuildIndexPath(const LogIndex* index, unsigned long long segmentBase, char* path, size_t size) {
+    snprintf(path, size, "%s\\%0*llu%s", index->directory, SEGMENTLOG_NAME_DIGITS, segmentBase, LOGINDEX_EXTENSION);
+}
+
+static LogIndexTopic* FindSlot(LogIndexTopic* topics, size_t capacity, unsigned long long hash) {
+    size_t mask = capacity - 1;
+    size_t slot = (size_t)hash & mask;
+    while (topics[slot].hash != 0 && topics[slot].hash != hash) {
+        slot = (slot + 1) & mask;
+    }
+    return &topics[slot];
+}
+
+static bool GrowTopics(LogIndex* index) {
+    size_t newCapacity = index->topicCapacity * 2;
+    LogIndexTopic* grown = (LogIndexTopic*)calloc(newCapacity, sizeof(LogIndexTopic));
+    if (!grown) {
+        return false;
+    }
+
+    for (size_t i = 0; i < index->topicCapacity; i++) {
+        if (index->topics[i].hash != 0) {
+            *FindSlot(grown, newCapacity, index->topics[i].hash) = index->topics[i];
+        }
+    }
+
+    free(index->topics);
+    index->topics = grown;
+    index->topicCapacity = newCapacity;
+    return true;
+}
+
+// Append an entry to the in-memory list of its topic
+static bool AddEntry(LogIndex* index, unsigned long long hash, unsigned long long offset, unsigned int length) {
+    // Keep the load factor at or below one half
+    if ((index->topicCount + 1) * 2 > index->topicCapacity && !GrowTopics(index)) {
+        return false;
+    }
+
+    LogIndexTopic* topic = FindSlot(index->topics, index->topicCapacity, hash);
+    if (topic->hash == 0) {
+        topic->hash = hash;
+        index->topicCount++;
+    }
+
+    if (topic->count == topic->capacity) {
+        size_t newCapacity = topic->capacity ? topic->capacity * 2 : LOGINDEX_INITIAL_ENTRIES;
+        LogIndexEntry* grown = (LogIndexEntry*)realloc(topic->entries, newCapacity * sizeof(LogIndexEntry));
+        if (!grown) {
+            return false;
+        }
+        topic->entries = grown;
+        topic->capacity = newCapacity;
+    }
+
+    topic->entries[topic->count].offset = offset;
+    topic->entries[topic->count].length = length;
+    topic->count++;
+    return true;
+}
+
+bool LogIndex_Flush(LogIndex* index) {
+    size_t written = 0;
+    while (written < index->bufferUsed) {
+        DWORD chunk = 0;
+        if (!WriteFile(index->activeFile, index->writeBuffer + written, (DWORD)(index->bufferUsed - written), &chunk, NULL)) {
+            LogMessage(LOG_ERROR, "Index write failed: %lu", GetLastError());
+            break;
+        }
+        written += chunk;
+    }
+
+    if (written > 0 && written < index->bufferUsed) {
+        memmove(index->writeBuffer, index->writeBuffer + written, index->bufferUsed - written);
+    }
+    index->bufferUsed -= written;
+    return index->bufferUsed == 0;
+}
+
+static void CloseActiveFile(LogIndex* index) {
+    if (index->activeFile != INVALID_HANDLE_VALUE) {
+        LogIndex_Flush(index);
+        CloseHandle(index->activeFile);
+        index->activeFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+// Load the index of one segment, keeping the entries that line up with the segment's records.
+// Leaves the index file open and positioned after them; covered receives the first unindexed offset
+static bool LoadSegmentIndex(LogIndex* index, const SegmentInfo* segment, unsigned long long* covered) {
+    char path[MAX_PATH];
+    BuildIndexPath(index, segment->baseOffset, path, sizeof(path));
+
+    CloseActiveFile(index);
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        LogMessage(LOG_ERROR, "Failed to open index %s: %lu", path, GetLastError());
+        return false;
+    }
+
+    unsigned long long segmentEnd = segment->baseOffset + segment->size;
+    unsigned long long next = segment->baseOffset;
+    unsigned long long validEntries = 0;
+    bool consistent = true;
+
+    // The write buffer doubles as the read buffer; it holds a whole number of entries
+    while (consistent) {
+        DWORD bytesRead = 0;
+        if (!ReadFile(file, index->writeBuffer, LOGINDEX_WRITE_BUFFER_SIZE, &bytesRead, NULL)) {
+            LogMessage(LOG_ERROR, "Failed to read index %s: %lu", path, GetLastError());
+            CloseHandle(file);
+            return false;
+        }
+        if (bytesRead < LOGINDEX_ENTRY_SIZE) {
+            break;
+        }
+
+        for (DWORD position = 0; position + LOGINDEX_ENTRY_SIZE <= bytesRead; position += LOGINDEX_ENTRY_SIZE) {
+            const char* entry = index->writeBuffer + position;
+            unsigned long long hash = ReadUInt64(entry);
+            unsigned long long offset = ReadUInt64(entry + 8);
+            unsigned int length = ReadUInt32(entry + 16);
+
+            // Every record is indexed in order, so each entry must start where the previous ended
+            if (hash == 0 || offset != next || length == 0 || offset + length > segmentEnd) {
+                consistent = false;
+                break;
+            }
+            if (!AddEntry(index, hash, offset, length)) {
+                CloseHandle(file);
+                return false;
+            }
+            next = offset + length;
+            validEntries++;
+        }
+    }
+
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)(validEntries * LOGINDEX_ENTRY_SIZE);
+    if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN) || !SetEndOfFile(file)) {
+        LogMessage(LOG_ERROR, "Failed to position index %s: %lu", path, GetLastError());
+        CloseHandle(file);
+        return false;
+    }
+
+    index->activeFile = file;
+    index->activeBase = segment->baseOffset;
+    *covered = next;
+    return true;
+}
+
+// Index a record found while scanning the part of a segment the index file did not cover
+static bool IndexRecord(unsigned long long offset, const char* topic, const char* payload,
+    size_t payloadLength, void* context) {
+    RebuildState* state = (RebuildState*)context;
+    (void)payload;
+
+    if (offset >= state->segmentEnd) {
+        return false;
+    }
+
+    size_t length = Frame_EncodedSize(strlen(topic), payloadLength);
+    if (!LogIndex_Add(state->index, state->segmentBase, topic, offset, length)) {
+        state->failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool LogIndex_Open(LogIndex* index, SegmentLog* log) {
+    if (!index || !log) {
+        return false;
+    }
+
+    memset(index, 0, sizeof(*index));
+    index->activeFile = INVALID_HANDLE_VALUE;
+    strncpy(index->directory, log->directory, sizeof(index->directory) - 1);
+
+    index->topicCapacity = LOGINDEX_INITIAL_TOPICS;
+    index->topics = (LogIndexTopic*)calloc(index->topicCapacity, sizeof(LogIndexTopic));
+    index->writeBuffer = (char*)malloc(LOGINDEX_WRITE_BUFFER_SIZE);
+    if (!index->topics || !index->writeBuffer) {
+        LogIndex_Close(index);
+        return false;
+    }
+
+    size_t segmentCount;
+    const SegmentInfo* segments = SegmentLog_GetSegments(log, &segmentCount);
+    for (size_t i = 0; i < segmentCount; i++) {
+        SegmentInfo segment = segments[i];
+        unsigned long long covered;
+        if (!LoadSegmentIndex(index, &segment, &covered)) {
+            LogIndex_Close(index);
+            return false;
+        }
+
+        unsigned long long segmentEnd = segment.baseOffset + segment.size;
+        if (covered < segmentEnd) {
+            LogMessage(LOG_WARNING, "Re-indexing %llu bytes of segment %llu", segmentEnd - covered, segment.baseOffset);
+
+            RebuildState state = { index, segment.baseOffset, segmentEnd, false };
+            if (!SegmentLog_ScanFrom(log, covered, IndexRecord, &state) || state.failed) {
+                LogIndex_Close(index);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void LogIndex_Close(LogIndex* index) {
+    if (!index) {
+        return;
+    }
+
+    CloseActiveFile(index);
+
+    if (index->topics) {
+        for (size_t i = 0; i < index->topicCapacity; i++) {
+            free(index->topics[i].entries);
+        }
+    }
+    free(index->topics);
+    free(index->writeBuffer);
+    index->topics = NULL;
+    index->writeBuffer = NULL;
+    index->topicCapacity = 0;
+    index->topicCount = 0;
+    index->bufferUsed = 0;
+}
+
+bool LogIndex_Add(LogIndex* index, unsigned long long segmentBase, const char* topic,
+    unsigned long long offset, size_t length) {
+    // The log rolled: entries from here on go to a fresh index file for the new segment
+    if (index->activeFile == INVALID_HANDLE_VALUE || segmentBase != index->activeBase) {
+        CloseActiveFile(index);
+
+        char path[MAX_PATH];
+        BuildIndexPath(index, segmentBase, path, sizeof(path));
+        index->activeFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+        if (index->activeFile == INVALID_HANDLE_VALUE) {
+            LogMessage(LOG_ERROR, "Failed to create index %s: %lu", path, GetLastError());
+            return false;
+        }
+        index->activeBase = segmentBase;
+    }
+
+    unsigned long long hash = HashTopic(topic);
+    if (!AddEntry(index, hash, offset, (unsigned int)length)) {
+        return false;
+    }
+
+    if (index->bufferUsed + LOGINDEX_ENTRY_SIZE > LOGINDEX_WRITE_BUFFER_SIZE && !LogIndex_Flush(index)) {
+        return false;
+    }
+
+    char* entry = index->writeBuffer + index->bufferUsed;
+    WriteUInt64(entry, hash);
+    WriteUInt64(entry + 8, offset);
+    WriteUInt32(entry + 16, (unsigned int)length);
+    index->bufferUsed += LOGINDEX_ENTRY_SIZE;
+    return true;
+}
+
+bool LogIndex_Lookup(const LogIndex* index, const char* topic, LogIndexEntry** entries, size_t* count) {
+    *entries = NULL;
+    *count = 0;
+
+    const LogIndexTopic* found = FindSlot(index->topics, index->topicCapacity, HashTopic(topic));
+    if (found->hash == 0 || found->count == 0) {
+        return true;
+    }
+
+    *entries = (LogIndexEntry*)malloc(found->count * sizeof(LogIndexEntry));
+    if (!*entries) {
+        return false;
+    }
+
+    memcpy(*entries, found->entries, found->count * sizeof(LogIndexEntry));
+    *count = found->count;
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <WinSock2.h>
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "segmentlog.h"
+
+// Every segment <base>.log has an index <base>.idx with one fixed-size entry per record:
+//   [topicHash:8][offset:8][length:4] (network byte order)
+// The index is derived data: on open, entries the log does not back are cut off and records
+// missing from the index are re-indexed from the segment, so it never needs to be forced to disk.
+#define LOGINDEX_EXTENSION ".idx"
+#define LOGINDEX_ENTRY_SIZE 20
+#define LOGINDEX_WRITE_BUFFER_SIZE (4096 * LOGINDEX_ENTRY_SIZE)
+#define LOGINDEX_INITIAL_TOPICS 64
+#define LOGINDEX_INITIAL_ENTRIES 8
+
+// Location of one record in the log
+typedef struct {
+    unsigned long long offset;
+    unsigned int length;
+} LogIndexEntry;
+
+// Records of every topic whose name hashes to hash; collisions are filtered when the records are read
+typedef struct {
+    unsigned long long hash; // 0 marks an empty slot
+    LogIndexEntry* entries;  // In offset order
+    size_t count;
+    size_t capacity;
+} LogIndexTopic;
+
+// Topic -> record list for a SegmentLog, kept in memory and appended to the index files.
+// Not thread-safe: callers serialize it together with the log it indexes.
+typedef struct {
+    char directory[MAX_PATH];
+    LogIndexTopic* topics;          // Open addressing with linear probing
+    size_t topicCapacity;           // Always a power of two
+    size_t topicCount;
+    HANDLE activeFile;              // Index of the segment currently appended to
+    unsigned long long activeBase;
+    char* writeBuffer;
+    size_t bufferUsed;
+} LogIndex;
+
+// Load (and repair) the index files for every segment of an open log
+bool LogIndex_Open(LogIndex* index, SegmentLog* log);
+
+// Flush buffered entries and free the index
+void LogIndex_Close(LogIndex* index);
+
+// Record that the record of length bytes at offset in segment segmentBase belongs to topic
+// Entries must be added in log order; a new segmentBase starts a new index file
+bool LogIndex_Add(LogIndex* index, unsigned long long segmentBase, const char* topic,
+    unsigned long long offset, size_t length);
+
+// Write buffered entries to the active index file
+bool LogIndex_Flush(LogIndex* index);
+
+// Copy the entries recorded for topic into a malloc'd array (NULL when there are none)
+bool LogIndex_Lookup(const LogIndex* index, const char* topic, LogIndexEntry** entries, size_t* count);
+
+#endif // LOGINDEX_H
@@ -0,0 +1,557 @@
+#include "pch.h"
+#include "metrics.h"
+#include "topicset.h"
+#include "textbuffer.h"
+#include "frame.h"
+#include "logging.h"
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Table slots are claimed with a compare-exchange so registration never takes a lock:
+// EMPTY -> CLAIMED while the name is copied in -> READY once it can be read
+#define SLOT_EMPTY 0
+#define SLOT_CLAIMED 1
+#define SLOT_READY 2
+
+#define SNAPSHOT_INITIAL_SIZE 4096
+
+static const double reportedPercentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+static const char* topicCounterNames[TOPIC_COUNTER_COUNT] = {
+    "topic_messages_in", "topic_bytes_in", "topic_messages_out", "topic_bytes_out", "topic_drops"
+};
+
+static Metric metrics[METRICS_MAX_METRICS];                 // Open addressing by name hash
+static Metric* volatile registered[METRICS_MAX_METRICS];    // Registration order, for output
+static volatile LONG registeredCount = 0;
+static MetricsTopic topics[METRICS_MAX_TOPICS];
+static MetricsTopic otherTopic = { SLOT_READY, METRICS_OTHER_TOPIC };
+static LARGE_INTEGER counterFrequency;
+
+// Publishing state
+static MetricsConfig config;
+static char serviceName[METRICS_NAME_LENGTH];
+static char filePath[MAX_PATH];
+static ULONGLONG startTick;
+static HANDLE stopEvent = NULL;
+static HANDLE dumpThread = NULL;
+static HANDLE scrapeThread = NULL;
+static SOCKET scrapeSocket = INVALID_SOCKET;
+static volatile bool stopping = false;
+
+// Values at the previous file write, for rates (only touched by the dump thread and Metrics_Stop)
+static long long previousValues[METRICS_MAX_METRICS];
+static long long previousTopicValues[METRICS_MAX_TOPICS + 1][TOPIC_COUNTER_COUNT];
+static ULONGLONG previousTick;
+
+// Write a topic as a label value, escaping what the text format reserves
+static void AppendLabel(TextBuffer* text, const char* value) {
+    char escaped[MAX_TOPIC_LENGTH * 2];
+    size_t length = 0;
+    for (const char* c = value; *c && length + 2 < sizeof(escaped); c++) {
+        if (*c == '"' || *c == '\\') {
+            escaped[length++] = '\\';
+            escaped[length++] = *c;
+        }
+        else if (*c == '\n') {
+            escaped[length++] = '\\';
+            escaped[length++] = 'n';
+        }
+        else {
+            escaped[length++] = *c;
+        }
+    }
+    escaped[length] = '\0';
+    TextBuffer_Append(text, "{topic=\"%s\"}", escaped);
+}
+
+static void AtomicMin(volatile LONG64* target, unsigned long long value) {
+    LONG64 current = *target;
+    while (value < (unsigned long long)current) {
+        LONG64 seen = InterlockedCompareExchange64(target, (LONG64)value, current);
+        if (seen == current) {
+            return;
+        }
+        current = seen;
+    }
+}
+
+static void AtomicMax(volatile LONG64* target, unsigned long long value) {
+    LONG64 current = *target;
+    while (value > (unsigned long long)current) {
+        LONG64 seen = InterlockedCompareExchange64(target, (LONG64)value, current);
+        if (seen == current) {
+            return;
+        }
+        current = seen;
+    }
+}
+
+// Wait for a slot another thread is claiming to become readable
+static LONG WaitForSlot(volatile LONG* state) {
+    LONG current = *state;
+    while (current == SLOT_CLAIMED) {
+        YieldProcessor();
+        current = *state;
+    }
+    return current;
+}
+
+Metric* Metrics_Register(const char* name, MetricType type) {
+    size_t length = strlen(name);
+    if (length == 0 || length >= METRICS_NAME_LENGTH) {
+        return NULL;
+    }
+
+    // Allocate before claiming so a claimed slot is always complete
+    Histogram* histogram = NULL;
+    if (type == METRIC_HISTOGRAM) {
+        histogram = (Histogram*)malloc(sizeof(Histogram));
+        if (!histogram) {
+            LogMessage(LOG_ERROR, "Failed to allocate histogram for metric %s", name);
+            return NULL;
+        }
+        Histogram_Reset(histogram);
+        histogram->min = ~0ULL;
+    }
+
+    unsigned int hash = TopicSet_Hash(name, length);
+    for (size_t probe = 0; probe < METRICS_MAX_METRICS; probe++) {
+        Metric* metric = &metrics[(hash + probe) % METRICS_MAX_METRICS];
+
+        if (metric->state == SLOT_EMPTY &&
+            InterlockedCompareExchange(&metric->state, SLOT_CLAIMED, SLOT_EMPTY) == SLOT_EMPTY) {
+            memcpy(metric->name, name, length + 1);
+            metric->type = type;
+            metric->value = 0;
+            metric->histogram = histogram;
+            InterlockedExchange(&metric->state, SLOT_READY);
+
+            LONG index = InterlockedIncrement(&registeredCount) - 1;
+            registered[index] = metric;
+            return metric;
+        }
+
+        if (WaitForSlot(&metric->state) == SLOT_READY && strcmp(metric->name, name) == 0) {
+            free(histogram);
+            return metric->type == type ? metric : NULL;
+        }
+    }
+
+    free(histogram);
+    LogMessage(LOG_WARNING, "Metric table full, %s is not recorded", name);
+    return NULL;
+}
+
+void Metrics_Add(Metric* metric, long long delta) {
+    if (metric) {
+        InterlockedExchangeAdd64(&metric->value, delta);
+    }
+}
+
+void Metrics_Set(Metric* metric, long long value) {
+    if (metric) {
+        InterlockedExchange64(&metric->value, value);
+    }
+}
+
+long long Metrics_Value(const Metric* metric) {
+    return metric ? metric->value : 0;
+}
+
+void Metrics_Record(Metric* metric, unsigned long long value) {
+    if (!metric || !metric->histogram) {
+        return;
+    }
+
+    Histogram* histogram = metric->histogram;
+    InterlockedIncrement64((volatile LONG64*)&histogram->counts[Histogram_BucketIndex(value)]);
+    InterlockedIncrement64((volatile LONG64*)&histogram->count);
+    InterlockedExchangeAdd64((volatile LONG64*)&histogram->sum, (LONG64)value);
+    AtomicMin((volatile LONG64*)&histogram->min, value);
+    AtomicMax((volatile LONG64*)&histogram->max, value);
+}
+
+unsigned long long Metrics_Now(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (unsigned long long)now.QuadPart;
+}
+
+void Metrics_RecordSince(Metric* metric, unsigned long long start) {
+    if (!metric) {
+        return;
+    }
+
+    // The frequency never changes, so racing first calls all store the same value
+    if (counterFrequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&counterFrequency);
+    }
+    unsigned long long elapsed = Metrics_Now() - start;
+    Metrics_Record(metric, elapsed * 1000000 / (unsigned long long)counterFrequency.QuadPart);
+}
+
+static MetricsTopic* FindTopic(const char* topic) {
+    size_t length = strlen(topic);
+    if (length == 0 || length >= MAX_TOPIC_LENGTH) {
+        return &otherTopic;
+    }
+
+    unsigned int hash = TopicSet_Hash(topic, length);
+    for (size_t probe = 0; probe < METRICS_TOPIC_PROBES; probe++) {
+        MetricsTopic* entry = &topics[(hash + probe) % METRICS_MAX_TOPICS];
+
+        if (entry->state == SLOT_EMPTY &&
+            InterlockedCompareExchange(&entry->state, SLOT_CLAIMED, SLOT_EMPTY) == SLOT_EMPTY) {
+            memcpy(entry->topic, topic, length + 1);
+            InterlockedExchange(&entry->state, SLOT_READY);
+            return entry;
+        }
+
+        if (WaitForSlot(&entry->state) == SLOT_READY && strcmp(entry->topic, topic) == 0) {
+            return entry;
+        }
+    }
+    return &otherTopic;
+}
+
+void Metrics_CountTopic(const char* topic, TopicCounter counter, unsigned long long value) {
+    if (topic && counter < TOPIC_COUNTER_COUNT) {
+        InterlockedExchangeAdd64(&FindTopic(topic)->counters[counter], (LONG64)value);
+    }
+}
+
+// Copy a histogram that other threads keep recording into; the count is taken from the
+// copied buckets so percentiles stay consistent with them
+static void CopyHistogram(Histogram* copy, const Histogram* live) {
+    memcpy(copy, live, sizeof(*copy));
+    copy->count = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        copy->count += copy->counts[i];
+    }
+    if (copy->count == 0) {
+        copy->min = 0;
+        copy->max = 0;
+    }
+}
+
+static const char* TypeName(MetricType type) {
+    switch (type) {
+    case METRIC_COUNTER: return "counter";
+    case METRIC_GAUGE:   return "gauge";
+    default:             return "summary";
+    }
+}
+
+static void AppendMetric(TextBuffer* text, const Metric* metric, Histogram* scratch) {
+    TextBuffer_Append(text, "# TYPE %s %s\n", metric->name, TypeName(metric->type));
+    if (metric->type != METRIC_HISTOGRAM) {
+        TextBuffer_Append(text, "%s %lld\n", metric->name, (long long)metric->value);
+        return;
+    }
+
+    if (!metric->histogram) {
+        return;
+    }
+    CopyHistogram(scratch, metric->histogram);
+    for (size_t i = 0; i < sizeof(reportedPercentiles) / sizeof(reportedPercentiles[0]); i++) {
+        TextBuffer_Append(text, "%s{quantile=\"%g\"} %llu\n", metric->name, reportedPercentiles[i] / 100.0,
+            Histogram_Percentile(scratch, reportedPercentiles[i]));
+    }
+    TextBuffer_Append(text, "%s_sum %llu\n%s_count %llu\n", metric->name, scratch->sum, metric->name, scratch->count);
+    TextBuffer_Append(text, "# TYPE %s_max gauge\n%s_max %llu\n", metric->name, metric->name, scratch->max);
+}
+
+// Each topic counter is one family with a line per topic that has counted anything
+static void AppendTopics(TextBuffer* text) {
+    for (int counter = 0; counter < TOPIC_COUNTER_COUNT; counter++) {
+        TextBuffer_Append(text, "# TYPE %s counter\n", topicCounterNames[counter]);
+        for (size_t i = 0; i <= METRICS_MAX_TOPICS; i++) {
+            const MetricsTopic* entry = i < METRICS_MAX_TOPICS ? &topics[i] : &otherTopic;
+            LONG64 value = entry->counters[counter];
+            if (entry->state == SLOT_READY && value != 0) {
+                TextBuffer_Append(text, "%s", topicCounterNames[counter]);
+                AppendLabel(text, entry->topic);
+                TextBuffer_Append(text, " %lld\n", (long long)value);
+            }
+        }
+    }
+}
+
+// Per-second rates of every counter since the previous file write
+static void AppendRates(TextBuffer* text, double seconds) {
+    LONG count = registeredCount;
+    for (LONG i = 0; i < count; i++) {
+        const Metric* metric = registered[i];
+        if (!metric || metric->type != METRIC_COUNTER) {
+            continue;
+        }
+        long long value = metric->value;
+        TextBuffer_Append(text, "%s_per_second %.2f\n", metric->name, (value - previousValues[i]) / seconds);
+        previousValues[i] = value;
+    }
+
+    for (int counter = 0; counter < TOPIC_COUNTER_COUNT; counter++) {
+        for (size_t i = 0; i <= METRICS_MAX_TOPICS; i++) {
+            const MetricsTopic* entry = i < METRICS_MAX_TOPICS ? &topics[i] : &otherTopic;
+            long long value = entry->counters[counter];
+            if (entry->state == SLOT_READY && value != previousTopicValues[i][counter]) {
+                TextBuffer_Append(text, "%s_per_second", topicCounterNames[counter]);
+                AppendLabel(text, entry->topic);
+                TextBuffer_Append(text, " %.2f\n", (value - previousTopicValues[i][counter]) / seconds);
+                previousTopicValues[i][counter] = value;
+            }
+        }
+    }
+}
+
+static bool RenderSnapshot(TextBuffer* text, bool withRates) {
+    if (!TextBuffer_Init(text, SNAPSHOT_INITIAL_SIZE)) {
+        return false;
+    }
+    Histogram* scratch = (Histogram*)malloc(sizeof(Histogram));
+    if (!scratch) {
+        free(text->data);
+        return false;
+    }
+
+    if (config.collector) {
+        config.collector(config.collectorContext);
+    }
+
+    ULONGLONG now = GetTickCount64();
+    TextBuffer_Append(text, "# %s metrics, uptime %.1f s\n", serviceName[0] ? serviceName : "process",
+        startTick ? (now - startTick) / 1000.0 : 0.0);
+
+    LONG count = registeredCount;
+    for (LONG i = 0; i < count; i++) {
+        if (registered[i]) {
+            AppendMetric(text, registered[i], scratch);
+        }
+    }
+    AppendTopics(text);
+
+    if (withRates) {
+        double seconds = (now - previousTick) / 1000.0;
+        TextBuffer_Append(text, "# Rates over the last %.1f s\n", seconds);
+        AppendRates(text, seconds > 0.0 ? seconds : 1.0);
+        previousTick = now;
+    }
+
+    free(scratch);
+    if (text->failed) {
+        free(text->data);
+        return false;
+    }
+    return true;
+}
+
+bool Metrics_Snapshot(char** text, size_t* length) {
+    TextBuffer snapshot;
+    if (!RenderSnapshot(&snapshot, false)) {
+        return false;
+    }
+    *text = snapshot.data;
+    *length = snapshot.length;
+    return true;
+}
+
+// Replace the snapshot file in one step so readers never see half a snapshot
+static void WriteSnapshotFile(void) {
+    TextBuffer snapshot;
+    if (!RenderSnapshot(&snapshot, true)) {
+        LogMessage(LOG_WARNING, "Failed to render metrics snapshot");
+        return;
+    }
+
+    char temporaryPath[MAX_PATH + 4];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", filePath);
+    FILE* file = fopen(temporaryPath, "wb");
+    if (!file) {
+        LogMessage(LOG_WARNING, "Failed to open metrics file %s", temporaryPath);
+        free(snapshot.data);
+        return;
+    }
+
+    bool written = fwrite(snapshot.data, 1, snapshot.length, file) == snapshot.length;
+    written = fclose(file) == 0 && written;
+    free(snapshot.data);
+
+    if (!written || !MoveFileExA(temporaryPath, filePath, MOVEFILE_REPLACE_EXISTING)) {
+        LogMessage(LOG_WARNING, "Failed to write metrics file %s", filePath);
+    }
+}
+
+static unsigned __stdcall DumpThread(void* param) {
+    (void)param;
+    while (WaitForSingleObject(stopEvent, config.intervalMs) == WAIT_TIMEOUT) {
+        WriteSnapshotFile();
+    }
+    return 0;
+}
+
+// Answer one scrape: HTTP GETs get a response header, bare connections just the text
+static void ServeScrape(SOCKET client) {
+    char request[512];
+    int received = 0;
+
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(client, &readSet);
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = METRICS_SCRAPE_WAIT * 1000;
+    if (select(0, &readSet, NULL, NULL, &timeout) > 0) {
+        received = recv(client, request, sizeof(request) - 1, 0);
+    }
+    bool http = received >= 4 && memcmp(request, "GET ", 4) == 0;
+
+    char* text;
+    size_t length;
+    if (!Metrics_Snapshot(&text, &length)) {
+        return;
+    }
+
+    if (http) {
+        char header[160];
+        int headerLength = snprintf(header, sizeof(header),
+            "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", length);
+        Frame_SendAll(client, header, (size_t)headerLength);
+    }
+    Frame_SendAll(client, text, length);
+    free(text);
+}
+
+static unsigned __stdcall ScrapeThread(void* param) {
+    (void)param;
+    while (!stopping) {
+        SOCKET client = accept(scrapeSocket, NULL, NULL);
+        if (client == INVALID_SOCKET) continue;
+
+        ServeScrape(client);
+        shutdown(client, SD_SEND);
+        closesocket(client);
+    }
+    return 0;
+}
+
+static bool OpenScrapeSocket(unsigned short port) {
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        return false;
+    }
+
+    scrapeSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (scrapeSocket == INVALID_SOCKET) {
+        WSACleanup();
+        return false;
+    }
+
+    // Loopback only: the snapshot names every topic
+    struct sockaddr_in address;
+    ZeroMemory(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(scrapeSocket, (struct sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+        listen(scrapeSocket, SOMAXCONN) == SOCKET_ERROR) {
+        closesocket(scrapeSocket);
+        scrapeSocket = INVALID_SOCKET;
+        WSACleanup();
+        return false;
+    }
+    return true;
+}
+
+bool Metrics_Start(const MetricsConfig* metricsConfig) {
+    if (stopEvent != NULL) {
+        return false;
+    }
+
+    config = *metricsConfig;
+    if (config.intervalMs == 0) {
+        const char* interval = getenv(METRICS_INTERVAL_ENVIRONMENT);
+        config.intervalMs = interval && atoi(interval) > 0 ? (unsigned int)atoi(interval) : METRICS_DEFAULT_INTERVAL;
+    }
+    strncpy(serviceName, config.serviceName ? config.serviceName : "", sizeof(serviceName) - 1);
+    serviceName[sizeof(serviceName) - 1] = '\0';
+    strncpy(filePath, config.filePath ? config.filePath : "", sizeof(filePath) - 1);
+    filePath[sizeof(filePath) - 1] = '\0';
+    config.serviceName = serviceName;
+    config.filePath = filePath[0] ? filePath : NULL;
+
+    startTick = GetTickCount64();
+    previousTick = startTick;
+    stopping = false;
+
+    stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (stopEvent == NULL) {
+        LogMessage(LOG_ERROR, "Failed to create metrics stop event");
+        return false;
+    }
+
+    if (config.filePath) {
+        unsigned threadId;
+        dumpThread = (HANDLE)_beginthreadex(NULL, 0, DumpThread, NULL, 0, &threadId);
+        if (dumpThread == NULL) {
+            LogMessage(LOG_ERROR, "Failed to create metrics file thread");
+        }
+    }
+
+    // Scrapes are optional; a port in use only costs the socket
+    if (config.scrapePort != 0) {
+        if (!OpenScrapeSocket(config.scrapePort)) {
+            LogMessage(LOG_WARNING, "Metrics scrape port %u unavailable", config.scrapePort);
+        }
+        else {
+            unsigned threadId;
+            scrapeThread = (HANDLE)_beginthreadex(NULL, 0, ScrapeThread, NULL, 0, &threadId);
+            if (scrapeThread == NULL) {
+                LogMessage(LOG_ERROR, "Failed to create metrics scrape thread");
+                closesocket(scrapeSocket);
+                scrapeSocket = INVALID_SOCKET;
+                WSACleanup();
+            }
+        }
+    }
+
+    LogMessage(LOG_INFO, "Metrics: file %s every %u ms, scrape port %u", config.filePath ? config.filePath : "(none)",
+        config.intervalMs, scrapeThread ? config.scrapePort : 0);
+    return true;
+}
+
+void Metrics_Stop(void) {
+    if (stopEvent == NULL) {
+        return;
+    }
+
+    stopping = true;
+    SetEvent(stopEvent);
+
+    if (dumpThread != NULL) {
+        WaitForSingleObject(dumpThread, INFINITE);
+        CloseHandle(dumpThread);
+        dumpThread = NULL;
+    }
+
+    // Closing the socket unblocks accept()
+    if (scrapeThread != NULL) {
+        closesocket(scrapeSocket);
+        scrapeSocket = INVALID_SOCKET;
+        WaitForSingleObject(scrapeThread, INFINITE);
+        CloseHandle(scrapeThread);
+        scrapeThread = NULL;
+        WSACleanup();
+    }
+
+    if (config.filePath) {
+        WriteSnapshotFile();
+    }
+
+    // The collector may point into state the service is about to free
+    config.collector = NULL;
+    CloseHandle(stopEvent);
+    stopEvent = NULL;
+}
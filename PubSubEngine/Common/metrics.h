@@ -0,0 +1,99 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <WinSock2.h>
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "histogram.h"
+#include "message.h"
+
+#define METRICS_MAX_METRICS 256           // Named counters, gauges and histograms per process
+#define METRICS_MAX_TOPICS 4096           // Topics counted individually; the rest share METRICS_OTHER_TOPIC
+#define METRICS_TOPIC_PROBES 32           // Slots tried before a topic falls back to METRICS_OTHER_TOPIC
+#define METRICS_NAME_LENGTH 64
+#define METRICS_OTHER_TOPIC "(other)"
+#define METRICS_DEFAULT_INTERVAL 10000    // ms between snapshot file writes
+#define METRICS_INTERVAL_ENVIRONMENT "PUBSUB_METRICS_INTERVAL"
+#define METRICS_SCRAPE_WAIT 100           // ms a scrape connection gets to send its request line
+
+typedef enum {
+    METRIC_COUNTER,   // Only goes up
+    METRIC_GAUGE,     // Current level, set or adjusted
+    METRIC_HISTOGRAM  // Distribution of recorded values (latencies in microseconds, sizes)
+} MetricType;
+
+// Counters kept for every topic
+typedef enum {
+    TOPIC_MESSAGES_IN,
+    TOPIC_BYTES_IN,
+    TOPIC_MESSAGES_OUT,
+    TOPIC_BYTES_OUT,
+    TOPIC_DROPS,
+    TOPIC_COUNTER_COUNT
+} TopicCounter;
+
+// One registered metric; all updates are interlocked, so any thread may update it without a lock
+typedef struct {
+    volatile LONG state;           // Slot claim state, see metrics.cpp
+    char name[METRICS_NAME_LENGTH];
+    MetricType type;
+    volatile LONG64 value;         // Counters and gauges
+    Histogram* histogram;          // Histograms; buckets are updated with interlocked adds
+} Metric;
+
+// Per-topic counters
+typedef struct {
+    volatile LONG state;
+    char topic[MAX_TOPIC_LENGTH];
+    volatile LONG64 counters[TOPIC_COUNTER_COUNT];
+} MetricsTopic;
+
+// Called before each snapshot so a service can refresh gauges it does not track as they change
+typedef void (*MetricsCollector)(void* context);
+
+// Where and how often snapshots are published
+typedef struct {
+    const char* serviceName;       // Written at the top of every snapshot
+    const char* filePath;          // Rewritten every interval with counter rates added (NULL for none)
+    unsigned int intervalMs;       // 0 selects METRICS_INTERVAL_ENVIRONMENT or METRICS_DEFAULT_INTERVAL
+    unsigned short scrapePort;     // Loopback port serving the snapshot as plain text (0 for none)
+    MetricsCollector collector;    // May be NULL
+    void* collectorContext;
+} MetricsConfig;
+
+// Find or create a metric; returns NULL if the table is full or the name exists with another type.
+// The registry needs no initialization and lives for the whole process, so services register at startup.
+Metric* Metrics_Register(const char* name, MetricType type);
+
+// Add to a counter or gauge; a NULL metric is ignored so unregistered metrics cost a branch
+void Metrics_Add(Metric* metric, long long delta);
+
+// Set a gauge
+void Metrics_Set(Metric* metric, long long value);
+
+// Read a counter or gauge; a NULL metric reads as 0
+long long Metrics_Value(const Metric* metric);
+
+// Record a value in a histogram
+void Metrics_Record(Metric* metric, unsigned long long value);
+
+// Current performance counter, for Metrics_RecordSince
+unsigned long long Metrics_Now(void);
+
+// Record the microseconds elapsed since start (from Metrics_Now) in a histogram
+void Metrics_RecordSince(Metric* metric, unsigned long long start);
+
+// Add to one of a topic's counters
+void Metrics_CountTopic(const char* topic, TopicCounter counter, unsigned long long value);
+
+// Render every metric as plain text; the caller frees *text
+bool Metrics_Snapshot(char** text, size_t* length);
+
+// Start writing the snapshot file and serving scrapes
+bool Metrics_Start(const MetricsConfig* config);
+
+// Write a final snapshot and stop the publishing threads
+void Metrics_Stop(void);
+
+#endif // METRICS_H
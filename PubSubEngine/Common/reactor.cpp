@@ -0,0 +1,384 @@
+#include "pch.h"
+#include "reactor.h"
+#include "logging.h"
+#include <process.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Completion key posted to stop a loop; real completions carry their connection as the key
+#define REACTOR_QUIT_KEY 0
+
+// Read states of a connection. A parked connection has no receive armed but keeps the receive's
+// pending operation, so it stays alive until a posted wakeup stands in for the receive completion.
+#define REACTOR_READ_ACTIVE 0   // The receive is re-armed after each handler call
+#define REACTOR_READ_PAUSING 1  // The handler called Reactor_Pause; the loop parks it once the handler returns
+#define REACTOR_READ_PARKED 2   // Waiting for Reactor_Resume or Reactor_Close to post a wakeup
+#define REACTOR_READ_RESUMED 3  // Resumed before the loop parked it; the loop wakes it straight away
+
+// Start a zero-byte receive that completes once data (or EOF) is available
+static bool ArmReceive(ReactorConnection* connection) {
+    WSABUF buffer;
+    buffer.buf = NULL;
+    buffer.len = 0;
+    DWORD flags = 0;
+
+    ZeroMemory(&connection->overlapped, sizeof(connection->overlapped));
+    if (WSARecv(connection->socket, &buffer, 1, NULL, &flags, &connection->overlapped, NULL) == SOCKET_ERROR &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        return false;
+    }
+    return true;
+}
+
+static void LinkConnection(Reactor* reactor, ReactorConnection* connection) {
+    WaitForSingleObject(reactor->mutex, INFINITE);
+    connection->previous = NULL;
+    connection->next = reactor->connections;
+    if (reactor->connections) {
+        reactor->connections->previous = connection;
+    }
+    reactor->connections = connection;
+    InterlockedIncrement(&reactor->connectionCount);
+    ReleaseMutex(reactor->mutex);
+}
+
+static void UnlinkConnection(Reactor* reactor, ReactorConnection* connection) {
+    WaitForSingleObject(reactor->mutex, INFINITE);
+    if (connection->previous) {
+        connection->previous->next = connection->next;
+    }
+    else {
+        reactor->connections = connection->next;
+    }
+    if (connection->next) {
+        connection->next->previous = connection->previous;
+    }
+    ReleaseMutex(reactor->mutex);
+}
+
+// Drop one pending operation; the last one out detaches the owner and closes the socket.
+// Only the owning loop releases operations, and the count can only reach zero after a
+// close was requested, because the armed receive holds one until then.
+static void ReleaseOperation(ReactorConnection* connection) {
+    if (InterlockedDecrement(&connection->pendingOperations) > 0) {
+        return;
+    }
+
+    if (!connection->closed) {
+        connection->closed = true;
+        connection->onClose(connection);
+
+        // A Reactor_Send that raced with the close holds its own operation; its completion finishes up
+        if (connection->pendingOperations > 0) {
+            return;
+        }
+    }
+
+    Reactor* reactor = connection->reactor;
+
+    // Unlink first so Reactor_Destroy never cancels I/O on a socket that is being closed
+    UnlinkConnection(reactor, connection);
+    closesocket(connection->socket);
+    InterlockedDecrement(&reactor->connectionCount);
+    free(connection);
+}
+
+// The receive side has stopped: abort any send still in flight and drop the receive
+static void CloseConnection(ReactorConnection* connection) {
+    InterlockedExchange(&connection->closeRequested, 1);
+    CancelIoEx((HANDLE)connection->socket, NULL);
+    ReleaseOperation(connection);
+}
+
+// Complete the parked receive through the owning loop, which calls the read handler again
+static void PostWakeup(ReactorConnection* connection) {
+    PostQueuedCompletionStatus(connection->reactor->ports[connection->loop], 0, (ULONG_PTR)connection,
+        &connection->overlapped);
+}
+
+static void HandleReceiveCompletion(ReactorConnection* connection, BOOL completed) {
+    bool keep = completed && !connection->closeRequested && connection->onReadable(connection);
+
+    if (keep) {
+        LONG readState = InterlockedCompareExchange(&connection->readState, REACTOR_READ_PARKED, REACTOR_READ_PAUSING);
+        if (readState == REACTOR_READ_PAUSING) {
+            // A close requested before we parked found no receive to cancel, so finish it here
+            if (connection->closeRequested &&
+                InterlockedCompareExchange(&connection->readState, REACTOR_READ_ACTIVE, REACTOR_READ_PARKED) == REACTOR_READ_PARKED) {
+                CloseConnection(connection);
+            }
+            return;
+        }
+        if (readState == REACTOR_READ_RESUMED) {
+            InterlockedExchange(&connection->readState, REACTOR_READ_ACTIVE);
+            PostWakeup(connection);
+            return;
+        }
+    }
+
+    if (keep && ArmReceive(connection)) {
+        // A close requested while the handler ran may have missed the receive we just armed
+        if (connection->closeRequested) {
+            CancelIoEx((HANDLE)connection->socket, &connection->overlapped);
+        }
+        return;
+    }
+
+    CloseConnection(connection);
+}
+
+static void HandleSendCompletion(ReactorConnection* connection, BOOL completed, DWORD bytes) {
+    bool sent = completed && bytes == connection->writeLength;
+
+    if (!sent) {
+        Reactor_Close(connection);
+    }
+    if (!connection->closed && connection->onWritten) {
+        connection->onWritten(connection, sent);
+    }
+    ReleaseOperation(connection);
+}
+
+static unsigned __stdcall EventLoopThread(void* param) {
+    HANDLE port = (HANDLE)param;
+
+    while (true) {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        LPOVERLAPPED overlapped = NULL;
+        BOOL completed = GetQueuedCompletionStatus(port, &bytes, &key, &overlapped, INFINITE);
+
+        if (overlapped == NULL) {
+            if (!completed) {
+                LogMessage(LOG_ERROR, "Event loop wait failed: %lu", GetLastError());
+                break;
+            }
+            if (key == REACTOR_QUIT_KEY) {
+                break;
+            }
+            continue;
+        }
+
+        ReactorConnection* connection = (ReactorConnection*)key;
+        if (overlapped == &connection->overlapped) {
+            HandleReceiveCompletion(connection, completed);
+        }
+        else {
+            HandleSendCompletion(connection, completed, bytes);
+        }
+    }
+
+    return 0;
+}
+
+bool Reactor_Init(Reactor* reactor, int loopCount) {
+    if (!reactor) {
+        return false;
+    }
+
+    ZeroMemory(reactor, sizeof(*reactor));
+
+    if (loopCount <= 0) {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        loopCount = (int)info.dwNumberOfProcessors;
+    }
+    if (loopCount > REACTOR_MAX_LOOPS) {
+        loopCount = REACTOR_MAX_LOOPS;
+    }
+
+    reactor->mutex = CreateMutex(NULL, FALSE, NULL);
+    if (reactor->mutex == NULL) {
+        return false;
+    }
+
+    for (int i = 0; i < loopCount; i++) {
+        reactor->ports[i] = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+        if (reactor->ports[i] == NULL) {
+            Reactor_Destroy(reactor);
+            return false;
+        }
+
+        unsigned threadId;
+        reactor->threads[i] = (HANDLE)_beginthreadex(NULL, 0, EventLoopThread, reactor->ports[i], 0, &threadId);
+        if (reactor->threads[i] == NULL) {
+            CloseHandle(reactor->ports[i]);
+            reactor->ports[i] = NULL;
+            Reactor_Destroy(reactor);
+            return false;
+        }
+        reactor->loopCount = i + 1;
+    }
+
+    LogMessage(LOG_INFO, "Reactor started with %d event loops", reactor->loopCount);
+    return true;
+}
+
+void Reactor_Destroy(Reactor* reactor) {
+    if (!reactor || reactor->mutex == NULL) {
+        return;
+    }
+
+    // Let every loop run its close handlers before the loops stop
+    WaitForSingleObject(reactor->mutex, INFINITE);
+    for (ReactorConnection* connection = reactor->connections; connection; connection = connection->next) {
+        Reactor_Close(connection);
+    }
+    ReleaseMutex(reactor->mutex);
+
+    DWORD waited = 0;
+    while (reactor->connectionCount > 0 && waited < REACTOR_SHUTDOWN_TIMEOUT) {
+        Sleep(10);
+        waited += 10;
+    }
+    if (reactor->connectionCount > 0) {
+        LogMessage(LOG_WARNING, "Reactor stopping with %ld connections still open", reactor->connectionCount);
+    }
+
+    for (int i = 0; i < reactor->loopCount; i++) {
+        PostQueuedCompletionStatus(reactor->ports[i], 0, REACTOR_QUIT_KEY, NULL);
+    }
+
+    for (int i = 0; i < reactor->loopCount; i++) {
+        WaitForSingleObject(reactor->threads[i], INFINITE);
+        CloseHandle(reactor->threads[i]);
+        CloseHandle(reactor->ports[i]);
+        reactor->threads[i] = NULL;
+        reactor->ports[i] = NULL;
+    }
+    reactor->loopCount = 0;
+
+    CloseHandle(reactor->mutex);
+    reactor->mutex = NULL;
+}
+
+bool Reactor_SetNonBlocking(SOCKET sock) {
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+}
+
+bool Reactor_Add(Reactor* reactor, SOCKET sock, ReactorReadHandler onReadable,
+    ReactorCloseHandler onClose, ReactorWriteHandler onWritten, void* context) {
+    if (!reactor || reactor->loopCount == 0 || sock == INVALID_SOCKET || !onReadable || !onClose) {
+        return false;
+    }
+
+    ReactorConnection* connection = (ReactorConnection*)calloc(1, sizeof(ReactorConnection));
+    if (!connection) {
+        return false;
+    }
+
+    connection->socket = sock;
+    connection->reactor = reactor;
+    connection->loop = (int)((unsigned long)InterlockedIncrement(&reactor->nextLoop) % (unsigned long)reactor->loopCount);
+    connection->onReadable = onReadable;
+    connection->onClose = onClose;
+    connection->onWritten = onWritten;
+    connection->context = context;
+    connection->pendingOperations = 1;  // The receive armed below
+
+    if (CreateIoCompletionPort((HANDLE)sock, reactor->ports[connection->loop], (ULONG_PTR)connection, 0) == NULL) {
+        LogMessage(LOG_ERROR, "Failed to attach socket to event loop: %lu", GetLastError());
+        free(connection);
+        return false;
+    }
+
+    LinkConnection(reactor, connection);
+
+    if (!ArmReceive(connection)) {
+        UnlinkConnection(reactor, connection);
+        InterlockedDecrement(&reactor->connectionCount);
+        free(connection);
+        return false;
+    }
+
+    return true;
+}
+
+// Report a send that never started through the owning loop like any other completion
+static void PostFailedSend(ReactorConnection* connection) {
+    connection->writeLength = 1;
+    PostQueuedCompletionStatus(connection->reactor->ports[connection->loop], 0, (ULONG_PTR)connection,
+        &connection->writeOverlapped);
+}
+
+bool Reactor_Send(ReactorConnection* connection, const char* data, size_t length) {
+    if (!connection) {
+        return false;
+    }
+
+    // Take the operation before looking at the close flag so the loop cannot free the
+    // connection underneath us; if we lost the race, hand the operation back via the loop
+    InterlockedIncrement(&connection->pendingOperations);
+    if (connection->closeRequested) {
+        PostFailedSend(connection);
+        return false;
+    }
+
+    WSABUF buffer;
+    buffer.buf = (char*)data;
+    buffer.len = (ULONG)length;
+
+    connection->writeLength = (DWORD)length;
+    ZeroMemory(&connection->writeOverlapped, sizeof(connection->writeOverlapped));
+
+    if (WSASend(connection->socket, &buffer, 1, NULL, 0, &connection->writeOverlapped, NULL) == SOCKET_ERROR &&
+        WSAGetLastError() != WSA_IO_PENDING) {
+        PostFailedSend(connection);
+        return true;
+    }
+
+    // A close that ran between the flag check and WSASend may have missed this send
+    if (connection->closeRequested) {
+        CancelIoEx((HANDLE)connection->socket, &connection->writeOverlapped);
+    }
+    return true;
+}
+
+void Reactor_Pause(ReactorConnection* connection) {
+    InterlockedExchange(&connection->readState, REACTOR_READ_PAUSING);
+}
+
+void Reactor_Resume(ReactorConnection* connection) {
+    if (!connection) {
+        return;
+    }
+
+    for (;;) {
+        LONG readState = connection->readState;
+        if (readState == REACTOR_READ_PARKED) {
+            if (InterlockedCompareExchange(&connection->readState, REACTOR_READ_ACTIVE, REACTOR_READ_PARKED) == readState) {
+                PostWakeup(connection);
+                return;
+            }
+        }
+        else if (readState == REACTOR_READ_PAUSING) {
+            if (InterlockedCompareExchange(&connection->readState, REACTOR_READ_RESUMED, REACTOR_READ_PAUSING) == readState) {
+                return;
+            }
+        }
+        else {
+            return;
+        }
+    }
+}
+
+void Reactor_Close(ReactorConnection* connection) {
+    if (!connection) {
+        return;
+    }
+
+    // Cancelling the pending receive makes the owning loop close the connection
+    if (InterlockedExchange(&connection->closeRequested, 1) == 0) {
+        CancelIoEx((HANDLE)connection->socket, &connection->overlapped);
+
+        // A parked connection has no receive to cancel; wake it so the loop sees the close
+        if (InterlockedCompareExchange(&connection->readState, REACTOR_READ_ACTIVE, REACTOR_READ_PARKED) == REACTOR_READ_PARKED) {
+            PostWakeup(connection);
+        }
+    }
+}
+
+long Reactor_ConnectionCount(const Reactor* reactor) {
+    return reactor ? reactor->connectionCount : 0;
+}
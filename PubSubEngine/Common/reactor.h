@@ -0,0 +1,104 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <WinSock2.h>
+#include <windows.h>
+#include <stdbool.h>
+
+// Upper bound on event loop threads; 0 passed to Reactor_Init means one per processor
+#define REACTOR_MAX_LOOPS 64
+
+// How long Reactor_Destroy waits for open connections to finish closing
+#define REACTOR_SHUTDOWN_TIMEOUT 5000
+
+typedef struct ReactorConnection ReactorConnection;
+
+// Called on the owning loop thread when the socket is readable or the peer closed it.
+// The socket is non-blocking: read until WSAEWOULDBLOCK (or a per-wakeup limit) and
+// return true to keep the connection, false to close it. After Reactor_Resume it is
+// also called with nothing new to read, so it can finish what it left buffered.
+typedef bool (*ReactorReadHandler)(ReactorConnection* connection);
+
+// Called exactly once on the owning loop thread after the connection stopped receiving
+// and every send has completed. No handler runs after it and the socket is closed right
+// after, so remove the connection from anything other threads can reach and free the
+// per-connection context here.
+typedef void (*ReactorCloseHandler)(ReactorConnection* connection);
+
+// Called on the owning loop thread when a Reactor_Send finished; sent is false if it failed,
+// in which case the connection is already being closed
+typedef void (*ReactorWriteHandler)(ReactorConnection* connection, bool sent);
+
+// Structure to represent one socket owned by an event loop
+struct ReactorConnection {
+    WSAOVERLAPPED overlapped;      // Zero-byte receive used as the readiness notification
+    WSAOVERLAPPED writeOverlapped; // The one Reactor_Send allowed in flight
+    DWORD writeLength;
+    SOCKET socket;                 // Owned by the reactor, closed after the last operation
+    struct Reactor* reactor;
+    int loop;                      // Index of the event loop that owns the connection
+    volatile LONG closeRequested;  // Set by Reactor_Close from any thread
+    volatile LONG pendingOperations; // Armed receive plus in-flight send
+    volatile LONG readState;       // Whether reads are running, paused by the handler or parked
+    bool closed;                   // onClose has run (owning loop only)
+    ReactorReadHandler onReadable;
+    ReactorCloseHandler onClose;
+    ReactorWriteHandler onWritten;
+    void* context;                 // Caller state passed to Reactor_Add
+    ReactorConnection* previous;   // Links in the reactor's connection list
+    ReactorConnection* next;
+};
+
+// A fixed pool of event loop threads, each with its own completion port.
+// Readiness is signalled with a zero-byte overlapped receive, so an idle connection
+// pins no receive buffer and no thread: memory stays flat as connections grow.
+typedef struct Reactor {
+    HANDLE ports[REACTOR_MAX_LOOPS];
+    HANDLE threads[REACTOR_MAX_LOOPS];
+    int loopCount;
+    volatile LONG nextLoop;         // Round-robin cursor for new connections
+    volatile LONG connectionCount;
+    ReactorConnection* connections; // All live connections, guarded by mutex
+    HANDLE mutex;
+} Reactor;
+
+// Start loopCount event loop threads (0 = one per processor)
+bool Reactor_Init(Reactor* reactor, int loopCount);
+
+// Close every connection, wait for their close handlers and stop the loops
+void Reactor_Destroy(Reactor* reactor);
+
+// Switch a socket to non-blocking mode
+bool Reactor_SetNonBlocking(SOCKET sock);
+
+// Hand a connected, non-blocking socket to the next event loop
+// context is available to the handlers as connection->context; onWritten may be NULL
+// when the caller never uses Reactor_Send. The connection may be serviced (and even
+// closed) before this returns, so do not touch it afterwards.
+// Returns false on failure, in which case the caller still owns the socket and context
+bool Reactor_Add(Reactor* reactor, SOCKET sock, ReactorReadHandler onReadable,
+    ReactorCloseHandler onClose, ReactorWriteHandler onWritten, void* context);
+
+// Start an overlapped send of data, which must stay valid until onWritten runs.
+// Only one send may be in flight per connection. Call it from the connection's own
+// handlers or while holding the lock onClose takes, so the connection is known to be open.
+// Returns false if the connection is closing (onWritten then runs with sent = false)
+bool Reactor_Send(ReactorConnection* connection, const char* data, size_t length);
+
+// Stop reading a connection once the current read handler returns; call it only from that handler.
+// The connection stays open and sends keep completing, but the handler is not called again until
+// Reactor_Resume, so whatever it has decoded but not yet handled waits in its own buffer.
+void Reactor_Pause(ReactorConnection* connection);
+
+// Start reading a paused connection again, first calling its read handler so it can drain what
+// it kept; safe from any thread under the same rules as Reactor_Close (a no-op if not paused)
+void Reactor_Resume(ReactorConnection* connection);
+
+// Ask the owning loop to close a connection; safe to call from any thread as long as
+// the caller knows the close handler has not run yet (e.g. it holds the lock onClose takes)
+void Reactor_Close(ReactorConnection* connection);
+
+// Get the number of connections currently owned by the reactor
+long Reactor_ConnectionCount(const Reactor* reactor);
+
+#endif // REACTOR_H
@@ -0,0 +1,315 @@
+#ifndef RING_H
+#define RING_H
+
+// Bounded lock-free rings of pointers for handing work between threads:
+//   SpscRing - one producer thread, one consumer thread
+//   MpscRing - any number of producer threads, one consumer thread
+// The Try functions never block and move as many items as fit. The Wait functions spin,
+// then yield, then park on WaitOnAddress, so an idle consumer costs no CPU while a busy
+// pipeline never enters the kernel. Capacities are rounded up to a power of two.
+
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#pragma comment(lib, "Synchronization.lib")
+
+#define RING_CACHE_LINE 64
+#define RING_SPIN_LIMIT 128   // Busy polls before yielding the processor
+#define RING_YIELD_LIMIT 16   // SwitchToThread polls before parking
+
+// Where a blocked producer or consumer parks. Every successful push or pop bumps epoch
+// only when someone is parked, so the uncontended path is a single read.
+typedef struct {
+    volatile LONG epoch;
+    volatile LONG parked;
+    char padding[RING_CACHE_LINE - 2 * sizeof(LONG)];
+} RingWaiter;
+
+typedef struct {
+    void* volatile* slots;
+    LONG64 mask;
+    char padding0[RING_CACHE_LINE - sizeof(void*) - sizeof(LONG64)];
+    volatile LONG64 head;    // Next slot to read (consumer only)
+    LONG64 cachedTail;       // Consumer's last look at tail
+    char padding1[RING_CACHE_LINE - 2 * sizeof(LONG64)];
+    volatile LONG64 tail;    // Next slot to write (producer only)
+    LONG64 cachedHead;       // Producer's last look at head
+    char padding2[RING_CACHE_LINE - 2 * sizeof(LONG64)];
+    RingWaiter notEmpty;     // The consumer parks here
+    RingWaiter notFull;      // The producer parks here
+} SpscRing;
+
+// One MPSC slot; sequence is position + 1 once the value for that position is published
+typedef struct {
+    volatile LONG64 sequence;
+    void* volatile value;
+} RingCell;
+
+typedef struct {
+    RingCell* cells;
+    LONG64 mask;
+    char padding0[RING_CACHE_LINE - sizeof(void*) - sizeof(LONG64)];
+    volatile LONG64 tail;    // Next position producers claim
+    char padding1[RING_CACHE_LINE - sizeof(LONG64)];
+    volatile LONG64 head;    // Next position the consumer reads (consumer only)
+    char padding2[RING_CACHE_LINE - sizeof(LONG64)];
+    RingWaiter notEmpty;     // The consumer parks here
+    RingWaiter notFull;      // Producers park here
+} MpscRing;
+
+// A non-blocking push or pop used by Ring_Wait
+typedef size_t (*RingAttempt)(void* ring, void** items, size_t count);
+
+static inline LONG64 Ring_Capacity(size_t requested) {
+    LONG64 capacity = 2;
+    while ((size_t)capacity < requested) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+// Wake whoever is parked on waiter; callers publish with an interlocked operation first,
+// which orders the publish before the read of parked
+static inline void RingWaiter_Wake(RingWaiter* waiter) {
+    if (waiter->parked > 0) {
+        InterlockedIncrement(&waiter->epoch);
+        WakeByAddressAll((void*)&waiter->epoch);
+    }
+}
+
+// Retry attempt until it moves at least one item: spin, yield, then park.
+// Returns the items moved, or 0 if timeoutMs (INFINITE to never give up) ran out.
+static inline size_t Ring_Wait(RingWaiter* waiter, RingAttempt attempt, void* ring, void** items, size_t count,
+    DWORD timeoutMs) {
+    size_t moved;
+    for (int i = 0; i < RING_SPIN_LIMIT; i++) {
+        if ((moved = attempt(ring, items, count)) > 0) {
+            return moved;
+        }
+        YieldProcessor();
+    }
+    for (int i = 0; i < RING_YIELD_LIMIT; i++) {
+        if ((moved = attempt(ring, items, count)) > 0) {
+            return moved;
+        }
+        SwitchToThread();
+    }
+
+    ULONGLONG deadline = timeoutMs == INFINITE ? 0 : GetTickCount64() + timeoutMs;
+    for (;;) {
+        // Register before the last attempt: the other side either sees this thread
+        // parked and bumps epoch, or this attempt sees what it published
+        LONG epoch = waiter->epoch;
+        InterlockedIncrement(&waiter->parked);
+        moved = attempt(ring, items, count);
+        if (moved == 0) {
+            DWORD wait = INFINITE;
+            if (timeoutMs != INFINITE) {
+                ULONGLONG now = GetTickCount64();
+                wait = now < deadline ? (DWORD)(deadline - now) : 0;
+            }
+            if (wait > 0) {
+                WaitOnAddress(&waiter->epoch, &epoch, sizeof(epoch), wait);
+            }
+            else {
+                InterlockedDecrement(&waiter->parked);
+                return 0;
+            }
+        }
+        InterlockedDecrement(&waiter->parked);
+        if (moved > 0) {
+            return moved;
+        }
+    }
+}
+
+static inline bool SpscRing_Init(SpscRing* ring, size_t capacity) {
+    ZeroMemory(ring, sizeof(*ring));
+    LONG64 size = Ring_Capacity(capacity);
+    ring->slots = (void* volatile*)calloc((size_t)size, sizeof(void*));
+    if (!ring->slots) {
+        return false;
+    }
+    ring->mask = size - 1;
+    return true;
+}
+
+static inline void SpscRing_Destroy(SpscRing* ring) {
+    free((void*)ring->slots);
+    ring->slots = NULL;
+}
+
+// Push up to count items; returns how many fit
+static inline size_t SpscRing_TryPushBatch(SpscRing* ring, void* const* items, size_t count) {
+    LONG64 tail = ring->tail;
+    LONG64 capacity = ring->mask + 1;
+    if (capacity - (tail - ring->cachedHead) < (LONG64)count) {
+        ring->cachedHead = ring->head;
+    }
+
+    LONG64 space = capacity - (tail - ring->cachedHead);
+    size_t pushed = (LONG64)count < space ? count : (size_t)space;
+    if (pushed == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < pushed; i++) {
+        ring->slots[(tail + (LONG64)i) & ring->mask] = items[i];
+    }
+    InterlockedExchange64(&ring->tail, tail + (LONG64)pushed);
+    RingWaiter_Wake(&ring->notEmpty);
+    return pushed;
+}
+
+// Pop up to max items in order; returns how many were ready
+static inline size_t SpscRing_TryPopBatch(SpscRing* ring, void** items, size_t max) {
+    LONG64 head = ring->head;
+    if (ring->cachedTail - head < (LONG64)max) {
+        ring->cachedTail = ring->tail;
+    }
+
+    LONG64 ready = ring->cachedTail - head;
+    size_t popped = (LONG64)max < ready ? max : (size_t)ready;
+    if (popped == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < popped; i++) {
+        items[i] = ring->slots[(head + (LONG64)i) & ring->mask];
+    }
+    InterlockedExchange64(&ring->head, head + (LONG64)popped);
+    RingWaiter_Wake(&ring->notFull);
+    return popped;
+}
+
+static inline size_t SpscRing_PushAttempt(void* ring, void** items, size_t count) {
+    return SpscRing_TryPushBatch((SpscRing*)ring, items, count);
+}
+
+static inline size_t SpscRing_PopAttempt(void* ring, void** items, size_t max) {
+    return SpscRing_TryPopBatch((SpscRing*)ring, items, max);
+}
+
+// Push every item, waiting while the ring is full
+static inline void SpscRing_PushBatch(SpscRing* ring, void* const* items, size_t count) {
+    while (count > 0) {
+        size_t pushed = Ring_Wait(&ring->notFull, SpscRing_PushAttempt, ring, (void**)items, count, INFINITE);
+        items += pushed;
+        count -= pushed;
+    }
+}
+
+static inline void SpscRing_Push(SpscRing* ring, void* item) {
+    SpscRing_PushBatch(ring, &item, 1);
+}
+
+// Pop between 1 and max items, waiting up to timeoutMs; returns 0 on timeout
+static inline size_t SpscRing_PopBatch(SpscRing* ring, void** items, size_t max, DWORD timeoutMs) {
+    return Ring_Wait(&ring->notEmpty, SpscRing_PopAttempt, ring, items, max, timeoutMs);
+}
+
+// Items queued; exact on the consumer thread, a snapshot elsewhere
+static inline size_t SpscRing_Count(const SpscRing* ring) {
+    return (size_t)(ring->tail - ring->head);
+}
+
+static inline bool MpscRing_Init(MpscRing* ring, size_t capacity) {
+    ZeroMemory(ring, sizeof(*ring));
+    LONG64 size = Ring_Capacity(capacity);
+    ring->cells = (RingCell*)calloc((size_t)size, sizeof(RingCell));
+    if (!ring->cells) {
+        return false;
+    }
+    ring->mask = size - 1;
+    return true;
+}
+
+static inline void MpscRing_Destroy(MpscRing* ring) {
+    free(ring->cells);
+    ring->cells = NULL;
+}
+
+// Push up to count items as one contiguous run; returns how many fit
+static inline size_t MpscRing_TryPushBatch(MpscRing* ring, void* const* items, size_t count) {
+    LONG64 capacity = ring->mask + 1;
+
+    for (;;) {
+        // head only moves forward after the consumer is done with a cell, so every
+        // position below head + capacity is free to reuse
+        LONG64 position = ring->tail;
+        LONG64 space = capacity - (position - ring->head);
+        if (space <= 0 || count == 0) {
+            return 0;
+        }
+
+        size_t claimed = (LONG64)count < space ? count : (size_t)space;
+        if (InterlockedCompareExchange64(&ring->tail, position + (LONG64)claimed, position) != position) {
+            continue;  // Another producer claimed first; retry from the new tail
+        }
+
+        for (size_t i = 0; i < claimed; i++) {
+            RingCell* cell = &ring->cells[(position + (LONG64)i) & ring->mask];
+            cell->value = items[i];
+            InterlockedExchange64(&cell->sequence, position + (LONG64)i + 1);
+        }
+        RingWaiter_Wake(&ring->notEmpty);
+        return claimed;
+    }
+}
+
+// Pop up to max items in order; stops at the first position still being written
+static inline size_t MpscRing_TryPopBatch(MpscRing* ring, void** items, size_t max) {
+    LONG64 head = ring->head;
+    size_t popped = 0;
+
+    while (popped < max) {
+        RingCell* cell = &ring->cells[(head + (LONG64)popped) & ring->mask];
+        if (cell->sequence != head + (LONG64)popped + 1) {
+            break;
+        }
+        items[popped++] = cell->value;
+    }
+
+    if (popped > 0) {
+        InterlockedExchange64(&ring->head, head + (LONG64)popped);
+        RingWaiter_Wake(&ring->notFull);
+    }
+    return popped;
+}
+
+static inline size_t MpscRing_PushAttempt(void* ring, void** items, size_t count) {
+    return MpscRing_TryPushBatch((MpscRing*)ring, items, count);
+}
+
+static inline size_t MpscRing_PopAttempt(void* ring, void** items, size_t max) {
+    return MpscRing_TryPopBatch((MpscRing*)ring, items, max);
+}
+
+// Push every item, waiting while the ring is full; items from one call may interleave
+// with other producers' items when the ring is nearly full
+static inline void MpscRing_PushBatch(MpscRing* ring, void* const* items, size_t count) {
+    while (count > 0) {
+        size_t pushed = Ring_Wait(&ring->notFull, MpscRing_PushAttempt, ring, (void**)items, count, INFINITE);
+        items += pushed;
+        count -= pushed;
+    }
+}
+
+static inline void MpscRing_Push(MpscRing* ring, void* item) {
+    MpscRing_PushBatch(ring, &item, 1);
+}
+
+// Pop between 1 and max items, waiting up to timeoutMs; returns 0 on timeout
+static inline size_t MpscRing_PopBatch(MpscRing* ring, void** items, size_t max, DWORD timeoutMs) {
+    return Ring_Wait(&ring->notEmpty, MpscRing_PopAttempt, ring, items, max, timeoutMs);
+}
+
+// Items claimed by producers and not yet popped; a snapshot
+static inline size_t MpscRing_Count(const MpscRing* ring) {
+    LONG64 count = ring->tail - ring->head;
+    return count > 0 ? (size_t)count : 0;
+}
+
+#endif // RING_H
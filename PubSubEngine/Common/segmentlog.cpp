@@ -0,0 +1,479 @@
+#include "pch.h"
+#include "segmentlog.h"
+#include "frame.h"
+#include "logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEGMENTLOG_INITIAL_SEGMENTS 16
+
+static void BuildSegmentPath(const char* directory, unsigned long long baseOffset, char* path, size_t size) {
+    snprintf(path, size, "%s\\%0*llu%s", directory, SEGMENTLOG_NAME_DIGITS, baseOffset, SEGMENTLOG_EXTENSION);
+}
+
+// Parse "<20 digits>.log"; anything else in the directory is ignored
+static bool ParseSegmentName(const char* name, unsigned long long* baseOffset) {
+    if (strlen(name) != SEGMENTLOG_NAME_DIGITS + strlen(SEGMENTLOG_EXTENSION) ||
+        strcmp(name + SEGMENTLOG_NAME_DIGITS, SEGMENTLOG_EXTENSION) != 0) {
+        return false;
+    }
+
+    unsigned long long value = 0;
+    for (int i = 0; i < SEGMENTLOG_NAME_DIGITS; i++) {
+        if (name[i] < '0' || name[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (unsigned long long)(name[i] - '0');
+    }
+
+    *baseOffset = value;
+    return true;
+}
+
+static int CompareSegments(const void* left, const void* right) {
+    unsigned long long a = ((const SegmentInfo*)left)->baseOffset;
+    unsigned long long b = ((const SegmentInfo*)right)->baseOffset;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static bool AddSegment(SegmentLog* log, unsigned long long baseOffset, unsigned long long size) {
+    if (log->segmentCount == log->segmentCapacity) {
+        size_t newCapacity = log->segmentCapacity ? log->segmentCapacity * 2 : SEGMENTLOG_INITIAL_SEGMENTS;
+        SegmentInfo* grown = (SegmentInfo*)realloc(log->segments, newCapacity * sizeof(SegmentInfo));
+        if (!grown) {
+            return false;
+        }
+        log->segments = grown;
+        log->segmentCapacity = newCapacity;
+    }
+
+    log->segments[log->segmentCount].baseOffset = baseOffset;
+    log->segments[log->segmentCount].size = size;
+    log->segmentCount++;
+    return true;
+}
+
+// Open a segment for appending, positioned at validSize (anything after it is cut off)
+static HANDLE OpenActiveSegment(const SegmentLog* log, unsigned long long baseOffset, unsigned long long validSize) {
+    char path[MAX_PATH];
+    BuildSegmentPath(log->directory, baseOffset, path, sizeof(path));
+
+    HANDLE file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        LogMessage(LOG_ERROR, "Failed to open segment %s: %lu", path, GetLastError());
+        return INVALID_HANDLE_VALUE;
+    }
+
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)validSize;
+    if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN) || !SetEndOfFile(file)) {
+        LogMessage(LOG_ERROR, "Failed to position segment %s: %lu", path, GetLastError());
+        CloseHandle(file);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    return file;
+}
+
+// Decode the records of one segment file from start (relative to the segment), stopping at the
+// first incomplete or corrupt one. validSize receives the end of the intact part; stopped is set
+// if the visitor ended the scan
+static bool ScanSegmentFile(const SegmentLog* log, const SegmentInfo* segment, unsigned long long start,
+    SegmentLogVisitor visitor, void* context, unsigned long long* validSize, bool* stopped) {
+    char path[MAX_PATH];
+    BuildSegmentPath(log->directory, segment->baseOffset, path, sizeof(path));
+
+    *validSize = start;
+    *stopped = false;
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        LogMessage(LOG_ERROR, "Failed to read segment %s: %lu", path, GetLastError());
+        return false;
+    }
+
+    LARGE_INTEGER startPosition;
+    startPosition.QuadPart = (LONGLONG)start;
+    if (start > 0 && !SetFilePointerEx(file, startPosition, NULL, FILE_BEGIN)) {
+        LogMessage(LOG_ERROR, "Failed to seek segment %s: %lu", path, GetLastError());
+        CloseHandle(file);
+        return false;
+    }
+
+    FrameDecoder decoder;
+    if (!FrameDecoder_Init(&decoder, SEGMENTLOG_READ_CHUNK)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    bool success = true;
+    unsigned long long position = start;
+    while (!*stopped) {
+        Frame frame;
+        int result;
+        while ((result = FrameDecoder_Next(&decoder, &frame)) == 1) {
+            if (visitor && !visitor(segment->baseOffset + position, frame.topic, frame.payload,
+                frame.payloadLength, context)) {
+                *stopped = true;
+                break;
+            }
+            position += Frame_EncodedSize(frame.topicLength, frame.payloadLength);
+        }
+        if (*stopped || result < 0) {
+            break; // A corrupt record makes the rest of the segment unreadable
+        }
+
+        size_t available;
+        char* target = FrameDecoder_WritePtr(&decoder, &available);
+        if (!target) {
+            break;
+        }
+
+        DWORD bytesRead = 0;
+        if (!ReadFile(file, target, (DWORD)(available < SEGMENTLOG_READ_CHUNK ? available : SEGMENTLOG_READ_CHUNK),
+            &bytesRead, NULL)) {
+            LogMessage(LOG_ERROR, "Failed to read segment %s: %lu", path, GetLastError());
+            success = false;
+            break;
+        }
+        if (bytesRead == 0) {
+            break; // End of file; leftover bytes are a torn record
+        }
+        FrameDecoder_Commit(&decoder, bytesRead);
+    }
+
+    *validSize = position;
+    FrameDecoder_Destroy(&decoder);
+    CloseHandle(file);
+    return success;
+}
+
+// Find existing segments in the directory
+static bool LoadSegments(SegmentLog* log) {
+    char pattern[MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*%s", log->directory, SEGMENTLOG_EXTENSION);
+
+    WIN32_FIND_DATAA findData;
+    HANDLE search = FindFirstFileA(pattern, &findData);
+    if (search == INVALID_HANDLE_VALUE) {
+        return GetLastError() == ERROR_FILE_NOT_FOUND;
+    }
+
+    bool success = true;
+    do {
+        unsigned long long baseOffset;
+        if (!ParseSegmentName(findData.cFileName, &baseOffset)) {
+            continue;
+        }
+        unsigned long long size = ((unsigned long long)findData.nFileSizeHigh << 32) | findData.nFileSizeLow;
+        if (!AddSegment(log, baseOffset, size)) {
+            success = false;
+            break;
+        }
+    } while (FindNextFileA(search, &findData));
+
+    FindClose(search);
+
+    if (log->segmentCount > 1) {
+        qsort(log->segments, log->segmentCount, sizeof(SegmentInfo), CompareSegments);
+    }
+    return success;
+}
+
+bool SegmentLog_Open(SegmentLog* log, const char* directory, unsigned long long segmentSize) {
+    if (!log || !directory) {
+        return false;
+    }
+
+    memset(log, 0, sizeof(*log));
+    log->activeFile = INVALID_HANDLE_VALUE;
+    log->segmentSize = segmentSize ? segmentSize : SEGMENTLOG_DEFAULT_SEGMENT_SIZE;
+    strncpy(log->directory, directory, sizeof(log->directory) - 1);
+    log->directory[sizeof(log->directory) - 1] = '\0';
+
+    if (!CreateDirectoryA(log->directory, NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+        LogMessage(LOG_ERROR, "Failed to create log directory %s: %lu", log->directory, GetLastError());
+        return false;
+    }
+
+    log->writeBuffer = (char*)malloc(SEGMENTLOG_WRITE_BUFFER_SIZE);
+    if (!log->writeBuffer || !LoadSegments(log) ||
+        (log->segmentCount == 0 && !AddSegment(log, 0, 0))) {
+        SegmentLog_Close(log);
+        return false;
+    }
+
+    // Only the active segment can end in a torn record: earlier ones were complete when rolled
+    SegmentInfo* active = &log->segments[log->segmentCount - 1];
+    unsigned long long validSize = 0;
+    bool stopped;
+    if (active->size > 0 && !ScanSegmentFile(log, active, 0, NULL, NULL, &validSize, &stopped)) {
+        SegmentLog_Close(log);
+        return false;
+    }
+    if (validSize < active->size) {
+        LogMessage(LOG_WARNING, "Truncating %llu trailing bytes from segment %llu",
+            active->size - validSize, active->baseOffset);
+    }
+    active->size = validSize;
+
+    log->activeFile = OpenActiveSegment(log, active->baseOffset, validSize);
+    if (log->activeFile == INVALID_HANDLE_VALUE) {
+        SegmentLog_Close(log);
+        return false;
+    }
+
+    log->nextOffset = active->baseOffset + active->size;
+    return true;
+}
+
+void SegmentLog_Close(SegmentLog* log) {
+    if (!log) {
+        return;
+    }
+
+    if (log->activeFile != INVALID_HANDLE_VALUE) {
+        SegmentLog_Flush(log);
+        CloseHandle(log->activeFile);
+        log->activeFile = INVALID_HANDLE_VALUE;
+    }
+
+    free(log->writeBuffer);
+    free(log->segments);
+    log->writeBuffer = NULL;
+    log->segments = NULL;
+    log->segmentCount = 0;
+    log->segmentCapacity = 0;
+    log->bufferUsed = 0;
+}
+
+bool SegmentLog_Flush(SegmentLog* log) {
+    size_t written = 0;
+    while (written < log->bufferUsed) {
+        DWORD chunk = 0;
+        if (!WriteFile(log->activeFile, log->writeBuffer + written, (DWORD)(log->bufferUsed - written), &chunk, NULL)) {
+            LogMessage(LOG_ERROR, "Segment write failed: %lu", GetLastError());
+            break;
+        }
+        written += chunk;
+    }
+
+    // Keep whatever did not make it so a later flush can retry
+    if (written > 0 && written < log->bufferUsed) {
+        memmove(log->writeBuffer, log->writeBuffer + written, log->bufferUsed - written);
+    }
+    log->bufferUsed -= written;
+    return log->bufferUsed == 0;
+}
+
+bool SegmentLog_Sync(SegmentLog* log) {
+    if (!SegmentLog_Flush(log)) {
+        return false;
+    }
+
+    if (!FlushFileBuffers(log->activeFile)) {
+        LogMessage(LOG_ERROR, "Segment sync failed: %lu", GetLastError());
+        return false;
+    }
+    return true;
+}
+
+// Close the active segment and start a new one at the current end of the log
+static bool RollSegment(SegmentLog* log) {
+    if (!SegmentLog_Sync(log)) {
+        return false;
+    }
+
+    HANDLE file = OpenActiveSegment(log, log->nextOffset, 0);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    if (!AddSegment(log, log->nextOffset, 0)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    CloseHandle(log->activeFile);
+    log->activeFile = file;
+    LogMessage(LOG_INFO, "Rolled to new segment at base offset %llu", log->nextOffset);
+    return true;
+}
+
+bool SegmentLog_Append(SegmentLog* log, const char* topic, const char* payload, unsigned long long* offset) {
+    size_t topicLength = strlen(topic);
+    size_t payloadLength = strlen(payload);
+    if (topicLength > FRAME_MAX_TOPIC || payloadLength > FRAME_MAX_PAYLOAD) {
+        return false;
+    }
+
+    size_t recordSize = Frame_EncodedSize(topicLength, payloadLength);
+    SegmentInfo* active = &log->segments[log->segmentCount - 1];
+    if (active->size > 0 && active->size + recordSize > log->segmentSize) {
+        if (!RollSegment(log)) {
+            return false;
+        }
+        active = &log->segments[log->segmentCount - 1];
+    }
+
+    if (log->bufferUsed + recordSize > SEGMENTLOG_WRITE_BUFFER_SIZE && !SegmentLog_Flush(log)) {
+        return false;
+    }
+
+    Frame_Encode(log->writeBuffer + log->bufferUsed, SEGMENTLOG_WRITE_BUFFER_SIZE - log->bufferUsed,
+        FRAME_PUBLISH, 0, topic, topicLength, payload, payloadLength);
+    log->bufferUsed += recordSize;
+
+    if (offset) {
+        *offset = log->nextOffset;
+    }
+    log->nextOffset += recordSize;
+    active->size += recordSize;
+    return true;
+}
+
+bool SegmentLog_Scan(SegmentLog* log, SegmentLogVisitor visitor, void* context) {
+    return SegmentLog_ScanFrom(log, 0, visitor, context);
+}
+
+bool SegmentLog_ScanFrom(SegmentLog* log, unsigned long long startOffset, SegmentLogVisitor visitor, void* context) {
+    if (!SegmentLog_Flush(log)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < log->segmentCount; i++) {
+        const SegmentInfo* segment = &log->segments[i];
+        if (segment->baseOffset + segment->size <= startOffset) {
+            continue;
+        }
+
+        unsigned long long start = startOffset > segment->baseOffset ? startOffset - segment->baseOffset : 0;
+        unsigned long long validSize;
+        bool stopped;
+        if (!ScanSegmentFile(log, segment, start, visitor, context, &validSize, &stopped)) {
+            return false;
+        }
+        if (stopped) {
+            break;
+        }
+    }
+    return true;
+}
+
+const SegmentInfo* SegmentLog_GetSegments(const SegmentLog* log, size_t* count) {
+    *count = log->segmentCount;
+    return log->segments;
+}
+
+bool SegmentReader_Open(SegmentReader* reader, const SegmentLog* log) {
+    memset(reader, 0, sizeof(*reader));
+    reader->file = INVALID_HANDLE_VALUE;
+    strncpy(reader->directory, log->directory, sizeof(reader->directory) - 1);
+
+    reader->segments = (SegmentInfo*)malloc(log->segmentCount * sizeof(SegmentInfo));
+    if (!reader->segments || !FrameDecoder_Init(&reader->decoder, FRAME_DECODER_INITIAL_CAPACITY)) {
+        free(reader->segments);
+        reader->segments = NULL;
+        return false;
+    }
+
+    memcpy(reader->segments, log->segments, log->segmentCount * sizeof(SegmentInfo));
+    reader->segmentCount = log->segmentCount;
+    reader->openSegment = log->segmentCount;
+    return true;
+}
+
+void SegmentReader_Close(SegmentReader* reader) {
+    if (reader->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(reader->file);
+        reader->file = INVALID_HANDLE_VALUE;
+    }
+    FrameDecoder_Destroy(&reader->decoder);
+    free(reader->segments);
+    reader->segments = NULL;
+    reader->segmentCount = 0;
+}
+
+// Find the segment holding offset in the snapshot (binary search over base offsets)
+static size_t FindSegment(const SegmentReader* reader, unsigned long long offset) {
+    size_t low = 0;
+    size_t high = reader->segmentCount;
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (reader->segments[middle].baseOffset <= offset) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Drop whatever a failed read left in the decoder
+static void ResetDecoder(SegmentReader* reader) {
+    reader->decoder.start = 0;
+    reader->decoder.end = 0;
+    reader->decoder.required = 0;
+}
+
+int SegmentReader_Read(SegmentReader* reader, unsigned long long offset, size_t length, Frame* frame) {
+    if (reader->segmentCount == 0 || length > FRAME_MAX_SIZE) {
+        return -1;
+    }
+
+    size_t index = FindSegment(reader, offset);
+    const SegmentInfo* segment = &reader->segments[index];
+    if (offset < segment->baseOffset || offset + length > segment->baseOffset + segment->size) {
+        return -1;
+    }
+
+    if (index != reader->openSegment) {
+        if (reader->file != INVALID_HANDLE_VALUE) {
+            CloseHandle(reader->file);
+        }
+
+        char path[MAX_PATH];
+        BuildSegmentPath(reader->directory, segment->baseOffset, path, sizeof(path));
+        reader->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+        reader->openSegment = reader->file != INVALID_HANDLE_VALUE ? index : reader->segmentCount;
+        if (reader->file == INVALID_HANDLE_VALUE) {
+            LogMessage(LOG_ERROR, "Failed to read segment %s: %lu", path, GetLastError());
+            return -1;
+        }
+    }
+
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)(offset - segment->baseOffset);
+    if (!SetFilePointerEx(reader->file, position, NULL, FILE_BEGIN)) {
+        return -1;
+    }
+
+    // Pull exactly one record into the decoder, which grows as needed
+    size_t remaining = length;
+    while (remaining > 0) {
+        size_t available;
+        char* target = FrameDecoder_WritePtr(&reader->decoder, &available);
+        if (!target) {
+            ResetDecoder(reader);
+            return -1;
+        }
+
+        DWORD bytesRead = 0;
+        DWORD chunk = (DWORD)(available < remaining ? available : remaining);
+        if (!ReadFile(reader->file, target, chunk, &bytesRead, NULL) || bytesRead == 0) {
+            ResetDecoder(reader);
+            return -1;
+        }
+        FrameDecoder_Commit(&reader->decoder, bytesRead);
+        remaining -= bytesRead;
+    }
+
+    if (FrameDecoder_Next(&reader->decoder, frame) != 1 || reader->decoder.start != reader->decoder.end) {
+        ResetDecoder(reader);
+        return -1;
+    }
+    return 1;
+}
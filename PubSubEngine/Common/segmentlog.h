@@ -0,0 +1,98 @@
+#ifndef SEGMENTLOG_H
+#define SEGMENTLOG_H
+
+#include <WinSock2.h>
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame.h"
+
+// Roll over to a new segment once the active one would grow past this size
+#define SEGMENTLOG_DEFAULT_SEGMENT_SIZE (64ULL * 1024 * 1024)
+
+// Appends collect here before reaching the file; must hold at least one FRAME_MAX_SIZE record
+#define SEGMENTLOG_WRITE_BUFFER_SIZE (256 * 1024)
+
+// Read chunk used when scanning segments
+#define SEGMENTLOG_READ_CHUNK (64 * 1024)
+
+// Segment files are named after their base offset: <directory>\<20 digit offset>.log
+#define SEGMENTLOG_NAME_DIGITS 20
+#define SEGMENTLOG_EXTENSION ".log"
+
+// One segment file; offsets are logical byte positions across the whole log
+typedef struct {
+    unsigned long long baseOffset; // Offset of the first record in the segment
+    unsigned long long size;       // Bytes appended so far, including buffered ones
+} SegmentInfo;
+
+// Append-only log of framed records split across fixed-size segment files.
+// Only the last (active) segment is written; it stays open for the lifetime of the log.
+// Segments are forced to disk when they roll, so SegmentLog_Sync only has to cover the active one.
+// Not thread-safe: callers serialize access.
+typedef struct {
+    char directory[MAX_PATH];
+    unsigned long long segmentSize;
+    SegmentInfo* segments;      // Sorted by base offset, last one active
+    size_t segmentCount;
+    size_t segmentCapacity;
+    HANDLE activeFile;
+    char* writeBuffer;
+    size_t bufferUsed;
+    unsigned long long nextOffset; // Offset the next record will get
+} SegmentLog;
+
+// Random access to records of a log, independent of its writer.
+// Works on a snapshot of the segment table, so it can run without the log's lock
+// as long as every record it reads was flushed before the snapshot was taken.
+typedef struct {
+    char directory[MAX_PATH];
+    SegmentInfo* segments;
+    size_t segmentCount;
+    size_t openSegment;   // Index of the segment file is open on (segmentCount = none)
+    HANDLE file;
+    FrameDecoder decoder;
+} SegmentReader;
+
+// Called for each record visited by SegmentLog_Scan; return false to stop the scan
+typedef bool (*SegmentLogVisitor)(unsigned long long offset, const char* topic,
+    const char* payload, size_t payloadLength, void* context);
+
+// Open (or create) the log in directory, recovering existing segments
+// A torn record at the end of the active segment is truncated away.
+// segmentSize 0 selects SEGMENTLOG_DEFAULT_SEGMENT_SIZE
+bool SegmentLog_Open(SegmentLog* log, const char* directory, unsigned long long segmentSize);
+
+// Flush buffered records and close the active segment
+void SegmentLog_Close(SegmentLog* log);
+
+// Append a record; offset (may be NULL) receives its logical offset
+// The record is buffered and reaches the file on the next flush, roll or when the buffer fills
+bool SegmentLog_Append(SegmentLog* log, const char* topic, const char* payload, unsigned long long* offset);
+
+// Write buffered records to the active segment file
+bool SegmentLog_Flush(SegmentLog* log);
+
+// Write buffered records and force the active segment to disk
+bool SegmentLog_Sync(SegmentLog* log);
+
+// Visit every record in offset order, flushing buffered records first
+bool SegmentLog_Scan(SegmentLog* log, SegmentLogVisitor visitor, void* context);
+
+// Visit the records from startOffset (which must be a record boundary) onwards
+bool SegmentLog_ScanFrom(SegmentLog* log, unsigned long long startOffset, SegmentLogVisitor visitor, void* context);
+
+// Get the segment table (valid until the next append)
+const SegmentInfo* SegmentLog_GetSegments(const SegmentLog* log, size_t* count);
+
+// Snapshot the log's segments for reading; call with the log's writer serialized
+bool SegmentReader_Open(SegmentReader* reader, const SegmentLog* log);
+
+// Release the reader's file handle and snapshot
+void SegmentReader_Close(SegmentReader* reader);
+
+// Read the record of length bytes at offset; frame points into the reader until the next read
+// Returns 1 on success, -1 if the record is out of range, unreadable or corrupt
+int SegmentReader_Read(SegmentReader* reader, unsigned long long offset, size_t length, Frame* frame);
+
+#endif // SEGMENTLOG_H
@@ -0,0 +1,192 @@
+#include "pch.h"
+#include "sendqueue.h"
+#include <stdlib.h>
+#include <string.h>
+
+static SharedFrame* CreateFrame(FrameType type, unsigned char flags, const TraceHeader* trace,
+    const char* topic, const char* payload) {
+    size_t topicLength = topic ? strlen(topic) : 0;
+    size_t payloadLength = payload ? strlen(payload) : 0;
+    size_t length = Frame_EncodedSize(topicLength, payloadLength) + (trace ? Trace_EncodedSize(trace) : 0);
+
+    SharedFrame* frame = (SharedFrame*)malloc(sizeof(SharedFrame) + length);
+    if (!frame) {
+        return NULL;
+    }
+
+    frame->references = 1;
+    frame->length = Frame_EncodeTraced(frame->data, length + 1, type, flags, trace, topic, topicLength, payload, payloadLength);
+    if (frame->length == 0) {
+        free(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+SharedFrame* SharedFrame_Create(FrameType type, const char* topic, const char* payload) {
+    return CreateFrame(type, 0, NULL, topic, payload);
+}
+
+SharedFrame* SharedFrame_CreateTraced(FrameType type, const TraceHeader* trace, const char* topic, const char* payload) {
+    return CreateFrame(type, 0, trace, topic, payload);
+}
+
+SharedFrame* SharedFrame_CreateFlagged(FrameType type, unsigned char flags, const char* topic, const char* payload) {
+    return CreateFrame(type, flags, NULL, topic, payload);
+}
+
+void SharedFrame_AddRef(SharedFrame* frame) {
+    InterlockedIncrement(&frame->references);
+}
+
+void SharedFrame_Release(SharedFrame* frame) {
+    if (frame && InterlockedDecrement(&frame->references) == 0) {
+        free(frame);
+    }
+}
+
+bool SendQueue_Init(SendQueue* queue, size_t maxFrames, size_t maxBytes) {
+    if (!queue) {
+        return false;
+    }
+
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->freeEntries = NULL;
+    queue->depth = 0;
+    queue->bytes = 0;
+    queue->maxFrames = maxFrames > 0 ? maxFrames : SENDQUEUE_DEFAULT_MAX_FRAMES;
+    queue->maxBytes = maxBytes > 0 ? maxBytes : SENDQUEUE_DEFAULT_MAX_BYTES;
+    queue->dropped = 0;
+    queue->sending = false;
+    InitializeCriticalSection(&queue->lock);
+    return true;
+}
+
+static void FreeEntries(SendQueueEntry* entry, bool releaseFrames) {
+    while (entry) {
+        SendQueueEntry* next = entry->next;
+        if (releaseFrames) {
+            SharedFrame_Release(entry->frame);
+        }
+        free(entry);
+        entry = next;
+    }
+}
+
+void SendQueue_Destroy(SendQueue* queue) {
+    if (!queue) {
+        return;
+    }
+
+    FreeEntries(queue->head, true);
+    FreeEntries(queue->freeEntries, false);
+
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->freeEntries = NULL;
+    queue->depth = 0;
+    queue->bytes = 0;
+    queue->sending = false;
+    DeleteCriticalSection(&queue->lock);
+}
+
+bool SendQueue_Push(SendQueue* queue, SharedFrame* frame, const char** sendData, size_t* sendLength) {
+    *sendData = NULL;
+    *sendLength = 0;
+
+    EnterCriticalSection(&queue->lock);
+
+    if (queue->depth >= queue->maxFrames || queue->bytes + frame->length > queue->maxBytes) {
+        queue->dropped++;
+        LeaveCriticalSection(&queue->lock);
+        return false;
+    }
+
+    SendQueueEntry* entry = queue->freeEntries;
+    if (entry) {
+        queue->freeEntries = entry->next;
+    }
+    else {
+        entry = (SendQueueEntry*)malloc(sizeof(SendQueueEntry));
+        if (!entry) {
+            queue->dropped++;
+            LeaveCriticalSection(&queue->lock);
+            return false;
+        }
+    }
+
+    SharedFrame_AddRef(frame);
+    entry->frame = frame;
+    entry->next = NULL;
+
+    if (queue->tail) {
+        queue->tail->next = entry;
+    }
+    else {
+        queue->head = entry;
+    }
+    queue->tail = entry;
+    queue->depth++;
+    queue->bytes += frame->length;
+
+    if (!queue->sending) {
+        queue->sending = true;
+        *sendData = queue->head->frame->data;
+        *sendLength = queue->head->frame->length;
+    }
+
+    LeaveCriticalSection(&queue->lock);
+    return true;
+}
+
+bool SendQueue_Complete(SendQueue* queue, const char** sendData, size_t* sendLength) {
+    *sendData = NULL;
+    *sendLength = 0;
+
+    EnterCriticalSection(&queue->lock);
+
+    SharedFrame* done = NULL;
+    SendQueueEntry* entry = queue->head;
+    if (entry) {
+        done = entry->frame;
+        queue->head = entry->next;
+        if (!queue->head) {
+            queue->tail = NULL;
+        }
+        queue->depth--;
+        queue->bytes -= done->length;
+
+        entry->next = queue->freeEntries;
+        queue->freeEntries = entry;
+    }
+
+    bool more = queue->head != NULL;
+    queue->sending = more;
+    if (more) {
+        *sendData = queue->head->frame->data;
+        *sendLength = queue->head->frame->length;
+    }
+
+    LeaveCriticalSection(&queue->lock);
+
+    SharedFrame_Release(done);
+    return more;
+}
+
+bool SendQueue_InFlight(SendQueue* queue, const char** sendData, size_t* sendLength) {
+    EnterCriticalSection(&queue->lock);
+    bool sending = queue->sending && queue->head != NULL;
+    *sendData = sending ? queue->head->frame->data : NULL;
+    *sendLength = sending ? queue->head->frame->length : 0;
+    LeaveCriticalSection(&queue->lock);
+    return sending;
+}
+
+void SendQueue_GetStats(SendQueue* queue, SendQueueStats* stats) {
+    EnterCriticalSection(&queue->lock);
+    stats->depth = queue->depth;
+    stats->bytes = queue->bytes;
+    stats->dropped = queue->dropped;
+    LeaveCriticalSection(&queue->lock);
+}
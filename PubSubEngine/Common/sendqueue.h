@@ -0,0 +1,88 @@
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <WinSock2.h>
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame.h"
+
+// Default bounds for one connection's outbound queue
+#define SENDQUEUE_DEFAULT_MAX_FRAMES 1024
+#define SENDQUEUE_DEFAULT_MAX_BYTES (1024 * 1024)
+
+// An encoded frame that is never modified after creation, so any number of queues can
+// send it; each queue holds a reference and the last release frees it
+typedef struct {
+    volatile LONG references;
+    size_t length;
+    char data[1];  // Encoded frame, allocated inline
+} SharedFrame;
+
+// One queued reference to a shared frame
+typedef struct SendQueueEntry {
+    struct SendQueueEntry* next;
+    SharedFrame* frame;
+} SendQueueEntry;
+
+// Bounded FIFO of encoded frames for one connection with a single writer in flight.
+// Producers push and, when the writer is idle, get the head frame back to start
+// sending; the writer calls SendQueue_Complete after each send to get the next one.
+typedef struct {
+    SendQueueEntry* head;       // Frame currently being sent (when sending is true)
+    SendQueueEntry* tail;
+    SendQueueEntry* freeEntries; // Recycled entries, so steady-state pushes do not allocate
+    size_t depth;               // Frames queued, including the one in flight
+    size_t bytes;               // Encoded bytes queued, including the one in flight
+    size_t maxFrames;
+    size_t maxBytes;
+    unsigned long long dropped; // Frames rejected because the queue was full
+    bool sending;               // A send of the head frame is in flight
+    CRITICAL_SECTION lock;      // Held only for pointer updates, never across a send
+} SendQueue;
+
+// Snapshot of a queue's counters
+typedef struct {
+    size_t depth;
+    size_t bytes;
+    unsigned long long dropped;
+} SendQueueStats;
+
+// Encode a frame once; the caller owns the single reference
+SharedFrame* SharedFrame_Create(FrameType type, const char* topic, const char* payload);
+
+// Encode a frame carrying a trace block once (NULL trace creates a plain frame)
+SharedFrame* SharedFrame_CreateTraced(FrameType type, const TraceHeader* trace, const char* topic, const char* payload);
+
+// Encode a frame with header flags once, e.g. a FRAME_CONFIRM and its outcome
+SharedFrame* SharedFrame_CreateFlagged(FrameType type, unsigned char flags, const char* topic, const char* payload);
+
+// Take another reference
+void SharedFrame_AddRef(SharedFrame* frame);
+
+// Drop a reference, freeing the frame with the last one
+void SharedFrame_Release(SharedFrame* frame);
+
+// Initialize an empty queue; 0 selects the default bound
+bool SendQueue_Init(SendQueue* queue, size_t maxFrames, size_t maxBytes);
+
+// Free every queued frame
+void SendQueue_Destroy(SendQueue* queue);
+
+// Append a shared frame, taking a reference of the queue's own
+// When the writer is idle, *sendData/*sendLength receive the frame to send now (else NULL/0)
+// Returns false and counts a drop when the queue is full
+bool SendQueue_Push(SendQueue* queue, SharedFrame* frame, const char** sendData, size_t* sendLength);
+
+// Release the queue's reference to the frame whose send just finished
+// Returns true with the next frame to send, or false when the queue is drained
+bool SendQueue_Complete(SendQueue* queue, const char** sendData, size_t* sendLength);
+
+// Get the frame whose send is in flight without releasing it
+// Returns false when the writer is idle
+bool SendQueue_InFlight(SendQueue* queue, const char** sendData, size_t* sendLength);
+
+// Read the current depth, byte count and drop count
+void SendQueue_GetStats(SendQueue* queue, SendQueueStats* stats);
+
+#endif // SENDQUEUE_H
@@ -0,0 +1,166 @@
+#include "pch.h"
+#include "spilljournal.h"
+#include "logging.h"
+#include <stdio.h>
+#include <string.h>
+
+static bool SeekTo(HANDLE file, unsigned long long offset) {
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)offset;
+    return SetFilePointerEx(file, position, NULL, FILE_BEGIN) != 0;
+}
+
+// Reads and writes name their offset instead of using the shared file pointer, so the reader
+// can read without the lock while appenders write
+static void PositionAt(OVERLAPPED* position, unsigned long long offset) {
+    ZeroMemory(position, sizeof(*position));
+    position->Offset = (DWORD)offset;
+    position->OffsetHigh = (DWORD)(offset >> 32);
+}
+
+static bool WriteAt(HANDLE file, unsigned long long offset, const void* data, DWORD length) {
+    OVERLAPPED position;
+    PositionAt(&position, offset);
+    DWORD written = 0;
+    return WriteFile(file, data, length, &written, &position) && written == length;
+}
+
+static bool ReadAt(HANDLE file, unsigned long long offset, void* buffer, DWORD length, DWORD* read) {
+    OVERLAPPED position;
+    PositionAt(&position, offset);
+    *read = 0;
+    return ReadFile(file, buffer, length, read, &position) != 0;
+}
+
+bool SpillJournal_Open(SpillJournal* journal, const char* path, unsigned long long limit, size_t tagSize) {
+    if (!journal || !path || tagSize > SPILLJOURNAL_MAX_TAG) {
+        return false;
+    }
+
+    ZeroMemory(journal, sizeof(*journal));
+    snprintf(journal->path, sizeof(journal->path), "%s", path);
+    journal->tagSize = tagSize;
+    journal->limit = limit;
+
+    // Temporary and delete-on-close: the cache manager keeps it in memory while it can
+    journal->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (journal->file == INVALID_HANDLE_VALUE) {
+        LogMessage(LOG_ERROR, "Failed to create spill journal %s: %lu", path, GetLastError());
+        return false;
+    }
+
+    InitializeCriticalSection(&journal->lock);
+    return true;
+}
+
+void SpillJournal_Close(SpillJournal* journal) {
+    if (!journal || journal->file == INVALID_HANDLE_VALUE || journal->file == NULL) {
+        return;
+    }
+
+    if (journal->records > 0) {
+        LogMessage(LOG_WARNING, "Discarding %lld records left in spill journal %s", journal->records, journal->path);
+    }
+    CloseHandle(journal->file);
+    journal->file = INVALID_HANDLE_VALUE;
+    DeleteCriticalSection(&journal->lock);
+}
+
+bool SpillJournal_Append(SpillJournal* journal, const void* tag, const char* data, size_t length) {
+    if (length == 0 || length > FRAME_MAX_SIZE) {
+        return false;
+    }
+
+    unsigned int header = (unsigned int)length;
+    size_t total = SPILLJOURNAL_RECORD_HEADER + journal->tagSize + length;
+
+    // The limit bounds the file itself: consumed records only give their space back once the reader catches up
+    EnterCriticalSection(&journal->lock);
+    if (journal->limit > 0 && journal->writeOffset + total > journal->limit) {
+        LeaveCriticalSection(&journal->lock);
+        return false;
+    }
+
+    unsigned long long offset = journal->writeOffset;
+    bool success = WriteAt(journal->file, offset, &header, SPILLJOURNAL_RECORD_HEADER) &&
+        (journal->tagSize == 0 ||
+            WriteAt(journal->file, offset + SPILLJOURNAL_RECORD_HEADER, tag, (DWORD)journal->tagSize)) &&
+        WriteAt(journal->file, offset + SPILLJOURNAL_RECORD_HEADER + journal->tagSize, data, (DWORD)length);
+    if (success) {
+        journal->writeOffset += total;
+        InterlockedIncrement64(&journal->records);
+    }
+    else {
+        LogMessage(LOG_ERROR, "Failed to append to spill journal %s: %lu", journal->path, GetLastError());
+    }
+    LeaveCriticalSection(&journal->lock);
+    return success;
+}
+
+size_t SpillJournal_Peek(SpillJournal* journal, char* buffer, WSABUF* frames, const char** tags,
+    size_t maxFrames, size_t* bytes) {
+    *bytes = 0;
+    if (journal->records == 0 || maxFrames == 0) {
+        return 0;
+    }
+
+    // Only the reader moves readOffset and appends never touch bytes before writeOffset,
+    // so the read itself runs without the lock and never holds up an appender
+    EnterCriticalSection(&journal->lock);
+    unsigned long long readOffset = journal->readOffset;
+    unsigned long long available = journal->writeOffset - readOffset;
+    LeaveCriticalSection(&journal->lock);
+
+    DWORD wanted = available < SPILLJOURNAL_READ_SIZE ? (DWORD)available : SPILLJOURNAL_READ_SIZE;
+    DWORD read = 0;
+    bool success = ReadAt(journal->file, readOffset, buffer, wanted, &read);
+
+    if (!success) {
+        LogMessage(LOG_ERROR, "Failed to read spill journal %s: %lu", journal->path, GetLastError());
+        return 0;
+    }
+
+    // Only whole records count; the rest is read again on the next peek
+    size_t count = 0;
+    size_t used = 0;
+    size_t prefix = SPILLJOURNAL_RECORD_HEADER + journal->tagSize;
+    while (count < maxFrames && read - used >= prefix) {
+        unsigned int length;
+        memcpy(&length, buffer + used, SPILLJOURNAL_RECORD_HEADER);
+        if (read - used - prefix < length) {
+            break;
+        }
+
+        if (tags) {
+            tags[count] = buffer + used + SPILLJOURNAL_RECORD_HEADER;
+        }
+        frames[count].buf = buffer + used + prefix;
+        frames[count].len = length;
+        count++;
+        used += prefix + length;
+    }
+
+    *bytes = used;
+    return count;
+}
+
+void SpillJournal_Consume(SpillJournal* journal, size_t frames, size_t bytes) {
+    EnterCriticalSection(&journal->lock);
+    journal->readOffset += bytes;
+    InterlockedExchangeAdd64(&journal->records, -(LONG64)frames);
+
+    // Caught up: start over at the front so the file does not keep growing
+    if (journal->readOffset == journal->writeOffset) {
+        journal->readOffset = 0;
+        journal->writeOffset = 0;
+        if (!SeekTo(journal->file, 0) || !SetEndOfFile(journal->file)) {
+            LogMessage(LOG_WARNING, "Failed to truncate spill journal %s: %lu", journal->path, GetLastError());
+        }
+    }
+    LeaveCriticalSection(&journal->lock);
+}
+
+long long SpillJournal_Count(const SpillJournal* journal) {
+    return journal->records;
+}
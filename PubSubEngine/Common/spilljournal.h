@@ -0,0 +1,59 @@
+#ifndef SPILLJOURNAL_H
+#define SPILLJOURNAL_H
+
+#include <WinSock2.h>
+#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame.h"
+
+// Buffer size for SpillJournal_Peek; holds at least one record of the largest frame
+#define SPILLJOURNAL_READ_SIZE (256 * 1024)
+
+// Prefix in front of every record: the encoded frame's length in host byte order
+#define SPILLJOURNAL_RECORD_HEADER 4
+
+// Largest tag a journal can keep next to each frame
+#define SPILLJOURNAL_MAX_TAG 64
+
+// Overflow file behind an in-memory queue. Encoded frames that do not fit in the queue are
+// appended here and read back in order once the queue drains; the file is emptied whenever
+// the reader catches up and deleted on close, so it never outlives the process.
+// Each record may carry a fixed-size tag that is handed back with its frame.
+// Appenders and the single reader may run on different threads; the reader's file reads
+// happen outside the lock, which only covers the offsets and each append.
+typedef struct {
+    char path[MAX_PATH];
+    HANDLE file;
+    CRITICAL_SECTION lock;
+    size_t tagSize;                  // Bytes of tag stored between each record's header and frame
+    unsigned long long limit;        // Size the file may reach before appends fail, consumed records included
+    unsigned long long writeOffset;  // End of the last appended record
+    unsigned long long readOffset;   // Start of the oldest record not yet consumed
+    volatile LONG64 records;         // Records appended and not yet consumed
+} SpillJournal;
+
+// Create (or truncate) the journal file; limit 0 means no limit, tagSize 0 means untagged records
+bool SpillJournal_Open(SpillJournal* journal, const char* path, unsigned long long limit, size_t tagSize);
+
+// Close and delete the journal file, discarding any records left in it
+void SpillJournal_Close(SpillJournal* journal);
+
+// Append one encoded frame with its tag (tagSize bytes, ignored for untagged journals);
+// returns false if the journal is full or the write failed
+bool SpillJournal_Append(SpillJournal* journal, const void* tag, const char* data, size_t length);
+
+// Read the oldest records into buffer (SPILLJOURNAL_READ_SIZE bytes) without consuming them.
+// frames receives up to maxFrames spans pointing into buffer, tags (may be NULL) each frame's
+// tag and bytes the journal space they take; returns the number of frames, 0 when the journal
+// is empty or unreadable.
+size_t SpillJournal_Peek(SpillJournal* journal, char* buffer, WSABUF* frames, const char** tags,
+    size_t maxFrames, size_t* bytes);
+
+// Drop the records returned by the last SpillJournal_Peek once they have been delivered
+void SpillJournal_Consume(SpillJournal* journal, size_t frames, size_t bytes);
+
+// Get the number of records waiting; a snapshot when called off the reader's thread
+long long SpillJournal_Count(const SpillJournal* journal);
+
+#endif // SPILLJOURNAL_H
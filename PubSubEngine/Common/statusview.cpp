@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "statusview.h"
+#include "logging.h"
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATUS_TEXT_INITIAL_SIZE 4096
+
+static StatusViewConfig config;
+static HANDLE consoleHandle = INVALID_HANDLE_VALUE;
+static HANDLE stopEvent = NULL;
+static HANDLE renderThread = NULL;
+
+// Renderer-thread state
+static char* screen = NULL;        // Frame padded to the window width
+static size_t screenCapacity = 0;
+static SHORT renderedLines = 0;    // Rows written by the previous frame
+
+bool StatusView_IsHeadless(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], STATUSVIEW_HEADLESS_ARGUMENT) == 0) {
+            return true;
+        }
+    }
+
+    const char* headless = getenv(STATUSVIEW_HEADLESS_ENVIRONMENT);
+    return headless != NULL && headless[0] != '\0' && strcmp(headless, "0") != 0;
+}
+
+// Grow the padded frame buffer
+static bool ReserveScreen(size_t size) {
+    if (size <= screenCapacity) {
+        return true;
+    }
+
+    char* grown = (char*)realloc(screen, size);
+    if (!grown) {
+        return false;
+    }
+    screen = grown;
+    screenCapacity = size;
+    return true;
+}
+
+// Overwrite the window in place: every row is padded to the window width, so nothing
+// needs clearing except rows a longer previous frame left below this one
+static void Render(const StatusText* text) {
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (!GetConsoleScreenBufferInfo(consoleHandle, &info)) {
+        return;
+    }
+
+    // The last window row stays empty so the final newline never scrolls the window
+    int width = info.srWindow.Right - info.srWindow.Left + 1;
+    int height = info.srWindow.Bottom - info.srWindow.Top;
+    if (width < 2 || height < 1) {
+        return;
+    }
+
+    size_t rowSize = (size_t)width;  // width - 1 characters and a newline
+    if (!ReserveScreen(rowSize * (size_t)height)) {
+        return;
+    }
+
+    size_t length = 0;
+    SHORT lines = 0;
+    const char* cursor = text->data;
+    const char* end = text->data + text->length;
+    while (cursor < end && lines < height) {
+        const char* newline = (const char*)memchr(cursor, '\n', (size_t)(end - cursor));
+        size_t lineLength = (size_t)((newline ? newline : end) - cursor);
+        size_t visible = lineLength < rowSize - 1 ? lineLength : rowSize - 1;
+
+        memcpy(screen + length, cursor, visible);
+        memset(screen + length + visible, ' ', rowSize - 1 - visible);
+        screen[length + rowSize - 1] = '\n';
+        length += rowSize;
+        lines++;
+
+        cursor = newline ? newline + 1 : end;
+    }
+
+    COORD home = { 0, info.srWindow.Top };
+    DWORD count;
+    SetConsoleCursorPosition(consoleHandle, home);
+    WriteConsoleA(consoleHandle, screen, (DWORD)length, &count, NULL);
+
+    if (renderedLines > lines) {
+        COORD below = { 0, (SHORT)(info.srWindow.Top + lines) };
+        FillConsoleOutputCharacterA(consoleHandle, ' ', (DWORD)width * (renderedLines - lines), below, &count);
+    }
+    renderedLines = lines;
+}
+
+static unsigned __stdcall RenderThread(void* param) {
+    (void)param;
+    StatusText text;
+    if (!TextBuffer_Init(&text, STATUS_TEXT_INITIAL_SIZE)) {
+        LogMessage(LOG_ERROR, "Failed to allocate the status view");
+        return 1;
+    }
+
+    do {
+        TextBuffer_Reset(&text);
+        config.builder(&text, config.builderContext);
+        if (!text.failed) {
+            Render(&text);
+        }
+    } while (WaitForSingleObject(stopEvent, config.intervalMs) == WAIT_TIMEOUT);
+
+    free(text.data);
+    return 0;
+}
+
+bool StatusView_Start(const StatusViewConfig* viewConfig) {
+    if (stopEvent != NULL || !viewConfig || !viewConfig->builder) {
+        return false;
+    }
+
+    config = *viewConfig;
+    if (config.intervalMs == 0) {
+        const char* interval = getenv(STATUSVIEW_INTERVAL_ENVIRONMENT);
+        config.intervalMs = interval && atoi(interval) > 0 ? (unsigned int)atoi(interval) : STATUSVIEW_DEFAULT_INTERVAL;
+    }
+
+    consoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (consoleHandle == INVALID_HANDLE_VALUE || consoleHandle == NULL) {
+        LogMessage(LOG_ERROR, "Failed to get console handle");
+        return false;
+    }
+
+    stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (stopEvent == NULL) {
+        LogMessage(LOG_ERROR, "Failed to create status view stop event");
+        return false;
+    }
+
+    unsigned threadId;
+    renderThread = (HANDLE)_beginthreadex(NULL, 0, RenderThread, NULL, 0, &threadId);
+    if (renderThread == NULL) {
+        LogMessage(LOG_ERROR, "Failed to create status view thread");
+        CloseHandle(stopEvent);
+        stopEvent = NULL;
+        return false;
+    }
+    return true;
+}
+
+void StatusView_Stop(void) {
+    if (stopEvent == NULL) {
+        return;
+    }
+
+    SetEvent(stopEvent);
+    WaitForSingleObject(renderThread, INFINITE);
+    CloseHandle(renderThread);
+    renderThread = NULL;
+    CloseHandle(stopEvent);
+    stopEvent = NULL;
+
+    free(screen);
+    screen = NULL;
+    screenCapacity = 0;
+    renderedLines = 0;
+}
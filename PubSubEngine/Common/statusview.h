@@ -0,0 +1,36 @@
+#ifndef STATUSVIEW_H
+#define STATUSVIEW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "textbuffer.h"
+
+#define STATUSVIEW_DEFAULT_INTERVAL 500           // ms between redraws
+#define STATUSVIEW_INTERVAL_ENVIRONMENT "PUBSUB_STATUS_INTERVAL"
+#define STATUSVIEW_HEADLESS_ENVIRONMENT "PUBSUB_HEADLESS"
+#define STATUSVIEW_HEADLESS_ARGUMENT "--headless"
+#define STATUSVIEW_MAX_LISTED 32                  // Clients a view lists before summarizing the rest
+
+// Text of one status frame, one console row per line
+typedef TextBuffer StatusText;
+
+// Fills in the current status; runs on the renderer thread, never on a connection path
+typedef void (*StatusBuilder)(StatusText* text, void* context);
+
+typedef struct {
+    unsigned int intervalMs;   // 0 selects STATUSVIEW_INTERVAL_ENVIRONMENT or STATUSVIEW_DEFAULT_INTERVAL
+    StatusBuilder builder;
+    void* builderContext;
+} StatusViewConfig;
+
+// Check the command line and environment for headless mode
+bool StatusView_IsHeadless(int argc, char* argv[]);
+
+// Start redrawing the console at a fixed rate
+bool StatusView_Start(const StatusViewConfig* config);
+
+// Stop the renderer; the builder is not called again once this returns
+void StatusView_Stop(void);
+
+#endif // STATUSVIEW_H
@@ -0,0 +1,52 @@
+#include "pch.h"
+#include "textbuffer.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+bool TextBuffer_Init(TextBuffer* text, size_t capacity) {
+    text->capacity = capacity;
+    text->data = (char*)malloc(capacity);
+    if (!text->data) {
+        return false;
+    }
+    TextBuffer_Reset(text);
+    return true;
+}
+
+void TextBuffer_Reset(TextBuffer* text) {
+    text->length = 0;
+    text->failed = false;
+    text->data[0] = '\0';
+}
+
+void TextBuffer_Append(TextBuffer* text, const char* format, ...) {
+    if (text->failed) {
+        return;
+    }
+
+    for (;;) {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(text->data + text->length, text->capacity - text->length, format, args);
+        va_end(args);
+
+        if (written < 0) {
+            text->failed = true;
+            return;
+        }
+        if ((size_t)written < text->capacity - text->length) {
+            text->length += (size_t)written;
+            return;
+        }
+
+        size_t capacity = text->capacity * 2 > text->length + written + 1 ? text->capacity * 2 : text->length + written + 1;
+        char* data = (char*)realloc(text->data, capacity);
+        if (!data) {
+            text->failed = true;
+            return;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+}
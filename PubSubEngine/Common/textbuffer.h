@@ -0,0 +1,24 @@
+#ifndef TEXTBUFFER_H
+#define TEXTBUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Growable text buffer that formatted output is appended to
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool failed;     // Set once an append fails; later appends are ignored
+} TextBuffer;
+
+// Allocate an empty buffer
+bool TextBuffer_Init(TextBuffer* text, size_t capacity);
+
+// Empty the buffer and clear a failure, keeping the allocation
+void TextBuffer_Reset(TextBuffer* text);
+
+// Append formatted text, growing the buffer as needed
+void TextBuffer_Append(TextBuffer* text, const char* format, ...);
+
+#endif // TEXTBUFFER_H
@@ -0,0 +1,77 @@
+#include "pch.h"
+#include "topicfixture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void TopicFixture_MakeTopic(char* buffer, size_t size, size_t index) {
+    snprintf(buffer, size, "sensor/%zu/temperature", index);
+}
+
+bool TopicFixture_IsTopicInList(const char* topic, const char* topicList) {
+    if (!topic || !topicList) return false;
+
+    char* listCopy = _strdup(topicList);
+    char* token = strtok(listCopy, ",");
+
+    while (token != NULL) {
+        if (strcmp(token, topic) == 0) {
+            free(listCopy);
+            return true;
+        }
+        token = strtok(NULL, ",");
+    }
+
+    free(listCopy);
+    return false;
+}
+
+bool TopicFixture_Init(TopicFixture* fixture, size_t topicCount) {
+    char topic[TOPICFIXTURE_NAME_LENGTH];
+    size_t listCapacity = topicCount * sizeof(topic) + 1;
+    size_t listLength = 0;
+
+    fixture->topicCount = topicCount;
+    fixture->topicList = (char*)malloc(listCapacity);
+    fixture->probes = (char(*)[TOPICFIXTURE_NAME_LENGTH])malloc(TOPICFIXTURE_PROBES * sizeof(*fixture->probes));
+    if (!fixture->topicList || !fixture->probes) {
+        free(fixture->topicList);
+        free(fixture->probes);
+        return false;
+    }
+
+    fixture->topicList[0] = '\0';
+    for (size_t i = 0; i < topicCount; i++) {
+        TopicFixture_MakeTopic(topic, sizeof(topic), i);
+        listLength += snprintf(fixture->topicList + listLength, listCapacity - listLength, "%s%s", i ? "," : "", topic);
+    }
+
+    if (!TopicSet_Init(&fixture->set, topicCount)) {
+        free(fixture->topicList);
+        free(fixture->probes);
+        return false;
+    }
+    if (!TopicSet_BuildFromList(&fixture->set, fixture->topicList, ',')) {
+        TopicFixture_Destroy(fixture);
+        return false;
+    }
+
+    // Half the lookups hit, half miss
+    for (size_t i = 0; i < TOPICFIXTURE_PROBES; i++) {
+        if (i % 2 == 0) {
+            TopicFixture_MakeTopic(fixture->probes[i], sizeof(fixture->probes[i]), (i * 7919) % topicCount);
+        }
+        else {
+            snprintf(fixture->probes[i], sizeof(fixture->probes[i]), "missing/%zu", i);
+        }
+    }
+    return true;
+}
+
+void TopicFixture_Destroy(TopicFixture* fixture) {
+    TopicSet_Destroy(&fixture->set);
+    free(fixture->topicList);
+    free(fixture->probes);
+    fixture->topicList = NULL;
+    fixture->probes = NULL;
+}
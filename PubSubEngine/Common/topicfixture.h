@@ -0,0 +1,35 @@
+#ifndef TOPICFIXTURE_H
+#define TOPICFIXTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "topicset.h"
+
+// Number of precomputed lookup names in a fixture
+#define TOPICFIXTURE_PROBES 1024
+
+// Longest generated topic or probe name, including the terminator
+#define TOPICFIXTURE_NAME_LENGTH 64
+
+// Topics shared by the topic matching benchmarks, in both the old and the new representation
+typedef struct {
+    size_t topicCount;
+    char* topicList;                                   // "a,b,c" as the SE used to send it
+    TopicSet set;                                      // The same topics as a set
+    char (*probes)[TOPICFIXTURE_NAME_LENGTH];          // Even entries present, odd ones missing
+} TopicFixture;
+
+// Build "sensor/<i>/temperature" style topics so lengths resemble real ones
+void TopicFixture_MakeTopic(char* buffer, size_t size, size_t index);
+
+// Lookup as the Publisher Engine used to do it: copy the list and strtok through it
+bool TopicFixture_IsTopicInList(const char* topic, const char* topicList);
+
+// Generate topicCount topics as a list and a set, plus the probe names
+bool TopicFixture_Init(TopicFixture* fixture, size_t topicCount);
+
+// Free everything the fixture allocated
+void TopicFixture_Destroy(TopicFixture* fixture);
+
+#endif // TOPICFIXTURE_H
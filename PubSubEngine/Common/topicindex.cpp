@@ -0,0 +1,231 @@
+#include "pch.h"
+#include "topicindex.h"
+#include "topicset.h"
+#include <stdlib.h>
+#include <string.h>
+
+static size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t capacity = TOPICSET_MIN_CAPACITY;
+    while (capacity < value) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+static void FreeEntry(TopicIndexEntry* entry) {
+    free(entry->topic);
+    free(entry->members);
+    entry->topic = NULL;
+    entry->members = NULL;
+    entry->memberCount = 0;
+    entry->memberCapacity = 0;
+}
+
+static TopicIndexEntry* FindEntry(const TopicIndex* index, const char* topic, unsigned int hash) {
+    if (!index->entries) {
+        return NULL;
+    }
+
+    size_t mask = index->capacity - 1;
+    size_t slot = hash & mask;
+
+    for (size_t probes = 0; probes < index->capacity; probes++) {
+        TopicIndexEntry* entry = &index->entries[slot];
+        if (entry->state == TOPICSET_EMPTY) {
+            return NULL;
+        }
+        if (entry->state == TOPICSET_USED && entry->hash == hash && strcmp(entry->topic, topic) == 0) {
+            return entry;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+static bool Rehash(TopicIndex* index, size_t newCapacity) {
+    TopicIndexEntry* newEntries = (TopicIndexEntry*)calloc(newCapacity, sizeof(TopicIndexEntry));
+    if (!newEntries) {
+        return false;
+    }
+
+    size_t mask = newCapacity - 1;
+    for (size_t i = 0; i < index->capacity; i++) {
+        const TopicIndexEntry* entry = &index->entries[i];
+        if (entry->state != TOPICSET_USED) {
+            continue;
+        }
+
+        size_t slot = entry->hash & mask;
+        while (newEntries[slot].state == TOPICSET_USED) {
+            slot = (slot + 1) & mask;
+        }
+        newEntries[slot] = *entry;
+    }
+
+    free(index->entries);
+    index->entries = newEntries;
+    index->capacity = newCapacity;
+    index->tombstones = 0;
+    return true;
+}
+
+// Create the entry for a topic that is not in the index yet
+static TopicIndexEntry* CreateEntry(TopicIndex* index, const char* topic, unsigned int hash) {
+    if ((index->count + index->tombstones + 1) * 10 > index->capacity * 7) {
+        size_t newCapacity = (index->count + 1) * 10 > index->capacity * 5 ? index->capacity * 2 : index->capacity;
+        if (!Rehash(index, newCapacity)) {
+            return NULL;
+        }
+    }
+
+    char* topicCopy = _strdup(topic);
+    int* members = (int*)malloc(TOPICINDEX_INITIAL_MEMBERS * sizeof(int));
+    if (!topicCopy || !members) {
+        free(topicCopy);
+        free(members);
+        return NULL;
+    }
+
+    size_t mask = index->capacity - 1;
+    size_t slot = hash & mask;
+    while (index->entries[slot].state == TOPICSET_USED) {
+        slot = (slot + 1) & mask;
+    }
+
+    TopicIndexEntry* entry = &index->entries[slot];
+    if (entry->state == TOPICSET_DELETED) {
+        index->tombstones--;
+    }
+
+    entry->hash = hash;
+    entry->state = TOPICSET_USED;
+    entry->topic = topicCopy;
+    entry->members = members;
+    entry->memberCount = 0;
+    entry->memberCapacity = TOPICINDEX_INITIAL_MEMBERS;
+    index->count++;
+    return entry;
+}
+
+bool TopicIndex_Init(TopicIndex* index, size_t expectedTopics) {
+    if (!index) {
+        return false;
+    }
+
+    index->capacity = RoundUpToPowerOfTwo(expectedTopics + expectedTopics / 2 + 1);
+    index->entries = (TopicIndexEntry*)calloc(index->capacity, sizeof(TopicIndexEntry));
+    index->count = 0;
+    index->tombstones = 0;
+    return index->entries != NULL;
+}
+
+void TopicIndex_Destroy(TopicIndex* index) {
+    if (!index || !index->entries) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (index->entries[i].state == TOPICSET_USED) {
+            FreeEntry(&index->entries[i]);
+        }
+    }
+    free(index->entries);
+    index->entries = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->tombstones = 0;
+}
+
+int TopicIndex_Add(TopicIndex* index, const char* topic, int member) {
+    if (!index || !index->entries || !topic || *topic == '\0') {
+        return -1;
+    }
+
+    unsigned int hash = TopicSet_Hash(topic, strlen(topic));
+    TopicIndexEntry* entry = FindEntry(index, topic, hash);
+    if (!entry) {
+        entry = CreateEntry(index, topic, hash);
+        if (!entry) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < entry->memberCount; i++) {
+        if (entry->members[i] == member) {
+            return entry->memberCount;
+        }
+    }
+
+    if (entry->memberCount == entry->memberCapacity) {
+        int newCapacity = entry->memberCapacity * 2;
+        int* members = (int*)realloc(entry->members, newCapacity * sizeof(int));
+        if (!members) {
+            return -1;
+        }
+        entry->members = members;
+        entry->memberCapacity = newCapacity;
+    }
+
+    entry->members[entry->memberCount++] = member;
+    return entry->memberCount;
+}
+
+int TopicIndex_Remove(TopicIndex* index, const char* topic, int member) {
+    if (!index || !topic) {
+        return -1;
+    }
+
+    TopicIndexEntry* entry = FindEntry(index, topic, TopicSet_Hash(topic, strlen(topic)));
+    if (!entry) {
+        return -1;
+    }
+
+    for (int i = 0; i < entry->memberCount; i++) {
+        if (entry->members[i] == member) {
+            // Order does not matter, so fill the hole with the last member
+            entry->members[i] = entry->members[--entry->memberCount];
+
+            int remaining = entry->memberCount;
+            if (remaining == 0) {
+                FreeEntry(entry);
+                entry->state = TOPICSET_DELETED;
+                index->count--;
+                index->tombstones++;
+            }
+            return remaining;
+        }
+    }
+    return -1;
+}
+
+const int* TopicIndex_Find(const TopicIndex* index, const char* topic, int* memberCount) {
+    *memberCount = 0;
+    if (!index || !topic) {
+        return NULL;
+    }
+
+    const TopicIndexEntry* entry = FindEntry(index, topic, TopicSet_Hash(topic, strlen(topic)));
+    if (!entry) {
+        return NULL;
+    }
+
+    *memberCount = entry->memberCount;
+    return entry->members;
+}
+
+size_t TopicIndex_Count(const TopicIndex* index) {
+    return index ? index->count : 0;
+}
+
+void TopicIndex_ForEach(const TopicIndex* index, TopicIndexVisitor visitor, void* context) {
+    if (!index || !index->entries || !visitor) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        const TopicIndexEntry* entry = &index->entries[i];
+        if (entry->state == TOPICSET_USED) {
+            visitor(entry->topic, entry->memberCount, context);
+        }
+    }
+}
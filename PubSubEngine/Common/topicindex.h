@@ -0,0 +1,56 @@
+#ifndef TOPICINDEX_H
+#define TOPICINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Initial number of member slots reserved for a new topic
+#define TOPICINDEX_INITIAL_MEMBERS 4
+
+// Structure to represent one topic and the members interested in it
+typedef struct {
+    unsigned int hash;     // Precomputed hash of the topic
+    unsigned char state;   // TOPICSET_EMPTY, TOPICSET_USED or TOPICSET_DELETED
+    char* topic;           // Interned copy of the topic, owned by the index
+    int* members;          // Compact array of member slots
+    int memberCount;
+    int memberCapacity;
+} TopicIndexEntry;
+
+// Open addressing hash map from topic to a compact array of member slots
+// The index is not synchronized; callers guard it with their own lock
+typedef struct {
+    TopicIndexEntry* entries;
+    size_t capacity;     // Always a power of two
+    size_t count;        // Number of topics with at least one member
+    size_t tombstones;
+} TopicIndex;
+
+// Callback used by TopicIndex_ForEach
+typedef void (*TopicIndexVisitor)(const char* topic, int memberCount, void* context);
+
+// Initialize an empty index sized for the expected number of topics
+bool TopicIndex_Init(TopicIndex* index, size_t expectedTopics);
+
+// Free all memory owned by the index
+void TopicIndex_Destroy(TopicIndex* index);
+
+// Add a member to a topic
+// Returns the member count afterwards (1 means the topic was just created), or -1 on failure
+int TopicIndex_Add(TopicIndex* index, const char* topic, int member);
+
+// Remove a member from a topic, dropping the topic once it has no members
+// Returns the member count afterwards, or -1 if the member was not registered
+int TopicIndex_Remove(TopicIndex* index, const char* topic, int member);
+
+// Get the members of a topic; returns NULL and a count of 0 if nobody is interested
+// The returned array is only valid until the index is modified
+const int* TopicIndex_Find(const TopicIndex* index, const char* topic, int* memberCount);
+
+// Get the number of topics with at least one member
+size_t TopicIndex_Count(const TopicIndex* index);
+
+// Call the visitor once for every topic in the index
+void TopicIndex_ForEach(const TopicIndex* index, TopicIndexVisitor visitor, void* context);
+
+#endif // TOPICINDEX_H
@@ -0,0 +1,248 @@
+#include "pch.h"
+#include "topicset.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t capacity = TOPICSET_MIN_CAPACITY;
+    while (capacity < value) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+static const char* EntryName(const TopicSetEntry* entry) {
+    return entry->length > TOPICSET_INLINE_LENGTH ? entry->name.heapName : entry->name.inlineName;
+}
+
+static void FreeEntry(TopicSetEntry* entry) {
+    if (entry->state == TOPICSET_USED && entry->length > TOPICSET_INLINE_LENGTH) {
+        free(entry->name.heapName);
+    }
+    entry->name.heapName = NULL;
+}
+
+// Find the slot holding the topic, or -1 if it is not present
+static long FindSlot(const TopicSet* set, const char* topic, size_t length, unsigned int hash) {
+    if (!set->entries) {
+        return -1;
+    }
+
+    size_t mask = set->capacity - 1;
+    size_t index = hash & mask;
+
+    for (size_t probes = 0; probes < set->capacity; probes++) {
+        const TopicSetEntry* entry = &set->entries[index];
+        if (entry->state == TOPICSET_EMPTY) {
+            return -1;
+        }
+        if (entry->state == TOPICSET_USED && entry->hash == hash && entry->length == length &&
+            memcmp(EntryName(entry), topic, length) == 0) {
+            return (long)index;
+        }
+        index = (index + 1) & mask;
+    }
+    return -1;
+}
+
+// Move every used entry into a freshly allocated table without copying names
+static bool Rehash(TopicSet* set, size_t newCapacity) {
+    TopicSetEntry* newEntries = (TopicSetEntry*)calloc(newCapacity, sizeof(TopicSetEntry));
+    if (!newEntries) {
+        return false;
+    }
+
+    size_t mask = newCapacity - 1;
+    for (size_t i = 0; i < set->capacity; i++) {
+        const TopicSetEntry* entry = &set->entries[i];
+        if (entry->state != TOPICSET_USED) {
+            continue;
+        }
+
+        size_t index = entry->hash & mask;
+        while (newEntries[index].state == TOPICSET_USED) {
+            index = (index + 1) & mask;
+        }
+        newEntries[index] = *entry;
+    }
+
+    free(set->entries);
+    set->entries = newEntries;
+    set->capacity = newCapacity;
+    set->tombstones = 0;
+    return true;
+}
+
+bool TopicSet_Init(TopicSet* set, size_t expectedCount) {
+    if (!set) {
+        return false;
+    }
+
+    // Keep the load factor below 0.7
+    set->capacity = RoundUpToPowerOfTwo(expectedCount + expectedCount / 2 + 1);
+    set->entries = (TopicSetEntry*)calloc(set->capacity, sizeof(TopicSetEntry));
+    set->count = 0;
+    set->tombstones = 0;
+    return set->entries != NULL;
+}
+
+void TopicSet_Destroy(TopicSet* set) {
+    if (!set || !set->entries) {
+        return;
+    }
+
+    TopicSet_Clear(set);
+    free(set->entries);
+    set->entries = NULL;
+    set->capacity = 0;
+}
+
+void TopicSet_Clear(TopicSet* set) {
+    if (!set || !set->entries) {
+        return;
+    }
+
+    for (size_t i = 0; i < set->capacity; i++) {
+        FreeEntry(&set->entries[i]);
+        set->entries[i].state = TOPICSET_EMPTY;
+    }
+    set->count = 0;
+    set->tombstones = 0;
+}
+
+unsigned int TopicSet_Hash(const char* topic, size_t length) {
+    unsigned int hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)topic[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Insert a topic that is not necessarily null-terminated
+static bool InsertWithLength(TopicSet* set, const char* topic, size_t length) {
+    if (length == 0 || length > 0xFFFF) {
+        return false;
+    }
+
+    unsigned int hash = TopicSet_Hash(topic, length);
+    if (FindSlot(set, topic, length, hash) >= 0) {
+        return true;
+    }
+
+    // Grow (or just purge tombstones) before the table gets too crowded
+    if ((set->count + set->tombstones + 1) * 10 > set->capacity * 7) {
+        size_t newCapacity = (set->count + 1) * 10 > set->capacity * 5 ? set->capacity * 2 : set->capacity;
+        if (!Rehash(set, newCapacity)) {
+            return false;
+        }
+    }
+
+    char* heapName = NULL;
+    if (length > TOPICSET_INLINE_LENGTH) {
+        heapName = (char*)malloc(length + 1);
+        if (!heapName) {
+            return false;
+        }
+        memcpy(heapName, topic, length);
+        heapName[length] = '\0';
+    }
+
+    size_t mask = set->capacity - 1;
+    size_t index = hash & mask;
+    while (set->entries[index].state == TOPICSET_USED) {
+        index = (index + 1) & mask;
+    }
+
+    TopicSetEntry* entry = &set->entries[index];
+    if (entry->state == TOPICSET_DELETED) {
+        set->tombstones--;
+    }
+
+    entry->hash = hash;
+    entry->length = (unsigned short)length;
+    entry->state = TOPICSET_USED;
+    if (heapName) {
+        entry->name.heapName = heapName;
+    }
+    else {
+        memcpy(entry->name.inlineName, topic, length);
+        entry->name.inlineName[length] = '\0';
+    }
+
+    set->count++;
+    return true;
+}
+
+bool TopicSet_Insert(TopicSet* set, const char* topic) {
+    if (!set || !set->entries || !topic) {
+        return false;
+    }
+    return InsertWithLength(set, topic, strlen(topic));
+}
+
+bool TopicSet_Remove(TopicSet* set, const char* topic) {
+    if (!set || !topic) {
+        return false;
+    }
+
+    size_t length = strlen(topic);
+    long slot = FindSlot(set, topic, length, TopicSet_Hash(topic, length));
+    if (slot < 0) {
+        return false;
+    }
+
+    TopicSetEntry* entry = &set->entries[slot];
+    FreeEntry(entry);
+    entry->state = TOPICSET_DELETED;
+    set->count--;
+    set->tombstones++;
+    return true;
+}
+
+bool TopicSet_Contains(const TopicSet* set, const char* topic) {
+    if (!set || !topic) {
+        return false;
+    }
+
+    size_t length = strlen(topic);
+    return FindSlot(set, topic, length, TopicSet_Hash(topic, length)) >= 0;
+}
+
+bool TopicSet_ContainsHashed(const TopicSet* set, const char* topic, size_t length, unsigned int hash) {
+    if (!set || !topic) {
+        return false;
+    }
+    return FindSlot(set, topic, length, hash) >= 0;
+}
+
+bool TopicSet_BuildFromList(TopicSet* set, const char* topicList, char delimiter) {
+    if (!set || !set->entries || !topicList) {
+        return false;
+    }
+
+    TopicSet_Clear(set);
+
+    const char* start = topicList;
+    while (*start) {
+        const char* end = strchr(start, delimiter);
+        size_t length = end ? (size_t)(end - start) : strlen(start);
+
+        if (length > 0 && !InsertWithLength(set, start, length)) {
+            return false;
+        }
+
+        if (!end) {
+            break;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+size_t TopicSet_Count(const TopicSet* set) {
+    return set ? set->count : 0;
+}
@@ -0,0 +1,68 @@
+#ifndef TOPICSET_H
+#define TOPICSET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Topics up to this length are stored inside the entry without a heap allocation
+#define TOPICSET_INLINE_LENGTH 23
+
+// Minimum number of slots allocated for a set
+#define TOPICSET_MIN_CAPACITY 16
+
+// Slot states
+#define TOPICSET_EMPTY 0
+#define TOPICSET_USED 1
+#define TOPICSET_DELETED 2
+
+// Structure to represent a single slot in the table
+typedef struct {
+    unsigned int hash;       // Precomputed hash of the topic
+    unsigned short length;   // Topic length in bytes
+    unsigned char state;     // TOPICSET_EMPTY, TOPICSET_USED or TOPICSET_DELETED
+    union {
+        char inlineName[TOPICSET_INLINE_LENGTH + 1];
+        char* heapName;
+    } name;
+} TopicSetEntry;
+
+// Open addressing hash set of topic names with linear probing
+// The set is not synchronized; callers guard it with their own lock
+typedef struct {
+    TopicSetEntry* entries;
+    size_t capacity;     // Always a power of two
+    size_t count;        // Number of USED slots
+    size_t tombstones;   // Number of DELETED slots
+} TopicSet;
+
+// Initialize an empty set sized for the expected number of topics
+bool TopicSet_Init(TopicSet* set, size_t expectedCount);
+
+// Free all memory owned by the set
+void TopicSet_Destroy(TopicSet* set);
+
+// Remove every topic but keep the allocated table
+void TopicSet_Clear(TopicSet* set);
+
+// Hash a topic (FNV-1a, 32 bit)
+unsigned int TopicSet_Hash(const char* topic, size_t length);
+
+// Add a topic; returns false only on allocation failure or invalid input
+bool TopicSet_Insert(TopicSet* set, const char* topic);
+
+// Remove a topic; returns true if it was present
+bool TopicSet_Remove(TopicSet* set, const char* topic);
+
+// Check whether a topic is present (does not allocate)
+bool TopicSet_Contains(const TopicSet* set, const char* topic);
+
+// Same as TopicSet_Contains for callers that already know the length and hash
+bool TopicSet_ContainsHashed(const TopicSet* set, const char* topic, size_t length, unsigned int hash);
+
+// Replace the contents with the topics of a delimiter separated list
+bool TopicSet_BuildFromList(TopicSet* set, const char* topicList, char delimiter);
+
+// Get the number of topics in the set
+size_t TopicSet_Count(const TopicSet* set);
+
+#endif // TOPICSET_H
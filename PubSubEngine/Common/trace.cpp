@@ -0,0 +1,227 @@
+#include "pch.h"
+#include "trace.h"
+#include "metrics.h"
+#include "logging.h"
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_LINE_SIZE 1024
+
+static const char* hopNames[TRACE_HOP_MAX + 1] = {
+    "unknown", "publish", "pes_receive", "pes_forward", "se_receive",
+    "se_fanout", "se_send", "ss_receive", "ss_commit", "subscriber_receive"
+};
+
+static LARGE_INTEGER traceFrequency;
+static volatile LONG traceSequence = 0;
+static volatile LONG64 sampleCounter = 0;
+static volatile LONG64 sampleInterval = (LONG64)(1.0 / TRACE_DEFAULT_SAMPLE_RATE + 0.5); // 0 disables sampling
+
+// Sink state, set up once by Trace_OpenSink before the service starts its threads
+static CRITICAL_SECTION sinkLock;
+static bool sinkInitialized = false;
+static FILE* sinkFile = NULL;
+static char sinkService[METRICS_NAME_LENGTH];
+static Metric* hopLatency[TRACE_HOP_MAX + 1];  // Time from the previous hop to this one
+static Metric* totalLatency = NULL;            // Time from the first hop to the last
+
+static void WriteUInt64(char* out, unsigned long long value) {
+    for (int i = 7; i >= 0; i--) {
+        out[i] = (char)(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+static unsigned long long ReadUInt64(const char* in) {
+    const unsigned char* bytes = (const unsigned char*)in;
+    unsigned long long value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+unsigned long long Trace_Now(void) {
+    // The frequency never changes, so racing first calls all store the same value
+    if (traceFrequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&traceFrequency);
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    unsigned long long ticks = (unsigned long long)now.QuadPart;
+    unsigned long long frequency = (unsigned long long)traceFrequency.QuadPart;
+    return ticks / frequency * 1000000 + ticks % frequency * 1000000 / frequency;
+}
+
+void Trace_Begin(TraceHeader* trace, TraceHop hop) {
+    // Process id in the high half keeps ids from different publishers apart
+    trace->id = ((unsigned long long)GetCurrentProcessId() << 32) |
+        (unsigned long)InterlockedIncrement(&traceSequence);
+    trace->hopCount = 0;
+    Trace_AddHop(trace, hop, Trace_Now());
+}
+
+bool Trace_AddHop(TraceHeader* trace, TraceHop hop, unsigned long long timestamp) {
+    if (trace->hopCount >= TRACE_MAX_HOPS) {
+        return false;
+    }
+
+    trace->hops[trace->hopCount] = (unsigned char)hop;
+    trace->timestamps[trace->hopCount] = timestamp;
+    trace->hopCount++;
+    return true;
+}
+
+size_t Trace_EncodedSize(const TraceHeader* trace) {
+    return TRACE_WIRE_HEADER + trace->hopCount * TRACE_WIRE_HOP;
+}
+
+size_t Trace_Encode(char* buffer, size_t bufferSize, const TraceHeader* trace) {
+    size_t total = Trace_EncodedSize(trace);
+    if (trace->hopCount > TRACE_MAX_HOPS || total > bufferSize) {
+        return 0;
+    }
+
+    WriteUInt64(buffer, trace->id);
+    buffer[8] = (char)trace->hopCount;
+
+    char* cursor = buffer + TRACE_WIRE_HEADER;
+    for (unsigned int i = 0; i < trace->hopCount; i++) {
+        cursor[0] = (char)trace->hops[i];
+        WriteUInt64(cursor + 1, trace->timestamps[i]);
+        cursor += TRACE_WIRE_HOP;
+    }
+    return total;
+}
+
+bool Trace_Decode(const char* data, size_t length, TraceHeader* trace) {
+    if (length < TRACE_WIRE_HEADER) {
+        return false;
+    }
+
+    unsigned int hopCount = (unsigned char)data[8];
+    if (hopCount > TRACE_MAX_HOPS || length != TRACE_WIRE_HEADER + hopCount * TRACE_WIRE_HOP) {
+        return false;
+    }
+
+    trace->id = ReadUInt64(data);
+    trace->hopCount = hopCount;
+
+    const char* cursor = data + TRACE_WIRE_HEADER;
+    for (unsigned int i = 0; i < hopCount; i++) {
+        trace->hops[i] = (unsigned char)cursor[0];
+        trace->timestamps[i] = ReadUInt64(cursor + 1);
+        cursor += TRACE_WIRE_HOP;
+    }
+    return true;
+}
+
+bool Trace_ShouldSample(void) {
+    LONG64 interval = sampleInterval;
+    if (interval <= 0) {
+        return false;
+    }
+    return InterlockedIncrement64(&sampleCounter) % interval == 0;
+}
+
+const char* Trace_HopName(unsigned int hop) {
+    return hop <= TRACE_HOP_MAX ? hopNames[hop] : hopNames[0];
+}
+
+bool Trace_OpenSink(const char* path, const char* serviceName) {
+    const char* rate = getenv(TRACE_SAMPLE_ENVIRONMENT);
+    if (rate != NULL) {
+        double fraction = atof(rate);
+        if (fraction <= 0.0) {
+            sampleInterval = 0;
+        }
+        else {
+            sampleInterval = fraction >= 1.0 ? 1 : (LONG64)(1.0 / fraction + 0.5);
+        }
+    }
+
+    char name[METRICS_NAME_LENGTH];
+    for (unsigned int hop = TRACE_HOP_PUBLISH; hop <= TRACE_HOP_MAX; hop++) {
+        snprintf(name, sizeof(name), "trace_%s_us", hopNames[hop]);
+        hopLatency[hop] = Metrics_Register(name, METRIC_HISTOGRAM);
+    }
+    totalLatency = Metrics_Register("trace_total_us", METRIC_HISTOGRAM);
+
+    strncpy(sinkService, serviceName ? serviceName : "", sizeof(sinkService) - 1);
+    sinkService[sizeof(sinkService) - 1] = '\0';
+    if (!sinkInitialized) {
+        InitializeCriticalSection(&sinkLock);
+        sinkInitialized = true;
+    }
+
+    FILE* file = fopen(path, "a");
+    if (file == NULL) {
+        LogMessage(LOG_ERROR, "Failed to open trace file %s", path);
+        return false;
+    }
+
+    EnterCriticalSection(&sinkLock);
+    sinkFile = file;
+    LeaveCriticalSection(&sinkLock);
+
+    if (sampleInterval > 0) {
+        LogMessage(LOG_INFO, "Tracing 1 in %lld messages to %s", (long long)sampleInterval, path);
+    }
+    else {
+        LogMessage(LOG_INFO, "Trace sampling disabled; traced messages still go to %s", path);
+    }
+    return true;
+}
+
+void Trace_Record(const TraceHeader* trace, const char* topic, const char* detail) {
+    if (trace->hopCount == 0) {
+        return;
+    }
+
+    char line[TRACE_LINE_SIZE];
+    unsigned long long total = trace->timestamps[trace->hopCount - 1] - trace->timestamps[0];
+    int length = snprintf(line, sizeof(line), "trace=%016llx service=%s topic=%s total_us=%llu",
+        trace->id, sinkService, topic ? topic : "", total);
+    Metrics_Record(totalLatency, total);
+
+    // Each hop shows the time since the previous one, so the slow hop stands out
+    for (unsigned int i = 0; i < trace->hopCount && length > 0 && (size_t)length < sizeof(line); i++) {
+        unsigned int hop = trace->hops[i];
+        unsigned long long delta = i > 0 ? trace->timestamps[i] - trace->timestamps[i - 1] : 0;
+        length += snprintf(line + length, sizeof(line) - length, " %s=+%llu", Trace_HopName(hop), delta);
+        if (i > 0 && hop <= TRACE_HOP_MAX) {
+            Metrics_Record(hopLatency[hop], delta);
+        }
+    }
+    if (detail != NULL && length > 0 && (size_t)length < sizeof(line)) {
+        snprintf(line + length, sizeof(line) - length, " detail=%s", detail);
+    }
+
+    if (!sinkInitialized) {
+        return;
+    }
+
+    EnterCriticalSection(&sinkLock);
+    if (sinkFile != NULL) {
+        fprintf(sinkFile, "%s\n", line);
+        fflush(sinkFile);
+    }
+    LeaveCriticalSection(&sinkLock);
+}
+
+void Trace_CloseSink(void) {
+    if (!sinkInitialized) {
+        return;
+    }
+
+    // The lock stays initialized so late recorders on other threads find a closed sink
+    EnterCriticalSection(&sinkLock);
+    if (sinkFile != NULL) {
+        fclose(sinkFile);
+        sinkFile = NULL;
+    }
+    LeaveCriticalSection(&sinkLock);
+}
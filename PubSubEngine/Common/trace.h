@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Wire layout of a trace block (integers in network byte order):
+//   [traceId:8][hopCount:1] then hopCount x [hop:1][timestamp:8]
+// Timestamps are microseconds on the performance counter, which is monotonic and shared
+// by every process on a machine, so hops stamped by different services can be subtracted.
+#define TRACE_MAX_HOPS 8
+#define TRACE_WIRE_HEADER 9
+#define TRACE_WIRE_HOP 9
+#define TRACE_MAX_WIRE_SIZE (TRACE_WIRE_HEADER + TRACE_MAX_HOPS * TRACE_WIRE_HOP)
+
+// Fraction of messages the PES traces, read when a sink opens ("0.01" = 1 in 100, "0" = off)
+#define TRACE_SAMPLE_ENVIRONMENT "PUBSUB_TRACE_SAMPLE"
+#define TRACE_DEFAULT_SAMPLE_RATE 0.001
+
+// Points on the message path that stamp a trace
+typedef enum {
+    TRACE_HOP_PUBLISH = 1,           // Publisher client sends the message
+    TRACE_HOP_PES_RECEIVE = 2,       // PES decodes it
+    TRACE_HOP_PES_FORWARD = 3,       // PES hands it to the SE or SS connection
+    TRACE_HOP_SE_RECEIVE = 4,        // SE decodes it
+    TRACE_HOP_SE_FANOUT = 5,         // SE encodes it once for every subscriber queue
+    TRACE_HOP_SE_SEND = 6,           // SE finished writing it to one subscriber
+    TRACE_HOP_SS_RECEIVE = 7,        // SS decodes it
+    TRACE_HOP_SS_COMMIT = 8,         // SS reports it committed
+    TRACE_HOP_SUBSCRIBER_RECEIVE = 9 // Subscriber client decodes it
+} TraceHop;
+
+#define TRACE_HOP_MAX TRACE_HOP_SUBSCRIBER_RECEIVE
+
+typedef struct {
+    unsigned long long id;
+    unsigned int hopCount;
+    unsigned char hops[TRACE_MAX_HOPS];
+    unsigned long long timestamps[TRACE_MAX_HOPS];
+} TraceHeader;
+
+// Current time on the shared trace clock, in microseconds
+unsigned long long Trace_Now(void);
+
+// Start a trace with a fresh id and its first hop stamped now
+void Trace_Begin(TraceHeader* trace, TraceHop hop);
+
+// Append a hop; returns false when the trace already holds TRACE_MAX_HOPS hops
+bool Trace_AddHop(TraceHeader* trace, TraceHop hop, unsigned long long timestamp);
+
+// Get the number of bytes a trace occupies on the wire
+size_t Trace_EncodedSize(const TraceHeader* trace);
+
+// Encode a trace into buffer; returns the encoded size or 0 if it does not fit
+size_t Trace_Encode(char* buffer, size_t bufferSize, const TraceHeader* trace);
+
+// Decode a trace block of exactly length bytes
+bool Trace_Decode(const char* data, size_t length, TraceHeader* trace);
+
+// Decide whether the next message is traced; every 1 / rate-th message is
+bool Trace_ShouldSample(void);
+
+// Open the file sampled traces are appended to and read the sample rate
+bool Trace_OpenSink(const char* path, const char* serviceName);
+
+// Append one line with the time between consecutive hops and record those times in the
+// trace_<hop>_us histograms; detail (may be NULL) names e.g. the subscriber
+void Trace_Record(const TraceHeader* trace, const char* topic, const char* detail);
+
+// Close the sink file
+void Trace_CloseSink(void);
+
+// Name of a hop as written in the sink
+const char* Trace_HopName(unsigned int hop);
+
+#endif // TRACE_H
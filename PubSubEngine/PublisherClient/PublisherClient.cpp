@@ -9,6 +9,8 @@
 #include "PublisherClient.h"
 #include "../Common/logging.h"
 #include "../Common/error.h"
+#include "../Common/frame.h"
+#include "../Common/trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -16,11 +18,25 @@
 
 // Global variables
 static SOCKET serverSocket = INVALID_SOCKET;
+static FrameStream serverStream;
 static char username[MAX_USERNAME_INPUT + 1] = "";
 static ConnectionState connectionState = STATE_DISCONNECTED;
+static long long credits = 0;  // Messages the engine has granted and we have not sent yet
+
+// A published message waiting for its confirm
+typedef struct {
+    PublishCallback callback;
+    void* context;
+} PendingPublish;
+
+static PendingPublish pending[MAX_UNCONFIRMED];  // Indexed by sequence % MAX_UNCONFIRMED
+static unsigned long long published = 0;         // Sequence of the last message sent on this connection
+static unsigned long long confirmed = 0;         // Every message up to this sequence has been confirmed
+static unsigned long long outcomeCounts[CONFIRM_REJECTED + 1];  // Confirmed messages per outcome
 
 // Forward declarations
 static const char* ReceiveServerResponse(void);
+static void CompleteThrough(unsigned long long sequence, int outcome);
 
 bool Client_Initialize(void) {
     InitializeLogging("publisher_client.log");
@@ -45,15 +61,22 @@ bool Client_SetUsername(const char* newUsername) {
 
 static const char* ReceiveServerResponse(void) {
     static char buffer[1024];
-    int bytesReceived = recv(serverSocket, buffer, sizeof(buffer) - 1, 0);
-    if (bytesReceived <= 0) {
+    Frame frame;
+    if (FrameStream_Read(&serverStream, &frame) <= 0 || frame.type != FRAME_RESPONSE) {
         LogMessage(LOG_ERROR, "Server closed connection during authentication");
         return "SERVER_CLOSED";
     }
-    buffer[bytesReceived] = '\0';
+    strncpy(buffer, frame.payload, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
     return buffer;
 }
 
+static void CloseServerConnection(void) {
+    closesocket(serverSocket);
+    serverSocket = INVALID_SOCKET;
+    FrameStream_Destroy(&serverStream);
+}
+
 bool Client_ConnectToServer(void) {
     if (connectionState == STATE_CONNECTED) {
         return false;
@@ -87,20 +110,23 @@ bool Client_ConnectToServer(void) {
 
     freeaddrinfo(result);
 
-    // Send authentication message with username
-    char authMessage[256];
-    snprintf(authMessage, sizeof(authMessage), "%s|%s", PES_AUTH_MESSAGE, username);
-    if (send(serverSocket, authMessage, strlen(authMessage), 0) == SOCKET_ERROR) {
-        LogMessage(LOG_ERROR, "Failed to send authentication");
+    if (!FrameStream_Init(&serverStream, serverSocket)) {
+        LogMessage(LOG_ERROR, "Failed to allocate receive buffer");
         closesocket(serverSocket);
         serverSocket = INVALID_SOCKET;
         return false;
     }
 
+    // Send authentication frame with username
+    if (!Frame_Send(serverSocket, FRAME_AUTH, PES_AUTH_MESSAGE, username)) {
+        LogMessage(LOG_ERROR, "Failed to send authentication");
+        CloseServerConnection();
+        return false;
+    }
+
     const char* response = ReceiveServerResponse();
     if (strcmp(response, "SERVER_CLOSED") == 0) {
-        closesocket(serverSocket);
-        serverSocket = INVALID_SOCKET;
+        CloseServerConnection();
         return false;
     }
 
@@ -110,11 +136,13 @@ bool Client_ConnectToServer(void) {
         strstr(response, "Maximum clients") ||
         strstr(response, "Username already")) {
         LogMessage(LOG_WARNING, "Server denied connection: %s", response);
-        closesocket(serverSocket);
-        serverSocket = INVALID_SOCKET;
+        CloseServerConnection();
         return false;
     }
 
+    credits = 0;  // The engine grants the first window right after the welcome
+    published = 0;
+    confirmed = 0;
     connectionState = STATE_CONNECTED;
     LogMessage(LOG_INFO, "Connected to server successfully");
     return true;
@@ -126,25 +154,244 @@ void Client_Disconnect(void) {
     }
 
     if (serverSocket != INVALID_SOCKET) {
-        closesocket(serverSocket);
-        serverSocket = INVALID_SOCKET;
+        CloseServerConnection();
     }
 
     connectionState = STATE_DISCONNECTED;
+    if (published > confirmed) {
+        LogMessage(LOG_WARNING, "Disconnected with %llu messages unconfirmed", published - confirmed);
+    }
+    CompleteThrough(published, CONFIRM_DISCONNECTED);
 }
 
-bool Client_PublishMessage(const char* topic, const char* message) {
+// Read the next frame from the engine, waiting until deadline (for good when timeoutMs is INFINITE)
+static int ReadEngineFrame(Frame* frame, DWORD timeoutMs, ULONGLONG deadline) {
+    if (timeoutMs == INFINITE) {
+        return FrameStream_Read(&serverStream, frame);
+    }
+    ULONGLONG now = GetTickCount64();
+    return FrameStream_ReadTimeout(&serverStream, frame, now < deadline ? (DWORD)(deadline - now) : 0);
+}
+
+// Complete every unconfirmed message up to sequence with one outcome, oldest first
+static void CompleteThrough(unsigned long long sequence, int outcome) {
+    while (confirmed < sequence) {
+        confirmed++;
+        PendingPublish* entry = &pending[confirmed % MAX_UNCONFIRMED];
+        outcomeCounts[outcome]++;
+        if (entry->callback) {
+            entry->callback(confirmed, outcome, entry->context);
+        }
+        entry->callback = NULL;
+    }
+}
+
+// Apply a grant or confirm from the engine; returns the number of messages it confirmed
+static int HandleEngineFrame(const Frame* frame) {
+    if (frame->type == FRAME_CREDIT) {
+        credits += strtoll(frame->payload, NULL, 10);
+        return 0;
+    }
+    if (frame->type != FRAME_CONFIRM) {
+        return 0;
+    }
+
+    unsigned long long through = strtoull(frame->payload, NULL, 10);
+    if (through <= confirmed || through > published || frame->flags < CONFIRM_STORED || frame->flags > CONFIRM_REJECTED) {
+        LogMessage(LOG_WARNING, "Ignoring confirm through %llu (outcome %d) with %llu of %llu confirmed",
+            through, frame->flags, confirmed, published);
+        return 0;
+    }
+
+    unsigned long long before = confirmed;
+    CompleteThrough(through, frame->flags);
+    return (int)(through - before);
+}
+
+// Read from the engine until a message may be sent: there is credit and room for one more
+// unconfirmed message, or timeoutMs (INFINITE to wait for good) runs out
+static PublishResult WaitToPublish(DWORD timeoutMs) {
+    ULONGLONG deadline = GetTickCount64() + (timeoutMs == INFINITE ? 0 : timeoutMs);
+
+    while (credits <= 0 || published - confirmed >= MAX_UNCONFIRMED) {
+        Frame frame;
+        int result = ReadEngineFrame(&frame, timeoutMs, deadline);
+        if (result == FRAME_STREAM_TIMEOUT) {
+            return PUBLISH_WOULD_BLOCK;
+        }
+        if (result <= 0) {
+            LogMessage(LOG_ERROR, "Lost connection to server while waiting to publish");
+            Client_Disconnect();
+            return PUBLISH_FAILED;
+        }
+        HandleEngineFrame(&frame);
+    }
+    return PUBLISH_OK;
+}
+
+PublishResult Client_PublishAsync(const char* topic, const char* message, DWORD timeoutMs,
+    PublishCallback callback, void* context) {
     if (!topic || !message || strlen(topic) == 0 || strlen(message) == 0 || connectionState != STATE_CONNECTED) {
-        return false;
+        return PUBLISH_FAILED;
+    }
+
+    PublishResult result = WaitToPublish(timeoutMs);
+    if (result != PUBLISH_OK) {
+        return result;
     }
 
-    char buffer[512];
-    snprintf(buffer, sizeof(buffer), "%s|%s", topic, message);
-    if (send(serverSocket, buffer, strlen(buffer), 0) == SOCKET_ERROR) {
+    // Every message is stamped; the PES decides which ones stay traced
+    TraceHeader trace;
+    Trace_Begin(&trace, TRACE_HOP_PUBLISH);
+    if (!Frame_SendTraced(serverSocket, FRAME_PUBLISH, &trace, topic, message)) {
+        // The send may have stopped part way and shut the socket down; nothing more can go out on it
         LogMessage(LOG_ERROR, "Failed to send publish request");
-        return false;
+        Client_Disconnect();
+        return PUBLISH_FAILED;
     }
-    return true;
+
+    // The engine numbers messages in the order it reads them, so the sequence is implicit on the wire
+    published++;
+    pending[published % MAX_UNCONFIRMED].callback = callback;
+    pending[published % MAX_UNCONFIRMED].context = context;
+    credits--;
+    return PUBLISH_OK;
+}
+
+PublishResult Client_PublishBatch(const PublishItem* items, size_t count, DWORD timeoutMs,
+    PublishCallback callback, size_t* sent) {
+    static char records[FRAME_MAX_PAYLOAD];
+    static char frameBuffer[FRAME_MAX_SIZE];
+    size_t done = 0;
+    if (sent) {
+        *sent = 0;
+    }
+    if (!items || connectionState != STATE_CONNECTED) {
+        return PUBLISH_FAILED;
+    }
+
+    // Reject the whole batch up front rather than stopping halfway through it
+    for (size_t i = 0; i < count; i++) {
+        if (!items[i].topic || !items[i].message || strlen(items[i].topic) == 0 || strlen(items[i].message) == 0 ||
+            strlen(items[i].topic) > FRAME_MAX_TOPIC ||
+            Frame_BatchRecordSize(strlen(items[i].topic), strlen(items[i].message)) > sizeof(records)) {
+            LogMessage(LOG_ERROR, "Invalid message %zu in publish batch", i);
+            return PUBLISH_FAILED;
+        }
+    }
+
+    ULONGLONG deadline = GetTickCount64() + (timeoutMs == INFINITE ? 0 : timeoutMs);
+    while (done < count) {
+        ULONGLONG now = GetTickCount64();
+        PublishResult result = WaitToPublish(timeoutMs == INFINITE ? INFINITE : (now < deadline ? (DWORD)(deadline - now) : 0));
+        if (result != PUBLISH_OK) {
+            return result;
+        }
+
+        // As many messages as credit, the confirm window and one frame allow
+        unsigned long long room = MAX_UNCONFIRMED - (published - confirmed);
+        size_t limit = (unsigned long long)credits < room ? (size_t)credits : (size_t)room;
+        size_t length = 0;
+        size_t packed = 0;
+        while (packed < limit && done + packed < count) {
+            const PublishItem* item = &items[done + packed];
+            size_t added = Frame_AppendBatchRecord(records + length, sizeof(records) - length,
+                item->topic, strlen(item->topic), item->message, strlen(item->message));
+            if (added == 0) {
+                break;
+            }
+            length += added;
+            packed++;
+        }
+
+        // One trace stamp for the whole frame; the PES decides per message which ones stay traced
+        TraceHeader trace;
+        Trace_Begin(&trace, TRACE_HOP_PUBLISH);
+        size_t size = Frame_EncodeTraced(frameBuffer, sizeof(frameBuffer), FRAME_PUBLISH_BATCH, 0, &trace,
+            NULL, 0, records, length);
+        if (size == 0) {
+            LogMessage(LOG_ERROR, "Failed to encode publish batch");
+            return PUBLISH_FAILED;
+        }
+        if (!Frame_SendAll(serverSocket, frameBuffer, size)) {
+            LogMessage(LOG_ERROR, "Failed to send publish batch");
+            Client_Disconnect();
+            return PUBLISH_FAILED;
+        }
+
+        for (size_t i = 0; i < packed; i++) {
+            published++;
+            pending[published % MAX_UNCONFIRMED].callback = callback;
+            pending[published % MAX_UNCONFIRMED].context = items[done + i].context;
+        }
+        credits -= (long long)packed;
+        done += packed;
+        if (sent) {
+            *sent = done;
+        }
+    }
+    return PUBLISH_OK;
+}
+
+PublishResult Client_PublishMessageTimeout(const char* topic, const char* message, DWORD timeoutMs) {
+    return Client_PublishAsync(topic, message, timeoutMs, NULL, NULL);
+}
+
+PublishResult Client_TryPublishMessage(const char* topic, const char* message) {
+    return Client_PublishMessageTimeout(topic, message, 0);
+}
+
+bool Client_PublishMessage(const char* topic, const char* message) {
+    return Client_PublishMessageTimeout(topic, message, INFINITE) == PUBLISH_OK;
+}
+
+int Client_PollConfirms(DWORD timeoutMs) {
+    if (connectionState != STATE_CONNECTED) {
+        return -1;
+    }
+
+    // Wait for the first frame only; after that take whatever has already arrived
+    ULONGLONG deadline = GetTickCount64() + (timeoutMs == INFINITE ? 0 : timeoutMs);
+    int total = 0;
+    for (;;) {
+        Frame frame;
+        int result = total > 0 ? FrameStream_ReadTimeout(&serverStream, &frame, 0) : ReadEngineFrame(&frame, timeoutMs, deadline);
+        if (result == FRAME_STREAM_TIMEOUT) {
+            return total;
+        }
+        if (result <= 0) {
+            LogMessage(LOG_ERROR, "Lost connection to server while waiting for confirms");
+            Client_Disconnect();
+            return -1;
+        }
+        total += HandleEngineFrame(&frame);
+    }
+}
+
+bool Client_Flush(DWORD timeoutMs) {
+    ULONGLONG deadline = GetTickCount64() + (timeoutMs == INFINITE ? 0 : timeoutMs);
+    while (connectionState == STATE_CONNECTED && confirmed < published) {
+        Frame frame;
+        int result = ReadEngineFrame(&frame, timeoutMs, deadline);
+        if (result == FRAME_STREAM_TIMEOUT) {
+            return false;
+        }
+        if (result <= 0) {
+            LogMessage(LOG_ERROR, "Lost connection to server while flushing");
+            Client_Disconnect();
+            return false;
+        }
+        HandleEngineFrame(&frame);
+    }
+    return connectionState == STATE_CONNECTED;
+}
+
+long long Client_GetCredits(void) {
+    return credits;
+}
+
+unsigned long long Client_GetUnconfirmed(void) {
+    return published - confirmed;
 }
 
 ConnectionState Client_GetConnectionState(void) {
@@ -169,7 +416,10 @@ void DisplayMenu(void) {
     ClearScreen();
     printf("=== Publisher Client ===\n");
     printf("Username: %s\n", strlen(username) > 0 ? username : "Not set");
-    printf("Status: %s\n\n", connectionState == STATE_CONNECTED ? "Connected" : "Disconnected");
+    printf("Status: %s\n", connectionState == STATE_CONNECTED ? "Connected" : "Disconnected");
+    printf("Confirmed: %llu stored | %llu not stored | %llu rejected | %llu lost | %llu waiting\n\n",
+        outcomeCounts[CONFIRM_STORED], outcomeCounts[CONFIRM_UNSTORED], outcomeCounts[CONFIRM_REJECTED],
+        outcomeCounts[CONFIRM_DISCONNECTED], published - confirmed);
 
     if (connectionState == STATE_DISCONNECTED) {
         printf("1. Set Username\n");
@@ -177,7 +427,8 @@ void DisplayMenu(void) {
         printf("3. Exit\n");
     } else {
         printf("1. Publish Message\n");
-        printf("2. Exit\n");
+        printf("2. Publish Batch\n");
+        printf("3. Exit\n");
     }
     printf("\nEnter choice: ");
 }
@@ -192,6 +443,9 @@ int main(void) {
     bool running = true;
 
     while (running) {
+        if (connectionState == STATE_CONNECTED) {
+            Client_PollConfirms(0);
+        }
         DisplayMenu();
 
         if (fgets(input, sizeof(input), stdin) == NULL) {
@@ -249,7 +503,30 @@ int main(void) {
                     }
                     break;
                 }
-                case '2':
+                case '2': {
+                    char topic[256];
+                    char messages[512];
+                    PublishItem items[MAX_CONSOLE_BATCH];
+                    size_t count = 0;
+                    printf("Enter topic: ");
+                    if (fgets(topic, sizeof(topic), stdin) == NULL) break;
+                    topic[strcspn(topic, "\n")] = 0;
+                    printf("Enter messages separated by ';': ");
+                    if (fgets(messages, sizeof(messages), stdin) == NULL) break;
+                    messages[strcspn(messages, "\n")] = 0;
+                    for (char* part = strtok(messages, ";"); part && count < MAX_CONSOLE_BATCH; part = strtok(NULL, ";")) {
+                        items[count].topic = topic;
+                        items[count].message = part;
+                        items[count].context = NULL;
+                        count++;
+                    }
+                    if (count == 0 || Client_PublishBatch(items, count, INFINITE, NULL, NULL) != PUBLISH_OK) {
+                        printf("Failed to publish batch!\n");
+                        system("pause");
+                    }
+                    break;
+                }
+                case '3':
                     Client_Disconnect();
                     continue;
                 default:
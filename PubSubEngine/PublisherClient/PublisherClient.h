@@ -0,0 +1,99 @@
+#ifndef PUBLISHER_CLIENT_H
+#define PUBLISHER_CLIENT_H
+
+#include <stdbool.h>
+#include <WinSock2.h>
+
+#define MAX_USERNAME_INPUT 31
+#define DEFAULT_PORT "55001"
+#define PES_AUTH_MESSAGE "PES_AUTH"
+#define MAX_UNCONFIRMED 65536      // Messages awaiting a confirm before publishing waits for one
+#define CONFIRM_DISCONNECTED 0     // Outcome for messages still unconfirmed when the connection is lost
+#define MAX_CONSOLE_BATCH 64       // Messages one batch entered at the console may hold
+
+// Client states
+typedef enum {
+    STATE_DISCONNECTED,
+    STATE_CONNECTED
+} ConnectionState;
+
+// Outcome of a publish that may have to wait for credit from the Publisher Engine
+typedef enum {
+    PUBLISH_OK,
+    PUBLISH_WOULD_BLOCK,  // No credit arrived in time; nothing was sent
+    PUBLISH_FAILED
+} PublishResult;
+
+// Called once per message when the engine confirms it, in publish order, with its sequence
+// (numbered from 1 per connection) and a CONFIRM_* outcome from frame.h or CONFIRM_DISCONNECTED.
+// Confirms are read while publishing, polling or flushing, so callbacks run on that thread.
+typedef void (*PublishCallback)(unsigned long long sequence, int outcome, void* context);
+
+// One message of a batch; context is handed to the batch's callback for this message
+typedef struct {
+    const char* topic;
+    const char* message;
+    void* context;
+} PublishItem;
+
+// Initialize the client
+bool Client_Initialize(void);
+
+// Connect to the Publisher Engine Service
+bool Client_ConnectToServer(void);
+
+// Disconnect from the server
+void Client_Disconnect(void);
+
+// Set the username
+bool Client_SetUsername(const char* username);
+
+// Publish a message on a topic, waiting for credit if the engine has none to spare;
+// the message carries a trace stamped at send time
+bool Client_PublishMessage(const char* topic, const char* message);
+
+// Publish a message only if credit is already available
+PublishResult Client_TryPublishMessage(const char* topic, const char* message);
+
+// Publish a message, waiting up to timeoutMs for credit
+PublishResult Client_PublishMessageTimeout(const char* topic, const char* message, DWORD timeoutMs);
+
+// Publish a message without waiting for its confirm, waiting up to timeoutMs for credit or
+// for room among the unconfirmed messages; callback (may be NULL) reports its outcome later
+PublishResult Client_PublishAsync(const char* topic, const char* message, DWORD timeoutMs,
+    PublishCallback callback, void* context);
+
+// Publish count messages in order, packing as many as credit allows into each multi-message
+// frame so a burst goes out in a few writes. Waits up to timeoutMs in total for credit; *sent
+// (may be NULL) receives how many went out, which is fewer than count unless PUBLISH_OK.
+PublishResult Client_PublishBatch(const PublishItem* items, size_t count, DWORD timeoutMs,
+    PublishCallback callback, size_t* sent);
+
+// Handle confirms that arrive within timeoutMs; returns the messages confirmed or -1 if the connection was lost
+int Client_PollConfirms(DWORD timeoutMs);
+
+// Wait up to timeoutMs until every published message has been confirmed
+bool Client_Flush(DWORD timeoutMs);
+
+// Get the number of messages that can be published without waiting
+long long Client_GetCredits(void);
+
+// Get the number of published messages still waiting for a confirm
+unsigned long long Client_GetUnconfirmed(void);
+
+// Get the current connection state
+ConnectionState Client_GetConnectionState(void);
+
+// Get the current username
+const char* Client_GetUsername(void);
+
+// Clean up resources
+void Client_Cleanup(void);
+
+// Display the main menu
+void DisplayMenu(void);
+
+// Clear the console screen
+void ClearScreen(void);
+
+#endif // PUBLISHER_CLIENT_H
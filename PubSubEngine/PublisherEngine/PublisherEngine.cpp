@@ -21,48 +21,357 @@
 #include "../Common/logging.h"
 #include "../Common/error.h"
 #include "../Common/client.h"
+#include "../Common/interest.h"
+#include "../Common/topicset.h"
+#include "../Common/frame.h"
+#include "../Common/reactor.h"
+#include "../Common/metrics.h"
+#include "../Common/trace.h"
+#include "../Common/statusview.h"
+#include "../Common/executor.h"
+#include "../Common/ring.h"
+#include "../Common/sendqueue.h"
+#include "../Common/spilljournal.h"
 
-#define BUFFER_SIZE 1024
 #define SE_PORT "55002"
 #define SS_PORT "55003"
 #define CONNECTION_RETRY_DELAY 3000
+#define INTEREST_INITIAL_CAPACITY 256
+#define SS_AUTH_KEY "X8k9#mP2$vL5nQ7"
+#define EVENT_LOOP_COUNT 0            // 0 = one event loop per processor
+#define PUBLISHER_SHARDS 0            // 0 = one publisher table shard per processor
+#define PUBLISHER_SHARD_CAPACITY 64   // Initial publishers per shard, grows on demand
+#define LISTEN_BACKLOG 8192           // Connections the listener queues while the accept thread catches up
+#define CONNECTION_BUFFER_SIZE 512    // Initial decoder buffer per publisher, grows on demand
+#define MAX_READS_PER_WAKEUP 16       // Bound the work one publisher can do per loop iteration
+#define WORKER_COUNT 0                // 0 = one routing worker per processor
+#define PIN_WORKERS false             // Pin routing worker i to processor i
+#define ROUTE_STRANDS 64              // Topics hash onto this many in-order routing queues
+#define ROUTE_MAX_PENDING 65536       // Messages waiting for routing before publisher reads pause
+#define ROUTE_RESUME_PENDING (ROUTE_MAX_PENDING / 2)  // Backlog at which paused publishers are read again
+#define CREDIT_MAX_WINDOW 1024        // Messages one publisher may have in flight while downstream queues are empty
+#define CREDIT_MIN_WINDOW 16          // Window every publisher keeps however full the queues get
+#define CREDIT_GRANT_FRACTION 4       // Top a window up once this fraction of it can be returned
+#define CONFIRM_BATCH 256             // Settled messages a confirm waits for while others are still in flight
+#define SESSION_INITIAL_OUTCOMES 1024 // Unsettled messages tracked per publisher before its table grows
+#define COMMIT_INITIAL_CAPACITY 8192  // Messages awaiting an SS commit before that queue grows
+#define UNSTORED_BACKLOG (2 * LINK_BATCH_FRAMES)  // SS refusals remembered until the writer tracks their message
+#define LINK_QUEUE_CAPACITY 8192      // Frames queued for one downstream link before routing waits
+#define LINK_BATCH_FRAMES 256         // Most frames gathered into one write
+#define LINK_FLUSH_BYTES (64 * 1024)  // A batch holding this many bytes is written at once
+#define LINK_MAX_LINGER_US 200        // Longest the first frame of a batch waits for others to join it
+#define LINK_IDLE_WAIT 100            // ms a link writer parks before checking for shutdown
+#define SE_OVERFLOW LINK_OVERFLOW_BLOCK
+#define SS_OVERFLOW LINK_OVERFLOW_SPILL
+#define SS_SPILL_LIMIT (1024ULL * 1024 * 1024)  // Bytes of spilled frames before further ones are not stored
+
+// What routing does with a frame when a link's queue is full
+typedef enum {
+    LINK_OVERFLOW_BLOCK,  // Wait for the writer, pausing publishers through the routing backlog
+    LINK_OVERFLOW_DROP,   // Discard the frame and count it
+    LINK_OVERFLOW_SPILL   // Append it to the link's journal; the writer replays it once the queue drains
+} LinkOverflow;
+
+// One downstream service connection. Routing workers encode each frame once and queue it
+// here; the link's writer thread is the only thread that writes to the socket. The writer
+// gathers whatever is queued into one vectored send, flushing when the batch is full, when
+// the queue runs dry or when the first frame has lingered LINK_MAX_LINGER_US. Each link
+// has its own overflow policy, so a slow Storage Service never holds up live delivery.
+typedef struct {
+    const char* name;
+    LinkOverflow overflow;
+    SOCKET socket;
+    volatile bool connected;
+    bool confirms;                // Written publish frames wait for an SS commit to settle their publisher's messages
+    CRITICAL_SECTION sendLock;    // Held by the writer around a batch and by whoever closes the socket
+    MpscRing queue;               // LinkFrame pointers waiting for the writer
+    HANDLE writer;
+    volatile bool stopping;
+    volatile LONG64 written;      // Publish frames written since the link last connected
+    Metric* forwarded;
+    Metric* latency;
+    Metric* queueGauge;
+    Metric* batchFrames;          // Frames per write
+    Metric* batchBytes;           // Bytes per write
+    Metric* batchLinger;          // Microseconds from the first frame's dequeue to its write
+    unsigned long long lingerTicks;  // LINK_MAX_LINGER_US in Metrics_Now units
+    SpillJournal spill;           // Overflow for LINK_OVERFLOW_SPILL; frames in it stay queued across reconnects
+    SRWLOCK spillOrder;           // Shared by routing around queue-or-spill, exclusive while the writer moves the queue into the journal
+    char* replayBuffer;           // SPILLJOURNAL_READ_SIZE bytes, used by the writer only
+    struct LinkFrame* held[LINK_BATCH_FRAMES];  // Batch kept from a lost connection when it could not be spilled (writer only)
+    size_t heldCount;
+    Metric* spilled;
+    Metric* replayed;
+    Metric* dropped;
+    Metric* spillGauge;
+} DownstreamLink;
+
+// One partition of the publisher table. A publisher lives in the shard its username hashes to,
+// so connects and disconnects of different publishers rarely wait on the same lock.
+typedef struct {
+    CRITICAL_SECTION lock;
+    Client** publishers;  // Guarded by lock, grows on demand
+    int count;
+    int capacity;
+    TopicSet names;       // Usernames in use in this shard (guarded by lock)
+} PublisherShard;
 
 // Global variables
 static SOCKET serverSocket = INVALID_SOCKET;
-static SOCKET seSocket = INVALID_SOCKET;
-static SOCKET ssSocket = INVALID_SOCKET;
-static Client* publishers[MAX_CLIENTS];
-static int publisherCount = 0;
-static HANDLE publishersMutex;
+static DownstreamLink seLink;
+static DownstreamLink ssLink;
+static PublisherShard* publisherShards;
+static int shardCount = 0;
+static volatile LONG publisherCount = 0;   // Across all shards
+static volatile LONG nextPublisherId = 0;
+static Reactor reactor;
+static Executor executor;
+static ExecutorStrand routeStrands[ROUTE_STRANDS];  // Keep each topic's messages in order
 static volatile bool shouldStop = false;
-static HANDLE consoleHandle;
-static COORD cursorPosition = { 0, 0 };
 
-// Connection status
-static volatile bool seConnected = false;
-static volatile bool ssConnected = false;
+// Storage commit progress for the current SS connection, reported back in FRAME_ACK
+static volatile LONG64 ssCommittedMessages = 0;
+static volatile LONG ssDurabilityMode = -1;  // Flags of the last ack, -1 until the first one
+static LONG ssGeneration = 0;  // Numbers SS connections so a late listener cannot touch a newer one (under pendingCommitsLock)
+
+// One SS connection as its ack listener sees it
+typedef struct {
+    SOCKET socket;
+    LONG generation;
+} StorageConnection;
+
+// Local copy of the topics that currently have subscribers, pushed by the SE
+static TopicSet interestTopics;
+static unsigned long interestVersion = 0;
+static SRWLOCK interestLock = SRWLOCK_INIT;  // Shared for lookups, exclusive for updates
+
+// Metrics, registered in PublisherEngine_Init
+static Metric* messagesIn;
+static Metric* bytesIn;
+static Metric* messagesRejected;
+static Metric* forwardedToSE;
+static Metric* forwardedToSS;
+static Metric* skippedNoInterest;
+static Metric* forwardFailures;
+static Metric* receiveLatency;
+static Metric* forwardSELatency;
+static Metric* forwardSSLatency;
+static Metric* publishersGauge;
+static Metric* seLinkGauge;
+static Metric* ssLinkGauge;
+static Metric* ssUncommittedGauge;
+static Metric* interestTopicsGauge;
+static Metric* routePendingGauge;
+static Metric* routeStolenGauge;
+static Metric* creditsGranted;
+static Metric* creditViolations;
+static Metric* creditWindowGauge;
+static Metric* batchSizes;
+static Metric* settledOutcomes[CONFIRM_REJECTED + 1];
+static Metric* pendingCommitsGauge;
+static Metric* unstorableMessages;
+static Metric* refusedBySS;
+
+// Flow-control and confirm account of one publisher, shared by the connection and everything
+// holding one of its messages. The publisher may send as many messages as it has been granted;
+// credit comes back as routing finishes with its messages, sized by how full the routing
+// backlog and the blocking downstream queues are. Messages are numbered from 1 in the order
+// they are read and settle out of order (per topic, then per SS commit); cumulative confirms
+// report the outcomes back once every earlier message has settled too.
+typedef struct {
+    volatile LONG references;
+    LONG id;                    // Names the session in spill journal records (see Session_Find)
+    CRITICAL_SECTION lock;      // Serializes grants, confirms and the close
+    ReactorConnection* connection;  // NULL once the connection closed or stopped taking grants and confirms
+    SendQueue outbound;         // Grants and confirms waiting for the connection's event loop to write them
+    volatile LONG64 received;   // Messages read from the publisher, i.e. the last sequence (event loop only)
+    volatile LONG64 retired;    // Messages routing has finished with
+    volatile LONG64 granted;    // Credit sent so far (written under lock)
+    LONG64 settled;             // Every message up to this sequence has an outcome (under lock)
+    LONG64 confirmed;           // Sequence the last confirm covered (under lock)
+    unsigned char runOutcome;   // Outcome of the messages after confirmed up to settled
+    unsigned char* outcomes;    // Ring of outcomes for the messages after settled, 0 while unknown
+    size_t outcomeHead;         // Slot of sequence settled + 1
+    size_t outcomeCapacity;     // Power of two, 0 until the first message settles
+    bool untracked;             // Outcomes could not be recorded; confirms have stopped
+} PublisherSession;
+
+// Per-connection state owned by the reactor
+typedef struct {
+    FrameDecoder decoder;
+    Client* publisher;         // NULL until the connection authenticates
+    PublisherSession* session; // Created with the publisher
+    bool paused;               // Listed in pausedPublishers (guarded by pausedLock)
+} PublisherConnection;
+
+// A publisher's message written to the SS, waiting for the commit that covers it
+typedef struct {
+    PublisherSession* session;  // Referenced until the message settles, NULL once the SS refused it
+    LONG64 sequence;
+    LONG64 position;            // Publish frames written on the SS connection up to and including this one
+} PendingCommit;
+
+// A frame queued for the downstream links, with the publisher message the SS link settles once
+// a commit covers it. The links share one, as they share the encoded frame inside it.
+typedef struct LinkFrame {
+    volatile LONG references;   // One per queue, batch or caller holding it
+    SharedFrame* frame;
+    PublisherSession* session;  // Referenced until the message settles, NULL if nothing waits on it
+    LONG64 sequence;
+} LinkFrame;
+
+// Tag kept next to each spilled SS frame so replay can still settle the message
+typedef struct {
+    LONG session;               // Id of the session the record holds a reference on, 0 for untracked frames
+    LONG64 sequence;
+} SpillTag;
+
+// Live sessions by id, so journal records name a session without storing a pointer to it.
+// A record keeps its session referenced, so the id cannot be reused while the record exists.
+static PublisherSession** sessionTable;  // Slot id - 1, NULL while the id is free
+static LONG* freeSessionIds;             // Ids given back by released sessions
+static size_t freeSessionIdCount;
+static size_t sessionTableSize;          // Ids handed out so far
+static size_t sessionTableCapacity;
+static SRWLOCK sessionTableLock = SRWLOCK_INIT;
+
+// Messages written to the current SS connection and not yet committed, oldest first
+static PendingCommit* pendingCommits;
+static size_t pendingCommitsHead;
+static size_t pendingCommitsCount;
+static size_t pendingCommitsCapacity;
+static CRITICAL_SECTION pendingCommitsLock;
+
+// Positions the SS refused before the writer got to track them, ascending (guarded by pendingCommitsLock)
+static LONG64 unstoredPositions[UNSTORED_BACKLOG];
+static size_t unstoredHead;
+static size_t unstoredCount;
+
+// Publishers whose reads are paused until routing catches up
+static ReactorConnection* pausedPublishers[MAX_CLIENTS];
+static volatile LONG pausedCount;
+static CRITICAL_SECTION pausedLock;
 
 // Forward declarations
 static unsigned __stdcall HandleClientThread(void* param);
-static unsigned __stdcall HandleRequestsThread(void* param);
+static bool OnPublisherReadable(ReactorConnection* connection);
+static void OnPublisherClosed(ReactorConnection* connection);
+static void OnPublisherWritten(ReactorConnection* connection, bool sent);
 static unsigned __stdcall ConnectionManagerThread(void* param);
-static void ClearScreen(void);
-static void UpdateDisplay(void);
-static void MoveCursor(int x, int y);
-static bool ConnectToService(const char* port, SOCKET* serviceSocket, const char* serviceName);
-static bool RequestTopicsFromSE(char* topicList, size_t bufferSize);
-static bool IsTopicInList(const char* topic, const char* topicList);
-static bool ForwardToSE(const char* topic, const char* message);
-static bool ForwardToSS(const char* topic, const char* message);
-static bool IsUsernameUnique(const char* username);
+static void BuildStatus(StatusText* text, void* context);
+static unsigned __stdcall InterestListenerThread(void* param);
+static unsigned __stdcall StorageAckListenerThread(void* param);
+static SOCKET ConnectToService(const char* port, const char* authKey, const char* serviceName);
+static bool HasInterest(const char* topic);
+static void ApplyInterestDelta(const InterestDelta* delta);
+static void ClearInterest(void);
+static bool StartLink(DownstreamLink* link, const char* name, LinkOverflow overflow, const char* spillPath,
+    Metric* forwarded, Metric* latency);
+static void QueueOnLink(DownstreamLink* link, LinkFrame* frame);
+static SharedFrame* EncodePublish(const char* topic, const char* message, const TraceHeader* trace);
+static LinkFrame* LinkFrame_Create(SharedFrame* frame);
+static void LinkFrame_Release(LinkFrame* frame);
+static bool IsUsernameUnique(PublisherShard* shard, const char* username);
+static bool InitPublisherShards(void);
+static long long CreditWindow(void);
+static bool RouteMessage(const char* topic, const char* message, const TraceHeader* trace,
+    PublisherSession* session, LONG64 sequence);
+static void Session_Settle(PublisherSession* session, LONG64 sequence, unsigned char outcome);
+static void Session_Release(PublisherSession* session);
+static void SettleFrame(LinkFrame* frame, unsigned char outcome);
+static PublisherSession* Session_Find(LONG id);
+
+static void RegisterMetrics(void) {
+    messagesIn = Metrics_Register("pes_messages_in", METRIC_COUNTER);
+    bytesIn = Metrics_Register("pes_bytes_in", METRIC_COUNTER);
+    messagesRejected = Metrics_Register("pes_messages_rejected", METRIC_COUNTER);
+    forwardedToSE = Metrics_Register("pes_forwarded_se", METRIC_COUNTER);
+    forwardedToSS = Metrics_Register("pes_forwarded_ss", METRIC_COUNTER);
+    skippedNoInterest = Metrics_Register("pes_skipped_no_interest", METRIC_COUNTER);
+    forwardFailures = Metrics_Register("pes_forward_failures", METRIC_COUNTER);
+    receiveLatency = Metrics_Register("pes_receive_us", METRIC_HISTOGRAM);
+    forwardSELatency = Metrics_Register("pes_forward_se_us", METRIC_HISTOGRAM);
+    forwardSSLatency = Metrics_Register("pes_forward_ss_us", METRIC_HISTOGRAM);
+    publishersGauge = Metrics_Register("pes_publishers", METRIC_GAUGE);
+    seLinkGauge = Metrics_Register("pes_se_connected", METRIC_GAUGE);
+    ssLinkGauge = Metrics_Register("pes_ss_connected", METRIC_GAUGE);
+    ssUncommittedGauge = Metrics_Register("pes_ss_uncommitted", METRIC_GAUGE);
+    interestTopicsGauge = Metrics_Register("pes_interest_topics", METRIC_GAUGE);
+    seLink.queueGauge = Metrics_Register("pes_se_queue", METRIC_GAUGE);
+    ssLink.queueGauge = Metrics_Register("pes_ss_queue", METRIC_GAUGE);
+    seLink.batchFrames = Metrics_Register("pes_se_batch_frames", METRIC_HISTOGRAM);
+    ssLink.batchFrames = Metrics_Register("pes_ss_batch_frames", METRIC_HISTOGRAM);
+    seLink.batchBytes = Metrics_Register("pes_se_batch_bytes", METRIC_HISTOGRAM);
+    ssLink.batchBytes = Metrics_Register("pes_ss_batch_bytes", METRIC_HISTOGRAM);
+    seLink.batchLinger = Metrics_Register("pes_se_batch_linger_us", METRIC_HISTOGRAM);
+    ssLink.batchLinger = Metrics_Register("pes_ss_batch_linger_us", METRIC_HISTOGRAM);
+    seLink.spilled = Metrics_Register("pes_se_spilled", METRIC_COUNTER);
+    ssLink.spilled = Metrics_Register("pes_ss_spilled", METRIC_COUNTER);
+    seLink.replayed = Metrics_Register("pes_se_replayed", METRIC_COUNTER);
+    ssLink.replayed = Metrics_Register("pes_ss_replayed", METRIC_COUNTER);
+    seLink.dropped = Metrics_Register("pes_se_dropped", METRIC_COUNTER);
+    ssLink.dropped = Metrics_Register("pes_ss_dropped", METRIC_COUNTER);
+    seLink.spillGauge = Metrics_Register("pes_se_spill_queue", METRIC_GAUGE);
+    ssLink.spillGauge = Metrics_Register("pes_ss_spill_queue", METRIC_GAUGE);
+    routePendingGauge = Metrics_Register("pes_route_pending", METRIC_GAUGE);
+    routeStolenGauge = Metrics_Register("pes_route_stolen", METRIC_GAUGE);
+    creditsGranted = Metrics_Register("pes_credits_granted", METRIC_COUNTER);
+    creditViolations = Metrics_Register("pes_credit_violations", METRIC_COUNTER);
+    creditWindowGauge = Metrics_Register("pes_credit_window", METRIC_GAUGE);
+    batchSizes = Metrics_Register("pes_publish_batch_messages", METRIC_HISTOGRAM);
+    settledOutcomes[CONFIRM_STORED] = Metrics_Register("pes_settled_stored", METRIC_COUNTER);
+    settledOutcomes[CONFIRM_UNSTORED] = Metrics_Register("pes_settled_unstored", METRIC_COUNTER);
+    settledOutcomes[CONFIRM_REJECTED] = Metrics_Register("pes_settled_rejected", METRIC_COUNTER);
+    pendingCommitsGauge = Metrics_Register("pes_pending_commits", METRIC_GAUGE);
+    unstorableMessages = Metrics_Register("pes_unstorable", METRIC_COUNTER);
+    refusedBySS = Metrics_Register("pes_ss_refused", METRIC_COUNTER);
+}
+
+// Refresh the gauges that are read from engine state rather than tracked as it changes
+static void CollectMetrics(void* context) {
+    (void)context;
+    Metrics_Set(publishersGauge, publisherCount);
+    Metrics_Set(seLinkGauge, seLink.connected);
+    Metrics_Set(ssLinkGauge, ssLink.connected);
+    Metrics_Set(ssUncommittedGauge, ssLink.connected ? ssLink.written - ssCommittedMessages : 0);
+    Metrics_Set(seLink.queueGauge, (long long)MpscRing_Count(&seLink.queue));
+    Metrics_Set(ssLink.queueGauge, (long long)MpscRing_Count(&ssLink.queue));
+    Metrics_Set(seLink.spillGauge, SpillJournal_Count(&seLink.spill));
+    Metrics_Set(ssLink.spillGauge, SpillJournal_Count(&ssLink.spill));
+    Metrics_Set(pendingCommitsGauge, (long long)pendingCommitsCount);
+
+    AcquireSRWLockShared(&interestLock);
+    Metrics_Set(interestTopicsGauge, (long long)TopicSet_Count(&interestTopics));
+    ReleaseSRWLockShared(&interestLock);
+
+    ExecutorStats executorStats;
+    Executor_GetStats(&executor, &executorStats);
+    Metrics_Set(routePendingGauge, executorStats.pending);
+    Metrics_Set(routeStolenGauge, (long long)executorStats.stolen);
+    Metrics_Set(creditWindowGauge, CreditWindow());
+}
 
 bool PublisherEngine_Init(void) {
     InitializeLogging("publisher_engine.log");
     SetLogLevel(LOG_INFO);
+    RegisterMetrics();
+
+    if (!InitPublisherShards()) {
+        LogMessage(LOG_ERROR, "Failed to allocate publisher table");
+        return false;
+    }
+
+    if (!TopicSet_Init(&interestTopics, INTEREST_INITIAL_CAPACITY)) {
+        LogMessage(LOG_ERROR, "Failed to allocate interest cache");
+        return false;
+    }
 
-    publishersMutex = CreateMutex(NULL, FALSE, NULL);
-    if (publishersMutex == NULL) {
-        LogMessage(LOG_ERROR, "Failed to create mutex: %s", GetErrorDescription(ERROR_MUTEX_ERROR));
+    InitializeCriticalSection(&pendingCommitsLock);
+    InitializeCriticalSection(&pausedLock);
+    ssLink.confirms = true;
+    if (!StartLink(&seLink, "SE", SE_OVERFLOW, NULL, forwardedToSE, forwardSELatency) ||
+        !StartLink(&ssLink, "SS", SS_OVERFLOW, SS_SPILL_FILE, forwardedToSS, forwardSSLatency)) {
+        LogMessage(LOG_ERROR, "Failed to start downstream link writers");
         return false;
     }
 
@@ -103,22 +412,37 @@ bool PublisherEngine_Init(void) {
 
     freeaddrinfo(result);
 
-    if (listen(serverSocket, SOMAXCONN) == SOCKET_ERROR) {
+    // A plain SOMAXCONN backlog is only a couple of hundred on client editions of Windows
+    if (listen(serverSocket, SOMAXCONN_HINT(LISTEN_BACKLOG)) == SOCKET_ERROR) {
         LogMessage(LOG_ERROR, "Listen failed: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
         closesocket(serverSocket);
         WSACleanup();
         return false;
     }
 
-    LogMessage(LOG_INFO, "Publisher Engine initialized and listening on port %s", DEFAULT_PORT);
+    // Routing runs on the workers so a few busy publishers can use every core
+    if (!Executor_Init(&executor, WORKER_COUNT, PIN_WORKERS)) {
+        LogMessage(LOG_ERROR, "Failed to start routing workers");
+        closesocket(serverSocket);
+        WSACleanup();
+        return false;
+    }
+    for (int i = 0; i < ROUTE_STRANDS; i++) {
+        ExecutorStrand_Init(&routeStrands[i], &executor);
+    }
 
-    consoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (consoleHandle == INVALID_HANDLE_VALUE) {
-        LogMessage(LOG_ERROR, "Failed to get console handle");
+    if (!Reactor_Init(&reactor, EVENT_LOOP_COUNT)) {
+        LogMessage(LOG_ERROR, "Failed to start event loops: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
+        closesocket(serverSocket);
+        WSACleanup();
         return false;
     }
 
-    UpdateDisplay();
+    LogMessage(LOG_INFO, "Publisher Engine initialized and listening on port %s", DEFAULT_PORT);
+
+    MetricsConfig metricsConfig = { "publisher_engine", METRICS_FILE, 0, METRICS_PORT, CollectMetrics, NULL };
+    Metrics_Start(&metricsConfig);
+    Trace_OpenSink(TRACE_FILE, "publisher_engine");
     return true;
 }
 
@@ -127,32 +451,108 @@ bool PublisherEngine_IsAuthorized(const char* authMessage) {
 }
 
 bool PublisherEngine_ReceiveMessage(const char* topic, const char* message) {
+    return PublisherEngine_ReceiveTraced(topic, message, NULL);
+}
+
+bool PublisherEngine_ReceiveTraced(const char* topic, const char* message, const TraceHeader* trace) {
+    return RouteMessage(topic, message, trace, NULL, 0);
+}
+
+// Route one message to the links. A message from a publisher session is settled here unless
+// it goes to the SS, in which case its frame carries a session reference until the SS commits it.
+static bool RouteMessage(const char* topic, const char* message, const TraceHeader* trace,
+    PublisherSession* session, LONG64 sequence) {
     if (!topic || !message) {
         LogMessage(LOG_ERROR, "Invalid parameters: %s", GetErrorDescription(ERROR_INVALID_MESSAGE));
         return false;
     }
 
-    LogMessage(LOG_INFO, "Received message for topic '%s': %s", topic, message);
+    if (Interest_IsControlTopic(topic)) {
+        LogMessage(LOG_WARNING, "Rejected message for reserved topic '%s': %s", topic, GetErrorDescription(ERROR_TOPIC_RESTRICTED));
+        Metrics_Add(messagesRejected, 1);
+        if (session) {
+            Session_Settle(session, sequence, CONFIRM_REJECTED);
+        }
+        return false;
+    }
 
-    // Get current topics from SE
-    char topicList[2048];
-    bool topicExists = false;
+    LOG_FAST(LOG_INFO, "Received message for topic '%s': %s", topic, message);
+
+    unsigned long long start = Metrics_Now();
+    size_t length = strlen(message);
+    Metrics_Add(messagesIn, 1);
+    Metrics_Add(bytesIn, (long long)length);
+    Metrics_CountTopic(topic, TOPIC_MESSAGES_IN, 1);
+    Metrics_CountTopic(topic, TOPIC_BYTES_IN, length);
+
+    // Sampled messages keep the publisher's trace (or start one here); the rest travel without one
+    TraceHeader sampled;
+    TraceHeader* activeTrace = NULL;
+    if (Trace_ShouldSample()) {
+        if (trace) {
+            sampled = *trace;
+            Trace_AddHop(&sampled, TRACE_HOP_PES_RECEIVE, Trace_Now());
+        }
+        else {
+            Trace_Begin(&sampled, TRACE_HOP_PES_RECEIVE);
+        }
+        activeTrace = &sampled;
+    }
 
-    if (seConnected && RequestTopicsFromSE(topicList, sizeof(topicList))) {
-        topicExists = IsTopicInList(topic, topicList);
-        LogMessage(LOG_INFO, "Topic '%s' %s in subscriber topics", topic, topicExists ? "found" : "not found");
+    // Forward to SE only if some subscriber is interested in the topic; always to SS if connected
+    bool toSE = false;
+    if (seLink.connected) {
+        toSE = HasInterest(topic);
+        if (!toSE) {
+            Metrics_Add(skippedNoInterest, 1);
+        }
+    }
+    // The SS refuses what does not fit a stored Message, so such messages never get a commit position
+    bool toSS = ssLink.connected;
+    if (toSS && (length == 0 || length >= MAX_MESSAGE_LENGTH || strlen(topic) >= MAX_TOPIC_LENGTH)) {
+        LOG_FAST(LOG_WARNING, "Not storing message for topic '%s': too long or empty", topic);
+        Metrics_Add(unstorableMessages, 1);
+        toSS = false;
+    }
+    unsigned char outcome = CONFIRM_UNSTORED;
+
+    if (toSE || toSS) {
+        // Encode once; both links write the same buffer
+        LinkFrame* frame = LinkFrame_Create(EncodePublish(topic, message, activeTrace));
+        if (!frame) {
+            LogMessage(LOG_ERROR, "Failed to encode message for topic: %s", topic);
+            Metrics_Add(forwardFailures, 1);
+            outcome = CONFIRM_REJECTED;
+        }
+        else {
+            if (toSS && session) {
+                InterlockedIncrement(&session->references);
+                frame->session = session;
+                frame->sequence = sequence;
+                session = NULL;  // The SS link settles it from here
+            }
+            if (toSE) {
+                QueueOnLink(&seLink, frame);
+                Metrics_CountTopic(topic, TOPIC_MESSAGES_OUT, 1);
+                Metrics_CountTopic(topic, TOPIC_BYTES_OUT, length);
+            }
+            if (toSS) {
+                QueueOnLink(&ssLink, frame);
+            }
+            LinkFrame_Release(frame);
+        }
     }
 
-    // Forward to SE only if topic exists in subscriber topics
-    if (seConnected && topicExists) {
-        ForwardToSE(topic, message);
+    if (session) {
+        Session_Settle(session, sequence, outcome);
     }
 
-    // Always forward to SS if connected
-    if (ssConnected) {
-        ForwardToSS(topic, message);
+    if (activeTrace) {
+        Trace_AddHop(activeTrace, TRACE_HOP_PES_FORWARD, Trace_Now());
+        Trace_Record(activeTrace, topic, NULL);
     }
 
+    Metrics_RecordSince(receiveLatency, start);
     return true;
 }
 
@@ -160,11 +560,8 @@ bool PublisherEngine_ForwardMessage(const char* topic, const char* message) {
     return PublisherEngine_ReceiveMessage(topic, message);
 }
 
-static bool ConnectToService(const char* port, SOCKET* serviceSocket, const char* serviceName) {
-    if (*serviceSocket != INVALID_SOCKET) {
-        return true; // Already connected
-    }
-
+// Connect and authenticate to a service; the caller publishes the socket on its link
+static SOCKET ConnectToService(const char* port, const char* authKey, const char* serviceName) {
     struct addrinfo* result = NULL, hints;
     ZeroMemory(&hints, sizeof(hints));
     hints.ai_family = AF_INET;
@@ -172,13 +569,13 @@ static bool ConnectToService(const char* port, SOCKET* serviceSocket, const char
     hints.ai_protocol = IPPROTO_TCP;
 
     if (getaddrinfo("localhost", port, &hints, &result) != 0) {
-        return false;
+        return INVALID_SOCKET;
     }
 
     SOCKET sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
     if (sock == INVALID_SOCKET) {
         freeaddrinfo(result);
-        return false;
+        return INVALID_SOCKET;
     }
 
     // Set non-blocking mode for timeout
@@ -189,7 +586,7 @@ static bool ConnectToService(const char* port, SOCKET* serviceSocket, const char
         if (WSAGetLastError() != WSAEWOULDBLOCK) {
             closesocket(sock);
             freeaddrinfo(result);
-            return false;
+            return INVALID_SOCKET;
         }
 
         // Wait for connection with timeout
@@ -204,7 +601,7 @@ static bool ConnectToService(const char* port, SOCKET* serviceSocket, const char
         if (select(0, NULL, &writeSet, NULL, &timeout) <= 0) {
             closesocket(sock);
             freeaddrinfo(result);
-            return false;
+            return INVALID_SOCKET;
         }
     }
 
@@ -214,130 +611,857 @@ static bool ConnectToService(const char* port, SOCKET* serviceSocket, const char
     freeaddrinfo(result);
 
     // Send authentication
-    char authMessage[256];
-    snprintf(authMessage, sizeof(authMessage), "%s|Publisher Service", PES_AUTH_MESSAGE);
-    if (send(sock, authMessage, strlen(authMessage), 0) == SOCKET_ERROR) {
+    if (!Frame_Send(sock, FRAME_AUTH, authKey, "Publisher Service")) {
         closesocket(sock);
-        return false;
+        return INVALID_SOCKET;
     }
 
-    *serviceSocket = sock;
     LogMessage(LOG_INFO, "Connected to %s successfully", serviceName);
-    return true;
+    return sock;
 }
 
-static bool RequestTopicsFromSE(char* topicList, size_t bufferSize) {
-    if (seSocket == INVALID_SOCKET) {
-        return false;
+static bool HasInterest(const char* topic) {
+    // Hash outside the lock so the critical section is a single probe sequence
+    size_t length = strlen(topic);
+    unsigned int hash = TopicSet_Hash(topic, length);
+
+    AcquireSRWLockShared(&interestLock);
+    bool found = TopicSet_ContainsHashed(&interestTopics, topic, length, hash);
+    ReleaseSRWLockShared(&interestLock);
+
+    return found;
+}
+
+static void ClearInterest(void) {
+    AcquireSRWLockExclusive(&interestLock);
+    TopicSet_Clear(&interestTopics);
+    interestVersion = 0;
+    ReleaseSRWLockExclusive(&interestLock);
+}
+
+static void ApplyInterestDelta(const InterestDelta* delta) {
+    bool needsSync = false;
+
+    AcquireSRWLockExclusive(&interestLock);
+
+    switch (delta->op) {
+    case INTEREST_RESET:
+        TopicSet_Clear(&interestTopics);
+        interestVersion = delta->version;
+        break;
+
+    case INTEREST_SNAPSHOT:
+    case INTEREST_ADD:
+        if (delta->op == INTEREST_ADD) {
+            needsSync = delta->version != interestVersion + 1;
+            interestVersion = delta->version;
+        }
+
+        if (!TopicSet_Insert(&interestTopics, delta->topic)) {
+            LogMessage(LOG_ERROR, "Failed to add topic '%s' to interest cache", delta->topic);
+        }
+        break;
+
+    case INTEREST_REMOVE:
+        needsSync = delta->version != interestVersion + 1;
+        interestVersion = delta->version;
+        TopicSet_Remove(&interestTopics, delta->topic);
+        break;
+
+    default:
+        break;
     }
 
-    // Send topic request
-    const char* request = "request|topics";
-    if (send(seSocket, request, strlen(request), 0) == SOCKET_ERROR) {
-        LogMessage(LOG_ERROR, "Failed to send topic request to SE");
-        seConnected = false;
-        closesocket(seSocket);
-        seSocket = INVALID_SOCKET;
-        return false;
+    ReleaseSRWLockExclusive(&interestLock);
+
+    if (needsSync) {
+        LogMessage(LOG_WARNING, "Interest version gap detected at %lu, requesting resync", delta->version);
+
+        InterestDelta request;
+        request.version = delta->version;
+        request.op = INTEREST_SYNC;
+        request.topic[0] = '\0';
+
+        char line[MAX_INTEREST_LINE];
+        LinkFrame* frame = Interest_FormatDelta(line, sizeof(line), &request) > 0 ?
+            LinkFrame_Create(SharedFrame_Create(FRAME_INTEREST, NULL, line)) : NULL;
+        if (frame) {
+            QueueOnLink(&seLink, frame);
+            LinkFrame_Release(frame);
+        }
     }
+}
 
-    // Receive response
-    int bytesReceived = recv(seSocket, topicList, bufferSize - 1, 0);
-    if (bytesReceived <= 0) {
-        LogMessage(LOG_ERROR, "Failed to receive topic list from SE");
-        seConnected = false;
-        closesocket(seSocket);
-        seSocket = INVALID_SOCKET;
-        return false;
+// Encode a publish frame once for every link, stamping the forward hop on a copy of the trace if there is one
+static SharedFrame* EncodePublish(const char* topic, const char* message, const TraceHeader* trace) {
+    if (!trace) {
+        return SharedFrame_Create(FRAME_PUBLISH, topic, message);
+    }
+
+    TraceHeader forwardTrace = *trace;
+    Trace_AddHop(&forwardTrace, TRACE_HOP_PES_FORWARD, Trace_Now());
+    return SharedFrame_CreateTraced(FRAME_PUBLISH, &forwardTrace, topic, message);
+}
+
+// Wrap an encoded frame for the links, taking over the caller's reference (NULL if frame is NULL)
+static LinkFrame* LinkFrame_Create(SharedFrame* frame) {
+    if (!frame) {
+        return NULL;
+    }
+
+    LinkFrame* linkFrame = (LinkFrame*)malloc(sizeof(LinkFrame));
+    if (!linkFrame) {
+        SharedFrame_Release(frame);
+        return NULL;
+    }
+    linkFrame->references = 1;
+    linkFrame->frame = frame;
+    linkFrame->session = NULL;
+    linkFrame->sequence = 0;
+    return linkFrame;
+}
+
+static void LinkFrame_AddRef(LinkFrame* frame) {
+    InterlockedIncrement(&frame->references);
+}
+
+// The session reference is not dropped here; whoever settles the message drops it
+static void LinkFrame_Release(LinkFrame* frame) {
+    if (InterlockedDecrement(&frame->references) == 0) {
+        SharedFrame_Release(frame->frame);
+        free(frame);
     }
+}
 
-    topicList[bytesReceived] = '\0';
-    LogMessage(LOG_INFO, "Received topic list from SE: %s", topicList);
+// Append a frame to a link's journal; the record takes over the frame's session reference
+static bool SpillFrame(DownstreamLink* link, LinkFrame* frame) {
+    SpillTag tag = { link->confirms && frame->session ? frame->session->id : 0, frame->sequence };
+    if (!SpillJournal_Append(&link->spill, &tag, frame->frame->data, frame->frame->length)) {
+        return false;
+    }
+    Metrics_Add(link->spilled, 1);
     return true;
 }
 
-static bool IsTopicInList(const char* topic, const char* topicList) {
-    if (!topic || !topicList) return false;
+// Hand a frame to a link's writer, applying the link's overflow policy when its queue is full
+static void QueueOnLink(DownstreamLink* link, LinkFrame* frame) {
+    if (link->stopping) {
+        if (link->confirms) {
+            SettleFrame(frame, CONFIRM_UNSTORED);
+        }
+        return;
+    }
+
+    if (link->overflow == LINK_OVERFLOW_BLOCK) {
+        LinkFrame_AddRef(frame);
+        MpscRing_Push(&link->queue, frame);
+        return;
+    }
 
-    char* listCopy = _strdup(topicList);
-    char* token = strtok(listCopy, ",");
+    // Once frames have spilled, later ones follow them through the journal to keep each topic in order
+    AcquireSRWLockShared(&link->spillOrder);
+    if (link->overflow == LINK_OVERFLOW_DROP || SpillJournal_Count(&link->spill) == 0) {
+        void* item = frame;
+        LinkFrame_AddRef(frame);
+        if (MpscRing_TryPushBatch(&link->queue, &item, 1) == 1) {
+            ReleaseSRWLockShared(&link->spillOrder);
+            return;
+        }
+        LinkFrame_Release(frame);
 
-    while (token != NULL) {
-        if (strcmp(token, topic) == 0) {
-            free(listCopy);
-            return true;
+        if (link->overflow == LINK_OVERFLOW_DROP) {
+            ReleaseSRWLockShared(&link->spillOrder);
+            Metrics_Add(link->dropped, 1);
+            if (link->confirms) {
+                SettleFrame(frame, CONFIRM_UNSTORED);
+            }
+            return;
         }
-        token = strtok(NULL, ",");
     }
 
-    free(listCopy);
-    return false;
+    bool spilled = SpillFrame(link, frame);
+    ReleaseSRWLockShared(&link->spillOrder);
+    if (spilled) {
+        return;
+    }
+
+    // The journal is full or failing: give the frame up rather than hold the routing strand, and
+    // with it live delivery, until storage catches up
+    Metrics_Add(forwardFailures, 1);
+    if (link->confirms) {
+        SettleFrame(frame, CONFIRM_UNSTORED);
+    }
 }
 
-static bool ForwardToSE(const char* topic, const char* message) {
-    if (seSocket == INVALID_SOCKET) {
-        return false;
+// Queue a message the writer has just sent to the SS until a commit covers it (under ssLink.sendLock,
+// so a lost connection's Commit_Abandon sees every message written on it). The SS may already have
+// committed and acked it while the rest of the batch was going out; such a message settles at once.
+static void Commit_Track(PublisherSession* session, LONG64 sequence, LONG64 position) {
+    EnterCriticalSection(&pendingCommitsLock);
+    // Refusals of earlier positions belonged to untracked frames
+    while (unstoredCount > 0 && unstoredPositions[unstoredHead] < position) {
+        unstoredHead = (unstoredHead + 1) % UNSTORED_BACKLOG;
+        unstoredCount--;
+    }
+    if (unstoredCount > 0 && unstoredPositions[unstoredHead] == position) {
+        unstoredHead = (unstoredHead + 1) % UNSTORED_BACKLOG;
+        unstoredCount--;
+        LeaveCriticalSection(&pendingCommitsLock);
+        Session_Settle(session, sequence, CONFIRM_UNSTORED);
+        Session_Release(session);
+        return;
     }
 
-    char buffer[MAX_TOPIC_LENGTH + MAX_MESSAGE_LENGTH + 2];
-    snprintf(buffer, sizeof(buffer), "%s|%s", topic, message);
+    // Read under the lock: an ack stores its count before Commit_Settle takes the lock to look for entries
+    if (position <= ssCommittedMessages) {
+        LeaveCriticalSection(&pendingCommitsLock);
+        Session_Settle(session, sequence, CONFIRM_STORED);
+        Session_Release(session);
+        return;
+    }
 
-    if (send(seSocket, buffer, strlen(buffer), 0) == SOCKET_ERROR) {
-        LogMessage(LOG_ERROR, "Failed to forward message to SE");
-        seConnected = false;
-        closesocket(seSocket);
-        seSocket = INVALID_SOCKET;
-        return false;
+    if (pendingCommitsCount == pendingCommitsCapacity) {
+        size_t capacity = pendingCommitsCapacity ? pendingCommitsCapacity * 2 : COMMIT_INITIAL_CAPACITY;
+        PendingCommit* entries = (PendingCommit*)malloc(capacity * sizeof(PendingCommit));
+        if (!entries) {
+            LeaveCriticalSection(&pendingCommitsLock);
+            LogMessage(LOG_ERROR, "Out of memory tracking SS commits; message %lld will not be confirmed as stored", sequence);
+            Session_Settle(session, sequence, CONFIRM_UNSTORED);
+            Session_Release(session);
+            return;
+        }
+        for (size_t i = 0; i < pendingCommitsCount; i++) {
+            entries[i] = pendingCommits[(pendingCommitsHead + i) % pendingCommitsCapacity];
+        }
+        free(pendingCommits);
+        pendingCommits = entries;
+        pendingCommitsHead = 0;
+        pendingCommitsCapacity = capacity;
     }
 
-    LogMessage(LOG_INFO, "Forwarded message to SE: %s", buffer);
-    return true;
+    PendingCommit* entry = &pendingCommits[(pendingCommitsHead + pendingCommitsCount) % pendingCommitsCapacity];
+    entry->session = session;
+    entry->sequence = sequence;
+    entry->position = position;
+    pendingCommitsCount++;
+    LeaveCriticalSection(&pendingCommitsLock);
+}
+
+// Record an ack and settle every message the SS has committed; committed counts publish frames on the
+// connection of generation, so an ack that arrives after a newer connection took over is ignored
+static void Commit_Settle(LONG generation, LONG64 committed, LONG mode) {
+    bool recorded = false;
+    for (;;) {
+        EnterCriticalSection(&pendingCommitsLock);
+        if (generation != ssGeneration) {
+            LeaveCriticalSection(&pendingCommitsLock);
+            return;
+        }
+        if (!recorded) {
+            InterlockedExchange64(&ssCommittedMessages, committed);
+            InterlockedExchange(&ssDurabilityMode, mode);
+            recorded = true;
+        }
+        if (pendingCommitsCount == 0 || pendingCommits[pendingCommitsHead].position > committed) {
+            LeaveCriticalSection(&pendingCommitsLock);
+            return;
+        }
+        PendingCommit entry = pendingCommits[pendingCommitsHead];
+        pendingCommitsHead = (pendingCommitsHead + 1) % pendingCommitsCapacity;
+        pendingCommitsCount--;
+        LeaveCriticalSection(&pendingCommitsLock);
+
+        // Confirms go out with the commit lock released so a slow publisher cannot stall the writer
+        if (entry.session) {
+            Session_Settle(entry.session, entry.sequence, CONFIRM_STORED);
+            Session_Release(entry.session);
+        }
+    }
+}
+
+// The SS did not store the publish frame at position. Its FRAME_NACK comes before any ack that
+// covers the position, but may overtake the writer tracking it, in which case Commit_Track settles it.
+static void Commit_Fail(LONG generation, LONG64 position) {
+    EnterCriticalSection(&pendingCommitsLock);
+    if (generation != ssGeneration) {
+        LeaveCriticalSection(&pendingCommitsLock);
+        return;
+    }
+    Metrics_Add(refusedBySS, 1);
+
+    PublisherSession* session = NULL;
+    LONG64 sequence = 0;
+    bool tracked = false;
+    for (size_t i = pendingCommitsCount; i > 0; i--) {
+        PendingCommit* entry = &pendingCommits[(pendingCommitsHead + i - 1) % pendingCommitsCapacity];
+        if (entry->position == position) {
+            session = entry->session;
+            sequence = entry->sequence;
+            entry->session = NULL;
+            tracked = true;
+            break;
+        }
+        if (entry->position < position) {
+            break;
+        }
+    }
+    if (!tracked) {
+        // Overflow only ever drops the oldest, which belong to untracked frames long since written
+        if (unstoredCount == UNSTORED_BACKLOG) {
+            unstoredHead = (unstoredHead + 1) % UNSTORED_BACKLOG;
+            unstoredCount--;
+        }
+        unstoredPositions[(unstoredHead + unstoredCount) % UNSTORED_BACKLOG] = position;
+        unstoredCount++;
+    }
+    LeaveCriticalSection(&pendingCommitsLock);
+
+    if (session) {
+        Session_Settle(session, sequence, CONFIRM_UNSTORED);
+        Session_Release(session);
+    }
+}
+
+// The SS connection of generation is gone: messages it had not committed may or may not be stored.
+// Does nothing once a newer connection has taken over, which abandoned these messages as it started.
+static void Commit_Abandon(LONG generation) {
+    EnterCriticalSection(&pendingCommitsLock);
+    if (generation != ssGeneration) {
+        LeaveCriticalSection(&pendingCommitsLock);
+        return;
+    }
+    PendingCommit* entries = pendingCommits;
+    size_t head = pendingCommitsHead;
+    size_t count = pendingCommitsCount;
+    size_t capacity = pendingCommitsCapacity;
+    pendingCommits = NULL;
+    pendingCommitsHead = 0;
+    pendingCommitsCount = 0;
+    pendingCommitsCapacity = 0;
+    unstoredCount = 0;
+    LeaveCriticalSection(&pendingCommitsLock);
+
+    if (count > 0) {
+        LogMessage(LOG_WARNING, "%zu messages written to the SS were not confirmed as stored", count);
+    }
+    for (size_t i = 0; i < count; i++) {
+        PendingCommit* entry = &entries[(head + i) % capacity];
+        if (entry->session) {
+            Session_Settle(entry->session, entry->sequence, CONFIRM_UNSTORED);
+            Session_Release(entry->session);
+        }
+    }
+    free(entries);
+}
+
+// Start positions over for a new SS connection (under ssLink.sendLock, before its socket is published)
+// and return its generation. Messages still tracked for the previous connection were never acked on it.
+static LONG Commit_Begin(void) {
+    Commit_Abandon(ssGeneration);
+
+    EnterCriticalSection(&pendingCommitsLock);
+    LONG generation = ++ssGeneration;
+    ssLink.written = 0;
+    ssCommittedMessages = 0;
+    ssDurabilityMode = -1;
+    LeaveCriticalSection(&pendingCommitsLock);
+    return generation;
+}
+
+// Keep a batch a spilling link could not write for its next connection. With the journal empty, the
+// batch and everything queued behind it move into the journal, which routing then keeps appending to.
+// Otherwise the batch is older than what the journal holds and waits in link->held to go out first.
+static void KeepLinkBatch(DownstreamLink* link, LinkFrame** frames, size_t count) {
+    AcquireSRWLockExclusive(&link->spillOrder);
+    bool moved = SpillJournal_Count(&link->spill) == 0;
+    if (moved) {
+        void* queued[LINK_BATCH_FRAMES];
+        size_t more = count;
+        memcpy(queued, frames, count * sizeof(LinkFrame*));
+        do {
+            for (size_t i = 0; i < more; i++) {
+                LinkFrame* frame = (LinkFrame*)queued[i];
+                if (!SpillFrame(link, frame)) {
+                    Metrics_Add(forwardFailures, 1);
+                    if (link->confirms) {
+                        SettleFrame(frame, CONFIRM_UNSTORED);
+                    }
+                }
+                LinkFrame_Release(frame);
+            }
+        } while ((more = MpscRing_TryPopBatch(&link->queue, queued, LINK_BATCH_FRAMES)) > 0);
+    }
+    ReleaseSRWLockExclusive(&link->spillOrder);
+
+    if (!moved) {
+        if (frames != link->held) {
+            memcpy(link->held, frames, count * sizeof(LinkFrame*));
+        }
+        link->heldCount = count;
+    }
+}
+
+// Write one batch from a link's queue in a single gathering send. Frames that find the link down
+// are kept for the next connection on a spilling link and dropped on any other.
+static void WriteLinkBatch(DownstreamLink* link, LinkFrame** frames, size_t count, size_t bytes,
+    unsigned long long batchStart) {
+    WSABUF buffers[LINK_BATCH_FRAMES];
+    size_t publishes = 0;
+    for (size_t i = 0; i < count; i++) {
+        buffers[i].buf = frames[i]->frame->data;
+        buffers[i].len = (ULONG)frames[i]->frame->length;
+        if ((FrameType)(unsigned char)frames[i]->frame->data[0] == FRAME_PUBLISH) {
+            publishes++;
+        }
+    }
+
+    Metrics_RecordSince(link->batchLinger, batchStart);
+    Metrics_Record(link->batchFrames, count);
+    Metrics_Record(link->batchBytes, bytes);
+
+    bool sent = false;
+    EnterCriticalSection(&link->sendLock);
+    if (link->socket != INVALID_SOCKET) {
+        unsigned long long start = Metrics_Now();
+        if (Frame_SendBuffers(link->socket, buffers, (DWORD)count)) {
+            Metrics_RecordSince(link->latency, start);
+            Metrics_Add(link->forwarded, (long long)publishes);
+            if (link->confirms) {
+                LONG64 position = link->written;
+                for (size_t i = 0; i < count; i++) {
+                    if ((FrameType)(unsigned char)frames[i]->frame->data[0] != FRAME_PUBLISH) {
+                        continue;
+                    }
+                    position++;
+                    if (frames[i]->session) {
+                        Commit_Track(frames[i]->session, frames[i]->sequence, position);
+                    }
+                }
+            }
+            InterlockedExchangeAdd64(&link->written, (LONG64)publishes);
+            sent = true;
+        }
+        else {
+            LogMessage(LOG_ERROR, "Failed to forward %zu frames to %s", count, link->name);
+            link->connected = false;
+            closesocket(link->socket);
+            link->socket = INVALID_SOCKET;
+        }
+    }
+    LeaveCriticalSection(&link->sendLock);
+
+    if (!sent && link->overflow == LINK_OVERFLOW_SPILL && !link->stopping) {
+        KeepLinkBatch(link, frames, count);
+        return;
+    }
+    if (!sent) {
+        Metrics_Add(forwardFailures, (long long)count);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (link->confirms && !sent) {
+            SettleFrame(frames[i], CONFIRM_UNSTORED);
+        }
+        LinkFrame_Release(frames[i]);
+    }
+}
+
+static size_t FrameBytes(void* const* frames, size_t count) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        bytes += ((LinkFrame*)frames[i])->frame->length;
+    }
+    return bytes;
 }
 
-static bool ForwardToSS(const char* topic, const char* message) {
-    if (ssSocket == INVALID_SOCKET) {
+// Hand the tagged messages of a replayed batch over to commit tracking (under link->sendLock).
+// Frame_SendBuffers has advanced the spans, so frame types are read behind each tag instead.
+static void TrackReplayed(DownstreamLink* link, const char** tags, size_t count) {
+    LONG64 position = link->written;
+    for (size_t i = 0; i < count; i++) {
+        SpillTag tag;
+        memcpy(&tag, tags[i], sizeof(tag));
+        if ((FrameType)(unsigned char)tags[i][sizeof(tag)] != FRAME_PUBLISH) {
+            continue;
+        }
+        position++;
+        if (tag.session) {
+            Commit_Track(Session_Find(tag.session), tag.sequence, position);
+        }
+    }
+}
+
+// Send one batch of spilled frames, oldest first. Returns false if there was nothing to send
+// or the link is down; frames stay in the journal until a send succeeds, so a batch cut off by
+// a lost connection is sent again in full on the next one.
+static bool ReplaySpill(DownstreamLink* link) {
+    WSABUF buffers[LINK_BATCH_FRAMES];
+    const char* tags[LINK_BATCH_FRAMES];
+    size_t bytes;
+
+    EnterCriticalSection(&link->sendLock);
+    if (link->socket == INVALID_SOCKET) {
+        LeaveCriticalSection(&link->sendLock);
         return false;
     }
 
-    char buffer[MAX_TOPIC_LENGTH + MAX_MESSAGE_LENGTH + 2];
-    snprintf(buffer, sizeof(buffer), "%s|%s", topic, message);
+    size_t count = SpillJournal_Peek(&link->spill, link->replayBuffer, buffers, tags, LINK_BATCH_FRAMES, &bytes);
+    size_t publishes = 0;
+    for (size_t i = 0; i < count; i++) {
+        if ((FrameType)(unsigned char)buffers[i].buf[0] == FRAME_PUBLISH) {
+            publishes++;
+        }
+    }
+
+    bool sent = false;
+    if (count > 0) {
+        unsigned long long start = Metrics_Now();
+        if (Frame_SendBuffers(link->socket, buffers, (DWORD)count)) {
+            Metrics_RecordSince(link->latency, start);
+            Metrics_Add(link->forwarded, (long long)publishes);
+            Metrics_Add(link->replayed, (long long)count);
+            if (link->confirms) {
+                TrackReplayed(link, tags, count);
+            }
+            InterlockedExchangeAdd64(&link->written, (LONG64)publishes);
+            SpillJournal_Consume(&link->spill, count, bytes);
+            sent = true;
+        }
+        else {
+            LogMessage(LOG_ERROR, "Failed to replay %zu spilled frames to %s", count, link->name);
+            link->connected = false;
+            closesocket(link->socket);
+            link->socket = INVALID_SOCKET;
+        }
+    }
+    LeaveCriticalSection(&link->sendLock);
+
+    if (sent) {
+        Metrics_Record(link->batchFrames, count);
+        Metrics_Record(link->batchBytes, bytes);
+    }
+    return sent;
+}
+
+// Drains one link's queue for the lifetime of the engine. While the journal holds frames the
+// queue only has frames older than them, so the queue is emptied before each replay.
+static unsigned __stdcall LinkWriterThread(void* param) {
+    DownstreamLink* link = (DownstreamLink*)param;
+    void* frames[LINK_BATCH_FRAMES];
+
+    for (;;) {
+        // A batch kept from a lost connection is older than anything queued or spilled
+        if (link->heldCount > 0) {
+            if (!link->connected && !link->stopping) {
+                Sleep(LINK_IDLE_WAIT);
+                continue;
+            }
+            size_t held = link->heldCount;
+            link->heldCount = 0;
+            WriteLinkBatch(link, link->held, held, FrameBytes((void* const*)link->held, held), Metrics_Now());
+            continue;
+        }
+
+        bool spilled = SpillJournal_Count(&link->spill) > 0;
+        size_t count = spilled ? MpscRing_TryPopBatch(&link->queue, frames, LINK_BATCH_FRAMES) :
+            MpscRing_PopBatch(&link->queue, frames, LINK_BATCH_FRAMES, LINK_IDLE_WAIT);
+        if (count == 0) {
+            if (spilled && ReplaySpill(link)) {
+                continue;
+            }
+            if (link->stopping) {
+                break;
+            }
+            if (spilled) {
+                Sleep(LINK_IDLE_WAIT);  // Link is down; the journal waits for the next connection
+            }
+            continue;
+        }
+
+        // Keep gathering while routing keeps the queue fed; an empty queue means the link is idle
+        unsigned long long batchStart = Metrics_Now();
+        size_t bytes = FrameBytes(frames, count);
+        while (count < LINK_BATCH_FRAMES && bytes < LINK_FLUSH_BYTES && Metrics_Now() - batchStart < link->lingerTicks) {
+            size_t more = MpscRing_TryPopBatch(&link->queue, frames + count, LINK_BATCH_FRAMES - count);
+            if (more == 0) {
+                break;
+            }
+            bytes += FrameBytes(frames + count, more);
+            count += more;
+        }
+
+        WriteLinkBatch(link, (LinkFrame**)frames, count, bytes, batchStart);
+    }
+    return 0;
+}
 
-    if (send(ssSocket, buffer, strlen(buffer), 0) == SOCKET_ERROR) {
-        LogMessage(LOG_ERROR, "Failed to forward message to SS");
-        ssConnected = false;
-        closesocket(ssSocket);
-        ssSocket = INVALID_SOCKET;
+static bool StartLink(DownstreamLink* link, const char* name, LinkOverflow overflow, const char* spillPath,
+    Metric* forwarded, Metric* latency) {
+    link->name = name;
+    link->overflow = overflow;
+    link->socket = INVALID_SOCKET;
+    link->forwarded = forwarded;
+    link->latency = latency;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    link->lingerTicks = (unsigned long long)frequency.QuadPart * LINK_MAX_LINGER_US / 1000000;
+
+    InitializeCriticalSection(&link->sendLock);
+    InitializeSRWLock(&link->spillOrder);
+    if (!MpscRing_Init(&link->queue, LINK_QUEUE_CAPACITY)) {
         return false;
     }
 
-    LogMessage(LOG_INFO, "Forwarded message to SS: %s", buffer);
-    return true;
+    // Without a journal, spilling degrades to waiting for the writer
+    if (overflow == LINK_OVERFLOW_SPILL) {
+        link->replayBuffer = (char*)malloc(SPILLJOURNAL_READ_SIZE);
+        size_t tagSize = link->confirms ? sizeof(SpillTag) : 0;
+        if (!link->replayBuffer || !SpillJournal_Open(&link->spill, spillPath, SS_SPILL_LIMIT, tagSize)) {
+            LogMessage(LOG_WARNING, "No spill journal for %s; a full queue will pause routing", name);
+            link->overflow = LINK_OVERFLOW_BLOCK;
+        }
+    }
+
+    unsigned threadId;
+    link->writer = (HANDLE)_beginthreadex(NULL, 0, LinkWriterThread, link, 0, &threadId);
+    return link->writer != NULL;
+}
+
+// Write what is still queued and stop the writer. The queue and lock stay allocated so a
+// listener thread that is still winding down finds a stopped link rather than freed memory.
+static void StopLink(DownstreamLink* link) {
+    if (link->writer == NULL) {
+        return;
+    }
+
+    link->stopping = true;
+    WaitForSingleObject(link->writer, INFINITE);
+    CloseHandle(link->writer);
+    link->writer = NULL;
+
+    // Routing has stopped, so nothing appends to the journal any more; what is left was never stored
+    if (link->confirms && link->replayBuffer) {
+        WSABUF buffers[LINK_BATCH_FRAMES];
+        const char* tags[LINK_BATCH_FRAMES];
+        size_t bytes;
+        size_t count;
+        while ((count = SpillJournal_Peek(&link->spill, link->replayBuffer, buffers, tags, LINK_BATCH_FRAMES, &bytes)) > 0) {
+            for (size_t i = 0; i < count; i++) {
+                SpillTag tag;
+                memcpy(&tag, tags[i], sizeof(tag));
+                if (tag.session) {
+                    PublisherSession* session = Session_Find(tag.session);
+                    Session_Settle(session, tag.sequence, CONFIRM_UNSTORED);
+                    Session_Release(session);
+                }
+            }
+            SpillJournal_Consume(&link->spill, count, bytes);
+        }
+    }
+    SpillJournal_Close(&link->spill);
+    free(link->replayBuffer);
+    link->replayBuffer = NULL;
+}
+
+static bool IsUsernameUnique(PublisherShard* shard, const char* username) {
+    return !TopicSet_Contains(&shard->names, username);
 }
 
-static bool IsUsernameUnique(const char* username) {
-    for (int i = 0; i < publisherCount; i++) {
-        if (strcmp(publishers[i]->username, username) == 0) {
+static bool InitPublisherShards(void) {
+    shardCount = PUBLISHER_SHARDS;
+    if (shardCount <= 0) {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        shardCount = info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+    }
+
+    publisherShards = (PublisherShard*)calloc((size_t)shardCount, sizeof(PublisherShard));
+    if (!publisherShards) {
+        return false;
+    }
+    for (int i = 0; i < shardCount; i++) {
+        PublisherShard* shard = &publisherShards[i];
+        InitializeCriticalSection(&shard->lock);
+        shard->capacity = PUBLISHER_SHARD_CAPACITY;
+        shard->publishers = (Client**)malloc(shard->capacity * sizeof(Client*));
+        if (!shard->publishers || !TopicSet_Init(&shard->names, 0)) {
             return false;
         }
     }
     return true;
 }
 
+static PublisherShard* ShardFor(const char* username) {
+    return &publisherShards[TopicSet_Hash(username, strlen(username)) % (unsigned int)shardCount];
+}
+
+// Reads interest updates pushed by the SE for the lifetime of one SE connection
+static unsigned __stdcall InterestListenerThread(void* param) {
+    SOCKET sock = (SOCKET)(ULONG_PTR)param;
+    FrameStream stream;
+
+    if (!FrameStream_Init(&stream, sock)) {
+        LogMessage(LOG_ERROR, "Failed to allocate interest stream buffer");
+        return 0;
+    }
+
+    while (!shouldStop) {
+        Frame frame;
+        int result = FrameStream_Read(&stream, &frame);
+        if (result <= 0) {
+            if (result < 0) {
+                LogMessage(LOG_ERROR, "Invalid frame from Subscriber Engine");
+            }
+            LogMessage(LOG_WARNING, "Lost connection to Subscriber Engine");
+            EnterCriticalSection(&seLink.sendLock);
+            if (seLink.socket == sock) {
+                seLink.connected = false;
+                closesocket(seLink.socket);
+                seLink.socket = INVALID_SOCKET;
+            }
+            LeaveCriticalSection(&seLink.sendLock);
+            ClearInterest();
+            break;
+        }
+
+        if (frame.type != FRAME_INTEREST) {
+            LogMessage(LOG_WARNING, "Ignoring unexpected frame type %d from SE", frame.type);
+            continue;
+        }
+
+        InterestDelta delta;
+        if (Interest_ParseDelta(frame.payload, &delta)) {
+            ApplyInterestDelta(&delta);
+        }
+        else {
+            LogMessage(LOG_WARNING, "Ignoring malformed interest line from SE: %s", frame.payload);
+        }
+    }
+
+    FrameStream_Destroy(&stream);
+    return 0;
+}
+
+// Reads commit acks from the SS for the lifetime of one SS connection
+static unsigned __stdcall StorageAckListenerThread(void* param) {
+    StorageConnection connection = *(StorageConnection*)param;
+    SOCKET sock = connection.socket;
+    FrameStream stream;
+    free(param);
+
+    if (!FrameStream_Init(&stream, sock)) {
+        LogMessage(LOG_ERROR, "Failed to allocate storage ack stream buffer");
+        return 0;
+    }
+
+    while (!shouldStop) {
+        Frame frame;
+        int result = FrameStream_Read(&stream, &frame);
+        if (result <= 0) {
+            if (result < 0) {
+                LogMessage(LOG_ERROR, "Invalid frame from Storage Service");
+            }
+            LogMessage(LOG_WARNING, "Lost connection to Storage Service with %lld of %lld messages committed",
+                ssCommittedMessages, ssLink.written);
+            EnterCriticalSection(&ssLink.sendLock);
+            if (ssLink.socket == sock) {
+                ssLink.connected = false;
+                closesocket(ssLink.socket);
+                ssLink.socket = INVALID_SOCKET;
+            }
+            // A newer connection has already abandoned what was left of this one
+            Commit_Abandon(connection.generation);
+            LeaveCriticalSection(&ssLink.sendLock);
+            break;
+        }
+
+        if (frame.type == FRAME_NACK) {
+            LONG64 position = (LONG64)strtoull(frame.payload, NULL, 10);
+            LogMessage(LOG_WARNING, "SS did not store message %lld", position);
+            Commit_Fail(connection.generation, position);
+            continue;
+        }
+
+        if (frame.type != FRAME_ACK) {
+            LogMessage(LOG_WARNING, "Ignoring unexpected frame type %d from SS", frame.type);
+            continue;
+        }
+
+        // Acks are cumulative: everything up to this count is committed under the SS durability mode,
+        // apart from the frames already reported in a FRAME_NACK
+        LONG64 committed = (LONG64)strtoull(frame.payload, NULL, 10);
+        LogMessage(LOG_DEBUG, "SS committed %lld of %lld messages", committed, ssLink.written);
+        Commit_Settle(connection.generation, committed, (LONG)frame.flags);
+    }
+
+    FrameStream_Destroy(&stream);
+    return 0;
+}
+
 static unsigned __stdcall ConnectionManagerThread(void* param) {
     while (!shouldStop) {
         // Try to connect to SE
-        if (!seConnected) {
-            if (ConnectToService(SE_PORT, &seSocket, "Subscriber Engine")) {
-                seConnected = true;
-                UpdateDisplay();
+        if (!seLink.connected) {
+            SOCKET sock = ConnectToService(SE_PORT, PES_AUTH_MESSAGE, "Subscriber Engine");
+            if (sock != INVALID_SOCKET) {
+                EnterCriticalSection(&seLink.sendLock);
+                seLink.socket = sock;
+                seLink.connected = true;
+                LeaveCriticalSection(&seLink.sendLock);
+
+                unsigned threadId;
+                HANDLE listenerThread = (HANDLE)_beginthreadex(NULL, 0, InterestListenerThread, (void*)(ULONG_PTR)sock, 0, &threadId);
+                if (listenerThread == NULL) {
+                    LogMessage(LOG_ERROR, "Failed to create interest listener thread");
+                    EnterCriticalSection(&seLink.sendLock);
+                    if (seLink.socket == sock) {
+                        seLink.connected = false;
+                        closesocket(seLink.socket);
+                        seLink.socket = INVALID_SOCKET;
+                    }
+                    LeaveCriticalSection(&seLink.sendLock);
+                }
+                else {
+                    CloseHandle(listenerThread);
+                }
             }
         }
 
         // Try to connect to SS
-        if (!ssConnected) {
-            if (ConnectToService(SS_PORT, &ssSocket, "Storage Service")) {
-                ssConnected = true;
-                UpdateDisplay();
+        if (!ssLink.connected) {
+            SOCKET sock = ConnectToService(SS_PORT, SS_AUTH_KEY, "Storage Service");
+            if (sock != INVALID_SOCKET) {
+                // Positions restart with the connection; the writer sends under the same lock,
+                // so its first frame on the new socket already counts from zero
+                EnterCriticalSection(&ssLink.sendLock);
+                LONG generation = Commit_Begin();
+                ssLink.socket = sock;
+                ssLink.connected = true;
+                LeaveCriticalSection(&ssLink.sendLock);
+
+                unsigned threadId;
+                StorageConnection* connection = (StorageConnection*)malloc(sizeof(StorageConnection));
+                HANDLE ackThread = NULL;
+                if (connection) {
+                    connection->socket = sock;
+                    connection->generation = generation;
+                    ackThread = (HANDLE)_beginthreadex(NULL, 0, StorageAckListenerThread, connection, 0, &threadId);
+                }
+                if (ackThread == NULL) {
+                    LogMessage(LOG_ERROR, "Failed to create storage ack listener thread");
+                    free(connection);
+                    EnterCriticalSection(&ssLink.sendLock);
+                    if (ssLink.socket == sock) {
+                        ssLink.connected = false;
+                        closesocket(ssLink.socket);
+                        ssLink.socket = INVALID_SOCKET;
+                    }
+                    Commit_Abandon(generation);
+                    LeaveCriticalSection(&ssLink.sendLock);
+                }
+                else {
+                    CloseHandle(ackThread);
+                }
             }
         }
 
@@ -346,152 +1470,612 @@ static unsigned __stdcall ConnectionManagerThread(void* param) {
     return 0;
 }
 
-static unsigned __stdcall HandleRequestsThread(void* param) {
-    SOCKET clientSocket = *(SOCKET*)param;
-    char buffer[BUFFER_SIZE];
+// Permille of a queue's capacity in use, capped at 1000
+static long long Occupancy(long long used, long long capacity) {
+    long long permille = used * 1000 / capacity;
+    return permille < 1000 ? permille : 1000;
+}
 
-    while (!shouldStop) {
-        int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-        if (bytesReceived <= 0) {
-            // Client disconnected
-            WaitForSingleObject(publishersMutex, INFINITE);
-            for (int i = 0; i < publisherCount; i++) {
-                if (publishers[i]->clientSocket == clientSocket) {
-                    Client_Cleanup(publishers[i]);
-                    free(publishers[i]);
-                    // Move remaining publishers up
-                    for (int j = i; j < publisherCount - 1; j++) {
-                        publishers[j] = publishers[j + 1];
-                    }
-                    publisherCount--;
-                    break;
-                }
-            }
-            ReleaseMutex(publishersMutex);
-            UpdateDisplay();
-            break;
+// Window each publisher gets right now: the full window while routing and the blocking
+// links keep up, shrinking towards CREDIT_MIN_WINDOW as the fullest of them fills.
+// Spilling and dropping links absorb overload themselves, so they do not shrink it.
+static long long CreditWindow(void) {
+    long long occupancy = Occupancy(Executor_Pending(&executor), ROUTE_MAX_PENDING);
+    DownstreamLink* links[] = { &seLink, &ssLink };
+    for (int i = 0; i < 2; i++) {
+        if (links[i]->overflow == LINK_OVERFLOW_BLOCK && links[i]->queue.cells) {
+            long long link = Occupancy((long long)MpscRing_Count(&links[i]->queue), links[i]->queue.mask + 1);
+            occupancy = link > occupancy ? link : occupancy;
+        }
+    }
+    return CREDIT_MAX_WINDOW - (CREDIT_MAX_WINDOW - CREDIT_MIN_WINDOW) * occupancy / 1000;
+}
+
+// Give a session an id in sessionTable
+static bool Session_Register(PublisherSession* session) {
+    AcquireSRWLockExclusive(&sessionTableLock);
+    if (freeSessionIdCount == 0 && sessionTableSize == sessionTableCapacity) {
+        size_t capacity = sessionTableCapacity ? sessionTableCapacity * 2 : MAX_CLIENTS;
+        PublisherSession** table = (PublisherSession**)realloc(sessionTable, capacity * sizeof(PublisherSession*));
+        if (table) {
+            sessionTable = table;
+        }
+        LONG* freeIds = (LONG*)realloc(freeSessionIds, capacity * sizeof(LONG));
+        if (freeIds) {
+            freeSessionIds = freeIds;
         }
+        if (!table || !freeIds) {
+            ReleaseSRWLockExclusive(&sessionTableLock);
+            return false;
+        }
+        sessionTableCapacity = capacity;
+    }
+
+    session->id = freeSessionIdCount > 0 ? freeSessionIds[--freeSessionIdCount] : (LONG)++sessionTableSize;
+    sessionTable[session->id - 1] = session;
+    ReleaseSRWLockExclusive(&sessionTableLock);
+    return true;
+}
+
+// Look up a session a journal record holds a reference on
+static PublisherSession* Session_Find(LONG id) {
+    AcquireSRWLockShared(&sessionTableLock);
+    PublisherSession* session = sessionTable[id - 1];
+    ReleaseSRWLockShared(&sessionTableLock);
+    return session;
+}
+
+static PublisherSession* Session_Create(ReactorConnection* connection) {
+    PublisherSession* session = (PublisherSession*)calloc(1, sizeof(PublisherSession));
+    if (!session) {
+        return NULL;
+    }
+    if (!Session_Register(session)) {
+        free(session);
+        return NULL;
+    }
+
+    session->references = 1;
+    session->connection = connection;
+    SendQueue_Init(&session->outbound, 0, 0);
+    InitializeCriticalSection(&session->lock);
+    return session;
+}
+
+static void Session_Release(PublisherSession* session) {
+    if (InterlockedDecrement(&session->references) == 0) {
+        AcquireSRWLockExclusive(&sessionTableLock);
+        sessionTable[session->id - 1] = NULL;
+        freeSessionIds[freeSessionIdCount++] = session->id;
+        ReleaseSRWLockExclusive(&sessionTableLock);
+
+        SendQueue_Destroy(&session->outbound);
+        DeleteCriticalSection(&session->lock);
+        free(session->outcomes);
+        free(session);
+    }
+}
 
-        buffer[bytesReceived] = '\0';
+// Queue a frame for the publisher's event loop to write, taking over the caller's reference.
+// Never blocks: a full queue means the publisher has stopped reading (caller holds the lock).
+static bool Session_Send(PublisherSession* session, SharedFrame* frame) {
+    if (!frame) {
+        return false;
+    }
+
+    const char* sendData;
+    size_t sendLength;
+    bool queued = SendQueue_Push(&session->outbound, frame, &sendData, &sendLength);
+    SharedFrame_Release(frame);
+    if (sendData) {
+        Reactor_Send(session->connection, sendData, sendLength);
+    }
+    return queued;
+}
 
-        char* delimiter = strchr(buffer, '|');
-        if (delimiter) {
-            *delimiter = '\0';
-            char* topic = buffer;
-            char* message = delimiter + 1;
+// Top the publisher's window back up once enough of it is free. A publisher with nothing
+// outstanding is always topped up, so the last retirement never leaves it without credit.
+static void Credit_Grant(PublisherSession* session) {
+    long long window = CreditWindow();
+    long long outstanding = session->granted - session->retired;
+    long long grant = window - outstanding;
+    if (grant <= 0 || (grant < window / CREDIT_GRANT_FRACTION && outstanding > 0)) {
+        return;
+    }
 
-            LogMessage(LOG_INFO, "Publisher sent message: %s|%s", topic, message);
-            PublisherEngine_ReceiveMessage(topic, message);
+    EnterCriticalSection(&session->lock);
+    grant = window - (session->granted - session->retired);
+    if (grant > 0 && session->connection) {
+        char text[24];
+        snprintf(text, sizeof(text), "%lld", grant);
+        if (Session_Send(session, SharedFrame_Create(FRAME_CREDIT, NULL, text))) {
+            InterlockedExchangeAdd64(&session->granted, grant);
+            Metrics_Add(creditsGranted, grant);
+        }
+        else {
+            // A publisher that does not read its grants stops getting them; its reads stay open
+            LogMessage(LOG_WARNING, "Failed to send credit grant to publisher; no further grants on this connection");
+            session->connection = NULL;
         }
     }
+    LeaveCriticalSection(&session->lock);
+}
 
-    return 0;
+// Report every message up to settled to the publisher (caller holds the lock)
+static void Session_Confirm(PublisherSession* session) {
+    if (session->connection) {
+        char text[24];
+        snprintf(text, sizeof(text), "%lld", session->settled);
+        if (!Session_Send(session, SharedFrame_CreateFlagged(FRAME_CONFIRM, session->runOutcome, NULL, text))) {
+            LogMessage(LOG_WARNING, "Failed to send confirm to publisher; no further confirms or grants on this connection");
+            session->connection = NULL;
+        }
+    }
+    session->confirmed = session->settled;
 }
 
-static unsigned __stdcall HandleClientThread(void* param) {
-    while (!shouldStop) {
-        SOCKET clientSocket = accept(serverSocket, NULL, NULL);
-        if (clientSocket == INVALID_SOCKET) continue;
+// Make room to record the outcome of the message offset places after settled (caller holds the lock)
+static bool Session_Reserve(PublisherSession* session, size_t offset) {
+    if (offset < session->outcomeCapacity) {
+        return true;
+    }
 
-        char buffer[BUFFER_SIZE];
-        int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-        if (bytesReceived <= 0) {
-            closesocket(clientSocket);
-            continue;
+    size_t capacity = session->outcomeCapacity ? session->outcomeCapacity : SESSION_INITIAL_OUTCOMES;
+    while (capacity <= offset) {
+        capacity *= 2;
+    }
+    unsigned char* outcomes = (unsigned char*)calloc(capacity, 1);
+    if (!outcomes) {
+        return false;
+    }
+
+    // Unwrap the ring so settled + 1 lands in slot 0
+    for (size_t i = 0; i < session->outcomeCapacity; i++) {
+        outcomes[i] = session->outcomes[(session->outcomeHead + i) & (session->outcomeCapacity - 1)];
+    }
+    free(session->outcomes);
+    session->outcomes = outcomes;
+    session->outcomeHead = 0;
+    session->outcomeCapacity = capacity;
+    return true;
+}
+
+// Record the outcome of one message and confirm the run it completes. Confirms are batched
+// while other messages are still in flight, and sent at once when the publisher has nothing
+// else outstanding or the outcome changes, so every message is confirmed exactly once.
+static void Session_Settle(PublisherSession* session, LONG64 sequence, unsigned char outcome) {
+    Metrics_Add(settledOutcomes[outcome], 1);
+
+    EnterCriticalSection(&session->lock);
+    if (session->untracked || !Session_Reserve(session, (size_t)(sequence - session->settled - 1))) {
+        if (!session->untracked) {
+            LogMessage(LOG_ERROR, "Out of memory tracking publisher confirms; no further confirms on this connection");
+            session->untracked = true;
         }
+        LeaveCriticalSection(&session->lock);
+        return;
+    }
 
-        buffer[bytesReceived] = '\0';
+    size_t mask = session->outcomeCapacity - 1;
+    session->outcomes[(session->outcomeHead + (size_t)(sequence - session->settled - 1)) & mask] = outcome;
+    while (session->outcomes[session->outcomeHead] != 0) {
+        unsigned char next = session->outcomes[session->outcomeHead];
+        session->outcomes[session->outcomeHead] = 0;
+        session->outcomeHead = (session->outcomeHead + 1) & mask;
+        if (session->settled > session->confirmed && next != session->runOutcome) {
+            Session_Confirm(session);
+        }
+        session->runOutcome = next;
+        session->settled++;
+    }
 
-        // Split the buffer into auth and username parts
-        char* delimiter = strchr(buffer, '|');
-        if (!delimiter) {
-            send(clientSocket, "Invalid authentication format", strlen("Invalid authentication format"), 0);
-            LogMessage(LOG_WARNING, "Invalid authentication format");
-            closesocket(clientSocket);
-            continue;
+    if (session->settled > session->confirmed &&
+        (session->settled - session->confirmed >= CONFIRM_BATCH || session->settled == session->received)) {
+        Session_Confirm(session);
+    }
+    LeaveCriticalSection(&session->lock);
+}
+
+// Settle the message behind an SS frame and drop the session reference the frame held
+static void SettleFrame(LinkFrame* frame, unsigned char outcome) {
+    if (frame->session) {
+        Session_Settle(frame->session, frame->sequence, outcome);
+        Session_Release(frame->session);
+    }
+}
+
+// Send a status response to a connection that is about to be rejected
+static bool RejectClient(SOCKET clientSocket, const char* reason) {
+    Frame_Send(clientSocket, FRAME_RESPONSE, NULL, reason);
+    return false;
+}
+
+// Handle the first frame of a connection; returns false to drop it
+static bool AuthenticatePublisher(ReactorConnection* connection, PublisherConnection* state, const Frame* frame) {
+    if (frame->type != FRAME_AUTH || frame->payloadLength == 0) {
+        LogMessage(LOG_WARNING, "Invalid authentication format");
+        return RejectClient(connection->socket, "Invalid authentication format");
+    }
+
+    if (!PublisherEngine_IsAuthorized(frame->topic)) {
+        LogMessage(LOG_WARNING, "Unauthorized connection attempt");
+        return RejectClient(connection->socket, "Unauthorized connection attempt");
+    }
+
+    char username[MAX_USERNAME];
+    strncpy(username, frame->payload, sizeof(username) - 1);
+    username[sizeof(username) - 1] = '\0';
+
+    // Reserve a slot first so the limit holds across shards without a global lock
+    if (InterlockedIncrement(&publisherCount) > MAX_CLIENTS) {
+        InterlockedDecrement(&publisherCount);
+        LogMessage(LOG_ERROR, "Maximum clients reached");
+        return RejectClient(connection->socket, "Maximum clients reached");
+    }
+
+    PublisherShard* shard = ShardFor(username);
+    EnterCriticalSection(&shard->lock);
+
+    if (!IsUsernameUnique(shard, username)) {
+        LogMessage(LOG_WARNING, "Username already in use");
+        LeaveCriticalSection(&shard->lock);
+        InterlockedDecrement(&publisherCount);
+        return RejectClient(connection->socket, "Username already in use");
+    }
+
+    if (shard->count == shard->capacity) {
+        Client** grown = (Client**)realloc(shard->publishers, shard->capacity * 2 * sizeof(Client*));
+        if (grown) {
+            shard->publishers = grown;
+            shard->capacity *= 2;
         }
+    }
 
-        *delimiter = '\0';
-        char* authMessage = buffer;
-        char* username = delimiter + 1;
+    Client* newPublisher = shard->count < shard->capacity ? (Client*)malloc(sizeof(Client)) : NULL;
+    if (!newPublisher || !TopicSet_Insert(&shard->names, username)) {
+        LogMessage(LOG_ERROR, "Failed to create publisher");
+        LeaveCriticalSection(&shard->lock);
+        InterlockedDecrement(&publisherCount);
+        free(newPublisher);
+        return false;
+    }
 
-        if (!PublisherEngine_IsAuthorized(authMessage)) {
-            send(clientSocket, "Unauthorized connection attempt", strlen("Unauthorized connection attempt"), 0);
-            LogMessage(LOG_WARNING, "Unauthorized connection attempt");
-            closesocket(clientSocket);
-            continue;
+    PublisherSession* session = Session_Create(connection);
+    if (!session) {
+        LogMessage(LOG_ERROR, "Failed to create publisher");
+        TopicSet_Remove(&shard->names, username);
+        LeaveCriticalSection(&shard->lock);
+        InterlockedDecrement(&publisherCount);
+        free(newPublisher);
+        return false;
+    }
+
+    Client_Init(newPublisher, connection->socket, username, (int)InterlockedIncrement(&nextPublisherId));
+    shard->publishers[shard->count++] = newPublisher;
+    state->publisher = newPublisher;
+    state->session = session;
+    LeaveCriticalSection(&shard->lock);
+
+    // The welcome goes through the session's queue so it always precedes the first grant
+    EnterCriticalSection(&session->lock);
+    Session_Send(session, SharedFrame_Create(FRAME_RESPONSE, NULL, "Welcome to the publisher engine"));
+    LeaveCriticalSection(&session->lock);
+    Credit_Grant(session);
+    LogMessage(LOG_INFO, "New publisher connected. Username: %s, ID: %d", newPublisher->username, newPublisher->id);
+    return true;
+}
+
+// A published message copied out of the connection buffer, waiting on its topic's strand
+typedef struct {
+    TraceHeader trace;
+    bool traced;
+    PublisherSession* session;  // Referenced until the message is routed
+    LONG64 sequence;            // Position of the message in its publisher's stream
+    char* topic;    // Both strings live in the same allocation, right after the struct
+    char* message;
+} RouteTask;
+
+// Give a message's credit back to its publisher
+static void RetireMessage(PublisherSession* session) {
+    InterlockedIncrement64(&session->retired);
+    Credit_Grant(session);
+}
+
+// Read every paused publisher again
+static void ResumePublishers(void) {
+    EnterCriticalSection(&pausedLock);
+    for (LONG i = 0; i < pausedCount; i++) {
+        ((PublisherConnection*)pausedPublishers[i]->context)->paused = false;
+        Reactor_Resume(pausedPublishers[i]);
+    }
+    pausedCount = 0;
+    LeaveCriticalSection(&pausedLock);
+}
+
+// Stop reading one publisher until routing has caught up; the rest of its loop keeps running
+static void PausePublisher(ReactorConnection* connection, PublisherConnection* state) {
+    Reactor_Pause(connection);
+    EnterCriticalSection(&pausedLock);
+    if (!state->paused) {
+        pausedPublishers[pausedCount++] = connection;
+        state->paused = true;
+    }
+    LeaveCriticalSection(&pausedLock);
+
+    // Routing may have caught up before the connection was listed, leaving no one to resume it
+    if (Executor_Pending(&executor) <= ROUTE_RESUME_PENDING) {
+        ResumePublishers();
+    }
+}
+
+// Runs on a routing worker, in order with the other messages of the same topic
+static void RunRoute(void* argument) {
+    RouteTask* task = (RouteTask*)argument;
+    RouteMessage(task->topic, task->message, task->traced ? &task->trace : NULL, task->session, task->sequence);
+    RetireMessage(task->session);
+    Session_Release(task->session);
+    free(task);
+
+    if (pausedCount > 0 && Executor_Pending(&executor) <= ROUTE_RESUME_PENDING) {
+        ResumePublishers();
+    }
+}
+
+// Copy a decoded message off the event loop and queue its routing on the topic's strand
+static void DispatchPublish(PublisherSession* session, LONG64 sequence, const Frame* frame) {
+    RouteTask* task = (RouteTask*)malloc(sizeof(RouteTask) + frame->topicLength + frame->payloadLength + 2);
+    if (!task) {
+        LogMessage(LOG_ERROR, "Failed to queue message for topic: %s", frame->topic);
+        Metrics_Add(messagesRejected, 1);
+        Session_Settle(session, sequence, CONFIRM_REJECTED);
+        RetireMessage(session);
+        return;
+    }
+
+    InterlockedIncrement(&session->references);
+    task->session = session;
+    task->sequence = sequence;
+
+    task->topic = (char*)(task + 1);
+    memcpy(task->topic, frame->topic, frame->topicLength);
+    task->topic[frame->topicLength] = '\0';
+    task->message = task->topic + frame->topicLength + 1;
+    memcpy(task->message, frame->payload, frame->payloadLength);
+    task->message[frame->payloadLength] = '\0';
+    task->traced = frame->trace && Trace_Decode(frame->trace, frame->traceLength, &task->trace);
+
+    unsigned int hash = TopicSet_Hash(task->topic, frame->topicLength);
+    if (!ExecutorStrand_Post(&routeStrands[hash % ROUTE_STRANDS], RunRoute, task)) {
+        // Out of queue memory: route on the loop rather than lose the message
+        RunRoute(task);
+    }
+}
+
+// Unpack a multi-message frame and dispatch its messages in order, numbered as if each had been
+// sent on its own. The whole batch is checked first so a malformed one routes nothing.
+static bool DispatchBatch(PublisherSession* session, const Frame* batch) {
+    Frame message;
+    size_t offset = 0;
+    long long count = 0;
+    int result;
+    while ((result = Frame_NextBatchRecord(batch, &offset, &message)) == 1) {
+        count++;
+    }
+    if (result < 0) {
+        return false;
+    }
+
+    LOG_FAST(LOG_INFO, "Publisher sent batch of %lld messages", count);
+    Metrics_Record(batchSizes, count);
+
+    offset = 0;
+    while (Frame_NextBatchRecord(batch, &offset, &message) == 1) {
+        LONG64 sequence = ++session->received;
+        if (sequence > session->granted) {
+            Metrics_Add(creditViolations, 1);
         }
+        DispatchPublish(session, sequence, &message);
+    }
+    return true;
+}
 
-        WaitForSingleObject(publishersMutex, INFINITE);
+// Handle the frames buffered for a publisher
+// Returns 1 when all were handled, 0 when reads paused with the rest left buffered, -1 to drop the publisher
+static int HandlePublisherFrames(ReactorConnection* connection, PublisherConnection* state) {
+    Frame frame;
+    int result;
+    while ((result = FrameDecoder_Next(&state->decoder, &frame)) == 1) {
+        if (!state->publisher) {
+            if (!AuthenticatePublisher(connection, state, &frame)) {
+                return -1;
+            }
+        }
+        else if (frame.type == FRAME_PUBLISH) {
+            LOG_FAST(LOG_INFO, "Publisher sent message: %s|%s", frame.topic, frame.payload);
+            LONG64 sequence = ++state->session->received;
+            if (sequence > state->session->granted) {
+                Metrics_Add(creditViolations, 1);
+            }
+            DispatchPublish(state->session, sequence, &frame);
+        }
+        else if (frame.type == FRAME_PUBLISH_BATCH) {
+            if (!DispatchBatch(state->session, &frame)) {
+                LogMessage(LOG_WARNING, "Dropping publisher after malformed publish batch");
+                return -1;
+            }
+        }
 
-        if (publisherCount >= MAX_CLIENTS) {
-            send(clientSocket, "Maximum clients reached", strlen("Maximum clients reached"), 0);
-            LogMessage(LOG_ERROR, "Maximum clients reached");
-            ReleaseMutex(publishersMutex);
-            closesocket(clientSocket);
-            continue;
+        // Publishers that ignore their credit can still get this far ahead; stop reading so TCP pushes back on them
+        if (Executor_Pending(&executor) > ROUTE_MAX_PENDING) {
+            PausePublisher(connection, state);
+            return 0;
         }
+    }
 
-        if (!IsUsernameUnique(username)) {
-            send(clientSocket, "Username already in use", strlen("Username already in use"), 0);
-            LogMessage(LOG_WARNING, "Username already in use");
-            ReleaseMutex(publishersMutex);
-            closesocket(clientSocket);
-            continue;
+    if (result < 0) {
+        LogMessage(LOG_WARNING, "Dropping publisher after invalid frame");
+        return -1;
+    }
+    return 1;
+}
+
+// Runs on an event loop whenever a publisher socket is readable or its reads resume
+static bool OnPublisherReadable(ReactorConnection* connection) {
+    PublisherConnection* state = (PublisherConnection*)connection->context;
+
+    // Frames left buffered when reads paused go first
+    int handled = HandlePublisherFrames(connection, state);
+    if (handled <= 0) {
+        return handled == 0;
+    }
+
+    for (int reads = 0; reads < MAX_READS_PER_WAKEUP; reads++) {
+        int bytesReceived = FrameDecoder_Receive(&state->decoder, connection->socket);
+        if (bytesReceived == 0) {
+            return false;
+        }
+        if (bytesReceived < 0) {
+            return WSAGetLastError() == WSAEWOULDBLOCK;
         }
 
-        Client* newPublisher = (Client*)malloc(sizeof(Client));
-        if (!newPublisher) {
-            LogMessage(LOG_ERROR, "Failed to create publisher");
-            ReleaseMutex(publishersMutex);
-            closesocket(clientSocket);
-            continue;
+        handled = HandlePublisherFrames(connection, state);
+        if (handled <= 0) {
+            return handled == 0;
         }
+    }
 
-        Client_Init(newPublisher, clientSocket, username, publisherCount + 1);
-        send(clientSocket, "Welcome to the publisher engine", strlen("Welcome to the publisher engine"), 0);
-        LogMessage(LOG_INFO, "New publisher connected. Username: %s, ID: %d", newPublisher->username, newPublisher->id);
+    // Leave the rest for the next wakeup so one busy publisher cannot starve its loop
+    return true;
+}
+
+// Runs on the publisher's event loop after each queued grant or confirm has been written
+static void OnPublisherWritten(ReactorConnection* connection, bool sent) {
+    PublisherConnection* state = (PublisherConnection*)connection->context;
+    if (!sent || !state->session) {
+        return;
+    }
+
+    const char* sendData;
+    size_t sendLength;
+    if (SendQueue_Complete(&state->session->outbound, &sendData, &sendLength)) {
+        Reactor_Send(connection, sendData, sendLength);
+    }
+}
+
+static void OnPublisherClosed(ReactorConnection* connection) {
+    PublisherConnection* state = (PublisherConnection*)connection->context;
+
+    EnterCriticalSection(&pausedLock);
+    if (state->paused) {
+        for (LONG i = 0; i < pausedCount; i++) {
+            if (pausedPublishers[i] == connection) {
+                pausedPublishers[i] = pausedPublishers[--pausedCount];
+                break;
+            }
+        }
+    }
+    LeaveCriticalSection(&pausedLock);
+
+    if (state->publisher) {
+        PublisherShard* shard = ShardFor(state->publisher->username);
+        EnterCriticalSection(&shard->lock);
+        for (int i = 0; i < shard->count; i++) {
+            if (shard->publishers[i] == state->publisher) {
+                TopicSet_Remove(&shard->names, shard->publishers[i]->username);
+                // Move remaining publishers up
+                for (int j = i; j < shard->count - 1; j++) {
+                    shard->publishers[j] = shard->publishers[j + 1];
+                }
+                shard->count--;
+                InterlockedDecrement(&publisherCount);
+                break;
+            }
+        }
+        LeaveCriticalSection(&shard->lock);
+
+        // The reactor closes the socket once this handler returns
+        state->publisher->clientSocket = INVALID_SOCKET;
+        Client_Cleanup(state->publisher);
+        free(state->publisher);
+    }
+
+    // Messages still being routed keep the account alive but send no more credit
+    if (state->session) {
+        EnterCriticalSection(&state->session->lock);
+        state->session->connection = NULL;
+        LeaveCriticalSection(&state->session->lock);
+        Session_Release(state->session);
+    }
 
-        publishers[publisherCount++] = newPublisher;
-        ReleaseMutex(publishersMutex);
-        UpdateDisplay();
+    FrameDecoder_Destroy(&state->decoder);
+    free(state);
+}
 
-        unsigned threadId;
-        HANDLE requestThread = (HANDLE)_beginthreadex(NULL, 0, HandleRequestsThread, &clientSocket, 0, &threadId);
-        if (requestThread == NULL) {
-            LogMessage(LOG_ERROR, "Failed to create request handler thread");
+// Accept connections and hand them to the event loops
+// Several instances accept on the shared listener; the kernel hands each connection to one waiting thread
+static unsigned __stdcall HandleClientThread(void* param) {
+    while (!shouldStop) {
+        SOCKET clientSocket = accept(serverSocket, NULL, NULL);
+        if (clientSocket == INVALID_SOCKET) continue;
+
+        PublisherConnection* state = (PublisherConnection*)calloc(1, sizeof(PublisherConnection));
+        if (!state || !FrameDecoder_Init(&state->decoder, CONNECTION_BUFFER_SIZE) ||
+            !Reactor_SetNonBlocking(clientSocket) ||
+            !Reactor_Add(&reactor, clientSocket, OnPublisherReadable, OnPublisherClosed, OnPublisherWritten, state)) {
+            LogMessage(LOG_ERROR, "Failed to register publisher connection");
+            if (state) {
+                FrameDecoder_Destroy(&state->decoder);
+                free(state);
+            }
             closesocket(clientSocket);
-            continue;
         }
-        CloseHandle(requestThread);
     }
     return 0;
 }
 
 void PublisherEngine_Destroy(void) {
     shouldStop = true;
+    StatusView_Stop();
+    Metrics_Stop();
+
+    // Stopping the reactor runs OnPublisherClosed for every open connection; messages
+    // already queued for routing are still forwarded before the links close
+    Reactor_Destroy(&reactor);
+    Executor_Destroy(&executor);
+    for (int i = 0; i < ROUTE_STRANDS; i++) {
+        ExecutorStrand_Destroy(&routeStrands[i]);
+    }
+    StopLink(&seLink);
+    StopLink(&ssLink);
+    Trace_CloseSink();
+    DeleteCriticalSection(&pausedLock);
 
     // Close all client connections first
-    WaitForSingleObject(publishersMutex, INFINITE);
-    for (int i = 0; i < publisherCount; i++) {
-        if (publishers[i] && publishers[i]->clientSocket != INVALID_SOCKET) {
-            closesocket(publishers[i]->clientSocket);
-            Client_Cleanup(publishers[i]);
-            free(publishers[i]);
+    for (int s = 0; s < shardCount && publisherShards; s++) {
+        PublisherShard* shard = &publisherShards[s];
+        EnterCriticalSection(&shard->lock);
+        for (int i = 0; i < shard->count; i++) {
+            if (shard->publishers[i] && shard->publishers[i]->clientSocket != INVALID_SOCKET) {
+                closesocket(shard->publishers[i]->clientSocket);
+                Client_Cleanup(shard->publishers[i]);
+                free(shard->publishers[i]);
+            }
         }
+        shard->count = 0;
+        TopicSet_Destroy(&shard->names);
+        LeaveCriticalSection(&shard->lock);
     }
     publisherCount = 0;
-    ReleaseMutex(publishersMutex);
 
     // Close service connections
-    if (seSocket != INVALID_SOCKET) {
-        closesocket(seSocket);
-        seSocket = INVALID_SOCKET;
+    if (seLink.socket != INVALID_SOCKET) {
+        closesocket(seLink.socket);
+        seLink.socket = INVALID_SOCKET;
     }
 
-    if (ssSocket != INVALID_SOCKET) {
-        closesocket(ssSocket);
-        ssSocket = INVALID_SOCKET;
+    if (ssLink.socket != INVALID_SOCKET) {
+        closesocket(ssLink.socket);
+        ssLink.socket = INVALID_SOCKET;
     }
 
     // Close server socket
@@ -501,77 +2085,104 @@ void PublisherEngine_Destroy(void) {
     }
 
     // Cleanup Windows handles and WSA
-    if (publishersMutex) {
-        CloseHandle(publishersMutex);
-        publishersMutex = NULL;
+    if (publisherShards) {
+        for (int s = 0; s < shardCount; s++) {
+            free(publisherShards[s].publishers);
+            DeleteCriticalSection(&publisherShards[s].lock);
+        }
+        free(publisherShards);
+        publisherShards = NULL;
+        shardCount = 0;
     }
 
-    if (consoleHandle && consoleHandle != INVALID_HANDLE_VALUE) {
-        CloseHandle(consoleHandle);
-        consoleHandle = INVALID_HANDLE_VALUE;
-    }
+    TopicSet_Destroy(&interestTopics);
 
     WSACleanup();
     CloseLogging();
 }
 
-static void ClearScreen(void) {
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    DWORD count;
-    DWORD cellCount;
-
-    if (GetConsoleScreenBufferInfo(consoleHandle, &csbi)) {
-        cellCount = csbi.dwSize.X * csbi.dwSize.Y;
-        MoveCursor(0, 0);
-        FillConsoleOutputCharacter(consoleHandle, ' ', cellCount, cursorPosition, &count);
-        FillConsoleOutputAttribute(consoleHandle, csbi.wAttributes, cellCount, cursorPosition, &count);
-        MoveCursor(0, 0);
-    }
-}
-
-static void MoveCursor(int x, int y) {
-    cursorPosition.X = (SHORT)x;
-    cursorPosition.Y = (SHORT)y;
-    SetConsoleCursorPosition(consoleHandle, cursorPosition);
-}
+// A publisher as the status view lists it, copied out of its shard
+typedef struct {
+    int id;
+    char username[MAX_USERNAME];
+} StatusRow;
 
-static void UpdateDisplay(void) {
-    ClearScreen();
+// Runs on the status view thread; only the publisher list is read under the shard locks
+static void BuildStatus(StatusText* text, void* context) {
+    (void)context;
 
     // Status Bar
-    printf("=== Publisher Engine Status ===\n");
-    printf("Connected Publishers: %d/%d | SE: %s | SS: %s\n",
+    TextBuffer_Append(text, "=== Publisher Engine Status ===\n");
+    TextBuffer_Append(text, "Connected Publishers: %d/%d | SE: %s | SS: %s\n",
         publisherCount,
         MAX_CLIENTS,
-        seConnected ? "Connected" : "Disconnected",
-        ssConnected ? "Connected" : "Disconnected");
-    printf("=====================================\n\n");
-
-    // Publisher List
-    WaitForSingleObject(publishersMutex, INFINITE);
-
-    if (publisherCount == 0) {
-        printf("No publishers connected.\n");
+        seLink.connected ? "Connected" : "Disconnected",
+        ssLink.connected ? "Connected" : "Disconnected");
+    if (ssLink.connected) {
+        static const char* durabilityNames[] = { "sync", "group", "async" };
+        LONG mode = ssDurabilityMode;
+        TextBuffer_Append(text, "SS committed: %lld/%lld (%s)\n", ssCommittedMessages, ssLink.written,
+            mode >= 0 && mode <= 2 ? durabilityNames[mode] : "no ack yet");
+    }
+    if (SpillJournal_Count(&ssLink.spill) > 0) {
+        TextBuffer_Append(text, "SS spill journal: %lld frames waiting\n", SpillJournal_Count(&ssLink.spill));
+    }
+    TextBuffer_Append(text, "Messages: %lld in | %lld to SE | %lld to SS | %lld without interest | %lld rejected\n",
+        Metrics_Value(messagesIn), Metrics_Value(forwardedToSE), Metrics_Value(forwardedToSS),
+        Metrics_Value(skippedNoInterest), Metrics_Value(messagesRejected));
+    TextBuffer_Append(text, "Credit window: %lld per publisher | %lld over credit\n",
+        CreditWindow(), Metrics_Value(creditViolations));
+    TextBuffer_Append(text, "Settled: %lld stored | %lld not stored | %lld rejected | %zu awaiting SS commit\n",
+        Metrics_Value(settledOutcomes[CONFIRM_STORED]), Metrics_Value(settledOutcomes[CONFIRM_UNSTORED]),
+        Metrics_Value(settledOutcomes[CONFIRM_REJECTED]), pendingCommitsCount);
+    TextBuffer_Append(text, "=====================================\n\n");
+
+    // Publisher List: each shard lock is held only to copy its rows, formatting happens after
+    int total = publisherCount;
+    if (total == 0) {
+        TextBuffer_Append(text, "No publishers connected.\n");
     }
     else {
-        printf("Connected Publishers:\n");
-        for (int i = 0; i < publisherCount; i++) {
-            printf("  Publisher %d: %s\n",
-                publishers[i]->id,
-                publishers[i]->username);
+        StatusRow rows[STATUSVIEW_MAX_LISTED];
+        int listed = 0;
+        for (int s = 0; s < shardCount && listed < STATUSVIEW_MAX_LISTED; s++) {
+            PublisherShard* shard = &publisherShards[s];
+            EnterCriticalSection(&shard->lock);
+            for (int i = 0; i < shard->count && listed < STATUSVIEW_MAX_LISTED; i++, listed++) {
+                rows[listed].id = shard->publishers[i]->id;
+                memcpy(rows[listed].username, shard->publishers[i]->username, sizeof(rows[listed].username));
+            }
+            LeaveCriticalSection(&shard->lock);
+        }
+
+        TextBuffer_Append(text, "Connected Publishers:\n");
+        for (int i = 0; i < listed; i++) {
+            TextBuffer_Append(text, "  Publisher %d: %s\n", rows[i].id, rows[i].username);
+        }
+        if (total > listed) {
+            TextBuffer_Append(text, "  ... and %d more\n", total - listed);
         }
-        printf("\n");
+        TextBuffer_Append(text, "\n");
     }
 
-    ReleaseMutex(publishersMutex);
-    printf("Press 'q' to quit...\n");
+    TextBuffer_Append(text, "Press 'q' to quit...\n");
 }
 
-int main(void) {
+// Usage: PublisherEngine [--headless]
+int main(int argc, char* argv[]) {
     if (!PublisherEngine_Init()) {
         return 1;
     }
 
+    // The console is redrawn from its own thread; headless runs never touch it
+    if (StatusView_IsHeadless(argc, argv)) {
+        LogMessage(LOG_INFO, "Running headless, status view disabled");
+    }
+    else {
+        StatusViewConfig statusConfig = { 0, BuildStatus, NULL };
+        StatusView_Start(&statusConfig);
+    }
+
     // Start connection manager thread
     unsigned connThreadId;
     HANDLE connectionThread = (HANDLE)_beginthreadex(NULL, 0, ConnectionManagerThread, NULL, 0, &connThreadId);
@@ -581,16 +2192,16 @@ int main(void) {
         return 1;
     }
 
-    // Start client handler thread
+    // Start client handler thread; on failure the connection manager goes through the
+    // normal shutdown below before anything is destroyed
     unsigned clientThreadId;
     HANDLE clientThread = (HANDLE)_beginthreadex(NULL, 0, HandleClientThread, NULL, 0, &clientThreadId);
-    if (clientThread == NULL) {
+    bool started = clientThread != NULL;
+    if (!started) {
         LogMessage(LOG_ERROR, "Failed to create client handler thread");
-        PublisherEngine_Destroy();
-        return 1;
     }
 
-    while (!shouldStop) {
+    while (started && !shouldStop) {
         if (_kbhit()) {
             int ch = _getch();
             LogMessage(LOG_INFO, "Key pressed: %d", ch);
@@ -612,9 +2223,12 @@ int main(void) {
     }
 
     // Wait for threads to finish with timeout
-    if (WaitForSingleObject(clientThread, 5000) == WAIT_TIMEOUT) {
-        LogMessage(LOG_WARNING, "Client thread did not terminate gracefully, forcing termination");
-        TerminateThread(clientThread, 1);
+    if (started) {
+        if (WaitForSingleObject(clientThread, 5000) == WAIT_TIMEOUT) {
+            LogMessage(LOG_WARNING, "Client thread did not terminate gracefully, forcing termination");
+            TerminateThread(clientThread, 1);
+        }
+        CloseHandle(clientThread);
     }
 
     if (WaitForSingleObject(connectionThread, 5000) == WAIT_TIMEOUT) {
@@ -622,11 +2236,10 @@ int main(void) {
         TerminateThread(connectionThread, 1);
     }
 
-    CloseHandle(clientThread);
     CloseHandle(connectionThread);
 
     PublisherEngine_Destroy();
-    return 0;
+    return started ? 0 : 1;
 }
 
 // Run program: Ctrl + F5 or Debug > Start Without Debugging menu
@@ -3,13 +3,18 @@
 
 #include <stdbool.h>
 #include "../Common/client.h"
+#include "../Common/trace.h"
 
 #define MAX_TOPICS_PER_CLIENT 50
 #define MAX_TOPIC_LENGTH 128
-#define MAX_CLIENTS 100
+#define MAX_CLIENTS 65536
 #define DEFAULT_PORT "55001"
 #define PES_AUTH_MESSAGE "PES_AUTH"
 #define SUB_AUTH_MESSAGE "SUB_AUTH"
+#define METRICS_FILE "publisher_engine_metrics.txt"
+#define METRICS_PORT 55101
+#define TRACE_FILE "publisher_engine_traces.log"
+#define SS_SPILL_FILE "publisher_engine_ss_spill.bin"
 
 // Function to initialize the Publisher Engine
 bool PublisherEngine_Init(void);
@@ -17,6 +22,9 @@ bool PublisherEngine_Init(void);
 // Function to receive a new message
 bool PublisherEngine_ReceiveMessage(const char* topic, const char* message);
 
+// Function to receive a message that may carry the publisher's trace (trace may be NULL)
+bool PublisherEngine_ReceiveTraced(const char* topic, const char* message, const TraceHeader* trace);
+
 // Function to forward the new message to other services
 bool PublisherEngine_ForwardMessage(const char* topic, const char* message);
 
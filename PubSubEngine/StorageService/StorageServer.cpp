@@ -0,0 +1,436 @@
+// StorageServer.cpp : Network front end of the Storage Service. Accepts the PES connection (again
+// after each disconnect), appends the messages it forwards and acknowledges commits back to it.
+
+#include "../Common/pch.h"
+#define _CRT_SECURE_NO_WARNINGS
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <process.h>
+
+// Link with ws2_32.lib
+#pragma comment(lib, "ws2_32.lib")
+
+#include "StorageService.h"
+#include "../Common/logging.h"
+#include "../Common/error.h"
+#include "../Common/message.h"
+#include "../Common/frame.h"
+#include "../Common/metrics.h"
+#include "../Common/trace.h"
+
+// Network-related globals
+static SOCKET serverSocket = INVALID_SOCKET;
+static SOCKET clientSocket = INVALID_SOCKET;  // Current PES connection (guarded by ackLock)
+static volatile bool shouldStop = false;
+
+#define DEFAULT_PORT "55003"
+#define AUTH_KEY "X8k9#mP2$vL5nQ7"
+#define METRICS_FILE "storage_service_metrics.txt"
+#define METRICS_PORT 55103
+#define TRACE_FILE "storage_service_traces.log"
+#define MAX_PENDING_TRACES 64   // Sampled messages waiting for their commit
+#define UNSTORED_INITIAL_CAPACITY 64  // Refused publish frames waiting for an ack before that list grows
+#define ACCEPT_RETRY_DELAY 100        // ms to wait after a failed accept
+
+// A sampled message that is appended but not yet committed
+typedef struct {
+    unsigned long long record;  // Messages saved up to and including this one
+    char topic[MAX_TOPIC_LENGTH];
+    TraceHeader trace;
+} PendingTrace;
+
+static Metric* pesLinkGauge;
+
+// Trace state shared by the request thread and the commit handler
+static CRITICAL_SECTION traceLock;
+static PendingTrace pendingTraces[MAX_PENDING_TRACES];
+static size_t pendingTraceCount = 0;
+static unsigned long long committedRecords = 0;  // Last count reported to the commit handler
+static unsigned long long savedRecords = 0;      // Only touched by the request thread
+
+// Acks count every publish frame the PES sent on the current connection, so its positions stay
+// aligned with ours when a message cannot be stored. Refused frames are reported at once in a
+// FRAME_NACK and counted into the acked position once every record appended before them is committed.
+static CRITICAL_SECTION ackLock;                 // Serializes frames to the PES and guards the fields below
+static unsigned long long connectionBase = 0;    // Records appended before the current connection
+static unsigned long long* unstoredAfter;        // Records appended before each refused frame, oldest first
+static size_t unstoredHead;
+static size_t unstoredCount;
+static size_t unstoredCapacity;
+static unsigned long long unstoredAcked = 0;     // Refused frames already inside an acked position
+static unsigned long long receivedFrames = 0;    // Publish frames read on the current connection (request thread only)
+
+// Stamp the commit hop on every pending trace the commit covers (caller holds traceLock)
+static void CompleteTraces(void) {
+    unsigned long long now = Trace_Now();
+    size_t kept = 0;
+    for (size_t i = 0; i < pendingTraceCount; i++) {
+        PendingTrace* pending = &pendingTraces[i];
+        if (pending->record <= committedRecords) {
+            Trace_AddHop(&pending->trace, TRACE_HOP_SS_COMMIT, now);
+            Trace_Record(&pending->trace, pending->topic, NULL);
+        }
+        else {
+            pendingTraces[kept++] = *pending;
+        }
+    }
+    pendingTraceCount = kept;
+}
+
+// Remember a saved traced message until the commit that covers it
+static void TrackTrace(const Frame* frame, unsigned long long received) {
+    TraceHeader trace;
+    if (!Trace_Decode(frame->trace, frame->traceLength, &trace)) {
+        return;
+    }
+    Trace_AddHop(&trace, TRACE_HOP_SS_RECEIVE, received);
+
+    EnterCriticalSection(&traceLock);
+    if (pendingTraceCount < MAX_PENDING_TRACES) {
+        PendingTrace* pending = &pendingTraces[pendingTraceCount++];
+        pending->record = savedRecords;
+        strncpy(pending->topic, frame->topic, sizeof(pending->topic) - 1);
+        pending->topic[sizeof(pending->topic) - 1] = '\0';
+        pending->trace = trace;
+
+        // In sync mode the commit was reported before SaveMessage returned
+        CompleteTraces();
+    }
+    else {
+        LOG_FAST(LOG_DEBUG, "Too many traces awaiting commit, dropping trace %016llx", trace.id);
+    }
+    LeaveCriticalSection(&traceLock);
+}
+
+// Send a FRAME_ACK or FRAME_NACK carrying one count to the PES (caller holds ackLock)
+static bool SendCount(SOCKET sock, FrameType type, unsigned char flags, unsigned long long count) {
+    char payload[32];
+    char frame[FRAME_HEADER_SIZE + sizeof(payload) + 2];
+
+    int payloadLength = snprintf(payload, sizeof(payload), "%llu", count);
+    size_t frameLength = Frame_Encode(frame, sizeof(frame), type, flags, NULL, 0, payload, (size_t)payloadLength);
+    return frameLength > 0 && Frame_SendAll(sock, frame, frameLength);
+}
+
+// Tell the PES that the publish frame at position was not stored, before any ack can cover it
+static void ReportUnstored(SOCKET sock, unsigned long long position) {
+    EnterCriticalSection(&ackLock);
+    if (unstoredCount == unstoredCapacity) {
+        size_t capacity = unstoredCapacity ? unstoredCapacity * 2 : UNSTORED_INITIAL_CAPACITY;
+        unsigned long long* entries = (unsigned long long*)malloc(capacity * sizeof(unsigned long long));
+        if (!entries) {
+            // Without the entry our positions would drift from the PES's; make it start over instead
+            LeaveCriticalSection(&ackLock);
+            LogMessage(LOG_ERROR, "Out of memory tracking refused messages; dropping the PES connection");
+            shutdown(sock, SD_BOTH);
+            return;
+        }
+        for (size_t i = 0; i < unstoredCount; i++) {
+            entries[i] = unstoredAfter[(unstoredHead + i) % unstoredCapacity];
+        }
+        free(unstoredAfter);
+        unstoredAfter = entries;
+        unstoredHead = 0;
+        unstoredCapacity = capacity;
+    }
+    unstoredAfter[(unstoredHead + unstoredCount) % unstoredCapacity] = StorageService_GetAppendedRecords();
+    unstoredCount++;
+
+    if (!SendCount(sock, FRAME_NACK, 0, position)) {
+        LogMessage(LOG_WARNING, "Failed to report unstored message %llu to the PES", position);
+    }
+    LeaveCriticalSection(&ackLock);
+}
+
+// Tell the PES how many of the messages it sent on the current connection are committed
+// Only one thread commits per mode (the request thread in sync mode, the commit thread otherwise)
+static void SendCommitAck(unsigned long long committed, StorageDurability mode, void* context) {
+    (void)context;
+
+    // Records of an earlier connection were already given up on by the PES when it reconnected
+    EnterCriticalSection(&ackLock);
+    if (clientSocket != INVALID_SOCKET && committed >= connectionBase) {
+        // Refused frames that came before the next uncommitted record are settled too
+        while (unstoredCount > 0 && unstoredAfter[unstoredHead] <= committed) {
+            unstoredHead = (unstoredHead + 1) % unstoredCapacity;
+            unstoredCount--;
+            unstoredAcked++;
+        }
+        unsigned long long position = committed - connectionBase + unstoredAcked;
+        if (!SendCount(clientSocket, FRAME_ACK, (unsigned char)mode, position)) {
+            LogMessage(LOG_WARNING, "Failed to acknowledge %llu committed messages to the PES", position);
+        }
+    }
+    LeaveCriticalSection(&ackLock);
+
+    EnterCriticalSection(&traceLock);
+    committedRecords = committed;
+    if (pendingTraceCount > 0) {
+        CompleteTraces();
+    }
+    LeaveCriticalSection(&traceLock);
+}
+
+// Serve one authenticated PES connection until it drops
+static void HandleClientRequests(FrameStream* stream) {
+    while (!shouldStop) {
+        // Append everything received so far; the commit policy decides when it reaches the disk
+        Frame frame;
+        int result;
+        while ((result = FrameDecoder_Next(&stream->decoder, &frame)) == 1) {
+            if (frame.type == FRAME_PUBLISH) {
+                unsigned long long received = frame.trace ? Trace_Now() : 0;
+                receivedFrames++;
+                StorageService_SaveMessage(frame.topic, frame.payload, NULL);
+
+                // A record that was appended counts even if its sync failed: the next commit covers it
+                unsigned long long appended = StorageService_GetAppendedRecords();
+                if (appended == savedRecords) {
+                    ReportUnstored(stream->socket, receivedFrames);
+                }
+                else {
+                    savedRecords = appended;
+                    if (frame.trace) {
+                        TrackTrace(&frame, received);
+                    }
+                }
+            }
+        }
+
+        if (result < 0 || FrameDecoder_Receive(&stream->decoder, stream->socket) <= 0) {
+            LogMessage(LOG_ERROR, "Publisher Engine Service disconnected or error occurred");
+            Metrics_Set(pesLinkGauge, 0);
+            printf("[Storage] PES disconnected or error occurred\n");
+            fflush(stdout);
+            break;
+        }
+    }
+}
+
+// Read the PES handshake frame; the auth key travels in the topic field
+static bool AuthenticateClient(FrameStream* stream) {
+    Frame frame;
+    if (FrameStream_Read(stream, &frame) <= 0) {
+        return false;
+    }
+    return frame.type == FRAME_AUTH && strcmp(frame.topic, AUTH_KEY) == 0;
+}
+
+// Make sock the PES connection; its positions start from zero, like the PES's count for it
+static void BeginConnection(SOCKET sock) {
+    EnterCriticalSection(&ackLock);
+    clientSocket = sock;
+    connectionBase = StorageService_GetAppendedRecords();
+    unstoredHead = 0;
+    unstoredCount = 0;
+    unstoredAcked = 0;
+    LeaveCriticalSection(&ackLock);
+
+    receivedFrames = 0;
+    savedRecords = connectionBase;
+}
+
+static void EndConnection(void) {
+    EnterCriticalSection(&ackLock);
+    clientSocket = INVALID_SOCKET;
+    LeaveCriticalSection(&ackLock);
+}
+
+// Accept PES connections one at a time for the lifetime of the service; the PES reconnects
+// (and replays what it spilled) after every drop
+static unsigned __stdcall AcceptThread(void* param) {
+    (void)param;
+
+    LogMessage(LOG_INFO, "Server started. Waiting for Publisher Engine Service connection...");
+    printf("[Storage] Waiting for Publisher Engine Service connection...\n");
+    fflush(stdout);
+
+    while (!shouldStop) {
+        SOCKET sock = accept(serverSocket, (struct sockaddr*)NULL, (int*)NULL);
+        if (sock == INVALID_SOCKET) {
+            if (!shouldStop) {
+                LogMessage(LOG_ERROR, "Accept failed");
+                Sleep(ACCEPT_RETRY_DELAY);
+            }
+            continue;
+        }
+
+        FrameStream stream;
+        if (!FrameStream_Init(&stream, sock)) {
+            LogMessage(LOG_ERROR, "Failed to allocate client stream");
+            closesocket(sock);
+            continue;
+        }
+
+        if (!AuthenticateClient(&stream)) {
+            LogMessage(LOG_WARNING, "Client authentication failed, waiting for new connection");
+            printf("[Storage] Client authentication failed, waiting for new connection\n");
+            fflush(stdout);
+            FrameStream_Destroy(&stream);
+            closesocket(sock);
+            continue;
+        }
+
+        LogMessage(LOG_INFO, "Publisher Engine Service connected and authenticated successfully");
+        printf("[Storage] PES connected and authenticated successfully\n");
+        fflush(stdout);
+        Metrics_Set(pesLinkGauge, 1);
+
+        BeginConnection(sock);
+        HandleClientRequests(&stream);
+        EndConnection();
+
+        FrameStream_Destroy(&stream);
+        closesocket(sock);
+    }
+
+    return 0;
+}
+
+static bool InitializeServer(void) {
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        LogMessage(LOG_ERROR, "Connection error: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
+        return false;
+    }
+
+    struct sockaddr_in serverAddr;
+    serverAddr.sin_family = AF_INET;
+    int port = atoi(DEFAULT_PORT);
+
+    while (1) {
+        serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (serverSocket == INVALID_SOCKET) {
+            LogMessage(LOG_ERROR, "Socket error: %s", GetErrorDescription(ERROR_SOCKET_ERROR));
+            WSACleanup();
+            return false;
+        }
+
+        serverAddr.sin_port = htons(port);
+        serverAddr.sin_addr.s_addr = INADDR_ANY;
+
+        if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
+            if (WSAGetLastError() == 10048) {
+                LogMessage(LOG_WARNING, "Port %d already in use. Trying next port...", port);
+                closesocket(serverSocket);
+                port++;
+            } else {
+                LogMessage(LOG_ERROR, "Connection error: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
+                closesocket(serverSocket);
+                WSACleanup();
+                return false;
+            }
+        } else {
+            break;
+        }
+    }
+
+    // Get the local IP address
+    char hostname[100];
+    gethostname(hostname, sizeof(hostname));
+    struct addrinfo* result = NULL;
+    struct addrinfo hints;
+
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if (getaddrinfo(hostname, NULL, &hints, &result) != 0) {
+        LogMessage(LOG_ERROR, "Connection error: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
+        closesocket(serverSocket);
+        WSACleanup();
+        return false;
+    }
+
+    char localIP[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &((struct sockaddr_in*)result->ai_addr)->sin_addr, localIP, sizeof(localIP));
+    freeaddrinfo(result);
+
+    LogMessage(LOG_INFO, "Storage Service is listening on IP %s, port %d", localIP, port);
+    printf("[Storage] Listening -> %s:%d\n", localIP, port);
+    fflush(stdout);
+    return true;
+}
+
+// Usage: StorageService [directory] [segment size in MB] [sync|group|async] [group records] [group microseconds]
+int main(int argc, char* argv[]) {
+    const char* storageDirectory = argc > 1 ? argv[1] : STORAGE_DEFAULT_DIRECTORY;
+    unsigned long long segmentSize = argc > 2 ? strtoull(argv[2], NULL, 10) * 1024 * 1024 : 0;
+
+    StorageDurabilityConfig durability;
+    durability.mode = STORAGE_DURABILITY_GROUP;
+    durability.groupRecords = argc > 4 ? (unsigned int)strtoul(argv[4], NULL, 10) : STORAGE_DEFAULT_GROUP_RECORDS;
+    durability.groupMicroseconds = argc > 5 ? (unsigned int)strtoul(argv[5], NULL, 10) : STORAGE_DEFAULT_GROUP_MICROSECONDS;
+    if (argc > 3 && !StorageService_ParseDurability(argv[3], &durability.mode)) {
+        printf("[Storage] Unknown durability mode %s (expected sync, group or async)\n", argv[3]);
+        return 1;
+    }
+
+    if (!StorageService_Init(storageDirectory, segmentSize, &durability)) {
+        printf("[Storage] Failed to open storage directory %s\n", storageDirectory);
+        return 1;
+    }
+
+    if (!InitializeServer()) {
+        LogMessage(LOG_ERROR, "Failed to initialize server");
+        return 1;
+    }
+
+    if (listen(serverSocket, SOMAXCONN) == SOCKET_ERROR) {
+        LogMessage(LOG_ERROR, "Listen failed");
+        closesocket(serverSocket);
+        WSACleanup();
+        return 1;
+    }
+
+    pesLinkGauge = Metrics_Register("ss_pes_connected", METRIC_GAUGE);
+    MetricsConfig metricsConfig = { "storage_service", METRICS_FILE, 0, METRICS_PORT, NULL, NULL };
+    Metrics_Start(&metricsConfig);
+    InitializeCriticalSection(&traceLock);
+    InitializeCriticalSection(&ackLock);
+    Trace_OpenSink(TRACE_FILE, "storage_service");
+
+    // Acks go to whichever PES connection is current when a commit completes
+    StorageService_SetCommitHandler(SendCommitAck, NULL);
+
+    unsigned threadId;
+    HANDLE acceptThread = (HANDLE)_beginthreadex(NULL, 0, AcceptThread, NULL, 0, &threadId);
+    if (acceptThread == NULL) {
+        LogMessage(LOG_ERROR, "Failed to create accept thread");
+        StorageService_SetCommitHandler(NULL, NULL);
+        closesocket(serverSocket);
+        WSACleanup();
+        return 1;
+    }
+
+    printf("Press Enter to stop the storage service...\n");
+    getchar();
+
+    // Cleanup: closing the listener ends the accept, shutting the PES connection down ends its reads
+    shouldStop = true;
+    Metrics_Stop();
+    closesocket(serverSocket);
+    serverSocket = INVALID_SOCKET;
+    EnterCriticalSection(&ackLock);
+    if (clientSocket != INVALID_SOCKET) {
+        shutdown(clientSocket, SD_BOTH);
+    }
+    LeaveCriticalSection(&ackLock);
+    WaitForSingleObject(acceptThread, INFINITE);
+    CloseHandle(acceptThread);
+    StorageService_SetCommitHandler(NULL, NULL);
+    Trace_CloseSink();
+    DeleteCriticalSection(&traceLock);
+    DeleteCriticalSection(&ackLock);
+    free(unstoredAfter);
+    WSACleanup();
+    StorageService_Destroy();
+
+    return 0;
+}
@@ -16,56 +16,258 @@
 #include "../Common/message.h"
 #include "../Common/logging.h"
 #include "../Common/error.h"
+#include "../Common/frame.h"
+#include "../Common/logindex.h"
+#include "../Common/metrics.h"
 
 // Static variables for the service
-static char g_storagePath[256];
+static SegmentLog g_log;
+static LogIndex g_index;    // Topic -> records in g_log, guarded by g_storageMutex
 static HANDLE g_storageMutex;
 static bool g_isInitialized = false;
 
-// Network-related globals
-static SOCKET serverSocket = INVALID_SOCKET;
-static SOCKET clientSocket = INVALID_SOCKET;
-static volatile bool shouldStop = false;
+// Commit state; g_commitLock is only ever taken after g_storageMutex, never before it
+static StorageDurabilityConfig g_durability;
+static CRITICAL_SECTION g_commitLock;
+static CONDITION_VARIABLE g_commitNeeded;    // A group started, filled up, or shutdown was requested
+static CONDITION_VARIABLE g_commitFinished;  // Wakes every writer waiting on a commit
+static unsigned long long g_appendedRecords = 0;
+static unsigned long long g_committedRecords = 0;
+static unsigned long long g_committedOffset = 0; // Everything below this log offset is committed
+static ULONGLONG g_groupStart = 0;               // When the oldest uncommitted record was appended
+static bool g_commitStopping = false;
+static HANDLE g_commitThread = NULL;
+static StorageCommitHandler g_commitHandler = NULL;
+static void* g_commitContext = NULL;
+static LARGE_INTEGER g_clockFrequency;
+
+#define COMMIT_RETRY_DELAY 100   // ms to wait before retrying a failed commit
+
+// Metrics, registered in StorageService_Init
+static Metric* g_messagesSaved;
+static Metric* g_bytesSaved;
+static Metric* g_saveFailures;
+static Metric* g_commits;
+static Metric* g_saveLatency;
+static Metric* g_commitLatency;
+static Metric* g_commitRecords;
+static Metric* g_pendingGauge;
+static Metric* g_segmentsGauge;
+
+static const char* DurabilityName(StorageDurability mode) {
+    switch (mode) {
+    case STORAGE_DURABILITY_SYNC:  return "sync";
+    case STORAGE_DURABILITY_GROUP: return "group";
+    case STORAGE_DURABILITY_ASYNC: return "async";
+    default:                       return "unknown";
+    }
+}
+
+static ULONGLONG NowMicroseconds(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (ULONGLONG)(now.QuadPart * 1000000 / g_clockFrequency.QuadPart);
+}
+
+// Record that everything up to records / endOffset is committed and tell the waiters and the handler
+static void PublishCommit(unsigned long long records, unsigned long long endOffset) {
+    EnterCriticalSection(&g_commitLock);
+    if (records > g_committedRecords) {
+        Metrics_Add(g_commits, 1);
+        Metrics_Record(g_commitRecords, records - g_committedRecords);
+        g_committedRecords = records;
+        g_committedOffset = endOffset;
+    }
+    Metrics_Set(g_pendingGauge, (long long)(g_appendedRecords - g_committedRecords));
+    // Records appended while the commit ran start the next group
+    g_groupStart = NowMicroseconds();
+    StorageCommitHandler handler = g_commitHandler;
+    void* context = g_commitContext;
+    WakeAllConditionVariable(&g_commitFinished);
+    LeaveCriticalSection(&g_commitLock);
+
+    if (handler) {
+        handler(records, g_durability.mode, context);
+    }
+}
+
+// Flush (and in group mode force to disk) everything appended so far
+static bool CommitPending(void) {
+    if (WaitForSingleObject(g_storageMutex, INFINITE) != WAIT_OBJECT_0) {
+        LogMessage(LOG_ERROR, "Thread error: %s", GetErrorDescription(ERROR_MUTEX_ERROR));
+        return false;
+    }
+
+    unsigned long long start = Metrics_Now();
+    bool success = g_durability.mode == STORAGE_DURABILITY_GROUP ? SegmentLog_Sync(&g_log) : SegmentLog_Flush(&g_log);
+    Metrics_RecordSince(g_commitLatency, start);
+    unsigned long long endOffset = g_log.nextOffset;
+
+    // The index is rebuilt from the log after a crash, so it is written out but never synced
+    LogIndex_Flush(&g_index);
+
+    // Appends update the count under g_storageMutex, so it matches endOffset here
+    EnterCriticalSection(&g_commitLock);
+    unsigned long long records = g_appendedRecords;
+    LeaveCriticalSection(&g_commitLock);
+
+    ReleaseMutex(g_storageMutex);
+
+    if (!success) {
+        LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_FAILURE));
+        return false;
+    }
+
+    PublishCommit(records, endOffset);
+    return true;
+}
+
+// Commits a group once it holds groupRecords records or its oldest record has waited groupMicroseconds
+static unsigned __stdcall CommitThread(void* param) {
+    (void)param;
+
+    EnterCriticalSection(&g_commitLock);
+    while (!g_commitStopping) {
+        unsigned long long pending = g_appendedRecords - g_committedRecords;
+        if (pending == 0) {
+            SleepConditionVariableCS(&g_commitNeeded, &g_commitLock, INFINITE);
+            continue;
+        }
+
+        ULONGLONG waited = NowMicroseconds() - g_groupStart;
+        if (pending < g_durability.groupRecords && waited < g_durability.groupMicroseconds) {
+            // Waits have millisecond granularity, so a sub-millisecond window rounds up to 1 ms
+            DWORD timeout = (DWORD)((g_durability.groupMicroseconds - waited + 999) / 1000);
+            SleepConditionVariableCS(&g_commitNeeded, &g_commitLock, timeout);
+            continue;
+        }
 
-#define DEFAULT_PORT "55003"
-#define AUTH_KEY "X8k9#mP2$vL5nQ7"
-#define BUFFER_SIZE 1024
+        LeaveCriticalSection(&g_commitLock);
+        if (!CommitPending()) {
+            Sleep(COMMIT_RETRY_DELAY);
+        }
+        EnterCriticalSection(&g_commitLock);
+    }
+    LeaveCriticalSection(&g_commitLock);
+
+    return 0;
+}
 
-void StorageService_Init(const char* storageFilePath) {
+bool StorageService_Init(const char* storageDirectory, unsigned long long segmentSize,
+    const StorageDurabilityConfig* durability) {
     if (g_isInitialized) {
         LogMessage(LOG_WARNING, "Storage Service already initialized: %s", GetErrorDescription(ERROR_CLIENT_INIT_FAILED));
-        return;
+        return false;
     }
 
-    strncpy(g_storagePath, storageFilePath, sizeof(g_storagePath) - 1);
-    g_storagePath[sizeof(g_storagePath) - 1] = '\0';
-    
     InitializeLogging("storage_service.log");
     SetLogLevel(LOG_INFO);
+
+    g_messagesSaved = Metrics_Register("ss_messages_saved", METRIC_COUNTER);
+    g_bytesSaved = Metrics_Register("ss_bytes_saved", METRIC_COUNTER);
+    g_saveFailures = Metrics_Register("ss_save_failures", METRIC_COUNTER);
+    g_commits = Metrics_Register("ss_commits", METRIC_COUNTER);
+    g_saveLatency = Metrics_Register("ss_save_us", METRIC_HISTOGRAM);
+    g_commitLatency = Metrics_Register("ss_commit_us", METRIC_HISTOGRAM);
+    g_commitRecords = Metrics_Register("ss_commit_records", METRIC_HISTOGRAM);
+    g_pendingGauge = Metrics_Register("ss_pending_records", METRIC_GAUGE);
+    g_segmentsGauge = Metrics_Register("ss_segments", METRIC_GAUGE);
     
     g_storageMutex = CreateMutex(NULL, FALSE, NULL);
     if (g_storageMutex == NULL) {
         LogMessage(LOG_ERROR, "Mutex error: %s", GetErrorDescription(ERROR_MUTEX_ERROR));
-        return;
+        return false;
+    }
+
+    if (!SegmentLog_Open(&g_log, storageDirectory, segmentSize)) {
+        LogMessage(LOG_ERROR, "File access error: %s", GetErrorDescription(ERROR_FILE_ACCESS_DENIED));
+        CloseHandle(g_storageMutex);
+        g_storageMutex = NULL;
+        return false;
+    }
+
+    if (!LogIndex_Open(&g_index, &g_log)) {
+        LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_CORRUPTED));
+        SegmentLog_Close(&g_log);
+        CloseHandle(g_storageMutex);
+        g_storageMutex = NULL;
+        return false;
+    }
+
+    if (durability) {
+        g_durability = *durability;
+    }
+    else {
+        g_durability.mode = STORAGE_DURABILITY_GROUP;
+        g_durability.groupRecords = STORAGE_DEFAULT_GROUP_RECORDS;
+        g_durability.groupMicroseconds = STORAGE_DEFAULT_GROUP_MICROSECONDS;
+    }
+    if (g_durability.groupRecords == 0) {
+        g_durability.groupRecords = 1;
+    }
+
+    QueryPerformanceFrequency(&g_clockFrequency);
+    InitializeCriticalSection(&g_commitLock);
+    InitializeConditionVariable(&g_commitNeeded);
+    InitializeConditionVariable(&g_commitFinished);
+    g_appendedRecords = 0;
+    g_committedRecords = 0;
+    g_committedOffset = g_log.nextOffset;
+    g_commitStopping = false;
+
+    // Sync mode commits on the saving thread; the other modes need the group committer
+    if (g_durability.mode != STORAGE_DURABILITY_SYNC) {
+        unsigned threadId;
+        g_commitThread = (HANDLE)_beginthreadex(NULL, 0, CommitThread, NULL, 0, &threadId);
+        if (g_commitThread == NULL) {
+            LogMessage(LOG_ERROR, "Thread error: %s", GetErrorDescription(ERROR_THREAD_CREATE_FAILED));
+            DeleteCriticalSection(&g_commitLock);
+            LogIndex_Close(&g_index);
+            SegmentLog_Close(&g_log);
+            CloseHandle(g_storageMutex);
+            g_storageMutex = NULL;
+            return false;
+        }
     }
     
-    LogMessage(LOG_INFO, "Storage Service initialized with path: %s", storageFilePath);
-    printf("[Storage] Initialized -> path: %s\n", storageFilePath);
+    LogMessage(LOG_INFO, "Storage Service initialized with directory: %s, segment size: %llu bytes, durability: %s (%u records / %u us)",
+        storageDirectory, g_log.segmentSize, DurabilityName(g_durability.mode),
+        g_durability.groupRecords, g_durability.groupMicroseconds);
+    printf("[Storage] Initialized -> directory: %s, segment size: %llu bytes, %zu indexed topics\n",
+        storageDirectory, g_log.segmentSize, g_index.topicCount);
+    printf("[Storage] Durability -> %s", DurabilityName(g_durability.mode));
+    if (g_durability.mode != STORAGE_DURABILITY_SYNC) {
+        printf(" (every %u records or %u us)", g_durability.groupRecords, g_durability.groupMicroseconds);
+    }
+    printf("\n");
     fflush(stdout);
+    Metrics_Set(g_pendingGauge, 0);
+    Metrics_Set(g_segmentsGauge, (long long)g_log.segmentCount);
     g_isInitialized = true;
+
+    StorageService_ReportSegments();
+    return true;
 }
 
-bool StorageService_SaveMessage(const char* topic, const char* message) {
+bool StorageService_SaveMessage(const char* topic, const char* message, unsigned long long* offset) {
     if (!g_isInitialized) {
         LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_FAILURE));
         return false;
     }
 
+    unsigned long long start = Metrics_Now();
+    if (strlen(topic) >= MAX_TOPIC_LENGTH || strlen(message) >= MAX_MESSAGE_LENGTH) {
+        LogMessage(LOG_ERROR, "Message error: %s for topic: %.32s", GetErrorDescription(ERROR_INVALID_MESSAGE), topic);
+        Metrics_Add(g_saveFailures, 1);
+        return false;
+    }
+
     Message msg;
     Message_Init(&msg, topic, message);
 
     if (!Message_Validate(&msg)) {
         LogMessage(LOG_ERROR, "Message error: %s", GetErrorDescription(ERROR_INVALID_MESSAGE));
+        Metrics_Add(g_saveFailures, 1);
         return false;
     }
 
@@ -75,287 +277,262 @@ bool StorageService_SaveMessage(const char* topic, const char* message) {
         return false;
     }
 
-    FILE* storage = fopen(g_storagePath, "a");
-    bool success = false;
+    size_t segmentsBefore = g_log.segmentCount;
+    unsigned long long recordOffset = 0;
+    bool success = SegmentLog_Append(&g_log, msg.topic, msg.message, &recordOffset);
+    bool rolled = g_log.segmentCount != segmentsBefore;
+    unsigned long long baseOffset = g_log.segments[g_log.segmentCount - 1].baseOffset;
+    unsigned long long endOffset = g_log.nextOffset;
+    unsigned long long records = 0;
+
+    if (success) {
+        // A missing entry only hides the record from queries until the next restart re-indexes it
+        if (!LogIndex_Add(&g_index, baseOffset, msg.topic, recordOffset, (size_t)(endOffset - recordOffset))) {
+            LogMessage(LOG_WARNING, "Failed to index message at offset %llu", recordOffset);
+        }
+        if (offset) {
+            *offset = recordOffset;
+        }
 
-    if (storage != NULL) {
-        if (fprintf(storage, "%s|%s\n", msg.topic, msg.message) > 0) {
-            success = true;
-            LogMessage(LOG_INFO, "Message saved successfully for topic: %s", topic);
-            printf("[Storage] Saved -> %s|%s\n", msg.topic, msg.message);
-            fflush(stdout);
-        } else {
-            LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_FAILURE));
+        EnterCriticalSection(&g_commitLock);
+        records = ++g_appendedRecords;
+        if (records - g_committedRecords == 1) {
+            g_groupStart = NowMicroseconds();
+            WakeConditionVariable(&g_commitNeeded);
+        }
+        else if (records - g_committedRecords >= g_durability.groupRecords) {
+            WakeConditionVariable(&g_commitNeeded);
+        }
+        Metrics_Set(g_pendingGauge, (long long)(records - g_committedRecords));
+        LeaveCriticalSection(&g_commitLock);
+
+        if (rolled) {
+            Metrics_Set(g_segmentsGauge, (long long)g_log.segmentCount);
+        }
+
+        if (g_durability.mode == STORAGE_DURABILITY_SYNC) {
+            success = SegmentLog_Sync(&g_log);
         }
-        fclose(storage);
-    } else {
-        LogMessage(LOG_ERROR, "File access error: %s", GetErrorDescription(ERROR_FILE_ACCESS_DENIED));
     }
 
     ReleaseMutex(g_storageMutex);
-    return success;
-}
 
-bool StorageService_GetMessages(const char* topic, char** buffer, int* messageCount) {
-    if (!g_isInitialized) {
+    if (!success) {
         LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_FAILURE));
+        Metrics_Add(g_saveFailures, 1);
         return false;
     }
 
-    DWORD waitResult = WaitForSingleObject(g_storageMutex, INFINITE);
-    if (waitResult != WAIT_OBJECT_0) {
-        LogMessage(LOG_ERROR, "Thread error: %s", GetErrorDescription(ERROR_MUTEX_ERROR));
-        return false;
+    if (g_durability.mode == STORAGE_DURABILITY_SYNC) {
+        PublishCommit(records, endOffset);
     }
 
-    FILE* storage = fopen(g_storagePath, "r");
-    if (storage == NULL) {
-        LogMessage(LOG_ERROR, "File access error: %s", GetErrorDescription(ERROR_FILE_ACCESS_DENIED));
-        ReleaseMutex(g_storageMutex);
-        return false;
+    size_t length = strlen(msg.message);
+    Metrics_Add(g_messagesSaved, 1);
+    Metrics_Add(g_bytesSaved, (long long)length);
+    Metrics_CountTopic(msg.topic, TOPIC_MESSAGES_IN, 1);
+    Metrics_CountTopic(msg.topic, TOPIC_BYTES_IN, length);
+    Metrics_RecordSince(g_saveLatency, start);
+
+    if (rolled) {
+        printf("[Storage] Rolled -> new segment at base offset %llu\n", baseOffset);
+        fflush(stdout);
     }
+    LOG_FAST(LOG_DEBUG, "Message saved successfully for topic: %s", topic);
+    return true;
+}
 
-    // First pass: count matching messages
-    char line[MAX_MESSAGE_LENGTH + MAX_TOPIC_LENGTH + 2];
-    *messageCount = 0;
-    while (fgets(line, sizeof(line), storage)) {
-        char* delimiter = strchr(line, '|');
-        if (delimiter) {
-            *delimiter = '\0';
-            if (strcmp(line, topic) == 0) {
-                (*messageCount)++;
-            }
-        }
+unsigned long long StorageService_GetAppendedRecords(void) {
+    if (!g_isInitialized) {
+        return 0;
     }
 
-    // Allocate buffer for messages
-    *buffer = (char*)malloc(*messageCount * MAX_MESSAGE_LENGTH);
-    if (*buffer == NULL) {
-        LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_FULL));
-        fclose(storage);
-        ReleaseMutex(g_storageMutex);
+    EnterCriticalSection(&g_commitLock);
+    unsigned long long records = g_appendedRecords;
+    LeaveCriticalSection(&g_commitLock);
+    return records;
+}
+
+bool StorageService_Flush(void) {
+    if (!g_isInitialized) {
         return false;
     }
 
-    // Second pass: copy messages
-    rewind(storage);
-    char* currentPos = *buffer;
-    int foundCount = 0;
-    
-    while (fgets(line, sizeof(line), storage) && foundCount < *messageCount) {
-        char* delimiter = strchr(line, '|');
-        if (delimiter) {
-            *delimiter = '\0';
-            if (strcmp(line, topic) == 0) {
-                char* message = delimiter + 1;
-                size_t messageLen = strlen(message);
-                if (messageLen > 0 && message[messageLen-1] == '\n') {
-                    message[messageLen-1] = '\0';
-                }
-                strncpy(currentPos, message, MAX_MESSAGE_LENGTH - 1);
-                currentPos[MAX_MESSAGE_LENGTH - 1] = '\0';
-                currentPos += MAX_MESSAGE_LENGTH;
-                foundCount++;
-            }
-        }
+    DWORD waitResult = WaitForSingleObject(g_storageMutex, INFINITE);
+    if (waitResult != WAIT_OBJECT_0) {
+        LogMessage(LOG_ERROR, "Thread error: %s", GetErrorDescription(ERROR_MUTEX_ERROR));
+        return false;
     }
 
-    fclose(storage);
+    bool success = SegmentLog_Flush(&g_log);
+    LogIndex_Flush(&g_index);
     ReleaseMutex(g_storageMutex);
-    return true;
+
+    if (!success) {
+        LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_FAILURE));
+    }
+    return success;
 }
 
-void StorageService_Destroy(void) {
+void StorageService_SetCommitHandler(StorageCommitHandler handler, void* context) {
     if (!g_isInitialized) {
         return;
     }
 
-    LogMessage(LOG_INFO, "Storage Service shutting down");
-    CloseLogging();
-    
-    if (g_storageMutex != NULL) {
-        CloseHandle(g_storageMutex);
-        g_storageMutex = NULL;
-    }
-    
-    g_isInitialized = false;
+    EnterCriticalSection(&g_commitLock);
+    g_commitHandler = handler;
+    g_commitContext = context;
+    LeaveCriticalSection(&g_commitLock);
 }
 
-static unsigned __stdcall HandleClientRequests(void* param) {
-    SOCKET clientSock = *(SOCKET*)param;
-    char buffer[BUFFER_SIZE];
-
-    while (!shouldStop) {
-        int bytesReceived = recv(clientSock, buffer, sizeof(buffer) - 1, 0);
-        if (bytesReceived <= 0) {
-            LogMessage(LOG_ERROR, "Publisher Engine Service disconnected or error occurred");
-            printf("[Storage] PES disconnected or error occurred\n");
-            fflush(stdout);
-            break;
-        }
-
-        buffer[bytesReceived] = '\0';
-        char* delimiter = strchr(buffer, '|');
-        if (delimiter) {
-            *delimiter = '\0';
-            char* topic = buffer;
-            char* message = delimiter + 1;
-            StorageService_SaveMessage(topic, message);
-        }
+bool StorageService_WaitCommitted(unsigned long long offset) {
+    if (!g_isInitialized) {
+        return false;
     }
 
-    return 0;
+    EnterCriticalSection(&g_commitLock);
+    while (g_committedOffset <= offset && !g_commitStopping) {
+        SleepConditionVariableCS(&g_commitFinished, &g_commitLock, INFINITE);
+    }
+    bool committed = g_committedOffset > offset;
+    LeaveCriticalSection(&g_commitLock);
+    return committed;
 }
 
-static bool AuthenticateClient(SOCKET clientSocket) {
-    char buffer[256];
-    int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-    if (bytesReceived <= 0) {
+bool StorageService_GetMessages(const char* topic, char** buffer, int* messageCount) {
+    if (!g_isInitialized) {
+        LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_FAILURE));
         return false;
     }
-    buffer[bytesReceived] = '\0';
-    return strcmp(buffer, AUTH_KEY) == 0;
-}
 
-static bool InitializeServer(void) {
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        LogMessage(LOG_ERROR, "Connection error: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
+    DWORD waitResult = WaitForSingleObject(g_storageMutex, INFINITE);
+    if (waitResult != WAIT_OBJECT_0) {
+        LogMessage(LOG_ERROR, "Thread error: %s", GetErrorDescription(ERROR_MUTEX_ERROR));
         return false;
     }
 
-    struct sockaddr_in serverAddr;
-    serverAddr.sin_family = AF_INET;
-    int port = atoi(DEFAULT_PORT);
+    // Only the lookup and a snapshot happen under the lock; the records are read after releasing it
+    LogIndexEntry* entries = NULL;
+    size_t entryCount = 0;
+    SegmentReader reader;
+    bool success = LogIndex_Lookup(&g_index, topic, &entries, &entryCount);
+    if (success && entryCount > 0) {
+        success = SegmentLog_Flush(&g_log) && SegmentReader_Open(&reader, &g_log);
+    }
 
-    while (1) {
-        serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-        if (serverSocket == INVALID_SOCKET) {
-            LogMessage(LOG_ERROR, "Socket error: %s", GetErrorDescription(ERROR_SOCKET_ERROR));
-            WSACleanup();
-            return false;
-        }
+    ReleaseMutex(g_storageMutex);
 
-        serverAddr.sin_port = htons(port);
-        serverAddr.sin_addr.s_addr = INADDR_ANY;
-
-        if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-            if (WSAGetLastError() == 10048) {
-                LogMessage(LOG_WARNING, "Port %d already in use. Trying next port...", port);
-                closesocket(serverSocket);
-                port++;
-            } else {
-                LogMessage(LOG_ERROR, "Connection error: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
-                closesocket(serverSocket);
-                WSACleanup();
-                return false;
-            }
-        } else {
-            break;
-        }
+    if (!success) {
+        LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_FILE_ACCESS_DENIED));
+        free(entries);
+        return false;
     }
 
-    // Get the local IP address
-    char hostname[100];
-    gethostname(hostname, sizeof(hostname));
-    struct addrinfo* result = NULL;
-    struct addrinfo hints;
-
-    ZeroMemory(&hints, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
+    *buffer = NULL;
+    *messageCount = 0;
+    if (entryCount == 0) {
+        return true;
+    }
 
-    if (getaddrinfo(hostname, NULL, &hints, &result) != 0) {
-        LogMessage(LOG_ERROR, "Connection error: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
-        closesocket(serverSocket);
-        WSACleanup();
+    *buffer = (char*)malloc(entryCount * MAX_MESSAGE_LENGTH);
+    if (*buffer == NULL) {
+        LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_FULL));
+        SegmentReader_Close(&reader);
+        free(entries);
         return false;
     }
 
-    char localIP[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &((struct sockaddr_in*)result->ai_addr)->sin_addr, localIP, sizeof(localIP));
-    freeaddrinfo(result);
+    char* currentPos = *buffer;
+    for (size_t i = 0; i < entryCount; i++) {
+        Frame frame;
+        if (SegmentReader_Read(&reader, entries[i].offset, entries[i].length, &frame) != 1) {
+            LogMessage(LOG_ERROR, "Storage error: %s at offset %llu",
+                GetErrorDescription(ERROR_STORAGE_CORRUPTED), entries[i].offset);
+            continue;
+        }
 
-    LogMessage(LOG_INFO, "Storage Service is listening on IP %s, port %d", localIP, port);
-    printf("[Storage] Listening -> %s:%d\n", localIP, port);
-    fflush(stdout);
+        // Entries are keyed by topic hash, so a colliding topic can show up here
+        if (strcmp(frame.topic, topic) != 0) {
+            continue;
+        }
+
+        strncpy(currentPos, frame.payload, MAX_MESSAGE_LENGTH - 1);
+        currentPos[MAX_MESSAGE_LENGTH - 1] = '\0';
+        currentPos += MAX_MESSAGE_LENGTH;
+        (*messageCount)++;
+    }
+
+    SegmentReader_Close(&reader);
+    free(entries);
     return true;
 }
 
-int main(void) {
-    StorageService_Init("storage.txt");
-    
-    if (!InitializeServer()) {
-        LogMessage(LOG_ERROR, "Failed to initialize server");
-        return 1;
+bool StorageService_ParseDurability(const char* name, StorageDurability* mode) {
+    for (int candidate = STORAGE_DURABILITY_SYNC; candidate <= STORAGE_DURABILITY_ASYNC; candidate++) {
+        if (strcmp(name, DurabilityName((StorageDurability)candidate)) == 0) {
+            *mode = (StorageDurability)candidate;
+            return true;
+        }
     }
+    return false;
+}
 
-    if (listen(serverSocket, SOMAXCONN) == SOCKET_ERROR) {
-        LogMessage(LOG_ERROR, "Listen failed");
-        closesocket(serverSocket);
-        WSACleanup();
-        return 1;
+void StorageService_ReportSegments(void) {
+    if (!g_isInitialized) {
+        return;
     }
 
-    LogMessage(LOG_INFO, "Server started. Waiting for Publisher Engine Service connection...");
-    printf("[Storage] Waiting for Publisher Engine Service connection...\n");
-    fflush(stdout);
+    WaitForSingleObject(g_storageMutex, INFINITE);
 
-    while (!shouldStop) {
-        clientSocket = accept(serverSocket, (struct sockaddr*)NULL, (int*)NULL);
-        if (clientSocket == INVALID_SOCKET) {
-            LogMessage(LOG_ERROR, "Accept failed");
-            closesocket(serverSocket);
-            WSACleanup();
-            return 1;
-        }
+    size_t count;
+    const SegmentInfo* segments = SegmentLog_GetSegments(&g_log, &count);
+    printf("[Storage] Segments -> %zu\n", count);
+    for (size_t i = 0; i < count; i++) {
+        printf("[Storage]   base offset %20llu | %12llu bytes%s\n", segments[i].baseOffset, segments[i].size,
+            i + 1 == count ? " (active)" : "");
+        LogMessage(LOG_INFO, "Segment base offset %llu, %llu bytes", segments[i].baseOffset, segments[i].size);
+    }
+    fflush(stdout);
 
-        if (AuthenticateClient(clientSocket)) {
-            printf("[Storage] PES authenticated successfully\n");
-            fflush(stdout);
-            break; // Successfully authenticated client
-        }
+    ReleaseMutex(g_storageMutex);
+}
 
-        LogMessage(LOG_WARNING, "Client authentication failed, waiting for new connection");
-        printf("[Storage] Client authentication failed, waiting for new connection\n");
-        fflush(stdout);
-        closesocket(clientSocket);
-        clientSocket = INVALID_SOCKET;
+void StorageService_Destroy(void) {
+    if (!g_isInitialized) {
+        return;
     }
 
-    if (shouldStop) {
-        closesocket(serverSocket);
-        WSACleanup();
-        return 1;
-    }
+    LogMessage(LOG_INFO, "Storage Service shutting down");
 
-    LogMessage(LOG_INFO, "Publisher Engine Service connected and authenticated successfully");
-    printf("[Storage] PES connected and authenticated successfully\n");
-    fflush(stdout);
+    EnterCriticalSection(&g_commitLock);
+    g_commitStopping = true;
+    g_commitHandler = NULL;
+    WakeAllConditionVariable(&g_commitNeeded);
+    WakeAllConditionVariable(&g_commitFinished);
+    LeaveCriticalSection(&g_commitLock);
+
+    if (g_commitThread != NULL) {
+        WaitForSingleObject(g_commitThread, INFINITE);
+        CloseHandle(g_commitThread);
+        g_commitThread = NULL;
+    }
 
-    // Start the background thread to handle client requests
-    unsigned threadId;
-    HANDLE clientThread = (HANDLE)_beginthreadex(NULL, 0, HandleClientRequests, &clientSocket, 0, &threadId);
-    if (clientThread == NULL) {
-        LogMessage(LOG_ERROR, "Failed to create client thread");
-        closesocket(clientSocket);
-        closesocket(serverSocket);
-        WSACleanup();
-        return 1;
-    }
-
-    printf("Press Enter to stop the storage service...\n");
-    getchar();
-
-    // Cleanup
-    shouldStop = true;
-    WaitForSingleObject(clientThread, INFINITE);
-    CloseHandle(clientThread);
-    closesocket(clientSocket);
-    closesocket(serverSocket);
-    WSACleanup();
-    StorageService_Destroy();
+    // Whatever the mode, nothing appended is left behind on a clean shutdown
+    WaitForSingleObject(g_storageMutex, INFINITE);
+    if (!SegmentLog_Sync(&g_log)) {
+        LogMessage(LOG_ERROR, "Storage error: %s", GetErrorDescription(ERROR_STORAGE_FAILURE));
+    }
+    LogIndex_Close(&g_index);
+    SegmentLog_Close(&g_log);
+    ReleaseMutex(g_storageMutex);
+    DeleteCriticalSection(&g_commitLock);
 
-    return 0;
+    CloseLogging();
+    
+    if (g_storageMutex != NULL) {
+        CloseHandle(g_storageMutex);
+        g_storageMutex = NULL;
+    }
+    
+    g_isInitialized = false;
 }
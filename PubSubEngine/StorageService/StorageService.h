@@ -0,0 +1,62 @@
+#ifndef STORAGE_SERVICE_H
+#define STORAGE_SERVICE_H
+
+#include <stdbool.h>
+#include "../Common/segmentlog.h"
+
+#define STORAGE_DEFAULT_DIRECTORY "storage"
+#define STORAGE_DEFAULT_GROUP_RECORDS 256
+#define STORAGE_DEFAULT_GROUP_MICROSECONDS 2000
+
+// When an appended message counts as committed
+typedef enum {
+    STORAGE_DURABILITY_SYNC = 0,  // Forced to disk before StorageService_SaveMessage returns
+    STORAGE_DURABILITY_GROUP = 1, // Forced to disk in groups of up to groupRecords or every groupMicroseconds
+    STORAGE_DURABILITY_ASYNC = 2  // Handed to the OS on the group schedule, never waits for the disk
+} StorageDurability;
+
+typedef struct {
+    StorageDurability mode;
+    unsigned int groupRecords;      // Commit as soon as this many records are pending
+    unsigned int groupMicroseconds; // ...or once the oldest pending record has waited this long
+} StorageDurabilityConfig;
+
+// Called after each commit with the number of messages committed since startup.
+// Runs on the saving thread in sync mode and on the commit thread otherwise.
+typedef void (*StorageCommitHandler)(unsigned long long committedRecords, StorageDurability mode, void* context);
+
+// Function to initialize the Storage Service with its log directory, segment roll size and durability
+// segmentSize 0 selects SEGMENTLOG_DEFAULT_SEGMENT_SIZE, durability NULL selects group commit defaults
+bool StorageService_Init(const char* storageDirectory, unsigned long long segmentSize,
+    const StorageDurabilityConfig* durability);
+
+// Function to set the handler told about commits (NULL to clear)
+void StorageService_SetCommitHandler(StorageCommitHandler handler, void* context);
+
+// Function to block until the message at offset is committed; all writers of a group are released together
+bool StorageService_WaitCommitted(unsigned long long offset);
+
+// Function to append a message to the log; offset (may be NULL) receives its log offset
+// Messages that do not fit a Message (MAX_TOPIC_LENGTH / MAX_MESSAGE_LENGTH) are refused, never truncated
+bool StorageService_SaveMessage(const char* topic, const char* message, unsigned long long* offset);
+
+// Function to get the number of messages appended since startup, the count commit handlers are told about
+unsigned long long StorageService_GetAppendedRecords(void);
+
+// Function to write appended messages that are still buffered to the active segment
+// This does not count as a commit: the records are not forced to disk
+bool StorageService_Flush(void);
+
+// Function to get all stored messages for a topic (MAX_MESSAGE_LENGTH bytes per message)
+bool StorageService_GetMessages(const char* topic, char** buffer, int* messageCount);
+
+// Function to look up a durability mode by its name (sync, group or async)
+bool StorageService_ParseDurability(const char* name, StorageDurability* mode);
+
+// Function to print the base offset and size of every segment
+void StorageService_ReportSegments(void);
+
+// Function to clean up resources used by the Storage Service
+void StorageService_Destroy(void);
+
+#endif // STORAGE_SERVICE_H
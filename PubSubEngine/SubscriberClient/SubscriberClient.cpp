@@ -7,6 +7,8 @@
 #include "SubscriberClient.h"
 #include "../Common/logging.h"
 #include "../Common/error.h"
+#include "../Common/frame.h"
+#include "../Common/trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <process.h>
@@ -15,6 +17,7 @@
 
 // Global variables
 static SOCKET serverSocket = INVALID_SOCKET;
+static FrameStream serverStream;
 static char username[MAX_USERNAME_INPUT + 1] = "";
 static ConnectionState connectionState = STATE_DISCONNECTED;
 static HANDLE receiverThread = NULL;
@@ -24,6 +27,7 @@ static unsigned __stdcall MessageReceiverThread(void* param);
 static void DisplayMessage(const char* message, int delay);
 static void ClearScreen(void);
 static const char* ReceiveServerResponse(void);
+static void CloseServerConnection(void);
 bool Client_Initialize(void);
 bool Client_SetUsername(const char* newUsername);
 bool Client_ConnectToServer(void);
@@ -44,6 +48,7 @@ bool Client_Initialize(void) {
         return false;
     }
 
+    Trace_OpenSink(TRACE_FILE, "subscriber_client");
     return true;
 }
 
@@ -58,16 +63,24 @@ bool Client_SetUsername(const char* newUsername) {
 
 static const char* ReceiveServerResponse(void) {
     static char buffer[1024];
-    int bytesReceived = recv(serverSocket, buffer, sizeof(buffer) - 1, 0);
-    if (bytesReceived <= 0) {
+    Frame frame;
+    if (FrameStream_Read(&serverStream, &frame) <= 0 || frame.type != FRAME_RESPONSE) {
         LogMessage(LOG_ERROR, "Server closed connection during authentication");
-        Client_Disconnect();
+        CloseServerConnection();
         return "SERVER_CLOSED";
     }
-    buffer[bytesReceived] = '\0';
+    strncpy(buffer, frame.payload, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
     return buffer;
 }
 
+// Tear down a connection that never reached STATE_CONNECTED
+static void CloseServerConnection(void) {
+    closesocket(serverSocket);
+    serverSocket = INVALID_SOCKET;
+    FrameStream_Destroy(&serverStream);
+}
+
 bool Client_ConnectToServer(void) {
     if (connectionState == STATE_CONNECTED) {
         return false;
@@ -101,12 +114,17 @@ bool Client_ConnectToServer(void) {
 
     freeaddrinfo(result);
 
-    // Send authentication message with username
-    char authMessage[256];
-    snprintf(authMessage, sizeof(authMessage), "%s|%s", SUB_AUTH_MESSAGE, username);
-    if (send(serverSocket, authMessage, strlen(authMessage), 0) == SOCKET_ERROR) {
+    if (!FrameStream_Init(&serverStream, serverSocket)) {
+        LogMessage(LOG_ERROR, "Failed to allocate receive buffer");
+        closesocket(serverSocket);
+        serverSocket = INVALID_SOCKET;
+        return false;
+    }
+
+    // Send authentication frame with username
+    if (!Frame_Send(serverSocket, FRAME_AUTH, SUB_AUTH_MESSAGE, username)) {
         LogMessage(LOG_ERROR, "Failed to send authentication");
-        Client_Disconnect();
+        CloseServerConnection();
         return false;
     }
 
@@ -124,20 +142,21 @@ bool Client_ConnectToServer(void) {
         strstr(response, "Maximum clients") ||
         strstr(response, "Username already")) {
         LogMessage(LOG_WARNING, "Server denied connection: %s", response);
-        Client_Disconnect();
+        CloseServerConnection();
         return false;
     }
 
     // Start receiver thread
+    connectionState = STATE_CONNECTED;
     unsigned threadId;
     receiverThread = (HANDLE)_beginthreadex(NULL, 0, MessageReceiverThread, NULL, 0, &threadId);
     if (receiverThread == NULL) {
         LogMessage(LOG_ERROR, "Failed to create receiver thread");
-        Client_Disconnect();
+        connectionState = STATE_DISCONNECTED;
+        CloseServerConnection();
         return false;
     }
 
-    connectionState = STATE_CONNECTED;
     LogMessage(LOG_INFO, "Connected to server successfully");
     return true;
 }
@@ -160,6 +179,8 @@ void Client_Disconnect(void) {
         receiverThread = NULL;
     }
 
+    FrameStream_Destroy(&serverStream);
+
     fflush(stdout);
 }
 
@@ -168,10 +189,7 @@ bool Client_SubscribeToTopic(const char* topic) {
         return false;
     }
 
-    char buffer[256];
-    snprintf(buffer, sizeof(buffer), "%s|SUBSCRIBE", topic);
-
-    if (send(serverSocket, buffer, strlen(buffer), 0) == SOCKET_ERROR) {
+    if (!Frame_Send(serverSocket, FRAME_SUBSCRIBE, topic, NULL)) {
         LogMessage(LOG_ERROR, "Failed to send subscription request");
         return false;
     }
@@ -189,16 +207,15 @@ const char* Client_GetUsername(void) {
 
 void Client_Cleanup(void) {
     Client_Disconnect();
+    Trace_CloseSink();
     WSACleanup();
     CloseLogging();
 }
 
 static unsigned __stdcall MessageReceiverThread(void* param) {
-    char buffer[1024];
-
     while (connectionState == STATE_CONNECTED) {
-        int bytesReceived = recv(serverSocket, buffer, sizeof(buffer) - 1, 0);
-        if (bytesReceived <= 0) {
+        Frame frame;
+        if (FrameStream_Read(&serverStream, &frame) <= 0) {
             LogMessage(LOG_WARNING, "Lost connection to server");
             DisplayMessage("Lost connection to server", 1000);
             Client_Disconnect();
@@ -207,9 +224,20 @@ static unsigned __stdcall MessageReceiverThread(void* param) {
             return 0;
         }
 
-        buffer[bytesReceived] = '\0';
+        // Stamp on arrival, before the display delay, so the trace ends at the socket
+        TraceHeader trace;
+        if (frame.trace && Trace_Decode(frame.trace, frame.traceLength, &trace)) {
+            Trace_AddHop(&trace, TRACE_HOP_SUBSCRIBER_RECEIVE, Trace_Now());
+            Trace_Record(&trace, frame.topic, username);
+        }
+
         Sleep(1000);
-        printf("\nReceived message: %s\n", buffer);
+        if (frame.type == FRAME_MESSAGE) {
+            printf("\nReceived message: %s|%s\n", frame.topic, frame.payload);
+        }
+        else {
+            printf("\nReceived message: %s\n", frame.payload);
+        }
         fflush(stdout);
     }
 
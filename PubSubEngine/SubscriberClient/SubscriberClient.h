@@ -7,6 +7,7 @@
 #define MAX_USERNAME_INPUT 31
 #define DEFAULT_PORT "55002"
 #define SUB_AUTH_MESSAGE "SUB_AUTH"
+#define TRACE_FILE "subscriber_client_traces.log"
 
 // Client states
 typedef enum {
@@ -3,17 +3,27 @@
 
 #include <stdbool.h>
 #include "../Common/client.h"
+#include "../Common/reactor.h"
+#include "../Common/sendqueue.h"
 
 #define MAX_TOPICS_PER_CLIENT 50
 #define MAX_TOPIC_LENGTH 128
-#define MAX_CLIENTS 100
+#define MAX_CLIENTS 65536
 #define DEFAULT_PORT "55002"
 #define PES_AUTH_MESSAGE "PES_AUTH"
 #define SUB_AUTH_MESSAGE "SUB_AUTH"
+#define METRICS_FILE "subscriber_engine_metrics.txt"
+#define METRICS_PORT 55102
+#define TRACE_FILE "subscriber_engine_traces.log"
+#define SUBSCRIBER_QUEUE_MAX_FRAMES 1024          // Frames buffered per subscriber before dropping
+#define SUBSCRIBER_QUEUE_MAX_BYTES (1024 * 1024)  // Bytes buffered per subscriber before dropping
 
 // Structure to hold subscriber information
 typedef struct {
     Client client;
+    int slot;  // Index into the engine's slot table, used by the topic index
+    ReactorConnection* connection;  // Event loop connection that writes the outbound queue
+    SendQueue outbound;  // Frames waiting to be written to this subscriber
     char** topics;  // Array of topic strings
     size_t topicCount;  // Number of topics currently subscribed
     size_t topicCapacity;  // Total capacity of topics array
@@ -28,6 +38,9 @@ bool SubscriberEngine_Subscribe(Client* client, const char* topic);
 // Function to notify subscribers about a new message
 bool SubscriberEngine_NotifySubscribers(const char* topic, const char* message);
 
+// Function to notify subscribers about a message that carries a trace (trace may be NULL)
+bool SubscriberEngine_NotifyTraced(const char* topic, const char* message, const TraceHeader* trace);
+
 // Function to clean up resources used by the Subscriber Engine
 void SubscriberEngine_Destroy(void);
 
@@ -40,4 +53,7 @@ Subscriber* SubscriberEngine_CreateSubscriber(SOCKET socket, const char* usernam
 // Function to free subscriber resources
 void SubscriberEngine_FreeSubscriber(Subscriber* subscriber);
 
+// Function to read a subscriber's outbound queue depth, bytes and drops
+void SubscriberEngine_GetQueueStats(Subscriber* subscriber, SendQueueStats* stats);
+
 #endif // SUBSCRIBER_ENGINE_H
@@ -18,37 +18,101 @@
 #include "../Common/logging.h"
 #include "../Common/error.h"
 #include "../Common/client.h"
-
-#define BUFFER_SIZE 1024
+#include "../Common/interest.h"
+#include "../Common/topicindex.h"
+#include "../Common/frame.h"
+#include "../Common/reactor.h"
+#include "../Common/topicset.h"
+#include "../Common/metrics.h"
+#include "../Common/trace.h"
+#include "../Common/statusview.h"
+#include "../Common/executor.h"
+
+#define TOPIC_INDEX_INITIAL_CAPACITY 256
+#define EVENT_LOOP_COUNT 0            // 0 = one event loop per processor
+#define CONNECTION_BUFFER_SIZE 512    // Initial decoder buffer per connection, grows on demand
+#define MAX_READS_PER_WAKEUP 16       // Bound the work one connection can do per loop iteration
+#define WORKER_COUNT 0                // 0 = one fan-out worker per processor
+#define PIN_WORKERS false             // Pin fan-out worker i to processor i
+#define FANOUT_STRANDS 64             // Topics hash onto this many in-order fan-out queues
+#define FANOUT_MAX_PENDING 65536      // Messages waiting for fan-out before the PES link stops reading
+#define FANOUT_RESUME_PENDING (FANOUT_MAX_PENDING / 2)  // Backlog at which the PES link is read again
+#define PES_QUEUE_MAX_FRAMES (1024 * 1024)         // Interest lines queued for the PES; a full snapshot must fit
+#define PES_QUEUE_MAX_BYTES (256 * 1024 * 1024)
+#define STATUS_TOPICS_LENGTH 256      // Characters of a client's topic row the status view copies
 
 // Global variables
 static SOCKET serverSocket = INVALID_SOCKET;
 static SOCKET pesSocket = INVALID_SOCKET;
+static ReactorConnection* pesConnection = NULL;   // Reactor side of pesSocket (guarded by subscribersLock)
+static volatile LONG pesPaused = 0;               // PES reads wait for fan-out to catch up
+static SendQueue pesOutbound;                     // Interest lines for the PES, in version order
 static Subscriber* subscribers[MAX_CLIENTS];
 static int subscriberCount = 0;
-static HANDLE subscribersMutex;
+static Subscriber* subscriberSlots[MAX_CLIENTS];  // Stable slot -> subscriber lookup used by topicIndex
+static TopicIndex topicIndex;                     // Topic -> subscriber slots (guarded by subscribersLock)
+static int freeSlots[MAX_CLIENTS];                // Stack of unused slots (guarded by subscribersLock)
+static int freeSlotCount = 0;
+static TopicSet subscriberNames;                  // Usernames in use (guarded by subscribersLock)
+static Reactor reactor;
+static SRWLOCK subscribersLock = SRWLOCK_INIT;  // Shared for fan-out, exclusive for changes
+static Executor executor;
+static ExecutorStrand fanOutStrands[FANOUT_STRANDS];  // Keep each topic's messages in order
 static volatile bool shouldStop = false;
-static HANDLE consoleHandle;
-static COORD cursorPosition = { 0, 0 };
+
+// Version of the topic interest set pushed to the PES (guarded by subscribersLock)
+static unsigned long interestVersion = 0;
+
+// Metrics, registered in SubscriberEngine_Init
+static Metric* messagesIn;
+static Metric* bytesIn;
+static Metric* messagesOut;
+static Metric* bytesOut;
+static Metric* messagesDropped;
+static Metric* notifyLatency;
+static Metric* fanOut;
+static Metric* subscribersGauge;
+static Metric* pesLinkGauge;
+static Metric* topicsGauge;
+static Metric* queueDepthGauge;
+static Metric* queueBytesGauge;
+static Metric* fanOutPendingGauge;
+static Metric* fanOutStolenGauge;
+
+// Per-connection state owned by the reactor
+typedef struct {
+    FrameDecoder decoder;
+    Subscriber* subscriber;  // Set once the connection authenticates as a subscriber
+    bool isPes;              // Set once the connection authenticates as the PES
+} EngineConnection;
 
 // Forward declarations
 static unsigned __stdcall HandleClientThread(void* param);
-static unsigned __stdcall HandleRequestsThread(void* param);
-static void ClearScreen(void);
-static void UpdateDisplay(void);
-static void MoveCursor(int x, int y);
+static bool OnConnectionReadable(ReactorConnection* connection);
+static void OnConnectionClosed(ReactorConnection* connection);
+static void OnConnectionWritten(ReactorConnection* connection, bool sent);
+static void BuildStatus(StatusText* text, void* context);
+static int AllocateSubscriberSlot(void);
+static void ReleaseSubscriberSlot(int slot);
+static void SendInterestLine(InterestOp op, unsigned long version, const char* topic);
+static void PushInterestDelta(InterestOp op, const char* topic);
+static void SendInterestSnapshot(void);
 
 Subscriber* SubscriberEngine_CreateSubscriber(SOCKET socket, const char* username, int id) {
     Subscriber* sub = (Subscriber*)malloc(sizeof(Subscriber));
     if (!sub) return NULL;
 
     Client_Init(&sub->client, socket, username, id);
+    sub->slot = -1;
+    sub->connection = NULL;
     sub->topics = (char**)malloc(MAX_TOPICS_PER_CLIENT * sizeof(char*));
     if (!sub->topics) {
         free(sub);
         return NULL;
     }
 
+    SendQueue_Init(&sub->outbound, SUBSCRIBER_QUEUE_MAX_FRAMES, SUBSCRIBER_QUEUE_MAX_BYTES);
+
     sub->topicCount = 0;
     sub->topicCapacity = MAX_TOPICS_PER_CLIENT;
     return sub;
@@ -61,20 +125,102 @@ void SubscriberEngine_FreeSubscriber(Subscriber* subscriber) {
         free(subscriber->topics[i]);
     }
     free(subscriber->topics);
+    SendQueue_Destroy(&subscriber->outbound);
     Client_Cleanup(&subscriber->client);
     free(subscriber);
 }
 
+void SubscriberEngine_GetQueueStats(Subscriber* subscriber, SendQueueStats* stats) {
+    SendQueue_GetStats(&subscriber->outbound, stats);
+}
+
+// Queue an encoded frame for a subscriber and start its writer if it is idle (caller holds subscribersLock)
+static bool QueueSharedFrame(Subscriber* subscriber, SharedFrame* frame) {
+    const char* sendData;
+    size_t sendLength;
+    if (!SendQueue_Push(&subscriber->outbound, frame, &sendData, &sendLength)) {
+        LOG_FAST(LOG_DEBUG, "Outbound queue full for %s, dropping frame", subscriber->client.username);
+        return false;
+    }
+
+    if (sendData) {
+        Reactor_Send(subscriber->connection, sendData, sendLength);
+    }
+    return true;
+}
+
+// Queue a frame meant for a single subscriber (caller holds subscribersLock)
+static bool QueueFrame(Subscriber* subscriber, FrameType type, const char* topic, const char* payload) {
+    SharedFrame* frame = SharedFrame_Create(type, topic, payload);
+    if (!frame) {
+        return false;
+    }
+
+    bool queued = QueueSharedFrame(subscriber, frame);
+    SharedFrame_Release(frame);
+    return queued;
+}
+
+static void RegisterMetrics(void) {
+    messagesIn = Metrics_Register("se_messages_in", METRIC_COUNTER);
+    bytesIn = Metrics_Register("se_bytes_in", METRIC_COUNTER);
+    messagesOut = Metrics_Register("se_messages_out", METRIC_COUNTER);
+    bytesOut = Metrics_Register("se_bytes_out", METRIC_COUNTER);
+    messagesDropped = Metrics_Register("se_messages_dropped", METRIC_COUNTER);
+    notifyLatency = Metrics_Register("se_notify_us", METRIC_HISTOGRAM);
+    fanOut = Metrics_Register("se_fan_out", METRIC_HISTOGRAM);
+    subscribersGauge = Metrics_Register("se_subscribers", METRIC_GAUGE);
+    pesLinkGauge = Metrics_Register("se_pes_connected", METRIC_GAUGE);
+    topicsGauge = Metrics_Register("se_topics", METRIC_GAUGE);
+    queueDepthGauge = Metrics_Register("se_queue_depth", METRIC_GAUGE);
+    queueBytesGauge = Metrics_Register("se_queue_bytes", METRIC_GAUGE);
+    fanOutPendingGauge = Metrics_Register("se_fanout_pending", METRIC_GAUGE);
+    fanOutStolenGauge = Metrics_Register("se_fanout_stolen", METRIC_GAUGE);
+}
+
+// Refresh the gauges that are read from engine state rather than tracked as it changes
+static void CollectMetrics(void* context) {
+    (void)context;
+    size_t depth = 0;
+    size_t bytes = 0;
+
+    AcquireSRWLockShared(&subscribersLock);
+    for (int i = 0; i < subscriberCount; i++) {
+        SendQueueStats queueStats;
+        SubscriberEngine_GetQueueStats(subscribers[i], &queueStats);
+        depth += queueStats.depth;
+        bytes += queueStats.bytes;
+    }
+    Metrics_Set(subscribersGauge, subscriberCount);
+    Metrics_Set(pesLinkGauge, pesSocket != INVALID_SOCKET);
+    Metrics_Set(topicsGauge, (long long)TopicIndex_Count(&topicIndex));
+    ReleaseSRWLockShared(&subscribersLock);
+
+    Metrics_Set(queueDepthGauge, (long long)depth);
+    Metrics_Set(queueBytesGauge, (long long)bytes);
+
+    ExecutorStats executorStats;
+    Executor_GetStats(&executor, &executorStats);
+    Metrics_Set(fanOutPendingGauge, executorStats.pending);
+    Metrics_Set(fanOutStolenGauge, (long long)executorStats.stolen);
+}
+
 bool SubscriberEngine_Init(void) {
     InitializeLogging("subscriber_engine.log");
     SetLogLevel(LOG_INFO);
+    RegisterMetrics();
 
-    subscribersMutex = CreateMutex(NULL, FALSE, NULL);
-    if (subscribersMutex == NULL) {
-        LogMessage(LOG_ERROR, "Failed to create mutex: %s", GetErrorDescription(ERROR_MUTEX_ERROR));
+    if (!TopicIndex_Init(&topicIndex, TOPIC_INDEX_INITIAL_CAPACITY) || !TopicSet_Init(&subscriberNames, 0)) {
+        LogMessage(LOG_ERROR, "Failed to allocate topic index");
         return false;
     }
 
+    // Hand out low slots first so the slot table stays dense
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        freeSlots[i] = MAX_CLIENTS - 1 - i;
+    }
+    freeSlotCount = MAX_CLIENTS;
+
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
         LogMessage(LOG_ERROR, "WSAStartup failed: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
@@ -119,15 +265,29 @@ bool SubscriberEngine_Init(void) {
         return false;
     }
 
-    LogMessage(LOG_INFO, "Subscriber Engine initialized and listening on port %s", DEFAULT_PORT);
+    // Fan-out runs on the workers so one busy PES link can use every core
+    if (!Executor_Init(&executor, WORKER_COUNT, PIN_WORKERS)) {
+        LogMessage(LOG_ERROR, "Failed to start fan-out workers");
+        closesocket(serverSocket);
+        WSACleanup();
+        return false;
+    }
+    for (int i = 0; i < FANOUT_STRANDS; i++) {
+        ExecutorStrand_Init(&fanOutStrands[i], &executor);
+    }
 
-    consoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (consoleHandle == INVALID_HANDLE_VALUE) {
-        LogMessage(LOG_ERROR, "Failed to get console handle");
+    if (!Reactor_Init(&reactor, EVENT_LOOP_COUNT)) {
+        LogMessage(LOG_ERROR, "Failed to start event loops: %s", GetErrorDescription(ERROR_CONNECTION_FAILED));
+        closesocket(serverSocket);
+        WSACleanup();
         return false;
     }
-    UpdateDisplay();  // Initial display
 
+    LogMessage(LOG_INFO, "Subscriber Engine initialized and listening on port %s", DEFAULT_PORT);
+
+    MetricsConfig metricsConfig = { "subscriber_engine", METRICS_FILE, 0, METRICS_PORT, CollectMetrics, NULL };
+    Metrics_Start(&metricsConfig);
+    Trace_OpenSink(TRACE_FILE, "subscriber_engine");
     return true;
 }
 
@@ -142,13 +302,13 @@ bool SubscriberEngine_Subscribe(Client* client, const char* topic) {
         return false;
     }
 
-    WaitForSingleObject(subscribersMutex, INFINITE);
+    AcquireSRWLockExclusive(&subscribersLock);
 
     for (int i = 0; i < subscriberCount; i++) {
-        if (subscribers[i]->client.id == client->id) {
+        if (&subscribers[i]->client == client) {
             if (subscribers[i]->topicCount >= MAX_TOPICS_PER_CLIENT) {
-                ReleaseMutex(subscribersMutex);
-                send(client->clientSocket, "Subscription limit reached", strlen("Subscription limit reached"), 0);
+                QueueFrame(subscribers[i], FRAME_RESPONSE, NULL, "Subscription limit reached");
+                ReleaseSRWLockExclusive(&subscribersLock);
                 LogMessage(LOG_ERROR, "Subscription limit reached: %s", GetErrorDescription(ERROR_SUBSCRIPTION_LIMIT_REACHED));
                 return false;
             }
@@ -156,8 +316,8 @@ bool SubscriberEngine_Subscribe(Client* client, const char* topic) {
             // Check if already subscribed
             for (size_t j = 0; j < subscribers[i]->topicCount; j++) {
                 if (strcmp(subscribers[i]->topics[j], topic) == 0) {
-                    ReleaseMutex(subscribersMutex);
-                    send(client->clientSocket, "Already subscribed", strlen("Already subscribed"), 0);
+                    QueueFrame(subscribers[i], FRAME_RESPONSE, NULL, "Already subscribed");
+                    ReleaseSRWLockExclusive(&subscribersLock);
                     LogMessage(LOG_WARNING, "Already subscribed: %s", GetErrorDescription(ERROR_ALREADY_SUBSCRIBED));
                     return false;
                 }
@@ -166,216 +326,555 @@ bool SubscriberEngine_Subscribe(Client* client, const char* topic) {
             // Add new topic
             char* topicCopy = _strdup(topic);
             if (!topicCopy) {
-                ReleaseMutex(subscribersMutex);
+                ReleaseSRWLockExclusive(&subscribersLock);
+                return false;
+            }
+
+            int memberCount = TopicIndex_Add(&topicIndex, topic, subscribers[i]->slot);
+            if (memberCount < 0) {
+                free(topicCopy);
+                ReleaseSRWLockExclusive(&subscribersLock);
+                LogMessage(LOG_ERROR, "Failed to index subscription: %s", GetErrorDescription(ERROR_SUBSCRIBE_FAILED));
                 return false;
             }
 
             subscribers[i]->topics[subscribers[i]->topicCount++] = topicCopy;
-            ReleaseMutex(subscribersMutex);
-            send(client->clientSocket, "Subscribed to topic", strlen("Subscribed to topic"), 0);
+            if (memberCount == 1) {
+                PushInterestDelta(INTEREST_ADD, topic);
+            }
+            QueueFrame(subscribers[i], FRAME_RESPONSE, NULL, "Subscribed to topic");
+            ReleaseSRWLockExclusive(&subscribersLock);
             LogMessage(LOG_INFO, "Client %d subscribed to topic: %s", client->id, topic);
-            UpdateDisplay();
             return true;
         }
     }
 
-    ReleaseMutex(subscribersMutex);
-    send(client->clientSocket, "Failed to subscribe to topic", strlen("Failed to subscribe to topic"), 0);
+    ReleaseSRWLockExclusive(&subscribersLock);
+    Frame_Send(client->clientSocket, FRAME_RESPONSE, NULL, "Failed to subscribe to topic");
     return false;
 }
 
 bool SubscriberEngine_NotifySubscribers(const char* topic, const char* message) {
+    return SubscriberEngine_NotifyTraced(topic, message, NULL);
+}
+
+// A message encoded for fan-out, waiting on its topic's strand
+typedef struct {
+    SharedFrame* frame;
+    const char* topic;          // Points into frame->data
+    size_t topicLength;
+    size_t length;              // Payload bytes
+    unsigned long long start;   // When the SE received the message
+} Notification;
+
+// Count an incoming message and encode it once; every matching queue shares the buffer
+static bool PrepareNotification(Notification* notification, const char* topic, const char* message, const TraceHeader* trace) {
+    notification->start = Metrics_Now();
+    notification->length = strlen(message);
+    Metrics_Add(messagesIn, 1);
+    Metrics_Add(bytesIn, (long long)notification->length);
+    Metrics_CountTopic(topic, TOPIC_MESSAGES_IN, 1);
+    Metrics_CountTopic(topic, TOPIC_BYTES_IN, notification->length);
+
+    SharedFrame* frame;
+    if (trace) {
+        TraceHeader fanOutTrace = *trace;
+        Trace_AddHop(&fanOutTrace, TRACE_HOP_SE_FANOUT, Trace_Now());
+        frame = SharedFrame_CreateTraced(FRAME_MESSAGE, &fanOutTrace, topic, message);
+    }
+    else {
+        frame = SharedFrame_Create(FRAME_MESSAGE, topic, message);
+    }
+
+    Frame encoded;
+    if (!frame || !Frame_Parse(frame->data, frame->length, &encoded)) {
+        LogMessage(LOG_ERROR, "Failed to encode message for topic: %s", topic);
+        if (frame) {
+            SharedFrame_Release(frame);
+        }
+        return false;
+    }
+
+    notification->frame = frame;
+    notification->topic = encoded.topic;
+    notification->topicLength = encoded.topicLength;
+    return true;
+}
+
+// Queue a prepared message for every subscriber of its topic and drop the caller's reference
+static void DeliverNotification(Notification* notification) {
+    const char* topic = notification->topic;
+    size_t length = notification->length;
+
+    // Deliveries only read the index, so fan-out on different strands runs side by side
+    AcquireSRWLockShared(&subscribersLock);
+
+    // Only touch the subscribers registered for this topic
+    int memberCount;
+    int queued = 0;
+    int dropped = 0;
+    const int* slots = TopicIndex_Find(&topicIndex, topic, &memberCount);
+    for (int i = 0; i < memberCount; i++) {
+        Subscriber* subscriber = subscriberSlots[slots[i]];
+        if (!subscriber) {
+            continue;
+        }
+
+        // Only enqueue here; the subscriber's event loop does the writing
+        if (QueueSharedFrame(subscriber, notification->frame)) {
+            queued++;
+        }
+        else {
+            dropped++;
+        }
+    }
+
+    ReleaseSRWLockShared(&subscribersLock);
+
+    Metrics_Add(messagesOut, queued);
+    Metrics_Add(bytesOut, (long long)(queued * length));
+    Metrics_CountTopic(topic, TOPIC_MESSAGES_OUT, (unsigned long long)queued);
+    Metrics_CountTopic(topic, TOPIC_BYTES_OUT, (unsigned long long)queued * length);
+    if (dropped > 0) {
+        Metrics_Add(messagesDropped, dropped);
+        Metrics_CountTopic(topic, TOPIC_DROPS, (unsigned long long)dropped);
+    }
+    Metrics_Record(fanOut, (unsigned long long)memberCount);
+
+    // Queues hold their own references; the frame is freed after the last write
+    unsigned long long start = notification->start;
+    SharedFrame_Release(notification->frame);
+    Metrics_RecordSince(notifyLatency, start);
+}
+
+bool SubscriberEngine_NotifyTraced(const char* topic, const char* message, const TraceHeader* trace) {
     if (!topic || !message) {
         LogMessage(LOG_ERROR, "Invalid parameters: %s", GetErrorDescription(ERROR_INVALID_MESSAGE));
         return false;
     }
 
-    WaitForSingleObject(subscribersMutex, INFINITE);
+    Notification notification;
+    if (!PrepareNotification(&notification, topic, message, trace)) {
+        return false;
+    }
+    DeliverNotification(&notification);
+    return true;
+}
 
-    for (int i = 0; i < subscriberCount; i++) {
-        for (size_t j = 0; j < subscribers[i]->topicCount; j++) {
-            if (strcmp(subscribers[i]->topics[j], topic) == 0) {
-                Message msg;
-                Message_Init(&msg, topic, message);
+// Read the PES link again once fan-out has caught up
+static void ResumePes(void) {
+    if (InterlockedExchange(&pesPaused, 0) == 1) {
+        AcquireSRWLockShared(&subscribersLock);
+        Reactor_Resume(pesConnection);
+        ReleaseSRWLockShared(&subscribersLock);
+    }
+}
 
-                char buffer[MAX_TOPIC_LENGTH + MAX_MESSAGE_LENGTH + 2];
-                snprintf(buffer, sizeof(buffer), "%s|%s", topic, message);
+// Stop reading the PES link until fan-out catches up; subscribers on the same loop keep running
+static void PausePes(ReactorConnection* connection) {
+    Reactor_Pause(connection);
+    InterlockedExchange(&pesPaused, 1);
 
-                send(subscribers[i]->client.clientSocket, buffer, strlen(buffer), 0);
-            }
-        }
+    // Fan-out may have caught up before the flag was set, leaving no one to resume the link
+    if (Executor_Pending(&executor) <= FANOUT_RESUME_PENDING) {
+        ResumePes();
     }
+}
 
-    ReleaseMutex(subscribersMutex);
-    return true;
+// Runs on a fan-out worker, in order with the other messages of the same topic
+static void RunNotification(void* argument) {
+    Notification* notification = (Notification*)argument;
+    DeliverNotification(notification);
+    free(notification);
+
+    if (pesPaused && Executor_Pending(&executor) <= FANOUT_RESUME_PENDING) {
+        ResumePes();
+    }
+}
+
+// Encode a message from the PES on the event loop and queue its fan-out on the topic's strand
+static void DispatchNotification(const char* topic, const char* message, const TraceHeader* trace) {
+    Notification* notification = (Notification*)malloc(sizeof(Notification));
+    if (!notification) {
+        LogMessage(LOG_ERROR, "Failed to queue message for topic: %s", topic);
+        Metrics_Add(messagesDropped, 1);
+        return;
+    }
+    if (!PrepareNotification(notification, topic, message, trace)) {
+        free(notification);
+        return;
+    }
+
+    unsigned int hash = TopicSet_Hash(notification->topic, notification->topicLength);
+    if (!ExecutorStrand_Post(&fanOutStrands[hash % FANOUT_STRANDS], RunNotification, notification)) {
+        // Out of queue memory: deliver on the loop rather than lose the message
+        RunNotification(notification);
+    }
 }
 
 static bool IsUsernameUnique(const char* username) {
-    for (int i = 0; i < subscriberCount; i++) {
-        if (strcmp(subscribers[i]->client.username, username) == 0) {
+    return !TopicSet_Contains(&subscriberNames, username);
+}
+
+// Take a free entry in subscriberSlots (caller holds subscribersLock)
+static int AllocateSubscriberSlot(void) {
+    return freeSlotCount > 0 ? freeSlots[--freeSlotCount] : -1;
+}
+
+// Return a slot to the free stack (caller holds subscribersLock)
+static void ReleaseSubscriberSlot(int slot) {
+    subscriberSlots[slot] = NULL;
+    freeSlots[freeSlotCount++] = slot;
+}
+
+// Queue a single interest line for the PES link's event loop to write (caller holds subscribersLock
+// exclusively). Never blocks; if the line cannot be queued the link is dropped, and the PES reconnects
+// and rebuilds its cache from the snapshot it gets on authentication.
+static void SendInterestLine(InterestOp op, unsigned long version, const char* topic) {
+    if (!pesConnection || pesConnection->closeRequested) {
+        return;
+    }
+
+    InterestDelta delta;
+    delta.version = version;
+    delta.op = op;
+    strncpy(delta.topic, topic, MAX_TOPIC_LENGTH - 1);
+    delta.topic[MAX_TOPIC_LENGTH - 1] = '\0';
+
+    char line[MAX_INTEREST_LINE];
+    if (Interest_FormatDelta(line, sizeof(line), &delta) == 0) {
+        LogMessage(LOG_ERROR, "Failed to encode interest update for topic: %s", topic);
+        return;
+    }
+
+    SharedFrame* frame = SharedFrame_Create(FRAME_INTEREST, NULL, line);
+    const char* sendData = NULL;
+    size_t sendLength = 0;
+    bool queued = frame && SendQueue_Push(&pesOutbound, frame, &sendData, &sendLength);
+    if (frame) {
+        SharedFrame_Release(frame);
+    }
+
+    if (!queued) {
+        LogMessage(LOG_ERROR, "Failed to push interest update to PES; dropping the link so it resyncs");
+        Reactor_Close(pesConnection);
+    }
+    else if (sendData) {
+        Reactor_Send(pesConnection, sendData, sendLength);
+    }
+}
+
+// Record a change in the interest set and push it to the PES (caller holds subscribersLock)
+static void PushInterestDelta(InterestOp op, const char* topic) {
+    interestVersion++;
+    SendInterestLine(op, interestVersion, topic);
+    LogMessage(LOG_INFO, "Interest %s topic '%s' (version %lu)",
+        op == INTEREST_ADD ? "added" : "removed", topic, interestVersion);
+}
+
+static void SendSnapshotTopic(const char* topic, int memberCount, void* context) {
+    SendInterestLine(INTEREST_SNAPSHOT, interestVersion, topic);
+}
+
+// Send the full interest set so the PES can rebuild its cache (caller holds subscribersLock)
+static void SendInterestSnapshot(void) {
+    SendInterestLine(INTEREST_RESET, interestVersion, "");
+    TopicIndex_ForEach(&topicIndex, SendSnapshotTopic, NULL);
+    LogMessage(LOG_INFO, "Sent interest snapshot to PES (version %lu, %zu topics)", interestVersion, TopicIndex_Count(&topicIndex));
+}
+
+// Send a status response to a connection that is about to be rejected
+static bool RejectClient(SOCKET clientSocket, const char* reason) {
+    Frame_Send(clientSocket, FRAME_RESPONSE, NULL, reason);
+    return false;
+}
+
+// Handle the first frame of a connection; returns false to drop it
+static bool AuthenticateConnection(ReactorConnection* connection, EngineConnection* state, const Frame* frame) {
+    SOCKET clientSocket = connection->socket;
+
+    if (frame->type != FRAME_AUTH || frame->payloadLength == 0) {
+        LogMessage(LOG_WARNING, "Invalid authentication format");
+        return RejectClient(clientSocket, "Invalid authentication format");
+    }
+
+    if (!SubscriberEngine_IsAuthorized(frame->topic)) {
+        LogMessage(LOG_WARNING, "Unauthorized connection attempt");
+        return RejectClient(clientSocket, "Unauthorized connection attempt");
+    }
+
+    if (strcmp(frame->topic, PES_AUTH_MESSAGE) == 0) {
+        AcquireSRWLockExclusive(&subscribersLock);
+        if (pesSocket != INVALID_SOCKET) {
+            ReleaseSRWLockExclusive(&subscribersLock);
+            LogMessage(LOG_WARNING, "PES already connected");
+            return RejectClient(clientSocket, "PES already connected");
+        }
+        if (!SendQueue_Init(&pesOutbound, PES_QUEUE_MAX_FRAMES, PES_QUEUE_MAX_BYTES)) {
+            ReleaseSRWLockExclusive(&subscribersLock);
+            LogMessage(LOG_ERROR, "Failed to allocate PES send queue");
             return false;
         }
+        pesSocket = clientSocket;
+        pesConnection = connection;
+        state->isPes = true;
+        SendInterestSnapshot();
+        ReleaseSRWLockExclusive(&subscribersLock);
+        LogMessage(LOG_INFO, "PES connected successfully");
+        return true;
     }
-    return true;
-}
 
-static unsigned __stdcall HandleRequestsThread(void* param) {
-    SOCKET clientSocket = *(SOCKET*)param;
-    char buffer[BUFFER_SIZE];
+    // Subscriber Authentication
+    char username[MAX_USERNAME];
+    strncpy(username, frame->payload, sizeof(username) - 1);
+    username[sizeof(username) - 1] = '\0';
 
-    while (!shouldStop) {
-        int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-        if (bytesReceived <= 0) {
-            // Client disconnected
-            WaitForSingleObject(subscribersMutex, INFINITE);
-            if (clientSocket == pesSocket) {
-                pesSocket = INVALID_SOCKET;
-            }
-            else {
-                for (int i = 0; i < subscriberCount; i++) {
-                    if (subscribers[i]->client.clientSocket == clientSocket) {
-                        SubscriberEngine_FreeSubscriber(subscribers[i]);
-                        // Move remaining subscribers up
-                        for (int j = i; j < subscriberCount - 1; j++) {
-                            subscribers[j] = subscribers[j + 1];
-                        }
-                        subscriberCount--;
-                        break;
-                    }
-                }
-            }
-            ReleaseMutex(subscribersMutex);
-            UpdateDisplay();
-            break;
+    AcquireSRWLockExclusive(&subscribersLock);
+
+    if (subscriberCount >= MAX_CLIENTS || freeSlotCount == 0) {
+        LogMessage(LOG_ERROR, "Maximum clients reached");
+        ReleaseSRWLockExclusive(&subscribersLock);
+        return RejectClient(clientSocket, "Maximum clients reached");
+    }
+
+    if (!IsUsernameUnique(username)) {
+        LogMessage(LOG_WARNING, "Username already in use");
+        ReleaseSRWLockExclusive(&subscribersLock);
+        return RejectClient(clientSocket, "Username already in use");
+    }
+
+    Subscriber* newSub = SubscriberEngine_CreateSubscriber(clientSocket, username, subscriberCount + 1);
+    if (!newSub || !TopicSet_Insert(&subscriberNames, username)) {
+        LogMessage(LOG_ERROR, "Failed to create subscriber");
+        ReleaseSRWLockExclusive(&subscribersLock);
+        if (newSub) {
+            newSub->client.clientSocket = INVALID_SOCKET;
+            SubscriberEngine_FreeSubscriber(newSub);
         }
+        return false;
+    }
 
-        buffer[bytesReceived] = '\0';
+    newSub->slot = AllocateSubscriberSlot();
+    newSub->connection = connection;
+    subscriberSlots[newSub->slot] = newSub;
+    subscribers[subscriberCount++] = newSub;
+    state->subscriber = newSub;
+    QueueFrame(newSub, FRAME_RESPONSE, NULL, "Welcome to the subscriber engine");
+    ReleaseSRWLockExclusive(&subscribersLock);
 
-        char* delimiter = strchr(buffer, '|');
-        if (delimiter) {
-            *delimiter = '\0';
-            char* topic = buffer;
-            char* message = delimiter + 1;
+    LogMessage(LOG_INFO, "New subscriber connected. Username: %s, ID: %d", newSub->client.username, newSub->client.id);
+    return true;
+}
 
-            if (clientSocket == pesSocket) {
-                // Handle PES message
-                LogMessage(LOG_INFO, "PES sent message: %s|%s", topic, message);
-                SubscriberEngine_NotifySubscribers(topic, message);
+static void HandleFrame(EngineConnection* state, const Frame* frame) {
+    if (state->isPes) {
+        if (frame->type == FRAME_INTEREST) {
+            InterestDelta request;
+            if (Interest_ParseDelta(frame->payload, &request) && request.op == INTEREST_SYNC) {
+                LogMessage(LOG_INFO, "PES requested interest resync");
+                AcquireSRWLockExclusive(&subscribersLock);
+                SendInterestSnapshot();
+                ReleaseSRWLockExclusive(&subscribersLock);
+            }
+        }
+        else if (frame->type == FRAME_PUBLISH) {
+            // Handle PES message
+            LOG_FAST(LOG_INFO, "PES sent message: %s|%s", frame->topic, frame->payload);
+            TraceHeader trace;
+            if (frame->trace && Trace_Decode(frame->trace, frame->traceLength, &trace)) {
+                Trace_AddHop(&trace, TRACE_HOP_SE_RECEIVE, Trace_Now());
+                DispatchNotification(frame->topic, frame->payload, &trace);
             }
             else {
-                // Handle subscriber request
-                LogMessage(LOG_INFO, "Subscriber sent message: %s|%s", topic, message);
-                WaitForSingleObject(subscribersMutex, INFINITE);
-                for (int i = 0; i < subscriberCount; i++) {
-                    if (subscribers[i]->client.clientSocket == clientSocket) {
-                        SubscriberEngine_Subscribe(&subscribers[i]->client, topic);
-                        break;
-                    }
-                }
-                ReleaseMutex(subscribersMutex);
+                DispatchNotification(frame->topic, frame->payload, NULL);
             }
         }
     }
-
-    return 0;
+    else if (frame->type == FRAME_SUBSCRIBE) {
+        // Handle subscriber request
+        LOG_FAST(LOG_INFO, "Subscriber requested topic: %s", frame->topic);
+        SubscriberEngine_Subscribe(&state->subscriber->client, frame->topic);
+    }
 }
 
-static unsigned __stdcall HandleClientThread(void* param) {
-    while (!shouldStop) {
-        SOCKET clientSocket = accept(serverSocket, NULL, NULL);
-        if (clientSocket == INVALID_SOCKET) continue;
+// Handle the frames buffered for a connection
+// Returns 1 when all were handled, 0 when PES reads paused with the rest left buffered, -1 to drop the connection
+static int HandleConnectionFrames(ReactorConnection* connection, EngineConnection* state) {
+    Frame frame;
+    int result;
+    while ((result = FrameDecoder_Next(&state->decoder, &frame)) == 1) {
+        if (!state->isPes && !state->subscriber) {
+            if (!AuthenticateConnection(connection, state, &frame)) {
+                return -1;
+            }
+        }
+        else {
+            HandleFrame(state, &frame);
+        }
 
-        char buffer[BUFFER_SIZE];
-        int bytesReceived = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-        if (bytesReceived <= 0) {
-            closesocket(clientSocket);
-            continue;
+        // While the workers are this far behind, stop reading the PES link so TCP pushes back on it
+        if (state->isPes && Executor_Pending(&executor) > FANOUT_MAX_PENDING) {
+            PausePes(connection);
+            return 0;
         }
+    }
 
-        buffer[bytesReceived] = '\0';
+    if (result < 0) {
+        LogMessage(LOG_WARNING, "Dropping connection after invalid frame");
+        return -1;
+    }
+    return 1;
+}
 
-        // Split the buffer into auth and username parts
-        char* delimiter = strchr(buffer, '|');
-        if (!delimiter) {
-            send(clientSocket, "Invalid authentication format", strlen("Invalid authentication format"), 0);
-            LogMessage(LOG_WARNING, "Invalid authentication format");
-            closesocket(clientSocket);
-            continue;
+// Runs on an event loop whenever a subscriber or PES socket is readable or the PES link resumes
+static bool OnConnectionReadable(ReactorConnection* connection) {
+    EngineConnection* state = (EngineConnection*)connection->context;
+
+    // Frames left buffered when reads paused go first
+    int handled = HandleConnectionFrames(connection, state);
+    if (handled <= 0) {
+        return handled == 0;
+    }
+
+    for (int reads = 0; reads < MAX_READS_PER_WAKEUP; reads++) {
+        int bytesReceived = FrameDecoder_Receive(&state->decoder, connection->socket);
+        if (bytesReceived == 0) {
+            return false;
+        }
+        if (bytesReceived < 0) {
+            return WSAGetLastError() == WSAEWOULDBLOCK;
         }
 
-        *delimiter = '\0';
-        char* authMessage = buffer;
-        char* username = delimiter + 1;
+        handled = HandleConnectionFrames(connection, state);
+        if (handled <= 0) {
+            return handled == 0;
+        }
+    }
 
-        if (!SubscriberEngine_IsAuthorized(authMessage)) {
-            send(clientSocket, "Unauthorized connection attempt", strlen("Unauthorized connection attempt"), 0);
-            LogMessage(LOG_WARNING, "Unauthorized connection attempt");
-            closesocket(clientSocket);
-            continue;
+    // Leave the rest for the next wakeup so one busy connection cannot starve its loop
+    return true;
+}
+
+// Close the trace of a traced frame that has just been written to a subscriber
+static void RecordTracedSend(Subscriber* subscriber, const char* data, size_t length) {
+    Frame frame;
+    TraceHeader trace;
+    if (!Frame_Parse(data, length, &frame) || !frame.trace ||
+        !Trace_Decode(frame.trace, frame.traceLength, &trace)) {
+        return;
+    }
+
+    Trace_AddHop(&trace, TRACE_HOP_SE_SEND, Trace_Now());
+    Trace_Record(&trace, frame.topic, subscriber->client.username);
+}
+
+// Runs on the connection's event loop after each queued frame has been written
+static void OnConnectionWritten(ReactorConnection* connection, bool sent) {
+    EngineConnection* state = (EngineConnection*)connection->context;
+    if (!sent || (!state->subscriber && !state->isPes)) {
+        return;
+    }
+
+    const char* sendData;
+    size_t sendLength;
+    if (state->isPes) {
+        if (SendQueue_Complete(&pesOutbound, &sendData, &sendLength)) {
+            Reactor_Send(connection, sendData, sendLength);
         }
+        return;
+    }
 
-        if (strcmp(authMessage, PES_AUTH_MESSAGE) == 0) {
-            if (pesSocket != INVALID_SOCKET) {
-                send(clientSocket, "PES already connected", strlen("PES already connected"), 0);
-                LogMessage(LOG_WARNING, "PES already connected");
-                closesocket(clientSocket);
-                continue;
-            }
-            pesSocket = clientSocket;
-            LogMessage(LOG_INFO, "PES connected successfully");
-            UpdateDisplay();
+    if (SendQueue_InFlight(&state->subscriber->outbound, &sendData, &sendLength) &&
+        (sendData[1] & FRAME_FLAG_TRACE)) {
+        RecordTracedSend(state->subscriber, sendData, sendLength);
+    }
+
+    if (SendQueue_Complete(&state->subscriber->outbound, &sendData, &sendLength)) {
+        Reactor_Send(connection, sendData, sendLength);
+    }
+}
+
+static void OnConnectionClosed(ReactorConnection* connection) {
+    EngineConnection* state = (EngineConnection*)connection->context;
+
+    if (state->isPes || state->subscriber) {
+        AcquireSRWLockExclusive(&subscribersLock);
+        if (state->isPes) {
+            pesSocket = INVALID_SOCKET;
+            pesConnection = NULL;
+            pesPaused = 0;
+            SendQueue_Destroy(&pesOutbound);
         }
-        else { // Subscriber Authentication
-            if (subscriberCount >= MAX_CLIENTS) {
-                WaitForSingleObject(subscribersMutex, INFINITE);
-                send(clientSocket, "Maximum clients reached", strlen("Maximum clients reached"), 0);
-                LogMessage(LOG_ERROR, "Maximum clients reached");
-                ReleaseMutex(subscribersMutex);
-                closesocket(clientSocket);
-                continue;
+        else {
+            Subscriber* removed = state->subscriber;
+            for (int i = 0; i < subscriberCount; i++) {
+                if (subscribers[i] == removed) {
+                    // Move remaining subscribers up
+                    for (int j = i; j < subscriberCount - 1; j++) {
+                        subscribers[j] = subscribers[j + 1];
+                    }
+                    subscriberCount--;
+                    break;
+                }
             }
 
-            if (!IsUsernameUnique(username)) {
-                send(clientSocket, "Username already in use", strlen("Username already in use"), 0);
-                LogMessage(LOG_WARNING, "Username already in use");
-                ReleaseMutex(subscribersMutex);
-                closesocket(clientSocket);
-                continue;
+            // Drop the subscriber from the index and tell the PES about topics that lost their last subscriber
+            for (size_t j = 0; j < removed->topicCount; j++) {
+                if (TopicIndex_Remove(&topicIndex, removed->topics[j], removed->slot) == 0) {
+                    PushInterestDelta(INTEREST_REMOVE, removed->topics[j]);
+                }
             }
+            TopicSet_Remove(&subscriberNames, removed->client.username);
+            ReleaseSubscriberSlot(removed->slot);
 
-            Subscriber* newSub = SubscriberEngine_CreateSubscriber(clientSocket, username, subscriberCount + 1);
-            if (!newSub) {
-                LogMessage(LOG_ERROR, "Failed to create subscriber");
-                ReleaseMutex(subscribersMutex);
-                closesocket(clientSocket);
-                continue;
-            }
+            // The reactor closes the socket once this handler returns
+            removed->client.clientSocket = INVALID_SOCKET;
+            SubscriberEngine_FreeSubscriber(removed);
+        }
+        ReleaseSRWLockExclusive(&subscribersLock);
+    }
 
-            send(clientSocket, "Welcome to the subscriber engine", strlen("Welcome to the subscriber engine"), 0);
-            LogMessage(LOG_INFO, "New subscriber connected. Username: %s, ID: %d", newSub->client.username, newSub->client.id);
+    FrameDecoder_Destroy(&state->decoder);
+    free(state);
+}
 
-            subscribers[subscriberCount++] = newSub;
-            ReleaseMutex(subscribersMutex);
-            UpdateDisplay();
-        }
+// Accept connections and hand them to the event loops
+static unsigned __stdcall HandleClientThread(void* param) {
+    while (!shouldStop) {
+        SOCKET clientSocket = accept(serverSocket, NULL, NULL);
+        if (clientSocket == INVALID_SOCKET) continue;
 
-        unsigned threadId;
-        HANDLE requestThread = (HANDLE)_beginthreadex(NULL, 0, HandleRequestsThread, &clientSocket, 0, &threadId);
-        if (requestThread == NULL) {
-            LogMessage(LOG_ERROR, "Failed to create request handler thread");
+        EngineConnection* state = (EngineConnection*)calloc(1, sizeof(EngineConnection));
+        if (!state || !FrameDecoder_Init(&state->decoder, CONNECTION_BUFFER_SIZE) ||
+            !Reactor_SetNonBlocking(clientSocket) ||
+            !Reactor_Add(&reactor, clientSocket, OnConnectionReadable, OnConnectionClosed, OnConnectionWritten, state)) {
+            LogMessage(LOG_ERROR, "Failed to register client connection");
+            if (state) {
+                FrameDecoder_Destroy(&state->decoder);
+                free(state);
+            }
             closesocket(clientSocket);
-            continue;
         }
-        CloseHandle(requestThread);
     }
     return 0;
 }
 
 void SubscriberEngine_Destroy(void) {
     shouldStop = true;
+    StatusView_Stop();
+    Metrics_Stop();
+
+    // Stopping the reactor runs OnConnectionClosed for every open connection; fan-out
+    // still queued after that finds no subscribers and only releases its frames
+    Reactor_Destroy(&reactor);
+    Executor_Destroy(&executor);
+    for (int i = 0; i < FANOUT_STRANDS; i++) {
+        ExecutorStrand_Destroy(&fanOutStrands[i]);
+    }
+    Trace_CloseSink();
 
     // Close all client connections first
-    WaitForSingleObject(subscribersMutex, INFINITE);
+    AcquireSRWLockExclusive(&subscribersLock);
     for (int i = 0; i < subscriberCount; i++) {
         if (subscribers[i] && subscribers[i]->client.clientSocket != INVALID_SOCKET) {
             closesocket(subscribers[i]->client.clientSocket);
@@ -383,7 +882,11 @@ void SubscriberEngine_Destroy(void) {
         }
     }
     subscriberCount = 0;
-    ReleaseMutex(subscribersMutex);
+    memset(subscriberSlots, 0, sizeof(subscriberSlots));
+    freeSlotCount = 0;
+    TopicIndex_Destroy(&topicIndex);
+    TopicSet_Destroy(&subscriberNames);
+    ReleaseSRWLockExclusive(&subscribersLock);
 
     // Close PES connection
     if (pesSocket != INVALID_SOCKET) {
@@ -397,86 +900,100 @@ void SubscriberEngine_Destroy(void) {
         serverSocket = INVALID_SOCKET;
     }
 
-    // Cleanup Windows handles and WSA
-    if (subscribersMutex) {
-        CloseHandle(subscribersMutex);
-        subscribersMutex = NULL;
-    }
-
-    if (consoleHandle && consoleHandle != INVALID_HANDLE_VALUE) {
-        CloseHandle(consoleHandle);
-        consoleHandle = INVALID_HANDLE_VALUE;
-    }
-
     WSACleanup();
     CloseLogging();
 }
 
-static void ClearScreen(void) {
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    DWORD count;
-    DWORD cellCount;
-
-    if (GetConsoleScreenBufferInfo(consoleHandle, &csbi)) {
-        cellCount = csbi.dwSize.X * csbi.dwSize.Y;
-        MoveCursor(0, 0);
-        FillConsoleOutputCharacter(consoleHandle, ' ', cellCount, cursorPosition, &count);
-        FillConsoleOutputAttribute(consoleHandle, csbi.wAttributes, cellCount, cursorPosition, &count);
-        MoveCursor(0, 0);
-    }
-}
-
-static void MoveCursor(int x, int y) {
-    cursorPosition.X = (SHORT)x;
-    cursorPosition.Y = (SHORT)y;
-    SetConsoleCursorPosition(consoleHandle, cursorPosition);
-}
+// A client as the status view lists it, copied out under subscribersLock
+typedef struct {
+    int id;
+    char username[MAX_USERNAME];
+    SendQueueStats queueStats;
+    size_t topicCount;
+    char topics[STATUS_TOPICS_LENGTH];
+} StatusRow;
 
-static void UpdateDisplay(void) {
-    ClearScreen();
+// Runs on the status view thread; only the subscriber list is read under the lock
+static void BuildStatus(StatusText* text, void* context) {
+    (void)context;
 
     // Status Bar
-    printf("=== Subscriber Engine Status ===\n");
-    printf("Connected Clients: %d/%d | PES Service: %s\n",
+    TextBuffer_Append(text, "=== Subscriber Engine Status ===\n");
+    TextBuffer_Append(text, "Connected Clients: %d/%d | PES Service: %s\n",
         subscriberCount,
         MAX_CLIENTS,
         pesSocket != INVALID_SOCKET ? "Connected" : "Disconnected");
-    printf("=====================================\n\n");
-
-    // Client List
-    WaitForSingleObject(subscribersMutex, INFINITE);
-
-    if (subscriberCount == 0) {
-        printf("No clients connected.\n");
+    TextBuffer_Append(text, "Messages: %lld in | %lld delivered | %lld dropped\n",
+        Metrics_Value(messagesIn), Metrics_Value(messagesOut), Metrics_Value(messagesDropped));
+    TextBuffer_Append(text, "=====================================\n\n");
+
+    // Client List: the lock is held only to copy the rows, formatting happens after it is released
+    StatusRow rows[STATUSVIEW_MAX_LISTED];
+    AcquireSRWLockShared(&subscribersLock);
+    int total = subscriberCount;
+    int listed = total < STATUSVIEW_MAX_LISTED ? total : STATUSVIEW_MAX_LISTED;
+    for (int i = 0; i < listed; i++) {
+        rows[i].id = subscribers[i]->client.id;
+        memcpy(rows[i].username, subscribers[i]->client.username, sizeof(rows[i].username));
+        SubscriberEngine_GetQueueStats(subscribers[i], &rows[i].queueStats);
+        rows[i].topicCount = subscribers[i]->topicCount;
+
+        // One row of topics per client; the view cuts it at the window width anyway
+        size_t length = 0;
+        for (size_t j = 0; j < subscribers[i]->topicCount && length + 2 < sizeof(rows[i].topics); j++) {
+            if (j > 0) {
+                rows[i].topics[length++] = ',';
+            }
+            rows[i].topics[length++] = ' ';
+            size_t topicLength = strlen(subscribers[i]->topics[j]);
+            size_t room = sizeof(rows[i].topics) - 1 - length;
+            size_t copied = topicLength < room ? topicLength : room;
+            memcpy(rows[i].topics + length, subscribers[i]->topics[j], copied);
+            length += copied;
+        }
+        rows[i].topics[length] = '\0';
     }
-    else {
-        for (int i = 0; i < subscriberCount; i++) {
-            printf("Client %d: %s\n",
-                subscribers[i]->client.id,
-                subscribers[i]->client.username);
+    ReleaseSRWLockShared(&subscribersLock);
 
-            if (subscribers[i]->topicCount == 0) {
-                printf("  No topics subscribed\n");
-            }
-            else {
-                printf("  Subscribed topics:\n");
-                for (size_t j = 0; j < subscribers[i]->topicCount; j++) {
-                    printf("    - %s\n", subscribers[i]->topics[j]);
-                }
-            }
-            printf("\n");
+    if (total == 0) {
+        TextBuffer_Append(text, "No clients connected.\n");
+    }
+    for (int i = 0; i < listed; i++) {
+        TextBuffer_Append(text, "Client %d: %s | queued %zu frames (%zu bytes), dropped %llu\n",
+            rows[i].id,
+            rows[i].username,
+            rows[i].queueStats.depth,
+            rows[i].queueStats.bytes,
+            rows[i].queueStats.dropped);
+        if (rows[i].topicCount == 0) {
+            TextBuffer_Append(text, "  No topics subscribed\n");
         }
+        else {
+            TextBuffer_Append(text, "  Topics:%s\n", rows[i].topics);
+        }
+    }
+    if (total > listed) {
+        TextBuffer_Append(text, "... and %d more\n", total - listed);
     }
 
-    ReleaseMutex(subscribersMutex);
-    printf("Press 'q' to quit...\n");
+    TextBuffer_Append(text, "\nPress 'q' to quit...\n");
 }
 
-int main(void) {
+// Usage: SubscriberEngine [--headless]
+int main(int argc, char* argv[]) {
     if (!SubscriberEngine_Init()) {
         return 1;
     }
 
+    // The console is redrawn from its own thread; headless runs never touch it
+    if (StatusView_IsHeadless(argc, argv)) {
+        LogMessage(LOG_INFO, "Running headless, status view disabled");
+    }
+    else {
+        StatusViewConfig statusConfig = { 0, BuildStatus, NULL };
+        StatusView_Start(&statusConfig);
+    }
+
     unsigned threadId;
     HANDLE clientThread = (HANDLE)_beginthreadex(NULL, 0, HandleClientThread, NULL, 0, &threadId);
     if (clientThread == NULL) {
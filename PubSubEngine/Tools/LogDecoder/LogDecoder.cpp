@@ -0,0 +1,183 @@
+// LogDecoder.cpp : Renders binary log files written with InitializeBinaryLogging / PUBSUB_BINARY_LOG as text.
+
+#include "../../Common/pch.h"
+#define _CRT_SECURE_NO_WARNINGS
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../Common/logging.h"
+#include "../../Common/logformat.h"
+
+// Rendered text per message; the writer never queues more than LOG_MAX_MESSAGE bytes of arguments,
+// but strings can expand through widths
+#define DECODER_MAX_LINE 4096
+
+// Format strings of the session being decoded
+typedef struct {
+    LogFormat formats[LOG_MAX_FORMATS + 1];
+    char* strings[LOG_MAX_FORMATS + 1];
+    LogBinaryHeader header;
+} DecoderSession;
+
+static void ResetSession(DecoderSession* session) {
+    for (int i = 0; i <= LOG_MAX_FORMATS; i++) {
+        free(session->strings[i]);
+        session->strings[i] = NULL;
+    }
+}
+
+// "YYYY-MM-DD HH:MM:SS.uuuuuu" in local time for a counter value of the session
+static void FormatTimestamp(const DecoderSession* session, unsigned long long counter, char* buffer, size_t size) {
+    long long elapsed = (long long)(counter - session->header.counterBase);
+    long long frequency = (long long)session->header.counterFrequency;
+    long long ticks = (long long)session->header.baseTime + (elapsed / frequency) * 10000000LL +
+        (elapsed % frequency) * 10000000LL / frequency;
+
+    FILETIME time;
+    FILETIME local;
+    SYSTEMTIME parts;
+    time.dwLowDateTime = (DWORD)ticks;
+    time.dwHighDateTime = (DWORD)((unsigned long long)ticks >> 32);
+    FileTimeToLocalFileTime(&time, &local);
+    FileTimeToSystemTime(&local, &parts);
+    snprintf(buffer, size, "%04u-%02u-%02u %02u:%02u:%02u.%06u",
+        parts.wYear, parts.wMonth, parts.wDay, parts.wHour, parts.wMinute, parts.wSecond,
+        (unsigned)((unsigned long long)ticks % 10000000ULL / 10));
+}
+
+static bool ReadHeader(FILE* input, DecoderSession* session) {
+    if (fread(&session->header, sizeof(session->header), 1, input) != 1 ||
+        memcmp(session->header.magic, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_LENGTH) != 0 ||
+        session->header.counterFrequency == 0) {
+        return false;
+    }
+    ResetSession(session);
+    return true;
+}
+
+static bool DecodeFile(FILE* input, FILE* output, DecoderSession* session, unsigned long long* decoded) {
+    static char data[0x10000];
+    static char line[DECODER_MAX_LINE];
+    char timestamp[32];
+
+    if (!ReadHeader(input, session)) {
+        fprintf(stderr, "Not a binary log file\n");
+        return false;
+    }
+
+    while (true) {
+        int next = fgetc(input);
+        if (next == EOF) {
+            return true;
+        }
+
+        // Runs appended to the same file start with a new header; no record kind uses its first byte
+        if (next == LOG_BINARY_MAGIC[0]) {
+            ungetc(next, input);
+            if (!ReadHeader(input, session)) {
+                fprintf(stderr, "Corrupt session header after %llu records\n", *decoded);
+                return false;
+            }
+            continue;
+        }
+        ungetc(next, input);
+
+        LogBinaryRecordHeader record;
+        if (fread(&record, sizeof(record), 1, input) != 1 ||
+            (record.length > 0 && fread(data, 1, record.length, input) != record.length)) {
+            // A torn tail is expected if the process died while the writer was flushing
+            fprintf(stderr, "Truncated record after %llu records\n", *decoded);
+            return true;
+        }
+
+        switch (record.kind) {
+        case LOG_BINARY_FORMAT:
+            if (record.formatId == 0 || record.formatId > LOG_MAX_FORMATS) {
+                fprintf(stderr, "Invalid format id %u\n", record.formatId);
+                return false;
+            }
+            free(session->strings[record.formatId]);
+            session->strings[record.formatId] = (char*)malloc((size_t)record.length + 1);
+            if (session->strings[record.formatId] == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                return false;
+            }
+            memcpy(session->strings[record.formatId], data, record.length);
+            session->strings[record.formatId][record.length] = '\0';
+            if (!LogFormat_Parse(&session->formats[record.formatId], session->strings[record.formatId])) {
+                fprintf(stderr, "Unsupported format \"%s\"\n", session->strings[record.formatId]);
+                return false;
+            }
+            continue;
+
+        case LOG_BINARY_MESSAGE:
+            if (record.formatId == 0 || record.formatId > LOG_MAX_FORMATS || session->strings[record.formatId] == NULL) {
+                snprintf(line, sizeof(line), "(message with unknown format id %u)", record.formatId);
+            }
+            else if (!LogFormat_Render(&session->formats[record.formatId], data, record.length, line, sizeof(line))) {
+                snprintf(line, sizeof(line), "(unreadable arguments for \"%s\")", session->strings[record.formatId]);
+            }
+            break;
+
+        case LOG_BINARY_TEXT: {
+            size_t length = (record.length < sizeof(line)) ? record.length : sizeof(line) - 1;
+            memcpy(line, data, length);
+            line[length] = '\0';
+            break;
+        }
+
+        default:
+            fprintf(stderr, "Unknown record kind %u after %llu records\n", record.kind, *decoded);
+            return false;
+        }
+
+        FormatTimestamp(session, record.counter, timestamp, sizeof(timestamp));
+        fprintf(output, "[%s] [%s] %s\n", timestamp, LogLevelToString((LogLevel)record.level), line);
+        (*decoded)++;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: LogDecoder <binary log> [text output]\n");
+        return 1;
+    }
+
+    FILE* input = fopen(argv[1], "rb");
+    if (input == NULL) {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE* output = stdout;
+    if (argc > 2) {
+        output = fopen(argv[2], "w");
+        if (output == NULL) {
+            fprintf(stderr, "Cannot create %s\n", argv[2]);
+            fclose(input);
+            return 1;
+        }
+    }
+
+    DecoderSession* session = (DecoderSession*)calloc(1, sizeof(DecoderSession));
+    if (session == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        fclose(input);
+        return 1;
+    }
+
+    unsigned long long decoded = 0;
+    bool success = DecodeFile(input, output, session, &decoded);
+
+    ResetSession(session);
+    free(session);
+    fclose(input);
+    if (output != stdout) {
+        fclose(output);
+    }
+    return success ? 0 : 1;
+}